@@ -0,0 +1,171 @@
+/*
+ * File:   test_clock_discipline.c
+ * Author: LAM-HOANG
+ * Description:
+ *          SX1301 clock model against a simulated counter drifting by
+ *          DRIFT_PPM and sampled with jitter: conversions both ways across
+ *          counter wraps, wrap count, drift estimate, restart on a host
+ *          clock step and on a counter reset, and cost of one conversion.
+ * Created on October 17, 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "clock_discipline.h"
+
+#define DRIFT_PPM           17.5
+#define JITTER_US           20          /* host time of a sample off by up to this */
+#define SAMPLE_INTERVAL_US  10000000LL
+#define SIM_DURATION_US     (3LL * 3600 * 1000000)  /* more than two wraps */
+#define MAX_ERROR_US        30
+#define COUNT_START         0xFFF00000u /* wraps one second after the start */
+#define NB_CONVERSIONS      1000000
+
+static int64_t host0Us = 1791000000LL * 1000000;   /* host time of COUNT_START */
+static int64_t count0Us = COUNT_START;             /* counter at host0Us */
+static int64_t extBaseUs = 0;                       /* extended counter of the model at a simulated count of 0 */
+
+static struct timeval toTimeval(int64_t us){
+    struct timeval t;
+
+    t.tv_sec = us / 1000000;
+    t.tv_usec = us % 1000000;
+    return t;
+}
+
+/* extended counter of the simulated concentrator at a host time */
+static int64_t simCount(int64_t hostUs){
+    return count0Us + (int64_t)((hostUs - host0Us) * (1 + DRIFT_PPM * 1e-6) + 0.5);
+}
+
+/* conversions at a few host times after the latest sample, both ways */
+static int checkConversions(const ClockDiscipline_t *cd, int64_t fromUs, double *errMax){
+    struct timeval host;
+    uint32_t count;
+    uint64_t ext;
+    int64_t t, err;
+
+    for(t = fromUs; t < fromUs + SAMPLE_INTERVAL_US; t += 1234567){
+        host = toTimeval(t);
+        if(clkdUnixToCount(cd, &host, &count) != 0){
+            printf("ERROR: no conversion after a sample\n");
+            return 1;
+        }
+        err = (int32_t)(count - (uint32_t)simCount(t));
+        if(llabs(err) > *errMax){
+            *errMax = llabs(err);
+        }
+        if(llabs(err) > MAX_ERROR_US){
+            printf("ERROR: count %u at %lld, expected %u\n", count, (long long)t, (uint32_t)simCount(t));
+            return 1;
+        }
+        if(clkdCountToUnix(cd, (uint32_t)simCount(t), &host) != 0
+                || llabs((int64_t)host.tv_sec * 1000000 + host.tv_usec - t) > MAX_ERROR_US){
+            printf("ERROR: host time %ld.%06ld for count %u, expected %lld\n", host.tv_sec, host.tv_usec,
+                    (uint32_t)simCount(t), (long long)t);
+            return 1;
+        }
+        if(clkdExtend(cd, (uint32_t)simCount(t), &ext) != 0 || ext != (uint64_t)(extBaseUs + simCount(t))){
+            printf("ERROR: count %u extended to %llu, expected %lld\n", (uint32_t)simCount(t),
+                    (unsigned long long)ext, (long long)(extBaseUs + simCount(t)));
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(void){
+    ClockDiscipline_t cd;
+    struct timeval host;
+    uint32_t count;
+    int64_t t, sampleUs;
+    double errMax = 0;
+    clock_t start;
+    volatile uint32_t sink = 0;
+    int i, fail = 0;
+
+    srand(1);
+    clkdInit(&cd);
+    host = toTimeval(host0Us);
+    if(clkdUnixToCount(&cd, &host, &count) == 0 || clkdCountToUnix(&cd, 0, &host) == 0){
+        printf("ERROR: conversion without sample\n");
+        fail = 1;
+    }
+
+    /* drifting counter sampled every 10 s, the sample host time jittered */
+    for(t = host0Us; t < host0Us + SIM_DURATION_US; t += SAMPLE_INTERVAL_US){
+        sampleUs = t + (rand() % (2 * JITTER_US + 1)) - JITTER_US;
+        host = toTimeval(sampleUs);
+        if(clkdAddSample(&cd, &host, (uint32_t)simCount(t)) != (t == host0Us)){
+            printf("ERROR: unexpected restart at %lld\n", (long long)(t - host0Us));
+            fail = 1;
+            break;
+        }
+        /* the drift is only known after a few samples */
+        if((t - host0Us >= 4 * SAMPLE_INTERVAL_US) && checkConversions(&cd, t, &errMax)){
+            fail = 1;
+            break;
+        }
+    }
+    if(cd.nbWraps != (uint32_t)(simCount(t - SAMPLE_INTERVAL_US) >> 32)){
+        printf("ERROR: %u wraps counted, expected %lld\n", cd.nbWraps, (long long)(simCount(t - SAMPLE_INTERVAL_US) >> 32));
+        fail = 1;
+    }
+    if((cd.driftPpm < DRIFT_PPM - 0.5) || (cd.driftPpm > DRIFT_PPM + 0.5)){
+        printf("ERROR: drift %.3f ppm, expected %.3f\n", cd.driftPpm, DRIFT_PPM);
+        fail = 1;
+    }
+    printf("drift  : worst conversion error %.0f us\n", errMax);
+    clkdPrint(&cd, stdout);
+
+    /* host clock stepped forward by one second */
+    host0Us -= 1000000;
+    host = toTimeval(t + 1000000);
+    if(clkdAddSample(&cd, &host, (uint32_t)simCount(t + 1000000)) != 1 || cd.nbResets != 1){
+        printf("ERROR: host clock step not detected\n");
+        fail = 1;
+    }
+    t += 1000000;
+    for(i = 0; i < 4; i++, t += SAMPLE_INTERVAL_US){
+        host = toTimeval(t);
+        if(clkdAddSample(&cd, &host, (uint32_t)simCount(t)) != 0){
+            printf("ERROR: restart after the step\n");
+            fail = 1;
+        }
+    }
+    errMax = 0;
+    if(checkConversions(&cd, t, &errMax)){
+        fail = 1;
+    }
+
+    /* concentrator restarted, its counter back to zero */
+    host0Us = t;
+    count0Us = 0;
+    host = toTimeval(t);
+    if(clkdAddSample(&cd, &host, 0) != 1 || cd.nbResets != 2){
+        printf("ERROR: counter reset not detected\n");
+        fail = 1;
+    }
+    /* the extended counter carries on from the wraps already counted */
+    extBaseUs = (int64_t)cd.refCountUs;
+    host = toTimeval(t + SAMPLE_INTERVAL_US);
+    clkdAddSample(&cd, &host, (uint32_t)simCount(t + SAMPLE_INTERVAL_US));
+    if(checkConversions(&cd, t + SAMPLE_INTERVAL_US, &errMax)){
+        fail = 1;
+    }
+    clkdPrint(&cd, stdout);
+
+    /* cost of one conversion, what the JIT thread pays per downlink */
+    start = clock();
+    for(i = 0; i < NB_CONVERSIONS; i++){
+        host = toTimeval(t + i);
+        clkdUnixToCount(&cd, &host, &count);
+        sink += count;
+    }
+    printf("cost   : %.1f ns per conversion\n", (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / NB_CONVERSIONS);
+
+    printf("%s\n", fail ? "FAILED" : "PASSED");
+    return fail;
+}
@@ -0,0 +1,340 @@
+/*
+ * File:   test_jitqueue.c
+ * Author: LAM-HOANG
+ * Description:
+ *          JIT queue treap: packets enqueued in random order come out in
+ *          timestamp order, a packet colliding with its previous or next
+ *          neighbour is rejected, JIT_ERROR_FULL at the configured
+ *          capacity (above the default one), outdated packets dropped,
+ *          nodes reused after dequeue, and a thread waiting in jit_wait_next
+ *          woken for a new head at its due time.
+ * Created on October 17, 2026
+ */
+
+#define _GNU_SOURCE     /* timeradd, timercmp */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "jitqueue.h"
+
+#define TX_START_DELAY          1500    /* as in jitqueue.c */
+#define TX_MARGIN_DELAY         1000
+#define TX_JIT_DELAY            10000
+#define TX_DEVIATION_THRESHOLD  500
+
+#define BIG_CAPACITY            100     /* above JIT_QUEUE_DEFAULT */
+#define NB_REUSE_LOOPS          200     /* the last packet still within TX_MAX_ADVANCE_DELAY */
+#define WAIT_ARM_US             50000   /* left to the waiter to go to sleep */
+#define WAIT_HEAD_US            200000  /* new head, this long after it is enqueued */
+#define WAIT_LATE_MAX_US        5000    /* scheduling slack of the waiter */
+
+static struct lgw_pkt_tx_s pkt_model;
+static uint32_t collide_us;     /* two packets this close or closer collide */
+static uint32_t spacing_us;     /* slots of the tests, just clear of each other */
+static struct timeval base;     /* first slot, a little after now */
+
+static void make_packet(struct lgw_pkt_tx_s *pkt, int id) {
+    *pkt = pkt_model;
+    pkt->payload[0] = (uint8_t)id;
+    pkt->payload[1] = (uint8_t)(id >> 8);
+}
+
+static int packet_id(const struct lgw_pkt_tx_s *pkt) {
+    return pkt->payload[0] | (pkt->payload[1] << 8);
+}
+
+/* base + offset_us */
+static struct timeval at(int64_t offset_us) {
+    struct timeval t, d;
+
+    d.tv_sec = offset_us / 1000000;
+    d.tv_usec = offset_us % 1000000;
+    timeradd(&base, &d, &t);
+    return t;
+}
+
+static void reset_base(void) {
+    gettimeofday(&base, NULL);
+    base.tv_sec += 1; /* well clear of the too late limit */
+}
+
+static enum jit_error_e enqueue_at(struct jit_queue_s *queue, int64_t offset_us, int id) {
+    struct lgw_pkt_tx_s pkt;
+
+    make_packet(&pkt, id);
+    return jit_enqueue(queue, at(offset_us), &pkt, JIT_PKT_TYPE_DOWNLINK);
+}
+
+/* dequeue the head, found by peeking at its due time, and check it is the expected packet */
+static int dequeue_head(struct jit_queue_s *queue, int64_t offset_us, int id) {
+    struct timeval t = at(offset_us - TX_DEVIATION_THRESHOLD), early;
+    struct timeval one_us = {0, 1};
+    struct lgw_pkt_tx_s pkt;
+    enum jit_pkt_type_e type;
+    int idx;
+
+    timersub(&t, &one_us, &early);
+    if ((jit_peek(queue, &early, &idx) != JIT_ERROR_OK) || (idx != -1)) {
+        printf("ERROR: packet %d peeked before it is due\n", id);
+        return 1;
+    }
+    if ((jit_peek(queue, &t, &idx) != JIT_ERROR_OK) || (idx < 0)) {
+        printf("ERROR: packet %d not due at its due time\n", id);
+        return 1;
+    }
+    if ((jit_dequeue(queue, idx, &pkt, &type) != JIT_ERROR_OK) || (packet_id(&pkt) != id)) {
+        printf("ERROR: dequeued packet %d instead of %d\n", packet_id(&pkt), id);
+        return 1;
+    }
+    return 0;
+}
+
+static int test_capacity(void) {
+    struct jit_queue_s queue;
+    int order[BIG_CAPACITY];
+    int i, j, tmp, fail = 0;
+
+    memset(&queue, 0, sizeof queue);
+    if ((jit_queue_init(&queue, 0) == 0) || (jit_queue_init(&queue, JIT_QUEUE_MAX + 1) == 0)) {
+        printf("ERROR: invalid capacity accepted\n");
+        return 1;
+    }
+    if (jit_queue_init(&queue, BIG_CAPACITY) != 0) {
+        printf("ERROR: capacity %d rejected\n", BIG_CAPACITY);
+        return 1;
+    }
+
+    /* every slot once, in random order */
+    reset_base();
+    for (i = 0; i < BIG_CAPACITY; i++) {
+        order[i] = i;
+    }
+    for (i = BIG_CAPACITY - 1; i > 0; i--) {
+        j = rand() % (i + 1);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    for (i = 0; i < BIG_CAPACITY; i++) {
+        if (enqueue_at(&queue, (int64_t)order[i] * spacing_us, order[i]) != JIT_ERROR_OK) {
+            printf("ERROR: slot %d rejected, %d packets queued\n", order[i], i);
+            return 1;
+        }
+    }
+    if (!jit_queue_is_full(&queue) || (enqueue_at(&queue, (int64_t)BIG_CAPACITY * spacing_us, BIG_CAPACITY) != JIT_ERROR_FULL)) {
+        printf("ERROR: queue of %d packets not full\n", BIG_CAPACITY);
+        fail = 1;
+    }
+
+    /* out in timestamp order */
+    for (i = 0; (i < BIG_CAPACITY) && !fail; i++) {
+        fail = dequeue_head(&queue, (int64_t)i * spacing_us, i);
+    }
+    if (!fail && !jit_queue_is_empty(&queue)) {
+        printf("ERROR: queue not empty after dequeuing every packet\n");
+        fail = 1;
+    }
+    printf("order  : %d packets in random order, capacity %d\n", BIG_CAPACITY, queue.capacity);
+    free(queue.nodes);
+    return fail;
+}
+
+static int test_collision(void) {
+    struct jit_queue_s queue;
+    int64_t first = 0, last = 3 * (int64_t)collide_us;
+    int fail = 0;
+
+    memset(&queue, 0, sizeof queue);
+    jit_queue_init(&queue, JIT_QUEUE_DEFAULT);
+    reset_base();
+    enqueue_at(&queue, first, 1);
+    enqueue_at(&queue, last, 2);
+
+    /* too close to the previous packet only, to the next one only, then just clear of the previous one */
+    if (enqueue_at(&queue, first + collide_us, 3) != JIT_ERROR_COLLISION_PACKET) {
+        printf("ERROR: collision with the previous packet not detected\n");
+        fail = 1;
+    }
+    if (enqueue_at(&queue, last - collide_us, 4) != JIT_ERROR_COLLISION_PACKET) {
+        printf("ERROR: collision with the next packet not detected\n");
+        fail = 1;
+    }
+    if (enqueue_at(&queue, first - collide_us, 5) != JIT_ERROR_COLLISION_PACKET) {
+        printf("ERROR: collision with the next packet, at the head, not detected\n");
+        fail = 1;
+    }
+    if (enqueue_at(&queue, first + collide_us + 1, 6) != JIT_ERROR_OK) {
+        printf("ERROR: packet clear of the previous one rejected\n");
+        fail = 1;
+    }
+    /* now between two packets, clear of the next one but too close to the previous one */
+    if (enqueue_at(&queue, last - collide_us - 1, 7) != JIT_ERROR_COLLISION_PACKET) {
+        printf("ERROR: collision between two queued packets not detected\n");
+        fail = 1;
+    }
+    if (!fail && (dequeue_head(&queue, first, 1) || dequeue_head(&queue, first + collide_us + 1, 6)
+            || dequeue_head(&queue, last, 2))) {
+        fail = 1;
+    }
+    free(queue.nodes);
+    return fail;
+}
+
+static int test_outdated(void) {
+    struct jit_queue_s queue;
+    struct timeval t;
+    int idx, fail = 0;
+
+    memset(&queue, 0, sizeof queue);
+    jit_queue_init(&queue, JIT_QUEUE_DEFAULT);
+    reset_base();
+    enqueue_at(&queue, 0, 1);
+    enqueue_at(&queue, spacing_us, 2);
+    enqueue_at(&queue, 10 * (int64_t)spacing_us, 3);
+
+    /* the first two missed, the third one not due yet */
+    t = at(spacing_us + 1);
+    if ((jit_peek(&queue, &t, &idx) != JIT_ERROR_OK) || (idx != -1) || (queue.num_pkt != 1)) {
+        printf("ERROR: outdated packets not dropped, %u left\n", queue.num_pkt);
+        fail = 1;
+    }
+    if (!fail && dequeue_head(&queue, 10 * (int64_t)spacing_us, 3)) {
+        fail = 1;
+    }
+    free(queue.nodes);
+    return fail;
+}
+
+struct waiter_s {
+    struct jit_queue_s *queue;
+    enum jit_error_e err;
+    struct timeval tx_time;
+    struct timeval woken;
+    uint32_t late_us;
+    int idx;
+};
+
+static void *waiter(void *arg) {
+    struct waiter_s *w = arg;
+
+    w->err = jit_wait_next(w->queue, &w->tx_time, &w->late_us, &w->idx);
+    gettimeofday(&w->woken, NULL);
+    return NULL;
+}
+
+/* a waiter sleeping on a far head is woken by an earlier packet, then returns when that one is due */
+static int test_wait_next(void) {
+    static const uint8_t modes[] = {IMMEDIATE, TIMESTAMPED};
+    static const int32_t advances[] = {TX_DEVIATION_THRESHOLD, TX_JIT_DELAY};
+    struct jit_queue_s queue;
+    struct waiter_s w;
+    struct lgw_pkt_tx_s pkt;
+    struct timeval now, ts, d = {0, WAIT_HEAD_US};
+    enum jit_pkt_type_e type;
+    pthread_t thread;
+    int64_t early_us;
+    int i, fail = 0;
+
+    memset(&queue, 0, sizeof queue);
+    jit_queue_init(&queue, JIT_QUEUE_DEFAULT);
+    reset_base();
+    enqueue_at(&queue, 4000000, 1);
+
+    for (i = 0; (i < 2) && !fail; i++) {
+        memset(&w, 0, sizeof w);
+        w.queue = &queue;
+        pthread_create(&thread, NULL, waiter, &w);
+        usleep(WAIT_ARM_US);
+
+        gettimeofday(&now, NULL);
+        timeradd(&now, &d, &ts);
+        make_packet(&pkt, 2 + i);
+        pkt.tx_mode = modes[i];
+        if (jit_enqueue(&queue, ts, &pkt, JIT_PKT_TYPE_DOWNLINK) != JIT_ERROR_OK) {
+            printf("ERROR: new head rejected\n");
+            pthread_cancel(thread);
+            pthread_join(thread, NULL);
+            fail = 1;
+            break;
+        }
+        pthread_join(thread, NULL);
+
+        /* woken for the new head, its advance before the timestamp */
+        early_us = ((int64_t)ts.tv_sec - w.woken.tv_sec) * 1000000 + (ts.tv_usec - w.woken.tv_usec);
+        if ((w.err != JIT_ERROR_OK) || (w.idx < 0) || timercmp(&w.tx_time, &ts, !=)) {
+            printf("ERROR: waiter not woken for the new head, mode %u\n", modes[i]);
+            fail = 1;
+        } else if ((early_us > advances[i]) || (early_us < advances[i] - WAIT_LATE_MAX_US)) {
+            printf("ERROR: woken %lld us before the timestamp, expected %d, mode %u\n", (long long)early_us,
+                    advances[i], modes[i]);
+            fail = 1;
+        } else if ((jit_dequeue(&queue, w.idx, &pkt, &type) != JIT_ERROR_OK) || (packet_id(&pkt) != 2 + i)) {
+            printf("ERROR: dequeued packet %d instead of %d\n", packet_id(&pkt), 2 + i);
+            fail = 1;
+        }
+        printf("wait   : mode %u woken %lld us before the timestamp, %u us late\n", modes[i],
+                (long long)early_us, w.late_us);
+    }
+    free(queue.nodes);
+    return fail;
+}
+
+/* a small queue kept full, the head dequeued and a later packet put in its node: every node is reused */
+static int test_reuse(void) {
+    struct jit_queue_s queue;
+    int i, fail = 0;
+
+    memset(&queue, 0, sizeof queue);
+    jit_queue_init(&queue, 4);
+    reset_base();
+    for (i = 0; i < 4; i++) {
+        enqueue_at(&queue, (int64_t)i * spacing_us, i);
+    }
+    for (i = 0; (i < NB_REUSE_LOOPS) && !fail; i++) {
+        fail = dequeue_head(&queue, (int64_t)i * spacing_us, i);
+        if (!fail && (enqueue_at(&queue, (int64_t)(i + 4) * spacing_us, i + 4) != JIT_ERROR_OK)) {
+            printf("ERROR: node not reused at loop %d\n", i);
+            fail = 1;
+        }
+        if (!fail && !jit_queue_is_full(&queue)) {
+            printf("ERROR: %u packets queued at loop %d\n", queue.num_pkt, i);
+            fail = 1;
+        }
+    }
+    free(queue.nodes);
+    return fail;
+}
+
+int main(void) {
+    int fail = 0;
+
+    srand(1);
+    memset(&pkt_model, 0, sizeof pkt_model);
+    pkt_model.freq_hz = 922100000;
+    pkt_model.tx_mode = IMMEDIATE;
+    pkt_model.rf_chain = 0;
+    pkt_model.rf_power = 14;
+    pkt_model.modulation = MOD_LORA;
+    pkt_model.bandwidth = BW_500KHZ;
+    pkt_model.datarate = DR_LORA_SF7;
+    pkt_model.coderate = CR_LORA_4_5;
+    pkt_model.invert_pol = true;
+    pkt_model.preamble = 8;
+    pkt_model.size = 2;
+    /* packets collide up to pre-delay + time on air + margin apart */
+    collide_us = TX_START_DELAY + TX_JIT_DELAY + lgw_time_on_air(&pkt_model) * 1000 + TX_MARGIN_DELAY;
+    spacing_us = collide_us + 1;
+
+    fail |= test_capacity();
+    fail |= test_collision();
+    fail |= test_outdated();
+    fail |= test_reuse();
+    fail |= test_wait_next();
+
+    printf("%s\n", fail ? "FAILED" : "PASSED");
+    return fail;
+}
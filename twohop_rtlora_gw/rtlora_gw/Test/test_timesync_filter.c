@@ -0,0 +1,187 @@
+/*
+ * File:   test_timesync_filter.c
+ * Author: LAM-HOANG
+ * Description:
+ *          Server clock estimate against a simulated server clock ahead of
+ *          the host one by OFFSET_US and running SKEW_PPM fast: the least
+ *          round trip sample of a burst kept, the skew recovered, bursts of
+ *          queued samples rejected then the fit restarted after
+ *          TSF_MAX_REJECTS of them, and restarted on a server clock step.
+ * Created on October 17, 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "timesync_filter.h"
+
+#define HOST0_US            (1791000000LL * 1000000)
+#define OFFSET_US           123456789LL /* server - host at HOST0_US */
+#define SKEW_PPM            25.0
+#define PATH_US             2000        /* one way delay, no queuing */
+#define SLOW_PATH_US        8000        /* one way delay of a longer path, beyond the round trip gate */
+#define QUEUE_MAX_US        20000       /* queuing delay of the other samples, on the way up only */
+#define PROC_US             300         /* server processing time */
+#define SAMPLE_GAP_US       100000
+#define BURST_INTERVAL_US   64000000LL
+#define STEP_US             (2 * TSF_STEP_US)
+#define NB_SKEW_BURSTS      (2 * TSF_WINDOW)
+#define MAX_ERROR_US        2
+#define MAX_SKEW_ERROR_PPM  0.05
+
+static int64_t nowUs = HOST0_US;        /* host clock */
+static int64_t offsetUs = OFFSET_US;    /* server clock, stepped by the test */
+
+static struct timeval toTimeval(int64_t us){
+    struct timeval t;
+
+    t.tv_sec = us / 1000000;
+    t.tv_usec = us % 1000000;
+    return t;
+}
+
+static int64_t serverUs(int64_t hostUs){
+    return hostUs + offsetUs + llround(SKEW_PPM * 1e-6 * (hostUs - HOST0_US));
+}
+
+/* one request/response, upUs and downUs on the way */
+static void exchange(TimeSyncFilter_t *filter, int64_t upUs, int64_t downUs){
+    struct timeval t0, t1, t2, t3;
+
+    t0 = toTimeval(nowUs);
+    t1 = toTimeval(serverUs(nowUs + upUs));
+    t2 = toTimeval(serverUs(nowUs + upUs + PROC_US));
+    t3 = toTimeval(nowUs + upUs + PROC_US + downUs);
+    tsfAddSample(filter, &t0, &t1, &t2, &t3);
+    nowUs += SAMPLE_GAP_US;
+}
+
+/* a burst on a path, every sample but one queued, the one at random */
+static int burst(TimeSyncFilter_t *filter, int64_t pathUs){
+    int i, clean = rand() % TSF_BURST_SIZE;
+
+    for(i = 0; i < TSF_BURST_SIZE; i++){
+        exchange(filter, pathUs + ((i == clean) ? 0 : 1 + rand() % QUEUE_MAX_US), pathUs);
+    }
+    nowUs += BURST_INTERVAL_US - TSF_BURST_SIZE * SAMPLE_GAP_US;
+    return tsfEndBurst(filter);
+}
+
+/* a burst whose every sample is queued */
+static int queuedBurst(TimeSyncFilter_t *filter){
+    int i;
+
+    for(i = 0; i < TSF_BURST_SIZE; i++){
+        exchange(filter, PATH_US + QUEUE_MAX_US / 2 + rand() % QUEUE_MAX_US, PATH_US + QUEUE_MAX_US / 2);
+    }
+    nowUs += BURST_INTERVAL_US - TSF_BURST_SIZE * SAMPLE_GAP_US;
+    return tsfEndBurst(filter);
+}
+
+/* the skew is only known again once the window is full */
+static void refill(TimeSyncFilter_t *filter, int64_t pathUs){
+    while(filter->nbPoints < TSF_WINDOW){
+        burst(filter, pathUs);
+    }
+}
+
+/* estimate against the simulated server clock, now and one burst interval later */
+static int checkOffset(const TimeSyncFilter_t *filter, const char *what){
+    struct timeval host;
+    double est;
+    int64_t t;
+
+    for(t = nowUs; t <= nowUs + BURST_INTERVAL_US; t += BURST_INTERVAL_US){
+        host = toTimeval(t);
+        if(tsfOffsetAt(filter, &host, &est) != 0 || fabs(est - (serverUs(t) - t)) > MAX_ERROR_US){
+            printf("ERROR: %s, offset %.1f us, expected %lld\n", what, est, (long long)(serverUs(t) - t));
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(void){
+    TimeSyncFilter_t filter;
+    double offsetBefore, refBefore;
+    int64_t t;
+    int i, fail = 0;
+
+    srand(1);
+    tsfInit(&filter);
+    if(tsfEndBurst(&filter) == 0){
+        printf("ERROR: empty burst accepted\n");
+        fail = 1;
+    }
+
+    /* the only unqueued sample of the burst is the one kept, its offset exact */
+    if(burst(&filter, PATH_US) != 0 || fabs(filter.points[0].rttUs - 2 * PATH_US) > 1){
+        printf("ERROR: round trip %.0f us kept, expected %d\n", filter.points[0].rttUs, 2 * PATH_US);
+        fail = 1;
+    }
+    t = llround(filter.points[0].hostUs);
+    if(fabs(filter.points[0].offsetUs - (serverUs(t) - t)) > MAX_ERROR_US){
+        printf("ERROR: offset %.1f us kept, expected %lld\n", filter.points[0].offsetUs, (long long)(serverUs(t) - t));
+        fail = 1;
+    }
+
+    /* skew from the bursts of the window */
+    for(i = 1; i < NB_SKEW_BURSTS; i++){
+        if(burst(&filter, PATH_US) != 0){
+            printf("ERROR: burst %d rejected\n", i);
+            fail = 1;
+        }
+    }
+    if(fabs(filter.skewPpm - SKEW_PPM) > MAX_SKEW_ERROR_PPM || filter.nbResets != 0){
+        printf("ERROR: skew %.3f ppm, expected %.3f, %u restarts\n", filter.skewPpm, SKEW_PPM, filter.nbResets);
+        fail = 1;
+    }
+    fail |= checkOffset(&filter, "skew");
+    tsfPrint(&filter, stdout);
+
+    /* popcorn: queued bursts leave the estimate alone, a good one after them resets the count */
+    for(i = 0; i < 2 * TSF_MAX_REJECTS; i++){
+        if(i % TSF_MAX_REJECTS == TSF_MAX_REJECTS - 1){
+            if(burst(&filter, PATH_US) != 0 || filter.nbConsecRejects != 0){
+                printf("ERROR: burst after the queued ones rejected\n");
+                fail = 1;
+            }
+            continue;
+        }
+        offsetBefore = filter.offsetUs;
+        refBefore = filter.refUs;
+        if(queuedBurst(&filter) == 0 || filter.offsetUs != offsetBefore || filter.refUs != refBefore){
+            printf("ERROR: queued burst %d not rejected\n", i);
+            fail = 1;
+        }
+    }
+    fail |= checkOffset(&filter, "popcorn");
+
+    /* the path itself got longer: TSF_MAX_REJECTS bursts in a row and the fit restarts from the last one */
+    for(i = 0; i < TSF_MAX_REJECTS; i++){
+        if((burst(&filter, SLOW_PATH_US) == 0) != (i == TSF_MAX_REJECTS - 1)){
+            printf("ERROR: burst %d on the longer path %s\n", i, (i == TSF_MAX_REJECTS - 1) ? "rejected" : "accepted");
+            fail = 1;
+        }
+    }
+    if(filter.nbResets != 1 || filter.nbPoints != 1 || fabs(filter.points[0].rttUs - 2 * SLOW_PATH_US) > 1){
+        printf("ERROR: no restart on the longer path, %u restarts, %u points\n", filter.nbResets, filter.nbPoints);
+        fail = 1;
+    }
+    refill(&filter, SLOW_PATH_US);
+    fail |= checkOffset(&filter, "longer path");
+
+    /* server clock stepped */
+    offsetUs += STEP_US;
+    if(burst(&filter, SLOW_PATH_US) != 0 || filter.nbResets != 2 || filter.nbPoints != 1){
+        printf("ERROR: no restart on a step, %u restarts, %u points\n", filter.nbResets, filter.nbPoints);
+        fail = 1;
+    }
+    refill(&filter, SLOW_PATH_US);
+    fail |= checkOffset(&filter, "step");
+    tsfPrint(&filter, stdout);
+
+    printf("%s\n", fail ? "FAILED" : "PASSED");
+    return fail;
+}
@@ -0,0 +1,114 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   clock_discipline.h
+ * Author: LAM-HOANG
+ * Description:
+ *          Model of the SX1301 1 MHz counter against the host clock, fed
+ *          with (host time, counter) samples. The 32 bit counter is
+ *          extended to 64 bits by counting its wraps, which needs a sample
+ *          at least every half wrap (35 minutes). The last samples are
+ *          fitted by least squares into an offset and a drift in ppm, so
+ *          host times and counter values convert both ways with a few
+ *          operations. Not thread safe.
+ * Created on October 17, 2026
+ */
+
+#ifndef CLOCK_DISCIPLINE_H
+#define CLOCK_DISCIPLINE_H
+
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* FILE */
+#include <sys/time.h>   /* timeval */
+
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define CLKD_WINDOW             16      /* samples in the fit */
+#define CLKD_STEP_US            2000    /* a sample this far from the model is a clock step, the fit restarts */
+
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+typedef struct ClkdPoint_{
+    int64_t         hostUs;             /* host time */
+    uint64_t        countUs;            /* extended counter */
+}ClkdPoint_t;
+
+typedef struct ClockDiscipline_{
+    ClkdPoint_t     points[CLKD_WINDOW];    /* last samples, circular */
+    uint32_t        nbPoints;
+    uint32_t        next;
+    uint32_t        wraps;              /* high 32 bits of the extended counter */
+    /* model, count = refCountUs + corrUs + (host - refHostUs) * (1 + driftPpm / 1e6) */
+    bool            valid;
+    int64_t         refHostUs;          /* latest sample */
+    uint64_t        refCountUs;
+    double          corrUs;             /* fit correction at the latest sample */
+    double          driftPpm;           /* counter rate relative to the host clock */
+    double          residualUs;         /* standard deviation of the fit residuals */
+    /* counters */
+    uint32_t        nbSamples;
+    uint32_t        nbWraps;
+    uint32_t        nbResets;
+    double          lastErrorUs;        /* distance of the latest sample to the model it was added to */
+}ClockDiscipline_t;
+
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Reset a model, no conversion until the first sample
+@param cd[out] Model
+*/
+void clkdInit(ClockDiscipline_t *cd);
+
+/**
+@brief Add a sample of the counter, read at a known host time
+@param cd[in/out] Model
+@param host[in] Host time of the read
+@param count[in] Counter value
+@return 0 if the sample agrees with the model, 1 if the fit restarted from it (first sample, clock step or
+        counter reset)
+*/
+int clkdAddSample(ClockDiscipline_t *cd, const struct timeval *host, uint32_t count);
+
+/**
+@brief Extend a counter value to 64 bits
+@param cd[in] Model
+@param count[in] Counter value, within half a wrap of the latest sample
+@param countUs[out] Extended counter
+@return 0 if succeeded, -1 if there is no sample yet
+*/
+int clkdExtend(const ClockDiscipline_t *cd, uint32_t count, uint64_t *countUs);
+
+/**
+@brief Counter value at a host time
+@param cd[in] Model
+@param host[in] Host time
+@param count[out] Counter value, modulo 2^32
+@return 0 if succeeded, -1 if there is no sample yet
+*/
+int clkdUnixToCount(const ClockDiscipline_t *cd, const struct timeval *host, uint32_t *count);
+
+/**
+@brief Host time at a counter value
+@param cd[in] Model
+@param count[in] Counter value, within half a wrap of the latest sample
+@param host[out] Host time
+@return 0 if succeeded, -1 if there is no sample yet
+*/
+int clkdCountToUnix(const ClockDiscipline_t *cd, uint32_t count, struct timeval *host);
+
+/**
+@brief Print the model and the counters on one line
+@param cd[in] Model
+@param out[in] Output stream
+*/
+void clkdPrint(const ClockDiscipline_t *cd, FILE *out);
+
+#endif /* CLOCK_DISCIPLINE_H */
@@ -0,0 +1,225 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   frame_stream.h
+ * Author: LAM-HOANG
+ * Description:
+ *          Length-prefixed framing of the gateway <-> server TCP link.
+ *          The same file is used by the gateway and by the server.
+ * Created on October 17, 2026
+ */
+
+#ifndef FRAME_STREAM_H
+#define FRAME_STREAM_H
+
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define PROTOCOL_VERSION        3   /* v1.4: length-prefixed frames */
+
+/* Gateway <-> Server packet types */
+#define PKT_TIMESYNC_REQ        0 // gw -> sv
+#define PKT_TIMESYNC_RES        1 // sv -> gw
+#define PKT_DOWNLINK_DATA       2 // sv -> gw
+#define PKT_DOWNLINK_ACK        3 // gw -> sv
+#define PKT_UPLINK_DATA         4 // gw -> sv
+#define PKT_UPLINK_ACK          5 // sv -> gw
+#define PKT_HELLO               6 // gw -> sv, gateway MAC + requested link capabilities
+#define PKT_HELLO_ACK           7 // sv -> gw, accepted link capabilities
+
+/* Link capabilities, negotiated with PKT_HELLO/PKT_HELLO_ACK */
+#define LINK_CAP_BIN_UPLINK     0x01    /* PKT_UPLINK_DATA may use UPLINK_FMT_BIN */
+#define LINK_CAP_BIN_DOWNLINK   0x02    /* PKT_DOWNLINK_DATA may use DOWNLINK_FMT_BIN */
+
+/* Longest wait of frame_send() for room in the send buffer of a non-blocking socket */
+#define FRAME_SEND_TIMEOUT_MS   100
+
+/* Frame header: version(1) | token(2) | type(1) | payload length(2, big endian) */
+#define FRAME_HDR_SIZE          6
+#define FRAME_OFS_VERSION       0
+#define FRAME_OFS_TOKEN_H       1
+#define FRAME_OFS_TOKEN_L       2
+#define FRAME_OFS_TYPE          3
+#define FRAME_OFS_LENGTH        4
+
+/* PKT_UPLINK_DATA payload: gateway MAC(8) | format(1) | data
+   UPLINK_FMT_JSON: data is the rest of the {"rxpk":[...]} object
+   UPLINK_FMT_BIN : nb_pkt(1) | nb_pkt * (record header | raw payload) */
+#define UPLINK_FMT_JSON         '{'
+#define UPLINK_FMT_BIN          0x01
+
+/* UPLINK_FMT_BIN record header, multi-byte fields are big endian */
+#define UL_BIN_HDR_SIZE         2       /* format + nb_pkt */
+#define UL_BIN_OFS_FREQ         0       /* u32, Hz */
+#define UL_BIN_OFS_IF_CHAIN     4       /* u8 */
+#define UL_BIN_OFS_RF_CHAIN     5       /* u8 */
+#define UL_BIN_OFS_STATUS       6       /* u8, STAT_xxx */
+#define UL_BIN_OFS_MODULATION   7       /* u8, MOD_xxx */
+#define UL_BIN_OFS_BANDWIDTH    8       /* u8, BW_xxx */
+#define UL_BIN_OFS_CODERATE     9       /* u8, CR_xxx */
+#define UL_BIN_OFS_DATARATE     10      /* u32, DR_xxx or FSK bps */
+#define UL_BIN_OFS_COUNT_US     14      /* u32, concentrator counter */
+#define UL_BIN_OFS_RSSI         18      /* s16, 0.1 dB */
+#define UL_BIN_OFS_SNR          20      /* s16, 0.1 dB */
+#define UL_BIN_OFS_CRC          22      /* u16 */
+#define UL_BIN_OFS_SIZE         24      /* u16, payload size */
+#define UL_BIN_REC_SIZE         26
+
+/* PKT_DOWNLINK_DATA payload: format(1) | data
+   DOWNLINK_FMT_JSON: data is the rest of the {"txpk":{...}} object
+   DOWNLINK_FMT_BIN : one record header | raw payload, mapping struct lgw_pkt_tx_s */
+#define DOWNLINK_FMT_JSON       '{'
+#define DOWNLINK_FMT_BIN        0x01
+
+/* DOWNLINK_FMT_BIN record header, multi-byte fields are big endian */
+#define DL_BIN_HDR_SIZE         1       /* format */
+#define DL_BIN_OFS_TM_S         0       /* u32, unix TX time, seconds */
+#define DL_BIN_OFS_TM_US        4       /* u32, unix TX time, microseconds */
+#define DL_BIN_OFS_FREQ         8       /* u32, Hz */
+#define DL_BIN_OFS_TX_MODE      12      /* u8, IMMEDIATE/TIMESTAMPED/ON_GPS */
+#define DL_BIN_OFS_RF_CHAIN     13      /* u8 */
+#define DL_BIN_OFS_RF_POWER     14      /* s8, dBm */
+#define DL_BIN_OFS_MODULATION   15      /* u8, MOD_xxx */
+#define DL_BIN_OFS_BANDWIDTH    16      /* u8, BW_xxx */
+#define DL_BIN_OFS_CODERATE     17      /* u8, CR_xxx */
+#define DL_BIN_OFS_DATARATE     18      /* u32, DR_xxx or FSK bps */
+#define DL_BIN_OFS_INVERT_POL   22      /* u8, boolean */
+#define DL_BIN_OFS_NO_CRC       23      /* u8, boolean */
+#define DL_BIN_OFS_NO_HEADER    24      /* u8, boolean */
+#define DL_BIN_OFS_F_DEV        25      /* u8, FSK deviation, kHz */
+#define DL_BIN_OFS_PREAMBLE     26      /* u16 */
+#define DL_BIN_OFS_SIZE         28      /* u16, payload size */
+#define DL_BIN_REC_SIZE         30
+
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct frame_stream_s
+@brief Reassembly state of one TCP connection.
+Bytes are read straight into the tail of buf and complete frames are handed to
+the caller in place. The buffer is owned by the caller; its last byte is kept
+free so that each returned frame can be NUL terminated (JSON payloads).
+ */
+struct frame_stream_s {
+    uint8_t     *buf;           /* reassembly buffer */
+    uint32_t    size;           /* usable size of buf, one byte less than its allocation */
+    uint32_t    len;            /* number of bytes currently held in buf */
+    uint32_t    rd;             /* offset of the first byte not yet consumed */
+    uint32_t    term;           /* offset of the byte replaced by the NUL terminator */
+    uint8_t     term_byte;      /* original value of that byte */
+    bool        term_set;       /* true while a terminator has to be restored */
+    uint32_t    nb_frames;      /* number of complete frames returned */
+    uint32_t    nb_dropped;     /* number of bytes skipped to resynchronize */
+};
+
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Initialize the reassembly state of a connection
+@param fs[out] Stream to be initialized
+@param buf[in] Buffer used for reassembly
+@param buf_size[in] Size of the buffer in bytes, one byte is reserved for the terminator
+*/
+void frame_stream_init(struct frame_stream_s *fs, uint8_t *buf, uint32_t buf_size);
+
+/**
+@brief Get the place where the next read() has to store its data
+Already consumed frames are discarded first, so only a partial frame is moved.
+@param fs[in/out] Stream
+@param room[out] Number of bytes that can be written at the returned address
+@return pointer to the tail of the stream buffer
+*/
+uint8_t *frame_stream_wptr(struct frame_stream_s *fs, uint32_t *room);
+
+/**
+@brief Account for the bytes that have been written at frame_stream_wptr()
+@param fs[in/out] Stream
+@param nb_bytes[in] Number of bytes written
+*/
+void frame_stream_commit(struct frame_stream_s *fs, uint32_t nb_bytes);
+
+/**
+@brief Get the next complete frame of a stream
+The frame stays valid until the next call on the same stream. The byte that
+follows the frame is temporarily set to 0.
+@param fs[in/out] Stream
+@param frame_len[out] Frame size, header included
+@return pointer to the frame header, NULL if no complete frame is available
+*/
+uint8_t *frame_stream_next(struct frame_stream_s *fs, uint32_t *frame_len);
+
+/**
+@brief Write a frame header
+@param frame[out] Start of the frame
+@param type[in] Packet type (PKT_xxx)
+@param token_h[in] Token high byte
+@param token_l[in] Token low byte
+@param payload_len[in] Number of bytes following the header
+*/
+void frame_header_write(uint8_t *frame, uint8_t type, uint8_t token_h, uint8_t token_l, uint16_t payload_len);
+
+/**
+@brief Update the payload length of a frame whose header is already written
+@param frame[in/out] Start of the frame
+@param payload_len[in] Number of bytes following the header
+*/
+void frame_set_length(uint8_t *frame, uint16_t payload_len);
+
+/**
+@brief Get the payload length of a frame
+@param frame[in] Start of the frame
+@return number of bytes following the header
+*/
+uint16_t frame_get_length(const uint8_t *frame);
+
+/**
+@brief Send a whole frame on a stream socket, retrying on partial writes
+A non-blocking socket is waited for at most FRAME_SEND_TIMEOUT_MS each time its buffer is full.
+@param sock[in] Connected socket
+@param frame[in] Frame to be sent
+@param frame_len[in] Frame size, header included
+@return 0 on success, -1 if the connection failed, part of the frame may then have been sent
+*/
+int frame_send(int sock, const uint8_t *frame, uint32_t frame_len);
+
+/**
+@brief frame_send() with a given wait for room in the send buffer
+@param sock[in] Connected socket
+@param frame[in] Frame to be sent
+@param frame_len[in] Frame size, header included
+@param timeout_ms[in] Longest wait each time the send buffer is full
+@return 0 on success, -1 if the connection failed or stayed full, part of the frame may then have been sent
+*/
+int frame_send_timeout(int sock, const uint8_t *frame, uint32_t frame_len, int timeout_ms);
+
+/* big endian field access, used by the binary payload codecs */
+static inline void frame_put_u16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static inline void frame_put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static inline uint16_t frame_get_u16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t frame_get_u32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+#endif /* FRAME_STREAM_H */
+
@@ -30,7 +30,8 @@ Maintainer: Michael Coracin
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC CONSTANTS ----------------------------------------------------- */
 
-#define JIT_QUEUE_MAX           32  /* Maximum number of packets to be stored in JiT queue */
+#define JIT_QUEUE_DEFAULT       32  /* Default number of packets to be stored in JiT queue */
+#define JIT_QUEUE_MAX           1024 /* Maximum capacity of a JiT queue */
 #define JIT_NUM_BEACON_IN_QUEUE 3   /* Number of beacons to be loaded in JiT queue at any time */
 
 /* -------------------------------------------------------------------------- */
@@ -63,12 +64,19 @@ struct jit_node_s {
     /* Internal fields */
     uint32_t pre_delay;             /* Amount of time before packet timestamp to be reserved */
     uint32_t post_delay;            /* Amount of time after packet timestamp to be reserved (time on air) */
-
+    int left;                       /* Earlier packets in the queue tree, -1 for none */
+    int right;                      /* Later packets in the queue tree, next free node when not queued */
+    uint32_t prio;                  /* Random heap priority, balances the tree */
+    bool queued;                    /* The node holds a packet */
 };
 
 struct jit_queue_s {
-    uint8_t num_pkt;                /* Total number of packets in the queue (downlinks, ack...) */
-    struct jit_node_s nodes[JIT_QUEUE_MAX]; /* Nodes/packets array in the queue */
+    uint16_t num_pkt;               /* Total number of packets in the queue (downlinks, ack...) */
+    uint16_t capacity;              /* Number of nodes */
+    int root;                       /* Root of the tree of queued nodes, ordered by tx_timestamp, -1 if empty */
+    int free_node;                  /* First free node, -1 if the queue is full */
+    uint32_t prio_seed;             /* State of the priority generator */
+    struct jit_node_s *nodes;       /* Nodes/packets array in the queue, capacity nodes */
 };
 
 /* -------------------------------------------------------------------------- */
@@ -93,11 +101,14 @@ bool jit_queue_is_empty(struct jit_queue_s *queue);
 /**
 @brief Initialize a Just in Time queue.
 
-@param queue[in] Just in Time queue to be initialized. Memory should have been allocated already.
+@param queue[in] Just in Time queue to be initialized, zeroed or previously initialized.
+@param capacity[in] Number of packets the queue can hold, 1 to JIT_QUEUE_MAX
+@return 0 if succeeded, -1 if the capacity is invalid or cannot be allocated
 
-This function is used to reset every elements in the allocated queue.
+This function allocates the nodes of the queue and resets them. Packets are kept in a
+treap ordered by timestamp: insert, dequeue and the collision check are O(log n).
 */
-void jit_queue_init(struct jit_queue_s *queue);
+int jit_queue_init(struct jit_queue_s *queue, uint16_t capacity);
 
 /**
 @brief Add a packet in a Just-in-Time queue
@@ -142,6 +153,22 @@ enough the current concentrator time.
 */
 enum jit_error_e jit_peek(struct jit_queue_s *queue, struct timeval *time, int *pkt_idx);
 
+/**
+@brief Wait until the packet at the head of a JiT queue is soon to be sent.
+
+@param queue[in] Just in Time queue to wait on
+@param tx_time[out] Timestamp for transmission of the packet
+@param late_us[out] Time between the moment the packet was due for dequeuing and the return, in microseconds
+@param pkt_idx[out] Packet index which is to be dequeued, the head of the queue
+@return success once a packet is due
+
+Event-driven counterpart of jit_peek: the caller sleeps until the head packet is due, that is its
+timestamp minus the peek threshold, or minus the programming delay for a TIMESTAMPED packet, and is
+only woken earlier by jit_enqueue when a packet becomes the new head.
+Outdated packets are dropped as in jit_peek. It is a cancellation point.
+*/
+enum jit_error_e jit_wait_next(struct jit_queue_s *queue, struct timeval *tx_time, uint32_t *late_us, int *pkt_idx);
+
 /**
 @brief Debug function to print the queue's content on console
 
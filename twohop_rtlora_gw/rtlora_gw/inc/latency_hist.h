@@ -0,0 +1,79 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   latency_hist.h
+ * Author: LAM-HOANG
+ * Description:
+ *          Log-linear latency histograms, in the way of HdrHistogram: each
+ *          power of two of microseconds is split in 16 buckets, about 6% of
+ *          precision from 1 us to 71 minutes in 464 counters. Recording is
+ *          lock free, any thread may record while another one prints.
+ * Created on October 17, 2026
+ */
+
+#ifndef LATENCY_HIST_H
+#define LATENCY_HIST_H
+
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdio.h>      /* FILE */
+
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LAT_HIST_SUB_BITS       4   /* 2^4 buckets per power of two */
+#define LAT_HIST_SUB_COUNT      (1 << LAT_HIST_SUB_BITS)
+#define LAT_HIST_NB_BUCKETS     ((32 - LAT_HIST_SUB_BITS + 1) * LAT_HIST_SUB_COUNT)
+
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+typedef struct LatHist_{
+    const char  *name;
+    uint32_t    budgetUs;           /* values above are counted in nbOverBudget, 0 for none */
+    uint64_t    count[LAT_HIST_NB_BUCKETS];
+    uint64_t    total;
+    uint64_t    sumUs;
+    uint64_t    maxUs;
+    uint64_t    nbOverBudget;
+}LatHist_t;
+
+/* --- PUBLIC MACROS -------------------------------------------------------- */
+
+/* Static initializer, no init call is needed */
+#define LAT_HIST_INITIALIZER(name, budgetUs)    { (name), (budgetUs), { 0 }, 0, 0, 0, 0 }
+
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Current CLOCK_MONOTONIC time, for the stamps of a measure
+@return time in nanoseconds
+*/
+uint64_t latHistNowNs(void);
+
+/**
+@brief Add a value to a histogram
+@param hist[in/out] Histogram
+@param us[in] Latency in microseconds, values above 2^32 us go to the last bucket
+*/
+void latHistRecord(LatHist_t *hist, uint64_t us);
+
+/**
+@brief Value at a percentile of a histogram
+@param hist[in] Histogram
+@param percentile[in] 0 to 100
+@return upper bound of the bucket holding the percentile, at most the max, in microseconds, 0 if empty
+*/
+uint64_t latHistPercentile(const LatHist_t *hist, double percentile);
+
+/**
+@brief Print count, mean, percentiles, max and budget overruns of a histogram on one line
+@param hist[in] Histogram
+@param out[in] Output stream
+*/
+void latHistPrint(const LatHist_t *hist, FILE *out);
+
+#endif /* LATENCY_HIST_H */
@@ -12,6 +12,7 @@
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
+#include <stdint.h>      /* C99 types */
 #include <sys/time.h>    /* timeval */
 
 /* -------------------------------------------------------------------------- */
@@ -19,6 +20,27 @@
 
 int get_concentrator_time(struct timeval *concent_time, struct timeval unix_time);
 
+/**
+@brief Convert a host time into a SX1301 counter value, for TIMESTAMPED downlinks
+@param count_us[out] Counter value, modulo 2^32 so the counter wrap is handled
+@param unix_time[in] Host time
+@return 0 if succeeded, -1 if the counter has not been sampled yet
+*/
+int get_concentrator_count(uint32_t *count_us, struct timeval unix_time);
+
+/**
+@brief Convert a SX1301 counter value into a host time, for uplink timestamps
+@param unix_time[out] Host time
+@param count_us[in] Counter value, within 35 minutes of the latest sample
+@return 0 if succeeded, -1 if the counter has not been sampled yet
+*/
+int get_unix_time(struct timeval *unix_time, uint32_t count_us);
+
+/**
+@brief Print the clock model and the histogram of the sample errors
+*/
+void print_timersync_stat(void);
+
 void thread_timersync(void);
 
 #endif
@@ -0,0 +1,112 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   timesync_filter.h
+ * Author: LAM-HOANG
+ * Description:
+ *          Estimation of the server clock from TIMESYNC_REQ/RES exchanges,
+ *          in the way of NTP. Requests go by bursts and only the sample of
+ *          least round trip of a burst is kept, the others carry queuing
+ *          delay. The kept samples of the last bursts are fitted by least
+ *          squares into an offset and a skew, so the offset can be
+ *          extrapolated between bursts. Not thread safe.
+ * Created on October 17, 2026
+ */
+
+#ifndef TIMESYNC_FILTER_H
+#define TIMESYNC_FILTER_H
+
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* FILE */
+#include <sys/time.h>   /* timeval */
+
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define TSF_BURST_SIZE          8       /* requests per burst */
+#define TSF_WINDOW              8       /* bursts in the fit */
+#define TSF_RTT_MAX_US          200000  /* samples of longer round trip are rejected */
+#define TSF_RTT_GATE_FACTOR     3       /* a burst is rejected if its round trip exceeds this factor... */
+#define TSF_RTT_GATE_MARGIN_US  1000    /* ...of the least one of the window, plus this margin */
+#define TSF_MAX_REJECTS         4       /* consecutive rejected bursts after which the path is considered changed */
+#define TSF_STEP_US             5000    /* a burst this far from the fit is a clock step, the fit restarts */
+
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+typedef struct TimeSyncPoint_{
+    double      hostUs;         /* host time of the sample, middle of t0 and t3 */
+    double      offsetUs;       /* server time - host time */
+    double      rttUs;          /* round trip without the server processing time */
+}TimeSyncPoint_t;
+
+typedef struct TimeSyncFilter_{
+    TimeSyncPoint_t burstBest;          /* least round trip sample of the current burst */
+    uint32_t        burstNb;            /* valid samples in the current burst */
+    TimeSyncPoint_t points[TSF_WINDOW]; /* kept sample of the last bursts, circular */
+    uint32_t        nbPoints;
+    uint32_t        next;
+    /* estimate */
+    bool            valid;
+    double          refUs;              /* host time the offset refers to */
+    double          offsetUs;           /* server time - host time at refUs */
+    double          skewPpm;            /* server clock rate relative to the host one */
+    double          uncertaintyUs;      /* fit residual plus half of the least round trip */
+    /* counters */
+    uint32_t        nbSamples;
+    uint32_t        nbRejectedSamples;
+    uint32_t        nbBursts;
+    uint32_t        nbRejectedBursts;
+    uint32_t        nbConsecRejects;
+    uint32_t        nbResets;
+}TimeSyncFilter_t;
+
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Reset a filter, no estimate until the first burst ends
+@param filter[out] Filter
+*/
+void tsfInit(TimeSyncFilter_t *filter);
+
+/**
+@brief Add the sample of one request/response to the current burst
+@param filter[in/out] Filter
+@param t0[in] Host time the request was sent
+@param t1[in] Server time the request was received
+@param t2[in] Server time the response was sent
+@param t3[in] Host time the response was received
+@return 0 if the sample is valid, -1 if its round trip is negative or above TSF_RTT_MAX_US
+*/
+int tsfAddSample(TimeSyncFilter_t *filter, const struct timeval *t0, const struct timeval *t1,
+        const struct timeval *t2, const struct timeval *t3);
+
+/**
+@brief End the current burst, fit its best sample with those of the previous bursts
+@param filter[in/out] Filter
+@return 0 if the estimate was updated, -1 if the burst had no valid sample or was rejected
+*/
+int tsfEndBurst(TimeSyncFilter_t *filter);
+
+/**
+@brief Offset between the server and the host clocks at a host time
+@param filter[in] Filter
+@param host[in] Host time
+@param offsetUs[out] Server time - host time, extrapolated with the skew
+@return 0 if succeeded, -1 if there is no estimate yet
+*/
+int tsfOffsetAt(const TimeSyncFilter_t *filter, const struct timeval *host, double *offsetUs);
+
+/**
+@brief Print the estimate and the counters on one line
+@param filter[in] Filter
+@param out[in] Output stream
+*/
+void tsfPrint(const TimeSyncFilter_t *filter, FILE *out);
+
+#endif /* TIMESYNC_FILTER_H */
@@ -0,0 +1,149 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   clock_discipline.c
+ * Author: LAM-HOANG
+ *
+ * Created on October 17, 2026
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "clock_discipline.h"
+
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static int64_t clkdTimeUs(const struct timeval *t){
+    return (int64_t)t->tv_sec * 1000000 + t->tv_usec;
+}
+
+/* Signed distance of a counter value to the latest sample, the wrap is taken care of by the int32_t cast */
+static int64_t clkdCountDelta(const ClockDiscipline_t *cd, uint32_t count){
+    return (int32_t)(count - (uint32_t)cd->refCountUs);
+}
+
+/* Least squares fit of the window, x and y relative to the latest point keep the precision of doubles */
+static void clkdFit(ClockDiscipline_t *cd){
+    const ClkdPoint_t *latest = &cd->points[(cd->next + CLKD_WINDOW - 1) % CLKD_WINDOW];
+    double x[CLKD_WINDOW], y[CLKD_WINDOW];
+    double meanX = 0, meanY = 0, sxx = 0, sxy = 0, ssr = 0;
+    double slope, res;
+    uint32_t i, n = cd->nbPoints;
+
+    /* y is the offset change, (counter elapsed - host elapsed), so the slope is the drift */
+    for(i = 0; i < n; i++){
+        x[i] = (double)(cd->points[i].hostUs - latest->hostUs);
+        y[i] = (double)(int64_t)(cd->points[i].countUs - latest->countUs) - x[i];
+        meanX += x[i];
+        meanY += y[i];
+    }
+    meanX /= n;
+    meanY /= n;
+    for(i = 0; i < n; i++){
+        sxx += (x[i] - meanX) * (x[i] - meanX);
+        sxy += (x[i] - meanX) * (y[i] - meanY);
+    }
+    slope = (sxx > 0) ? (sxy / sxx) : 0;
+    for(i = 0; i < n; i++){
+        res = y[i] - (meanY + slope * (x[i] - meanX));
+        ssr += res * res;
+    }
+
+    cd->refHostUs = latest->hostUs;
+    cd->refCountUs = latest->countUs;
+    cd->corrUs = meanY - slope * meanX;
+    cd->driftPpm = slope * 1e6;
+    cd->residualUs = (n > 2) ? sqrt(ssr / (n - 2)) : 0;
+    cd->valid = true;
+}
+
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void clkdInit(ClockDiscipline_t *cd){
+    memset(cd, 0, sizeof(*cd));
+}
+
+int clkdAddSample(ClockDiscipline_t *cd, const struct timeval *host, uint32_t count){
+    int64_t hostUs = clkdTimeUs(host);
+    int64_t delta;
+    double dx;
+    bool restart;
+
+    cd->nbSamples++;
+    if(!cd->valid){
+        restart = true;
+        cd->lastErrorUs = 0;
+    } else {
+        delta = clkdCountDelta(cd, count);
+        dx = (double)(hostUs - cd->refHostUs);
+        cd->lastErrorUs = (double)delta - (cd->corrUs + dx * (1 + cd->driftPpm * 1e-6));
+        /* a counter going backwards was reset, a large error is a step of the host clock or a reset too */
+        restart = (delta < 0) || (fabs(cd->lastErrorUs) > CLKD_STEP_US);
+        if(restart){
+            cd->nbResets++;
+        } else if(count < (uint32_t)cd->refCountUs){
+            /* the counter went forward through zero: one more wrap */
+            cd->wraps++;
+            cd->nbWraps++;
+        }
+    }
+    if(restart){
+        cd->nbPoints = 0;
+        cd->next = 0;
+    }
+
+    cd->points[cd->next].hostUs = hostUs;
+    cd->points[cd->next].countUs = ((uint64_t)cd->wraps << 32) | count;
+    cd->next = (cd->next + 1) % CLKD_WINDOW;
+    if(cd->nbPoints < CLKD_WINDOW){
+        cd->nbPoints++;
+    }
+    clkdFit(cd);
+    return restart ? 1 : 0;
+}
+
+int clkdExtend(const ClockDiscipline_t *cd, uint32_t count, uint64_t *countUs){
+    if(!cd->valid){
+        return -1;
+    }
+    *countUs = cd->refCountUs + clkdCountDelta(cd, count);
+    return 0;
+}
+
+int clkdUnixToCount(const ClockDiscipline_t *cd, const struct timeval *host, uint32_t *count){
+    double dx;
+
+    if(!cd->valid){
+        return -1;
+    }
+    dx = (double)(clkdTimeUs(host) - cd->refHostUs);
+    *count = (uint32_t)(cd->refCountUs + llround(cd->corrUs + dx * (1 + cd->driftPpm * 1e-6)));
+    return 0;
+}
+
+int clkdCountToUnix(const ClockDiscipline_t *cd, uint32_t count, struct timeval *host){
+    int64_t hostUs;
+
+    if(!cd->valid){
+        return -1;
+    }
+    hostUs = cd->refHostUs + llround((clkdCountDelta(cd, count) - cd->corrUs) / (1 + cd->driftPpm * 1e-6));
+    host->tv_sec = hostUs / 1000000;
+    host->tv_usec = hostUs % 1000000;
+    return 0;
+}
+
+void clkdPrint(const ClockDiscipline_t *cd, FILE *out){
+    if(!cd->valid){
+        fprintf(out, "sx1301 clock: no sample\n");
+        return;
+    }
+    fprintf(out, "sx1301 clock: drift %.3f ppm, residual %.1f us, last error %.1f us, %u points, "
+            "%u samples, %u wraps, %u restarts\n", cd->driftPpm, cd->residualUs, cd->lastErrorUs, cd->nbPoints,
+            cd->nbSamples, cd->nbWraps, cd->nbResets);
+}
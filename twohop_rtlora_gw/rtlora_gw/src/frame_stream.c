@@ -0,0 +1,152 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   frame_stream.c
+ * Author: LAM-HOANG
+ *
+ * Created on October 17, 2026
+ */
+
+#define _GNU_SOURCE     /* MSG_NOSIGNAL */
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <poll.h>
+
+#include "frame_stream.h"
+
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static void frame_stream_restore(struct frame_stream_s *fs) {
+    if (fs->term_set) {
+        fs->buf[fs->term] = fs->term_byte;
+        fs->term_set = false;
+    }
+}
+
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void frame_stream_init(struct frame_stream_s *fs, uint8_t *buf, uint32_t buf_size) {
+    fs->buf = buf;
+    fs->size = buf_size - 1;
+    fs->len = 0;
+    fs->rd = 0;
+    fs->term = 0;
+    fs->term_byte = 0;
+    fs->term_set = false;
+    fs->nb_frames = 0;
+    fs->nb_dropped = 0;
+}
+
+uint8_t *frame_stream_wptr(struct frame_stream_s *fs, uint32_t *room) {
+    frame_stream_restore(fs);
+
+    /* drop consumed frames, only the partial frame at the end is moved */
+    if (fs->rd > 0) {
+        if (fs->len > fs->rd) {
+            memmove(fs->buf, fs->buf + fs->rd, fs->len - fs->rd);
+        }
+        fs->len -= fs->rd;
+        fs->rd = 0;
+    }
+
+    *room = fs->size - fs->len;
+    return fs->buf + fs->len;
+}
+
+void frame_stream_commit(struct frame_stream_s *fs, uint32_t nb_bytes) {
+    fs->len += nb_bytes;
+    if (fs->len > fs->size) {
+        fs->len = fs->size;
+    }
+}
+
+uint8_t *frame_stream_next(struct frame_stream_s *fs, uint32_t *frame_len) {
+    uint8_t *frame;
+    uint32_t payload_len;
+
+    frame_stream_restore(fs);
+
+    while ((fs->len - fs->rd) >= FRAME_HDR_SIZE) {
+        frame = fs->buf + fs->rd;
+        payload_len = frame_get_length(frame);
+
+        /* not a frame boundary (garbage or lost sync), skip one byte */
+        if ((frame[FRAME_OFS_VERSION] != PROTOCOL_VERSION) || (payload_len > (fs->size - FRAME_HDR_SIZE))) {
+            fs->rd++;
+            fs->nb_dropped++;
+            continue;
+        }
+
+        /* frame is not complete yet, wait for the next read */
+        if ((fs->len - fs->rd) < (FRAME_HDR_SIZE + payload_len)) {
+            return NULL;
+        }
+
+        *frame_len = FRAME_HDR_SIZE + payload_len;
+        fs->rd += *frame_len;
+
+        /* terminate the frame in place, the byte is restored on the next call */
+        fs->term = fs->rd;
+        fs->term_byte = fs->buf[fs->rd];
+        fs->buf[fs->rd] = 0;
+        fs->term_set = true;
+
+        fs->nb_frames++;
+        return frame;
+    }
+
+    return NULL;
+}
+
+void frame_header_write(uint8_t *frame, uint8_t type, uint8_t token_h, uint8_t token_l, uint16_t payload_len) {
+    frame[FRAME_OFS_VERSION] = PROTOCOL_VERSION;
+    frame[FRAME_OFS_TOKEN_H] = token_h;
+    frame[FRAME_OFS_TOKEN_L] = token_l;
+    frame[FRAME_OFS_TYPE] = type;
+    frame_set_length(frame, payload_len);
+}
+
+void frame_set_length(uint8_t *frame, uint16_t payload_len) {
+    frame_put_u16(frame + FRAME_OFS_LENGTH, payload_len);
+}
+
+uint16_t frame_get_length(const uint8_t *frame) {
+    return frame_get_u16(frame + FRAME_OFS_LENGTH);
+}
+
+int frame_send(int sock, const uint8_t *frame, uint32_t frame_len) {
+    return frame_send_timeout(sock, frame, frame_len, FRAME_SEND_TIMEOUT_MS);
+}
+
+int frame_send_timeout(int sock, const uint8_t *frame, uint32_t frame_len, int timeout_ms) {
+    struct pollfd pfd;
+    ssize_t n;
+
+    while (frame_len > 0) {
+        n = send(sock, frame, frame_len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                /* non-blocking socket with a full send buffer, wait a bit for room */
+                pfd.fd = sock;
+                pfd.events = POLLOUT;
+                if (poll(&pfd, 1, timeout_ms) > 0) {
+                    continue;
+                }
+            }
+            return -1;
+        }
+        frame += n;
+        frame_len -= (uint32_t)n;
+    }
+
+    return 0;
+}
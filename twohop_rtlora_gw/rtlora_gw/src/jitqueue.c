@@ -16,8 +16,8 @@ Maintainer: Michael Coracin
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
-#define _GNU_SOURCE     /* needed for qsort_r to be defined */
-#include <stdlib.h>     /* qsort_r */
+#define _GNU_SOURCE     /* needed for timersub, timercmp and pthread_cleanup_push to be defined */
+#include <stdlib.h>     /* calloc, free */
 #include <stdio.h>      /* printf, fprintf, snprintf, fopen, fputs */
 #include <string.h>     /* memset, memcpy */
 #include <pthread.h>
@@ -51,10 +51,173 @@ Maintainer: Michael Coracin
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
 static pthread_mutex_t mx_jit_queue = PTHREAD_MUTEX_INITIALIZER; /* control access to JIT queue */
+static pthread_cond_t cond_jit_head = PTHREAD_COND_INITIALIZER; /* signaled when a packet becomes the head of the queue */
+static bool jit_head_changed = false; /* protected by mx_jit_queue */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
+/* The queue is a treap: a binary search tree on tx_timestamp whose nodes are
+ * also a max-heap on a random priority, which keeps it balanced on average.
+ * Insert, removal, head and neighbour lookups are O(log n). Nodes are slots
+ * of queue->nodes, linked by index, -1 for none. mx_jit_queue must be held. */
+
+/* xorshift32, for the heap priorities */
+static uint32_t jit_next_prio(struct jit_queue_s *queue) {
+    uint32_t x = queue->prio_seed;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    queue->prio_seed = x;
+    return x;
+}
+
+/* Order of the tree, by timestamp then by slot */
+static bool jit_node_before(struct jit_queue_s *queue, int a, int b) {
+    if (timercmp(&(queue->nodes[a].tx_timestamp), &(queue->nodes[b].tx_timestamp), ==)) {
+        return a < b;
+    }
+    return timercmp(&(queue->nodes[a].tx_timestamp), &(queue->nodes[b].tx_timestamp), <);
+}
+
+/* Split a subtree into the nodes before key and the others */
+static void jit_tree_split(struct jit_queue_s *queue, int t, int key, int *before, int *after) {
+    if (t < 0) {
+        *before = -1;
+        *after = -1;
+    } else if (jit_node_before(queue, t, key)) {
+        jit_tree_split(queue, queue->nodes[t].right, key, &(queue->nodes[t].right), after);
+        *before = t;
+    } else {
+        jit_tree_split(queue, queue->nodes[t].left, key, before, &(queue->nodes[t].left));
+        *after = t;
+    }
+}
+
+/* Join two subtrees, all the nodes of before being before those of after */
+static int jit_tree_merge(struct jit_queue_s *queue, int before, int after) {
+    if (before < 0) {
+        return after;
+    }
+    if (after < 0) {
+        return before;
+    }
+    if (queue->nodes[before].prio > queue->nodes[after].prio) {
+        queue->nodes[before].right = jit_tree_merge(queue, queue->nodes[before].right, after);
+        return before;
+    }
+    queue->nodes[after].left = jit_tree_merge(queue, before, queue->nodes[after].left);
+    return after;
+}
+
+static int jit_tree_erase(struct jit_queue_s *queue, int t, int idx) {
+    if (t < 0) {
+        return -1;
+    }
+    if (t == idx) {
+        return jit_tree_merge(queue, queue->nodes[t].left, queue->nodes[t].right);
+    }
+    if (jit_node_before(queue, idx, t)) {
+        queue->nodes[t].left = jit_tree_erase(queue, queue->nodes[t].left, idx);
+    } else {
+        queue->nodes[t].right = jit_tree_erase(queue, queue->nodes[t].right, idx);
+    }
+    return t;
+}
+
+/* Slot of the earliest packet, -1 if the queue is empty */
+static int jit_head(struct jit_queue_s *queue) {
+    int n = queue->root;
+
+    while ((n >= 0) && (queue->nodes[n].left >= 0)) {
+        n = queue->nodes[n].left;
+    }
+    return n;
+}
+
+/* Latest packet at or before a timestamp, -1 if none */
+static int jit_floor(struct jit_queue_s *queue, struct timeval *time) {
+    int n = queue->root;
+    int best = -1;
+
+    while (n >= 0) {
+        if (timercmp(&(queue->nodes[n].tx_timestamp), time, >)) {
+            n = queue->nodes[n].left;
+        } else {
+            best = n;
+            n = queue->nodes[n].right;
+        }
+    }
+    return best;
+}
+
+/* Earliest packet after a timestamp, -1 if none */
+static int jit_ceiling(struct jit_queue_s *queue, struct timeval *time) {
+    int n = queue->root;
+    int best = -1;
+
+    while (n >= 0) {
+        if (timercmp(&(queue->nodes[n].tx_timestamp), time, >)) {
+            best = n;
+            n = queue->nodes[n].left;
+        } else {
+            n = queue->nodes[n].right;
+        }
+    }
+    return best;
+}
+
+/* Remove a queued packet and give its slot back */
+static void jit_remove_node(struct jit_queue_s *queue, int idx) {
+    queue->root = jit_tree_erase(queue, queue->root, idx);
+    memset(&(queue->nodes[idx]), 0, sizeof(struct jit_node_s));
+    queue->nodes[idx].left = -1;
+    queue->nodes[idx].right = queue->free_node;
+    queue->free_node = idx;
+    queue->num_pkt--;
+}
+
+/* Drop the packets whose timestamp is past, they are all at the head of the queue */
+static void jit_drop_outdated(struct jit_queue_s *queue, struct timeval *current_time) {
+    int head;
+
+    while (((head = jit_head(queue)) >= 0) && timercmp(current_time, &(queue->nodes[head].tx_timestamp), >)) {
+        MSG("WARNING: --- Packet dropped (tx_timestamp=%ld.%06ld)\n", queue->nodes[head].tx_timestamp.tv_sec, \
+                queue->nodes[head].tx_timestamp.tv_usec);
+        jit_remove_node(queue, head);
+    }
+}
+
+static void jit_print_subtree(struct jit_queue_s *queue, int t, int debug_level) {
+    if (t < 0) {
+        return;
+    }
+    jit_print_subtree(queue, queue->nodes[t].left, debug_level);
+    MSG_DEBUG(debug_level, " - node[%d]: timestamp=%ld.%06ld - type=%d\n",
+                t, queue->nodes[t].tx_timestamp.tv_sec, queue->nodes[t].tx_timestamp.tv_usec, queue->nodes[t].pkt_type);
+    jit_print_subtree(queue, queue->nodes[t].right, debug_level);
+}
+
+/* Moment a packet is due for dequeuing: a TIMESTAMPED packet is programmed TX_JIT_DELAY
+ * ahead so the concentrator fires it on its counter, the others are sent by the host
+ * TX_DEVIATION_THRESHOLD before their timestamp. The pre-delay reserved between queued
+ * packets is larger than the difference, so due times keep the order of timestamps. */
+static void jit_due_time(struct jit_node_s *node, struct timeval *due) {
+    struct timeval advance = {0, TX_DEVIATION_THRESHOLD};
+
+    if (node->pkt.tx_mode == TIMESTAMPED) {
+        advance.tv_usec = TX_JIT_DELAY;
+    }
+    timersub(&(node->tx_timestamp), &advance, due);
+}
+
+/* Release the queue if the JIT thread is canceled while waiting */
+static void jit_unlock_queue(void *arg) {
+    (void)arg;
+    pthread_mutex_unlock(&mx_jit_queue);
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ----------------------------------------- */
 
@@ -63,7 +226,7 @@ bool jit_queue_is_full(struct jit_queue_s *queue) {
 
     pthread_mutex_lock(&mx_jit_queue);
 
-    result = (queue->num_pkt == JIT_QUEUE_MAX)?true:false;
+    result = (queue->num_pkt == queue->capacity)?true:false;
 
     pthread_mutex_unlock(&mx_jit_queue);
 
@@ -82,66 +245,37 @@ bool jit_queue_is_empty(struct jit_queue_s *queue) {
     return result;
 }
 
-void jit_queue_init(struct jit_queue_s *queue) {
+int jit_queue_init(struct jit_queue_s *queue, uint16_t capacity) {
     int i;
 
+    if ((capacity == 0) || (capacity > JIT_QUEUE_MAX)) {
+        MSG("ERROR: JIT queue capacity must range from 1 to %d\n", JIT_QUEUE_MAX);
+        return -1;
+    }
+
     pthread_mutex_lock(&mx_jit_queue);
 
+    free(queue->nodes);
     memset(queue, 0, sizeof(*queue));
-    for (i=0; i<JIT_QUEUE_MAX; i++) {
-        queue->nodes[i].tx_timestamp.tv_sec = 0;
-        queue->nodes[i].tx_timestamp.tv_usec = 0;
-        queue->nodes[i].pre_delay = 0;
-        queue->nodes[i].post_delay = 0;
+    queue->nodes = calloc(capacity, sizeof(struct jit_node_s));
+    if (queue->nodes == NULL) {
+        pthread_mutex_unlock(&mx_jit_queue);
+        MSG("ERROR: failed to allocate a JIT queue of %u packets\n", capacity);
+        return -1;
     }
+    queue->capacity = capacity;
+    queue->root = -1;
+    queue->prio_seed = 0x9E3779B9;
+    /* chain every slot in the free list */
+    for (i=0; i<capacity; i++) {
+        queue->nodes[i].left = -1;
+        queue->nodes[i].right = (i + 1 < capacity) ? (i + 1) : -1;
+    }
+    queue->free_node = 0;
 
     pthread_mutex_unlock(&mx_jit_queue);
-}
-
-int compare(const void *a, const void *b, void *arg)
-{
-    struct jit_node_s *p = (struct jit_node_s *)a;
-    struct jit_node_s *q = (struct jit_node_s *)b;
-    int *counter = (int *)arg;
-    struct timeval p_time, q_time;
-    int return_val;
-    
-    p_time.tv_sec = p->tx_timestamp.tv_sec;
-    p_time.tv_usec = p->tx_timestamp.tv_usec;
 
-    q_time.tv_sec = q->tx_timestamp.tv_sec;
-    q_time.tv_usec = q->tx_timestamp.tv_usec;
-
-    if(timercmp(&p_time, &q_time, >))
-        *counter = *counter + 1;
-    
-    return_val = -1;
-    if(p_time.tv_sec >= q_time.tv_sec){
-        if (p_time.tv_sec == q_time.tv_sec){
-            if(p_time.tv_usec > q_time.tv_sec)
-                return_val = 1;
-            else
-              return_val = -1;  
-        } else {
-            return_val = 1;
-        }
-    } else {
-        return_val = -1;
-    } 
-   
-    return return_val;
-}
-
-void jit_sort_queue(struct jit_queue_s *queue) {
-    int counter = 0;
-
-    if (queue->num_pkt == 0) {
-        return;
-    }
-
-    MSG_DEBUG(DEBUG_JIT, "sorting queue in ascending order packet timestamp - queue size:%u\n", queue->num_pkt);
-    qsort_r(queue->nodes, queue->num_pkt, sizeof(queue->nodes[0]), compare, &counter);
-    MSG_DEBUG(DEBUG_JIT, "sorting queue done - swapped:%d\n", counter);
+    return 0;
 }
 
 bool jit_collision_test(struct timeval p1_timestamp, uint32_t p1_pre_delay, uint32_t p1_post_delay, struct timeval p2_timestamp, uint32_t p2_pre_delay, uint32_t p2_post_delay) {
@@ -165,8 +299,8 @@ bool jit_collision_test(struct timeval p1_timestamp, uint32_t p1_pre_delay, uint
 
 enum jit_error_e jit_peek(struct jit_queue_s *queue, struct timeval *time, int *pkt_idx) {
     /* Return index of node containing a packet inline with given time */
-    int i = 0;
-    struct timeval current_time, delta_time;
+    struct timeval current_time, due_time;
+    int head;
 
     if (pkt_idx == NULL) {
         MSG("ERROR: invalid parameter\n");
@@ -177,52 +311,93 @@ enum jit_error_e jit_peek(struct jit_queue_s *queue, struct timeval *time, int *
         return JIT_ERROR_EMPTY;
     }
 
-    pthread_mutex_lock(&mx_jit_queue);
-
-    /* Search for highest priority packet to be sent */
-    for (i=0; i<queue->num_pkt; i++) {
-        /* First check if that packet is outdated:
-         *  If a packet seems too much in advance, and was not rejected at enqueue time,
-         *  it means that we missed it for peeking, we need to drop it
-         *
-         *  Warning: unsigned arithmetic
-         *      t_packet > t_current + TX_MAX_ADVANCE_DELAY
-         */
+    if (time != NULL) {
+        current_time = *time;
+    } else {
         gettimeofday(&current_time, NULL);
-        if(timercmp(&current_time, &(queue->nodes[i].tx_timestamp), >)){
-            /* We drop the packet to avoid lock-up */
-            queue->num_pkt--;
-            MSG("WARNING: --- Packet dropped (tx_timestamp=%ld.%06ld)\n",queue->nodes[i].tx_timestamp.tv_sec, \
-                    queue->nodes[i].tx_timestamp.tv_sec);
-
-            /* Replace dropped packet with last packet of the queue */
-            memcpy(&(queue->nodes[i]), &(queue->nodes[queue->num_pkt]), sizeof(struct jit_node_s));
-            memset(&(queue->nodes[queue->num_pkt]), 0, sizeof(struct jit_node_s));
+    }
 
-            /* Sort queue in ascending order of packet timestamp */
-            jit_sort_queue(queue);
+    pthread_mutex_lock(&mx_jit_queue);
 
-            /* restart loop  after purge to find packet to be sent */
-            i = 0;
-            continue;
-        }
+    /* Packets missed for peeking are dropped to avoid lock-up */
+    jit_drop_outdated(queue, &current_time);
+    if (queue->num_pkt == 0) {
+        pthread_mutex_unlock(&mx_jit_queue);
+        return JIT_ERROR_EMPTY;
     }
-    gettimeofday(&current_time, NULL);
-    timersub(&(queue->nodes[0].tx_timestamp), &current_time, &delta_time);
-    if((delta_time.tv_sec*1000000 + delta_time.tv_usec) < TX_DEVIATION_THRESHOLD)
-        *pkt_idx = 0;
+
+    head = jit_head(queue);
+    jit_due_time(&(queue->nodes[head]), &due_time);
+    if(!timercmp(&current_time, &due_time, <))
+        *pkt_idx = head;
     else
         *pkt_idx = -1;
     MSG_DEBUG(DEBUG_JIT, "peek packet with tx_timestamp=%ld.%06ld at index %d\n",\
-            queue->nodes[0].tx_timestamp.tv_sec, queue->nodes[0].tx_timestamp.tv_usec, 0);
+            queue->nodes[head].tx_timestamp.tv_sec, queue->nodes[head].tx_timestamp.tv_usec, head);
 
     pthread_mutex_unlock(&mx_jit_queue);
 
     return JIT_ERROR_OK;
 }
 
+enum jit_error_e jit_wait_next(struct jit_queue_s *queue, struct timeval *tx_time, uint32_t *late_us, int *pkt_idx) {
+    struct timeval current_time, deadline, delta_time;
+    struct timespec abs_deadline;
+    int head = -1;
+
+    if ((tx_time == NULL) || (late_us == NULL) || (pkt_idx == NULL)) {
+        MSG("ERROR: invalid parameter\n");
+        return JIT_ERROR_INVALID;
+    }
+
+    pthread_mutex_lock(&mx_jit_queue);
+    pthread_cleanup_push(jit_unlock_queue, NULL);
+
+    while (1) {
+        jit_head_changed = false;
+        gettimeofday(&current_time, NULL);
+        jit_drop_outdated(queue, &current_time);
+        head = jit_head(queue);
+        if (head < 0) {
+            /* nothing to arm, sleep until a packet is enqueued */
+            while (!jit_head_changed) {
+                pthread_cond_wait(&cond_jit_head, &mx_jit_queue);
+            }
+            continue;
+        }
+
+        jit_due_time(&(queue->nodes[head]), &deadline);
+        if (!timercmp(&current_time, &deadline, <)) {
+            break;
+        }
+
+        /* timestamps are host UTC time, the deadline is on the condition variable's CLOCK_REALTIME */
+        abs_deadline.tv_sec = deadline.tv_sec;
+        abs_deadline.tv_nsec = deadline.tv_usec * 1000;
+        while (!jit_head_changed) {
+            if (pthread_cond_timedwait(&cond_jit_head, &mx_jit_queue, &abs_deadline) != 0) {
+                break; /* deadline reached */
+            }
+        }
+    }
+
+    timersub(&current_time, &deadline, &delta_time);
+    *late_us = (uint32_t)(delta_time.tv_sec * 1000000 + delta_time.tv_usec);
+    *tx_time = queue->nodes[head].tx_timestamp;
+    *pkt_idx = head;
+    MSG_DEBUG(DEBUG_JIT, "packet with tx_timestamp=%ld.%06ld due, woken %u us late\n",\
+            tx_time->tv_sec, tx_time->tv_usec, *late_us);
+
+    pthread_cleanup_pop(1);
+
+    return JIT_ERROR_OK;
+}
+
 enum jit_error_e jit_enqueue(struct jit_queue_s *queue, struct timeval time, struct lgw_pkt_tx_s *packet, enum jit_pkt_type_e pkt_type) {
     int i = 0;
+    int j;
+    int neighbour[2]; /* queued packets just before and just after this one */
+    int before, after;
     uint32_t packet_post_delay = 0;
     uint32_t packet_pre_delay = 0;
     uint32_t target_pre_delay = 0;
@@ -250,6 +425,11 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, struct timeval time, str
 
     pthread_mutex_lock(&mx_jit_queue);
 
+    if (queue->free_node < 0) {
+        pthread_mutex_unlock(&mx_jit_queue);
+        return JIT_ERROR_FULL;
+    }
+
     /* An immediate downlink becomes a timestamped downlink "ASAP" */
     /* Set the packet count_us to the first available slot */
 //    if (packet->tx_mode == IMMEDIATE){
@@ -298,49 +478,52 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, struct timeval time, str
         return JIT_ERROR_TOO_EARLY;
     }
     
+    /* The packet can be inserted to the queue if it does not collide with other packets.
+     * Queued packets never collide with each other and all have the same pre-delay, so
+     * if any of them collides with this one, so does its nearest neighbour on either side. */
     insert_ok = true;
-    if (queue->num_pkt == 0) {
-        /* If the jit queue is empty, we can insert this packet */
-        MSG_DEBUG(DEBUG_JIT, "DEBUG: insert downlink, first in JiT queue (at %ld.%ld)\n", tx_timestamp.tv_sec, tx_timestamp.tv_usec);
-    } else {
-        /* The packet can be inserted to the queue if it does not collide with other packets */
-        for (i = 0; i < queue->num_pkt; i++) {
-            if (jit_collision_test(tx_timestamp, packet_pre_delay, packet_post_delay, queue->nodes[i].tx_timestamp,\
-                queue->nodes[i].pre_delay, queue->nodes[i].post_delay) == true) {
-                MSG_DEBUG(DEBUG_JIT, "DEBUG: cannot insert downlink at %ld.%ld, collides with %ld.%ld (index=%d)\n",\
-                        tx_timestamp.tv_sec, tx_timestamp.tv_usec, queue->nodes[i].tx_timestamp.tv_sec, \
-                        queue->nodes[i].tx_timestamp.tv_usec, i);
-                
-                break;
-            }
-        }
-
-        if (i == queue->num_pkt) {
-            /* No collision with ASAP time, we can insert it */
-            MSG_DEBUG(DEBUG_JIT, "DEBUG: insert downlink at %ld.%ld (no collision)\n", tx_timestamp.tv_sec, tx_timestamp.tv_usec);
-            insert_ok = true;
-        } else {
-            /* No collision with ASAP time, we can insert it */
+    neighbour[0] = jit_floor(queue, &tx_timestamp);
+    neighbour[1] = jit_ceiling(queue, &tx_timestamp);
+    for (i = 0; i < 2; i++) {
+        j = neighbour[i];
+        if ((j >= 0) && (jit_collision_test(tx_timestamp, packet_pre_delay, packet_post_delay, queue->nodes[j].tx_timestamp,\
+            queue->nodes[j].pre_delay, queue->nodes[j].post_delay) == true)) {
+            MSG_DEBUG(DEBUG_JIT, "DEBUG: cannot insert downlink at %ld.%ld, collides with %ld.%ld (index=%d)\n",\
+                    tx_timestamp.tv_sec, tx_timestamp.tv_usec, queue->nodes[j].tx_timestamp.tv_sec, \
+                    queue->nodes[j].tx_timestamp.tv_usec, j);
             insert_ok = false;
+            break;
         }
     }
-        
+
     if(insert_ok == false){
         pthread_mutex_unlock(&mx_jit_queue);
         return JIT_ERROR_COLLISION_PACKET;
     }
-  
-    /* Finally enqueue it */
-    /* Insert packet at the end of the queue */
-    memcpy(&(queue->nodes[queue->num_pkt].pkt), packet, sizeof(struct lgw_pkt_tx_s));
-    queue->nodes[queue->num_pkt].pre_delay = packet_pre_delay;
-    queue->nodes[queue->num_pkt].post_delay = packet_post_delay;
-    queue->nodes[queue->num_pkt].pkt_type = pkt_type;
-    queue->nodes[queue->num_pkt].tx_timestamp.tv_sec = tx_timestamp.tv_sec;
-    queue->nodes[queue->num_pkt].tx_timestamp.tv_usec = tx_timestamp.tv_usec;
+    MSG_DEBUG(DEBUG_JIT, "DEBUG: insert downlink at %ld.%ld (no collision)\n", tx_timestamp.tv_sec, tx_timestamp.tv_usec);
+
+    /* Finally enqueue it in a free slot */
+    j = queue->free_node;
+    queue->free_node = queue->nodes[j].right;
+    memcpy(&(queue->nodes[j].pkt), packet, sizeof(struct lgw_pkt_tx_s));
+    queue->nodes[j].pre_delay = packet_pre_delay;
+    queue->nodes[j].post_delay = packet_post_delay;
+    queue->nodes[j].pkt_type = pkt_type;
+    queue->nodes[j].tx_timestamp.tv_sec = tx_timestamp.tv_sec;
+    queue->nodes[j].tx_timestamp.tv_usec = tx_timestamp.tv_usec;
+    queue->nodes[j].left = -1;
+    queue->nodes[j].right = -1;
+    queue->nodes[j].prio = jit_next_prio(queue);
+    queue->nodes[j].queued = true;
+    jit_tree_split(queue, queue->root, j, &before, &after);
+    queue->root = jit_tree_merge(queue, jit_tree_merge(queue, before, j), after);
     queue->num_pkt++;
-    /* Sort the queue in ascending order of packet timestamp */
-    jit_sort_queue(queue);
+
+    /* Only a new head moves the deadline of the JIT thread */
+    if (neighbour[0] < 0) {
+        jit_head_changed = true;
+        pthread_cond_signal(&cond_jit_head);
+    }
 
     /* Done */
     pthread_mutex_unlock(&mx_jit_queue);
@@ -359,7 +542,7 @@ enum jit_error_e jit_dequeue(struct jit_queue_s *queue, int index, struct lgw_pk
         return JIT_ERROR_INVALID;
     }
 
-    if ((index < 0) || (index >= JIT_QUEUE_MAX)) {
+    if ((index < 0) || (index >= queue->capacity)) {
         MSG("ERROR: invalid parameter\n");
         return JIT_ERROR_INVALID;
     }
@@ -370,21 +553,20 @@ enum jit_error_e jit_dequeue(struct jit_queue_s *queue, int index, struct lgw_pk
     }
 
     pthread_mutex_lock(&mx_jit_queue);
+
+    if (queue->nodes[index].queued == false) {
+        pthread_mutex_unlock(&mx_jit_queue);
+        MSG("ERROR: no packet queued at index %d\n", index);
+        return JIT_ERROR_INVALID;
+    }
     
     MSG_DEBUG(DEBUG_JIT, "dequeued packet with tx_timestamp=%ld.%06ld from index %d\n", \
             queue->nodes[index].tx_timestamp.tv_sec, queue->nodes[index].tx_timestamp.tv_usec, index);
             
     /* Dequeue requested packet */
     memcpy(packet, &(queue->nodes[index].pkt), sizeof(struct lgw_pkt_tx_s));
-    queue->num_pkt--;
     *pkt_type = queue->nodes[index].pkt_type;
-
-    /* Replace dequeued packet with last packet of the queue */
-    memcpy(&(queue->nodes[index]), &(queue->nodes[queue->num_pkt]), sizeof(struct jit_node_s));
-    memset(&(queue->nodes[queue->num_pkt]), 0, sizeof(struct jit_node_s));
-
-    /* Sort queue in ascending order of packet timestamp */
-    jit_sort_queue(queue);
+    jit_remove_node(queue, index);
 
     /* Done */
     pthread_mutex_unlock(&mx_jit_queue);
@@ -396,8 +578,9 @@ enum jit_error_e jit_dequeue(struct jit_queue_s *queue, int index, struct lgw_pk
 }
 
 void jit_print_queue(struct jit_queue_s *queue, bool show_all, int debug_level) {
-    int i = 0;
-    int loop_end;
+    if (debug_level == 0) {
+        return; /* keep enqueue and dequeue O(log n) when not debugging */
+    }
 
     if (jit_queue_is_empty(queue)) {
         MSG_DEBUG(debug_level, "INFO: [jit] queue is empty\n");
@@ -405,10 +588,9 @@ void jit_print_queue(struct jit_queue_s *queue, bool show_all, int debug_level)
         pthread_mutex_lock(&mx_jit_queue);
 
         MSG_DEBUG(debug_level, "INFO: [jit] queue contains %d packets:\n", queue->num_pkt);
-        loop_end = (show_all == true) ? JIT_QUEUE_MAX : queue->num_pkt;
-        for (i=0; i<loop_end; i++) {
-            MSG_DEBUG(debug_level, " - node[%d]: timestamp=%ld.%06ld - type=%d\n",
-                        i, queue->nodes[i].tx_timestamp.tv_sec, queue->nodes[i].tx_timestamp.tv_usec, queue->nodes[i].pkt_type);
+        jit_print_subtree(queue, queue->root, debug_level);
+        if (show_all == true) {
+            MSG_DEBUG(debug_level, " - %d free nodes\n", queue->capacity - queue->num_pkt);
         }
 
         pthread_mutex_unlock(&mx_jit_queue);
@@ -0,0 +1,111 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   latency_hist.c
+ * Author: LAM-HOANG
+ *
+ * Created on October 17, 2026
+ */
+
+#define _POSIX_C_SOURCE 200112L     /* clock_gettime */
+#include <time.h>
+
+#include "latency_hist.h"
+
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static unsigned int latHistIndex(uint64_t us){
+    unsigned int msb, shift;
+
+    if(us < LAT_HIST_SUB_COUNT){
+        return (unsigned int)us;
+    }
+    if(us > UINT32_MAX){
+        return LAT_HIST_NB_BUCKETS - 1;
+    }
+    msb = 63 - __builtin_clzll(us);
+    shift = msb - LAT_HIST_SUB_BITS;
+    return (shift + 1) * LAT_HIST_SUB_COUNT + (unsigned int)((us >> shift) & (LAT_HIST_SUB_COUNT - 1));
+}
+
+/* Last value of a bucket */
+static uint64_t latHistBucketMax(unsigned int index){
+    unsigned int shift;
+
+    if(index < LAT_HIST_SUB_COUNT){
+        return index;
+    }
+    shift = index / LAT_HIST_SUB_COUNT - 1;
+    return (((uint64_t)(LAT_HIST_SUB_COUNT + index % LAT_HIST_SUB_COUNT) + 1) << shift) - 1;
+}
+
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+uint64_t latHistNowNs(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+void latHistRecord(LatHist_t *hist, uint64_t us){
+    uint64_t max;
+
+    __atomic_fetch_add(&hist->count[latHistIndex(us)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->sumUs, us, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->total, 1, __ATOMIC_RELAXED);
+    if((hist->budgetUs != 0) && (us > hist->budgetUs)){
+        __atomic_fetch_add(&hist->nbOverBudget, 1, __ATOMIC_RELAXED);
+    }
+    max = __atomic_load_n(&hist->maxUs, __ATOMIC_RELAXED);
+    while((us > max) && !__atomic_compare_exchange_n(&hist->maxUs, &max, us, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+        /* max reloaded by the failed exchange */
+    }
+}
+
+uint64_t latHistPercentile(const LatHist_t *hist, double percentile){
+    uint64_t total, rank, max, seen = 0;
+    unsigned int i;
+
+    total = __atomic_load_n(&hist->total, __ATOMIC_RELAXED);
+    if(total == 0){
+        return 0;
+    }
+    rank = (uint64_t)(percentile / 100.0 * total + 0.5);
+    if(rank == 0){
+        rank = 1;
+    }
+    max = __atomic_load_n(&hist->maxUs, __ATOMIC_RELAXED);
+    for(i = 0; i < LAT_HIST_NB_BUCKETS; i++){
+        seen += __atomic_load_n(&hist->count[i], __ATOMIC_RELAXED);
+        if(seen >= rank){
+            return (latHistBucketMax(i) < max) ? latHistBucketMax(i) : max;
+        }
+    }
+    return max;
+}
+
+void latHistPrint(const LatHist_t *hist, FILE *out){
+    uint64_t total;
+
+    total = __atomic_load_n(&hist->total, __ATOMIC_RELAXED);
+    fprintf(out, "%-12s: %8llu", hist->name, (unsigned long long)total);
+    if(total == 0){
+        fprintf(out, "\n");
+        return;
+    }
+    fprintf(out, ", mean %8.1f us, p50 %7llu, p90 %7llu, p99 %7llu, p99.9 %7llu, max %7llu us",
+            (double)__atomic_load_n(&hist->sumUs, __ATOMIC_RELAXED) / total,
+            (unsigned long long)latHistPercentile(hist, 50.0), (unsigned long long)latHistPercentile(hist, 90.0),
+            (unsigned long long)latHistPercentile(hist, 99.0), (unsigned long long)latHistPercentile(hist, 99.9),
+            (unsigned long long)__atomic_load_n(&hist->maxUs, __ATOMIC_RELAXED));
+    if(hist->budgetUs != 0){
+        fprintf(out, ", %llu over %u us", (unsigned long long)__atomic_load_n(&hist->nbOverBudget, __ATOMIC_RELAXED),
+                hist->budgetUs);
+    }
+    fprintf(out, "\n");
+}
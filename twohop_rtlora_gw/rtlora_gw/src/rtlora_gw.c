@@ -45,6 +45,10 @@
 #include "trace.h"
 #include "base64.h"
 #include "jitqueue.h"
+#include "frame_stream.h"
+#include "latency_hist.h"
+#include "timersync.h"
+#include "timesync_filter.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -75,8 +79,6 @@
 #define FETCH_SLEEP_MS      10          /* nb of ms waited when a fetch return no packets */
 #define BEACON_POLL_MS      50          /* time in ms between polling of beacon TX status */
 
-#define PROTOCOL_VERSION    2           /* v1.3 */
-
 #define XERR_INIT_AVG       128         /* nb of measurements the XTAL correction is averaged on as initial value */
 #define XERR_FILT_COEF      256         /* coefficient for low-pass XTAL error tracking */
 
@@ -87,26 +89,25 @@
 //#define PKT_PULL_ACK        4
 //#define PKT_TX_ACK          5
 
-/* Gateway <-> Server packet types */
-#define PKT_TIMESYNC_REQ        0 // gw -> sv
-#define PKT_TIMESYNC_RES        1 // sv -> gw
-#define PKT_DOWNLINK_DATA       2 // sv -> gw
-#define PKT_DOWNLINK_ACK        3 // gw -> sv
-#define PKT_UPLINK_DATA         4 // gw -> sv
-#define PKT_UPLINK_ACK          5 // sv -> gw
-
-#define DOWNSTREAM_BUF_SIZE     1024
+/* Gateway <-> Server packet types and frame header: see frame_stream.h */
+#define DOWNSTREAM_BUF_SIZE     4096    /* reassembly buffer of the downstream frames */
 
 #define NB_PKT_MAX      8 /* max number of packets per fetch/send cycle */
 
 #define MIN_LORA_PREAMB 6 /* minimum Lora preamble length for this application */
 #define STD_LORA_PREAMB 8
+#define DL_STAT_INTERVAL 1000 /* print downlink decoding statistics every N downlinks */
+#define TX_JIT_WAKE_BUDGET_US 100 /* JIT thread wake-ups later than this are counted as overruns */
+#define TX_COUNT_MIN_LEAD_US 3000 /* a TIMESTAMPED downlink needs this much time to be programmed */
 #define MIN_FSK_PREAMB  3 /* minimum FSK preamble length for this application */
 #define STD_FSK_PREAMB  5
 
 #define STATUS_SIZE     200
 #define TX_BUFF_SIZE    ((540 * NB_PKT_MAX) + 30 + STATUS_SIZE)
 
+#define UPLINK_MAC_OFS  FRAME_HDR_SIZE          /* gateway MAC address in PKT_UPLINK_DATA */
+#define UPLINK_PAYLOAD_OFS (UPLINK_MAC_OFS + 8) /* format byte, then JSON or binary records */
+
 #define UNIX_GPS_EPOCH_OFFSET 315964800 /* Number of seconds ellapsed between 01.Jan.1970 00:00:00
                                                                           and 06.Jan.1980 00:00:00 */
 
@@ -119,8 +120,9 @@
 #define DEFAULT_BEACON_INFODESC     0
 
 #define TIMESYNC_LONG_INTERVAL      60000 // in miliseconds
-#define TIMESYNC_SHORT_INTERVAL     3000 // in miliseconds
-#define TIMESYNC_MAX_ERROR_TOLERANT 1000 // in microseconds
+#define TIMESYNC_SHORT_INTERVAL     3000 // in miliseconds, until the skew can be estimated
+#define TIMESYNC_SAMPLE_SPACING_MS  20 // between the requests of a burst
+#define TIMESYNC_BURST_TIMEOUT_MS   200 // responses arriving later are ignored
 
 #define SOCK_TIMEOUT_MS             20 /* non critical for throughput */
 
@@ -158,6 +160,8 @@ static uint64_t lgwm = 0; /* Lora gateway MAC address */
 /* gateway <-> MAC protocol variables */
 static uint32_t net_mac_h; /* Most Significant Nibble, network order */
 static uint32_t net_mac_l; /* Least Significant Nibble, network order */
+static uint8_t link_caps_req = LINK_CAP_BIN_UPLINK | LINK_CAP_BIN_DOWNLINK; /* link capabilities requested in PKT_HELLO */
+static volatile uint8_t link_caps = 0; /* link capabilities accepted by the server, 0 until PKT_HELLO_ACK */
 
 /* network sockets */
 //static int sock_up; /* socket for upstream traffic */
@@ -165,31 +169,13 @@ static int sock_down; /* socket for downstream traffic */
 //static struct sockaddr_in sock_up_address;
 static struct sockaddr_in sock_down_address;
 static struct timeval sock_timeout = {0, (SOCK_TIMEOUT_MS * 1000)}; /* non critical for throughput */
+static pthread_mutex_t mx_sock_send = PTHREAD_MUTEX_INITIALIZER; /* frames of the uplink and time sync threads must not interleave, the HELLO goes out before they start */
 
-/* time synchronization variables */
-enum timesync_flag_e {
-    TIMESYNC_DONE = 0,
-    TIMESYNC_WAITING,
-    TIMESYNC_ERROR // Timeout or error occurs
-};
-
-/**
-@struct timesync_var_s
-@brief Structure defining the time sync variable
- */
-struct timesync_var_s {
-    uint8_t token_h; /* random token for acknowledgement matching */
-    uint8_t token_l; /* random token for acknowledgement matching */
-    struct timeval t0; // is the client's timestamp of the request packet transmission,
-    struct timeval t1; // is the server's timestamp of the request packet reception,
-    struct timeval t2; // is the server's timestamp of the response packet transmission and
-    struct timeval t3; // is the client's timestamp of the response packet reception.
-    int time_offset; // in micro second
-    int offset_drift; // delta between current and previous offset, in micro second
-    enum timesync_flag_e flag;
-};
-
-static struct timesync_var_s timesync_var;
+/* time synchronization with the server: bursts of requests, token_h is the burst and token_l the request */
+static pthread_mutex_t mx_timesync = PTHREAD_MUTEX_INITIALIZER; /* control access to the time sync variables */
+static TimeSyncFilter_t timesync_filter;
+static uint8_t timesync_burst = 0; /* token_h of the burst waiting for responses, 0 when none */
+static struct timeval timesync_t0[TSF_BURST_SIZE]; /* send time of each request of the burst, zeroed once answered */
 
 /* network protocol variables */
 //static struct timeval push_timeout_half = {0, (PUSH_TIMEOUT_MS * 500)}; /* cut in half, critical for throughput */
@@ -215,6 +201,29 @@ static uint32_t autoquit_threshold = 0; /* enable auto-quit after a number of no
 
 /* Just In Time TX scheduling */
 static struct jit_queue_s jit_queue;
+static uint16_t jit_queue_size = JIT_QUEUE_DEFAULT; /* enough for a frame of downlinks when raised */
+
+/* time spent decoding downlinks, [0] JSON, [1] binary */
+struct dl_decode_stat_s {
+    uint32_t nb;
+    double sum_us;
+    double max_us;
+};
+static struct dl_decode_stat_s dl_decode_stat[2];
+
+/* lgw_send time past the TX time given by the server, the RT-LoRa budget is MAC_SHIFT_DELAY_MS */
+static LatHist_t jit_late_hist = LAT_HIST_INITIALIZER("lgw_send late", 0);
+/* JIT thread wake-up past the moment the head downlink was due for dequeuing */
+static LatHist_t jit_wake_hist = LAT_HIST_INITIALIZER("jit wake-up late", TX_JIT_WAKE_BUDGET_US);
+static uint32_t jit_nb_early = 0; /* downlinks sent before their TX time */
+
+/* TIMESTAMPED downlinks: time left between lgw_send and the TX on the concentrator counter */
+static LatHist_t jit_lead_hist = LAT_HIST_INITIALIZER("count_us lead", 0);
+static uint32_t jit_nb_no_sync = 0; /* sent IMMEDIATE as no host/concentrator offset was measured yet */
+static uint32_t jit_nb_missed = 0; /* sent IMMEDIATE as the counter value was already too close */
+
+/* uplinks: time between the end of the reception, from count_us, and the fetch by lgw_receive */
+static LatHist_t ul_fetch_hist = LAT_HIST_INITIALIZER("uplink fetch delay", 0);
 
 /* Gateway specificities */
 static int8_t antenna_gain = 0;
@@ -244,6 +253,11 @@ void thread_up(void);
 void thread_down(void);
 void thread_jit(void);
 void thread_timesync_to_server(void);
+
+static int serialize_bin_uplink(uint8_t *rec, const struct lgw_pkt_rx_s *p);
+static int parse_json_downlink(const char *json, struct lgw_pkt_tx_s *txpkt, struct timeval *tx_time);
+static int parse_bin_downlink(const uint8_t *data, int len, struct lgw_pkt_tx_s *txpkt, struct timeval *tx_time);
+static void print_dl_decode_stat(void);
 //void thread_timersync(void);
 
 /* -------------------------------------------------------------------------- */
@@ -251,6 +265,7 @@ void thread_timesync_to_server(void);
 //static int ipow(int base, int exp);
 
 static double difftimespec(struct timespec end, struct timespec beginning);
+static void timeval_add_us(struct timeval *t, long long us);
 
 bool open_log(void);
 
@@ -578,6 +593,7 @@ static int parse_gateway_configuration(const char * conf_file) {
     JSON_Object *root = NULL;
     JSON_Object *conf = NULL;
     const char *str; /* pointer to sub-strings in the JSON data */
+    JSON_Value *val = NULL; /* needed to detect the absence of some fields */
     unsigned long long ull = 0;
 
     /* try to parse JSON */
@@ -609,11 +625,63 @@ static int parse_gateway_configuration(const char * conf_file) {
         strncpy(gps_tty_path, str, sizeof gps_tty_path);
         MSG("INFO: GPS serial port path is configured to \"%s\"\n", gps_tty_path);
     }
+
+    /* uplink encoding requested to the server (optional) */
+    str = json_object_get_string(conf, "uplink_format");
+    if (str != NULL) {
+        if (!strcmp(str, "json")) {
+            link_caps_req &= ~LINK_CAP_BIN_UPLINK;
+        } else if (!strcmp(str, "binary")) {
+            link_caps_req |= LINK_CAP_BIN_UPLINK;
+        } else {
+            MSG("WARNING: invalid uplink_format \"%s\", use \"binary\" or \"json\"\n", str);
+        }
+        MSG("INFO: uplink format is configured to %s\n", (link_caps_req & LINK_CAP_BIN_UPLINK) ? "binary" : "json");
+    }
+
+    /* downlink encoding requested to the server (optional) */
+    str = json_object_get_string(conf, "downlink_format");
+    if (str != NULL) {
+        if (!strcmp(str, "json")) {
+            link_caps_req &= ~LINK_CAP_BIN_DOWNLINK;
+        } else if (!strcmp(str, "binary")) {
+            link_caps_req |= LINK_CAP_BIN_DOWNLINK;
+        } else {
+            MSG("WARNING: invalid downlink_format \"%s\", use \"binary\" or \"json\"\n", str);
+        }
+        MSG("INFO: downlink format is configured to %s\n", (link_caps_req & LINK_CAP_BIN_DOWNLINK) ? "binary" : "json");
+    }
+
+    /* capacity of the JIT queue (optional) */
+    val = json_object_get_value(conf, "jit_queue_size");
+    if (val != NULL) {
+        if ((json_value_get_type(val) == JSONNumber) && (json_value_get_number(val) >= 1) && (json_value_get_number(val) <= JIT_QUEUE_MAX)) {
+            jit_queue_size = (uint16_t)json_value_get_number(val);
+        } else {
+            MSG("WARNING: invalid jit_queue_size, it must range from 1 to %d\n", JIT_QUEUE_MAX);
+        }
+        MSG("INFO: JIT queue holds up to %u downlinks\n", jit_queue_size);
+    }
     
     json_value_free(root_val);
     return 0;
 }
 
+/*
+ * Move a time by a signed number of microseconds
+ */
+static void timeval_add_us(struct timeval *t, long long us) {
+    long long x;
+
+    x = (long long)t->tv_sec * 1000000 + t->tv_usec + us;
+    t->tv_sec = (time_t)(x / 1000000);
+    t->tv_usec = (suseconds_t)(x % 1000000);
+    if (t->tv_usec < 0) {
+        t->tv_sec -= 1;
+        t->tv_usec += 1000000;
+    }
+}
+
 /*
  * Difference between end and beginning in microsecond 
  */
@@ -667,6 +735,7 @@ int main(int argc, char * argv[]) {
     int i;
     int x = 0;
     int connect_attempts = 0;
+    uint8_t buff_hello[UPLINK_PAYLOAD_OFS + 1]; /* PKT_HELLO: MAC + requested capabilities */
 
     /* configuration file related */
     const char global_conf_fname[] = "global_conf.json"; /* contain global (typ. network-wide) configuration */
@@ -685,7 +754,7 @@ int main(int argc, char * argv[]) {
     pthread_t thrid_down;
     pthread_t thrid_timesync_to_server;
     pthread_t thrid_jit;
-//    pthread_t thrid_timersync;
+    pthread_t thrid_timersync;
 
     /* statistics variable */
     time_t t;
@@ -811,6 +880,15 @@ int main(int argc, char * argv[]) {
             break;
         }
     }
+
+    /* negotiate the link capabilities, JSON uplinks are used until the server answers */
+    frame_header_write(buff_hello, PKT_HELLO, 0, 0, 9);
+    *(uint32_t *)(buff_hello + UPLINK_MAC_OFS) = net_mac_h;
+    *(uint32_t *)(buff_hello + UPLINK_MAC_OFS + 4) = net_mac_l;
+    buff_hello[UPLINK_PAYLOAD_OFS] = link_caps_req;
+    if (frame_send(sock_down, buff_hello, sizeof buff_hello) != 0) {
+        MSG("WARNING: [main] failed to send HELLO\n");
+    }
     
     /* Start concentrator */
     i = lgw_start();
@@ -821,6 +899,11 @@ int main(int argc, char * argv[]) {
         MSG("ERROR: failed to start the concentrator\n");
         return EXIT_FAILURE;
     }
+
+    /* JIT queue initialization, before the threads that use it */
+    if (jit_queue_init(&jit_queue, jit_queue_size) != 0) {
+        exit(EXIT_FAILURE);
+    }
         
     /* spawn threads to manage upstream and downstream */
     i = pthread_create(&thrid_up, NULL, (void * (*)(void *))thread_up, NULL);
@@ -836,23 +919,23 @@ int main(int argc, char * argv[]) {
     }
 
     /* spawn threads to manage time synchronization with the server */
-//    i = pthread_create(&thrid_timesync_to_server, NULL, (void * (*)(void *))thread_timesync_to_server, NULL);
-//    if (i != 0) {
-//        MSG("ERROR: [main] impossible to create Time Sync thread\n");
-//        exit(EXIT_FAILURE);
-//    }
+    i = pthread_create(&thrid_timesync_to_server, NULL, (void * (*)(void *))thread_timesync_to_server, NULL);
+    if (i != 0) {
+        MSG("ERROR: [main] impossible to create Time Sync thread\n");
+        exit(EXIT_FAILURE);
+    }
     
     i = pthread_create( &thrid_jit, NULL, (void * (*)(void *))thread_jit, NULL);
     if (i != 0) {
         MSG("ERROR: [main] impossible to create JIT thread\n");
         exit(EXIT_FAILURE);
     }
-    /* Time sync to concentrator */
-//    i = pthread_create( &thrid_timersync, NULL, (void * (*)(void *))thread_timersync, NULL);
-//    if (i != 0) {
-//        MSG("ERROR: [main] impossible to create Timer Sync thread\n");
-//        exit(EXIT_FAILURE);
-//    }
+    /* Time sync to concentrator, needed to convert TIMESTAMPED downlinks into count_us */
+    i = pthread_create( &thrid_timersync, NULL, (void * (*)(void *))thread_timersync, NULL);
+    if (i != 0) {
+        MSG("ERROR: [main] impossible to create Timer Sync thread\n");
+        exit(EXIT_FAILURE);
+    }
     
     /* configure signal handling */
     sigemptyset(&sigact.sa_mask);
@@ -877,6 +960,7 @@ int main(int argc, char * argv[]) {
     pthread_cancel(thrid_up);
     pthread_cancel(thrid_down);
     pthread_cancel(thrid_jit); /* don't wait for jit thread */
+    pthread_cancel(thrid_timersync); /* don't wait for concentrator timer sync thread */
     pthread_cancel(thrid_timesync_to_server); /* don't wait for timer sync thread */
 
     /* if an exit signal was received, try to quit properly */
@@ -916,6 +1000,322 @@ static void print_tx_status(uint8_t tx_status) {
             break;
     }
 }
+
+/*
+ * Write one UPLINK_FMT_BIN record (header + raw payload), return its size in bytes
+ */
+static int serialize_bin_uplink(uint8_t *rec, const struct lgw_pkt_rx_s *p) {
+    frame_put_u32(rec + UL_BIN_OFS_FREQ, p->freq_hz);
+    rec[UL_BIN_OFS_IF_CHAIN] = p->if_chain;
+    rec[UL_BIN_OFS_RF_CHAIN] = p->rf_chain;
+    rec[UL_BIN_OFS_STATUS] = p->status;
+    rec[UL_BIN_OFS_MODULATION] = p->modulation;
+    rec[UL_BIN_OFS_BANDWIDTH] = p->bandwidth;
+    rec[UL_BIN_OFS_CODERATE] = p->coderate;
+    frame_put_u32(rec + UL_BIN_OFS_DATARATE, p->datarate);
+    frame_put_u32(rec + UL_BIN_OFS_COUNT_US, p->count_us);
+    frame_put_u16(rec + UL_BIN_OFS_RSSI, (uint16_t)(int16_t)lroundf(p->rssi * 10.0f));
+    frame_put_u16(rec + UL_BIN_OFS_SNR, (uint16_t)(int16_t)lroundf(p->snr * 10.0f));
+    frame_put_u16(rec + UL_BIN_OFS_CRC, p->crc);
+    frame_put_u16(rec + UL_BIN_OFS_SIZE, p->size);
+    memcpy(rec + UL_BIN_REC_SIZE, p->payload, p->size);
+    return UL_BIN_REC_SIZE + p->size;
+}
+
+/*
+ * Parse a DOWNLINK_FMT_JSON payload (NUL terminated), return 0 if txpkt and tx_time are valid
+ */
+static int parse_json_downlink(const char *json, struct lgw_pkt_tx_s *txpkt, struct timeval *tx_time) {
+    int i;
+    bool sent_immediate = false; /* option to sent the packet immediately */
+
+    /* JSON parsing variables */
+    JSON_Value *root_val = NULL;
+    JSON_Object *txpk_obj = NULL;
+    JSON_Value *val = NULL; /* needed to detect the absence of some fields */
+    const char *str; /* pointer to sub-strings in the JSON data */
+    short x0, x1;
+
+    /* initialize TX struct and try to parse JSON */
+    memset(txpkt, 0, sizeof *txpkt);
+    root_val = json_parse_string_with_comments(json);
+    if (root_val == NULL) {
+        MSG("WARNING: [down] invalid JSON, TX aborted\n");
+        return -1;
+    }
+    
+    /* look for JSON sub-object 'txpk' */
+    txpk_obj = json_object_get_object(json_value_get_object(root_val), "txpk");
+    if (txpk_obj == NULL) {
+        MSG("WARNING: [down] no \"txpk\" object in JSON, TX aborted\n");
+        json_value_free(root_val);
+        return -1;
+    }
+    
+    /* Parse Tx UNIX timestamp value (mandatory) */
+    val = json_object_get_value(txpk_obj,"tm_s");
+    if (val == NULL) {
+        MSG("WARNING: [down] no mandatory \"tm_s\" object in JSON, TX aborted\n");
+        json_value_free(root_val);
+        return -1;
+    } else {
+        tx_time->tv_sec = (uint32_t)json_value_get_number(val);
+    }
+    
+    val = json_object_get_value(txpk_obj,"tm_us");
+    if (val == NULL) {
+        MSG("WARNING: [down] no mandatory \"tm_us\" object in JSON, TX aborted\n");
+        json_value_free(root_val);
+        return -1;
+    } else {
+        tx_time->tv_usec = (uint32_t)json_value_get_number(val);
+    }
+    
+    /* Parse "immediate" tag, or target timestamp, or UTC time to be converted by GPS (mandatory) */
+    i = json_object_get_boolean(txpk_obj,"imme"); /* can be 1 if true, 0 if false, or -1 if not a JSON boolean */
+    if (i == 1) {
+        /* TX procedure: send immediately */
+        sent_immediate = true;
+//                    downlink_type = JIT_PKT_TYPE_DOWNLINK_CLASS_C;
+//                    MSG("INFO: [down] a packet will be sent in \"immediate\" mode\n");
+    } else {
+        sent_immediate = false;
+    }
+    
+    /* parse target frequency (mandatory) */
+    val = json_object_get_value(txpk_obj,"freq");
+    if (val == NULL) {
+        MSG("WARNING: [down] no mandatory \"txpk.freq\" object in JSON, TX aborted\n");
+        json_value_free(root_val);
+        return -1;
+    }
+    txpkt->freq_hz = (uint32_t)((double)(1.0e6) * json_value_get_number(val));
+    
+    /* parse RF chain used for TX (mandatory) */
+    val = json_object_get_value(txpk_obj,"rfch");
+    if (val == NULL) {
+        MSG("WARNING: [down] no mandatory \"txpk.rfch\" object in JSON, TX aborted\n");
+        json_value_free(root_val);
+        return -1;
+    }
+    txpkt->rf_chain = (uint8_t)json_value_get_number(val);
+
+    /* parse TX power (optional field) */
+    val = json_object_get_value(txpk_obj,"powe");
+    if (val != NULL) {
+        txpkt->rf_power = (int8_t)json_value_get_number(val) - antenna_gain;
+    }
+    
+    /* Parse modulation (mandatory) */
+    str = json_object_get_string(txpk_obj, "modu");
+    if (str == NULL) {
+        MSG("WARNING: [down] no mandatory \"txpk.modu\" object in JSON, TX aborted\n");
+        json_value_free(root_val);
+        return -1;
+    }
+    if (strcmp(str, "LORA") == 0) {
+        /* Lora modulation */
+        txpkt->modulation = MOD_LORA;
+
+        /* Parse Lora spreading-factor and modulation bandwidth (mandatory) */
+        str = json_object_get_string(txpk_obj, "datr");
+        if (str == NULL) {
+            MSG("WARNING: [down] no mandatory \"txpk.datr\" object in JSON, TX aborted\n");
+            json_value_free(root_val);
+            return -1;
+        }
+        i = sscanf(str, "SF%2hdBW%3hd", &x0, &x1);
+        if (i != 2) {
+            MSG("WARNING: [down] format error in \"txpk.datr\", TX aborted\n");
+            json_value_free(root_val);
+            return -1;
+        }
+        switch (x0) {
+            case  7: txpkt->datarate = DR_LORA_SF7;  break;
+            case  8: txpkt->datarate = DR_LORA_SF8;  break;
+            case  9: txpkt->datarate = DR_LORA_SF9;  break;
+            case 10: txpkt->datarate = DR_LORA_SF10; break;
+            case 11: txpkt->datarate = DR_LORA_SF11; break;
+            case 12: txpkt->datarate = DR_LORA_SF12; break;
+            default:
+                MSG("WARNING: [down] format error in \"txpk.datr\", invalid SF, TX aborted\n");
+                json_value_free(root_val);
+                return -1;
+        }
+        switch (x1) {
+            case 125: txpkt->bandwidth = BW_125KHZ; break;
+            case 250: txpkt->bandwidth = BW_250KHZ; break;
+            case 500: txpkt->bandwidth = BW_500KHZ; break;
+            default:
+                MSG("WARNING: [down] format error in \"txpk.datr\", invalid BW, TX aborted\n");
+                json_value_free(root_val);
+                return -1;
+        }
+
+        /* Parse ECC coding rate (optional field) */
+        str = json_object_get_string(txpk_obj, "codr");
+        if (str == NULL) {
+            MSG("WARNING: [down] no mandatory \"txpk.codr\" object in json, TX aborted\n");
+            json_value_free(root_val);
+            return -1;
+        }
+        if      (strcmp(str, "4/5") == 0) txpkt->coderate = CR_LORA_4_5;
+        else if (strcmp(str, "4/6") == 0) txpkt->coderate = CR_LORA_4_6;
+        else if (strcmp(str, "2/3") == 0) txpkt->coderate = CR_LORA_4_6;
+        else if (strcmp(str, "4/7") == 0) txpkt->coderate = CR_LORA_4_7;
+        else if (strcmp(str, "4/8") == 0) txpkt->coderate = CR_LORA_4_8;
+        else if (strcmp(str, "1/2") == 0) txpkt->coderate = CR_LORA_4_8;
+        else {
+            MSG("WARNING: [down] format error in \"txpk.codr\", TX aborted\n");
+            json_value_free(root_val);
+            return -1;
+        }
+
+        /* Parse signal polarity switch (optional field) */
+        val = json_object_get_value(txpk_obj,"ipol");
+        if (val != NULL) {
+            txpkt->invert_pol = (bool)json_value_get_boolean(val);
+        }
+
+        /* parse Lora preamble length (optional field, optimum min value enforced) */
+        val = json_object_get_value(txpk_obj,"prea");
+        if (val != NULL) {
+            i = (int)json_value_get_number(val);
+            if (i >= MIN_LORA_PREAMB) {
+                txpkt->preamble = (uint16_t)i;
+            } else {
+                txpkt->preamble = (uint16_t)MIN_LORA_PREAMB;
+            }
+        } else {
+            txpkt->preamble = (uint16_t)STD_LORA_PREAMB;
+        }
+
+    } else if (strcmp(str, "FSK") == 0) {
+        /* TODO FSK modulation */
+        MSG("WARNING: [down] FSK implementation is required. TX aborted\n");
+        json_value_free(root_val);
+        return -1;
+    } else {
+        MSG("WARNING: [down] invalid modulation in \"txpk.modu\", TX aborted\n");
+        json_value_free(root_val);
+        return -1;
+    }
+    
+    /* Parse payload length (mandatory) */
+    val = json_object_get_value(txpk_obj,"size");
+    if (val == NULL) {
+        MSG("WARNING: [down] no mandatory \"txpk.size\" object in JSON, TX aborted\n");
+        json_value_free(root_val);
+        return -1;
+    }
+    txpkt->size = (uint16_t)json_value_get_number(val);
+    
+    /* Parse payload data (mandatory) */
+    str = json_object_get_string(txpk_obj, "data");
+    if (str == NULL) {
+        MSG("WARNING: [down] no mandatory \"txpk.data\" object in JSON, TX aborted\n");
+        json_value_free(root_val);
+        return -1;
+    }
+    i = b64_to_bin(str, strlen(str), txpkt->payload, sizeof txpkt->payload);
+    if (i != txpkt->size) {
+        MSG("WARNING: [down] mismatch between .size and .data size once converter to binary\n");
+    }
+
+    /* free the JSON parse tree from memory */
+    json_value_free(root_val);
+    /* select TX mode */
+    if (sent_immediate) {
+        txpkt->tx_mode = IMMEDIATE;
+    } else {
+        txpkt->tx_mode = TIMESTAMPED;
+    }
+
+    return 0;
+}
+
+/*
+ * Parse a DOWNLINK_FMT_BIN payload, return 0 if txpkt and tx_time are valid
+ */
+static int parse_bin_downlink(const uint8_t *data, int len, struct lgw_pkt_tx_s *txpkt, struct timeval *tx_time) {
+    const uint8_t *rec = data + DL_BIN_HDR_SIZE;
+
+    if (len < (DL_BIN_HDR_SIZE + DL_BIN_REC_SIZE)) {
+        MSG("WARNING: [down] truncated binary downlink, TX aborted\n");
+        return -1;
+    }
+    memset(txpkt, 0, sizeof *txpkt);
+    txpkt->size = frame_get_u16(rec + DL_BIN_OFS_SIZE);
+    if ((txpkt->size > sizeof txpkt->payload) || (len < (DL_BIN_HDR_SIZE + DL_BIN_REC_SIZE + txpkt->size))) {
+        MSG("WARNING: [down] invalid binary downlink size %u, TX aborted\n", txpkt->size);
+        return -1;
+    }
+    if (rec[DL_BIN_OFS_MODULATION] != MOD_LORA) {
+        MSG("WARNING: [down] FSK implementation is required. TX aborted\n");
+        return -1;
+    }
+
+    /* the record maps struct lgw_pkt_tx_s field by field */
+    tx_time->tv_sec = frame_get_u32(rec + DL_BIN_OFS_TM_S);
+    tx_time->tv_usec = frame_get_u32(rec + DL_BIN_OFS_TM_US);
+    txpkt->freq_hz = frame_get_u32(rec + DL_BIN_OFS_FREQ);
+    txpkt->tx_mode = rec[DL_BIN_OFS_TX_MODE];
+    txpkt->rf_chain = rec[DL_BIN_OFS_RF_CHAIN];
+    txpkt->rf_power = (int8_t)rec[DL_BIN_OFS_RF_POWER] - antenna_gain;
+    txpkt->modulation = rec[DL_BIN_OFS_MODULATION];
+    txpkt->bandwidth = rec[DL_BIN_OFS_BANDWIDTH];
+    txpkt->coderate = rec[DL_BIN_OFS_CODERATE];
+    txpkt->datarate = frame_get_u32(rec + DL_BIN_OFS_DATARATE);
+    txpkt->invert_pol = rec[DL_BIN_OFS_INVERT_POL] != 0;
+    txpkt->no_crc = rec[DL_BIN_OFS_NO_CRC] != 0;
+    txpkt->no_header = rec[DL_BIN_OFS_NO_HEADER] != 0;
+    txpkt->f_dev = rec[DL_BIN_OFS_F_DEV];
+    txpkt->preamble = frame_get_u16(rec + DL_BIN_OFS_PREAMBLE);
+    if (txpkt->preamble < MIN_LORA_PREAMB) {
+        txpkt->preamble = MIN_LORA_PREAMB;
+    }
+    memcpy(txpkt->payload, rec + DL_BIN_REC_SIZE, txpkt->size);
+
+    return 0;
+}
+
+/*
+ * Print the time spent decoding downlinks, per format
+ */
+static void print_dl_decode_stat(void) {
+    static const char *fmt_name[2] = {"json", "binary"};
+    TimeSyncFilter_t filter_copy;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        if (dl_decode_stat[i].nb > 0) {
+            MSG("INFO: [down] %-6s downlinks: %u, decode avg %.1f us, max %.1f us\n", fmt_name[i], dl_decode_stat[i].nb,
+                    dl_decode_stat[i].sum_us / dl_decode_stat[i].nb, dl_decode_stat[i].max_us);
+        }
+    }
+    if (jit_wake_hist.total > 0) {
+        latHistPrint(&jit_wake_hist, stdout);
+    }
+    if ((jit_late_hist.total > 0) || (jit_nb_early > 0)) {
+        MSG("INFO: [jit] %u downlinks sent before their TX time\n", jit_nb_early);
+        latHistPrint(&jit_late_hist, stdout);
+    }
+    if ((jit_lead_hist.total > 0) || (jit_nb_no_sync > 0) || (jit_nb_missed > 0)) {
+        MSG("INFO: [jit] TIMESTAMPED downlinks: %llu, sent IMMEDIATE %u without sync, %u too late for the counter\n",
+                (unsigned long long)jit_lead_hist.total, jit_nb_no_sync, jit_nb_missed);
+        latHistPrint(&jit_lead_hist, stdout);
+    }
+    if (ul_fetch_hist.total > 0) {
+        latHistPrint(&ul_fetch_hist, stdout);
+    }
+    print_timersync_stat();
+    pthread_mutex_lock(&mx_timesync);
+    filter_copy = timesync_filter;
+    pthread_mutex_unlock(&mx_timesync);
+    MSG("INFO: [sync] ");
+    tsfPrint(&filter_copy, stdout);
+}
+
 /* -------------------------------------------------------------------------- */
 
 /* --- THREAD 1: RECEIVING PACKETS AND FORWARDING THEM ---------------------- */
@@ -929,10 +1329,14 @@ void thread_up(void) {
     struct lgw_pkt_rx_s rxpkt[NB_PKT_MAX]; /* array containing inbound packets + metadata */
     struct lgw_pkt_rx_s *p; /* pointer on a RX packet */
     int nb_pkt;
+    struct timeval fetch_time; /* host time of lgw_receive */
+    struct timeval rx_unix_time; /* host time of the end of a reception */
+    int64_t fetch_delay_us;
 
     /* data buffers */
     uint8_t buff_up[TX_BUFF_SIZE]; /* buffer to compose the upstream packet */
     int buff_index;
+    bool bin_uplink; /* compact binary records instead of JSON */
     unsigned int msg_start_index, msg_end_index;   // These variables to keep track of the starting index 
                                                     // and end index of the current msg in buff_up
     uint8_t buff_ack[32]; /* buffer to receive acknowledges */
@@ -960,16 +1364,16 @@ void thread_up(void) {
 //    }
 
     /* pre-fill the data buffer with fixed fields */
-    buff_up[0] = PROTOCOL_VERSION;
-    buff_up[3] = PKT_UPLINK_DATA;
-    *(uint32_t *)(buff_up + 4) = net_mac_h;
-    *(uint32_t *)(buff_up + 8) = net_mac_l;
+    frame_header_write(buff_up, PKT_UPLINK_DATA, 0, 0, 0);
+    *(uint32_t *)(buff_up + UPLINK_MAC_OFS) = net_mac_h;
+    *(uint32_t *)(buff_up + UPLINK_MAC_OFS + 4) = net_mac_l;
 
     while (!exit_sig && !quit_sig) {
         /* fetch packets */
         pthread_mutex_lock(&mx_concent);
         nb_pkt = lgw_receive(NB_PKT_MAX, rxpkt);
         pthread_mutex_unlock(&mx_concent);
+        gettimeofday(&fetch_time, NULL);
         if (nb_pkt == LGW_HAL_ERROR) {
             MSG("ERROR: [up] failed packet fetch, exiting\n");
             exit(EXIT_FAILURE);
@@ -988,13 +1392,20 @@ void thread_up(void) {
         /* start composing datagram with the header */
         token_h = (uint8_t)rand(); /* random token */
         token_l = (uint8_t)rand(); /* random token */
-        buff_up[1] = token_h;
-        buff_up[2] = token_l;
-        buff_index = 12; /* 12-byte header */
-
-        /* start of JSON structure */
-        memcpy((void *)(buff_up + buff_index), (void *)"{\"rxpk\":[", 9);
-        buff_index += 9;
+        buff_up[FRAME_OFS_TOKEN_H] = token_h;
+        buff_up[FRAME_OFS_TOKEN_L] = token_l;
+        buff_index = UPLINK_PAYLOAD_OFS; /* frame header + gateway MAC */
+        bin_uplink = (link_caps & LINK_CAP_BIN_UPLINK) != 0;
+
+        if (bin_uplink) {
+            /* format + number of packets, filled once the records are written */
+            buff_up[buff_index] = UPLINK_FMT_BIN;
+            buff_index += UL_BIN_HDR_SIZE;
+        } else {
+            /* start of JSON structure */
+            memcpy((void *)(buff_up + buff_index), (void *)"{\"rxpk\":[", 9);
+            buff_index += 9;
+        }
 
         /* serialize Lora packets metadata and payload */
         pkt_in_dgram = 0;
@@ -1014,6 +1425,11 @@ void thread_up(void) {
             switch(p->status) {
                 case STAT_CRC_OK:
                     printf( "INFO: RCV UPLINK MSG (addr %u)\n", mote_addr);
+                    if (get_unix_time(&rx_unix_time, p->count_us) == 0) {
+                        fetch_delay_us = (int64_t)(fetch_time.tv_sec - rx_unix_time.tv_sec) * 1000000
+                                + (fetch_time.tv_usec - rx_unix_time.tv_usec);
+                        latHistRecord(&ul_fetch_hist, (uint64_t)((fetch_delay_us < 0) ? 0 : fetch_delay_us));
+                    }
                     break;
                 case STAT_CRC_BAD:
                 case STAT_NO_CRC:
@@ -1029,6 +1445,12 @@ void thread_up(void) {
                     // exit(EXIT_FAILURE);
             }
 
+            if (bin_uplink) {
+                buff_index += serialize_bin_uplink(buff_up + buff_index, p);
+                ++pkt_in_dgram;
+                continue;
+            }
+
             /* Start of packet, add inter-packet separator if necessary */
             msg_start_index = buff_index;      
             if (pkt_in_dgram == 0) {
@@ -1177,6 +1599,16 @@ void thread_up(void) {
         if (pkt_in_dgram == 0) {
             /* all packet have been filtered out and no report, restart loop */
             continue;
+        } else if (bin_uplink) {
+            buff_up[UPLINK_PAYLOAD_OFS + 1] = (uint8_t)pkt_in_dgram;
+            frame_set_length(buff_up, buff_index - FRAME_HDR_SIZE);
+            pthread_mutex_lock(&mx_sock_send);
+            i = frame_send(sock_down, buff_up, buff_index);
+            pthread_mutex_unlock(&mx_sock_send);
+            if (i != 0) {
+                MSG("WARNING: [up] failed to send uplink frame\n");
+            }
+            continue;
         } else {
             /* end of packet array */
             buff_up[buff_index] = ']';
@@ -1187,11 +1619,17 @@ void thread_up(void) {
         buff_up[buff_index] = '}';
         ++buff_index;
         buff_up[buff_index] = 0; /* add string terminator, for safety */
+        frame_set_length(buff_up, buff_index - FRAME_HDR_SIZE);
 
-//        printf("\nJSON up: %s\n", (char *)(buff_up + 12)); /* DEBUG: display JSON payload */
+//        printf("\nJSON up: %s\n", (char *)(buff_up + UPLINK_PAYLOAD_OFS)); /* DEBUG: display JSON payload */
 
-        /* send datagram to server */
-        send(sock_down, (void *)buff_up, buff_index, 0);
+        /* send frame to server */
+        pthread_mutex_lock(&mx_sock_send);
+        i = frame_send(sock_down, buff_up, buff_index);
+        pthread_mutex_unlock(&mx_sock_send);
+        if (i != 0) {
+            MSG("WARNING: [up] failed to send uplink frame\n");
+        }
 //        clock_gettime(CLOCK_MONOTONIC, &send_time);
     }
     MSG("\nINFO: End of upstream thread\n");
@@ -1208,33 +1646,31 @@ void thread_down(void) {
 
     /* configuration and metadata for an outbound packet */
     struct lgw_pkt_tx_s txpkt;
-    bool sent_immediate = false; /* option to sent the packet immediately */
     
     /* data buffers */
-    uint8_t buff_down[DOWNSTREAM_BUF_SIZE]; /* buffer to receive downstream packets */
+    uint8_t buff_stream[DOWNSTREAM_BUF_SIZE]; /* reassembly buffer of downstream frames */
+    struct frame_stream_s stream_down;
+    uint8_t *buff_down; /* current frame, points into buff_stream */
+    uint8_t *rx_ptr;
+    uint32_t rx_room;
+    uint32_t frame_len;
     int msg_len;
 
     /* protocol variables */
 //    uint8_t token_h; /* random token for acknowledgement matching */
 //    uint8_t token_l; /* random token for acknowledgement matching */
 
-    /* JSON parsing variables */
-    JSON_Value *root_val = NULL;
-    JSON_Object *txpk_obj = NULL;
-    JSON_Value *val = NULL; /* needed to detect the absence of some fields */
-    const char *str; /* pointer to sub-strings in the JSON data */
-    short x0, x1;
-    uint64_t x2;
-    double x3, x4;
+    /* downlink decoding time measurement */
+    struct timespec decode_start;
+    struct timespec decode_end;
+    double decode_us;
+    struct dl_decode_stat_s *dl_stat;
     
     struct timeval current_time;
-    struct timeval unix_timeval = {0, 0};
-    int offset_previous = 0; // save previous offset value to calculate time drift
-    struct timeval time_temp_1 = {0,0}; // temporary variable to save operand value
-    struct timeval time_temp_2 = {0,0}; // temporary variable to save operand value
-    struct timeval time_temp_3 = {0,0}; // temporary variable to save operand value
-    
-    bool timesync_res = false; /* keep track of whether TIMESYNC_REQ was acknowledged or not */
+    struct timeval rx_time = {0, 0}; /* reception of the frames in the stream, t3 of the time sync samples */
+    struct timeval sv_t1, sv_t2; /* server reception and transmission times of a TIMESYNC_REQ */
+    double sv_offset_us; /* server time - host time */
+    int sync_ok;
     
     /* Just In Time downlink */
     struct timeval tx_unix_timestamp;
@@ -1247,276 +1683,99 @@ void thread_down(void) {
     static int log_count = 0;   // for rotating log file if it is too long
 #endif
     
-    /* JIT queue initialization */
-    jit_queue_init(&jit_queue);
+    frame_stream_init(&stream_down, buff_stream, sizeof buff_stream);
     /* loop */
     while (!exit_sig && !quit_sig) {
-        timesync_res = false;
-        /* try to receive a datagram */
-        msg_len = recv(sock_down, (void *) buff_down, (sizeof buff_down) - 1, 0);
-        /* if no network message was received, got back to listening sock_down socket */
-        if (msg_len == -1) {
-            //MSG("WARNING: [down] recv returned %s\n", strerror(errno)); /* too verbose */
+        /* handle the frames already in the stream before reading the socket again */
+        buff_down = frame_stream_next(&stream_down, &frame_len);
+        if (buff_down == NULL) {
+            /* try to receive more data, a read may hold several frames or only a part of one */
+            rx_ptr = frame_stream_wptr(&stream_down, &rx_room);
+            msg_len = recv(sock_down, (void *) rx_ptr, rx_room, 0);
+            /* if no network message was received, got back to listening sock_down socket */
+            if (msg_len == -1) {
+                //MSG("WARNING: [down] recv returned %s\n", strerror(errno)); /* too verbose */
+                continue;
+            }
+
+            if (msg_len == 0){
+                // server is stopped
+                MSG("Cannot connect to server. Stop program!\n");
+                exit_sig = true;
+                break;
+            }
+            /* the frames completed by this read arrived now */
+            gettimeofday(&rx_time, NULL);
+            frame_stream_commit(&stream_down, msg_len);
             continue;
         }
+        msg_len = frame_len;
         
-        if (msg_len == 0){
-            // server is stopped
-            MSG("Cannot connect to server. Stop program!\n");
-            exit_sig = true;
-            break;
-        }
-        
-        /* if the datagram does not respect protocol, just ignore it */
-        if ((msg_len < 12) || (buff_down[0] != PROTOCOL_VERSION)) {
+        /* if the frame does not respect protocol, just ignore it */
+        if ((msg_len < FRAME_HDR_SIZE) || (buff_down[0] != PROTOCOL_VERSION)) {
             MSG("DOWN: [down] ignoring invalid packet len=%d, protocol_version=%d\n", msg_len, buff_down[0]);
             continue;
         }
 
-        if(!((buff_down[3] == PKT_DOWNLINK_DATA) || (buff_down[3] == PKT_UPLINK_ACK) || (buff_down[3] == PKT_TIMESYNC_RES)))  {
+        if(!((buff_down[3] == PKT_DOWNLINK_DATA) || (buff_down[3] == PKT_UPLINK_ACK) || (buff_down[3] == PKT_TIMESYNC_RES) \
+                || (buff_down[3] == PKT_HELLO_ACK)))  {
             MSG("DOWN: [down] ignoring unknown packet type (%d)\n", buff_down[3]);
             continue;
         }
         
         switch (buff_down[3]) {
+            case PKT_HELLO_ACK:
+                if (msg_len > FRAME_HDR_SIZE) {
+                    link_caps = buff_down[FRAME_HDR_SIZE] & link_caps_req;
+                    MSG("INFO: [down] server accepted link capabilities 0x%02X\n", link_caps);
+                }
+                break;
             case PKT_TIMESYNC_RES:
-                if ((buff_down[1] == timesync_var.token_h) && (buff_down[2] == timesync_var.token_l)) {
-                    if (timesync_res) {
-                        MSG("DOWN duplicate RES received :)\n");
-                    } else { /* if that packet was not already acknowledged */
-                        timesync_res = true;
-                        /* Get current unix time */
-                        gettimeofday(&unix_timeval, NULL);
-                        timesync_var.t3 = unix_timeval;
-                        /* Retrieve timestamp t1 and t2 from response packet */
-                        timesync_var.t1.tv_sec = *(uint32_t *) (buff_down + 4);
-                        timesync_var.t1.tv_usec = *(uint32_t *) (buff_down + 8);
-                        timesync_var.t2.tv_sec = *(uint32_t *) (buff_down + 12);
-                        timesync_var.t2.tv_usec = *(uint32_t *) (buff_down + 16);
-
-                        /* Save previous offset */
-                        offset_previous = timesync_var.time_offset;
-
-                        /* Compute new offset between server and gateway, with microsecond precision */
-                        TIMERSUB(timesync_var.t1, timesync_var.t0, time_temp_1);
-                        TIMERSUB(timesync_var.t2, timesync_var.t3, time_temp_2);
-                        timesync_var.time_offset = time_temp_1.tv_sec * 1000000 + time_temp_1.tv_usec \
-                                                    + time_temp_2.tv_sec *1000000 + time_temp_2.tv_usec;
-                        timesync_var.time_offset = timesync_var.time_offset/2;
-                        timesync_var.offset_drift = timesync_var.time_offset - offset_previous;
-
-                        if(abs(timesync_var.time_offset) > TIMESYNC_MAX_ERROR_TOLERANT){
-                            timesync_var.flag = TIMESYNC_ERROR;
-                            
-                            MSG("T0: %ld.%ld\n", timesync_var.t0.tv_sec, timesync_var.t0.tv_usec);
-                            MSG("T1: %ld.%ld\n", timesync_var.t1.tv_sec, timesync_var.t1.tv_usec);
-                            MSG("T2: %ld.%ld\n", timesync_var.t2.tv_sec, timesync_var.t2.tv_usec);
-                            MSG("T3: %ld.%ld\n", timesync_var.t3.tv_sec, timesync_var.t3.tv_usec);
-                        } else
-                            timesync_var.flag = TIMESYNC_DONE;
-                    }
+                if (msg_len < (FRAME_HDR_SIZE + 16)) {
+                    MSG("WARNING: [down] truncated TIMESYNC_RES\n");
+                    break;
+                }
+                /* Retrieve timestamp t1 and t2 from response packet */
+                sv_t1.tv_sec = *(uint32_t *) (buff_down + FRAME_HDR_SIZE);
+                sv_t1.tv_usec = *(uint32_t *) (buff_down + FRAME_HDR_SIZE + 4);
+                sv_t2.tv_sec = *(uint32_t *) (buff_down + FRAME_HDR_SIZE + 8);
+                sv_t2.tv_usec = *(uint32_t *) (buff_down + FRAME_HDR_SIZE + 12);
+                pthread_mutex_lock(&mx_timesync);
+                if ((timesync_burst != 0) && (buff_down[1] == timesync_burst) && (buff_down[2] < TSF_BURST_SIZE)
+                        && (timesync_t0[buff_down[2]].tv_sec != 0)) {
+                    tsfAddSample(&timesync_filter, &timesync_t0[buff_down[2]], &sv_t1, &sv_t2, &rx_time);
+                    timesync_t0[buff_down[2]].tv_sec = 0; /* a duplicate is not a sample */
+                    pthread_mutex_unlock(&mx_timesync);
                 } else { /* out-of-sync token */
-                    timesync_var.flag = TIMESYNC_ERROR;
-                    MSG("INFO: [down] received out-of-sync ACK\n");
+                    pthread_mutex_unlock(&mx_timesync);
+                    MSG("INFO: [down] received out-of-sync TIMESYNC_RES\n");
                 }
                 break;
             case PKT_DOWNLINK_DATA:
-                buff_down[msg_len] = 0; /* add string terminator, just to be safe */
+                /* the frame is already NUL terminated by the stream decoder */
                 gettimeofday(&current_time, NULL);
-//                MSG("\nJSON down: %s\n", (char *)(buff_down + 4)); /* DEBUG: display JSON payload */
-                /* initialize TX struct and try to parse JSON */
-                memset(&txpkt, 0, sizeof txpkt);
-                root_val = json_parse_string_with_comments((const char *)(buff_down + 4)); /* JSON offset */
-                if (root_val == NULL) {
-                    MSG("WARNING: [down] invalid JSON, TX aborted\n");
-                    continue;
-                }
-                
-                /* look for JSON sub-object 'txpk' */
-                txpk_obj = json_object_get_object(json_value_get_object(root_val), "txpk");
-                if (txpk_obj == NULL) {
-                    MSG("WARNING: [down] no \"txpk\" object in JSON, TX aborted\n");
-                    json_value_free(root_val);
-                    continue;
-                }
-                
-                /* Parse Tx UNIX timestamp value (mandatory) */
-                val = json_object_get_value(txpk_obj,"tm_s");
-                if (val == NULL) {
-                    MSG("WARNING: [down] no mandatory \"tm_s\" object in JSON, TX aborted\n");
-                    json_value_free(root_val);
-                    continue;
-                } else {
-                    tx_unix_timestamp.tv_sec = (uint32_t)json_value_get_number(val);
-                }
-                
-                val = json_object_get_value(txpk_obj,"tm_us");
-                if (val == NULL) {
-                    MSG("WARNING: [down] no mandatory \"tm_us\" object in JSON, TX aborted\n");
-                    json_value_free(root_val);
-                    continue;
-                } else {
-                    tx_unix_timestamp.tv_usec = (uint32_t)json_value_get_number(val);
-                }
-                
-                /* Parse "immediate" tag, or target timestamp, or UTC time to be converted by GPS (mandatory) */
-                i = json_object_get_boolean(txpk_obj,"imme"); /* can be 1 if true, 0 if false, or -1 if not a JSON boolean */
-                if (i == 1) {
-                    /* TX procedure: send immediately */
-                    sent_immediate = true;
-//                    downlink_type = JIT_PKT_TYPE_DOWNLINK_CLASS_C;
-//                    MSG("INFO: [down] a packet will be sent in \"immediate\" mode\n");
+//                MSG("\nJSON down: %s\n", (char *)(buff_down + FRAME_HDR_SIZE)); /* DEBUG: display JSON payload */
+                /* decode the downlink in the format chosen by the server */
+                clock_gettime(CLOCK_MONOTONIC, &decode_start);
+                if (buff_down[FRAME_HDR_SIZE] == DOWNLINK_FMT_BIN) {
+                    i = parse_bin_downlink(buff_down + FRAME_HDR_SIZE, msg_len - FRAME_HDR_SIZE, &txpkt, &tx_unix_timestamp);
+                    dl_stat = &dl_decode_stat[1];
                 } else {
-                    sent_immediate = false;
-                    // TODO: implement send on timestamp
+                    i = parse_json_downlink((const char *)(buff_down + FRAME_HDR_SIZE), &txpkt, &tx_unix_timestamp);
+                    dl_stat = &dl_decode_stat[0];
                 }
-                
-                /* parse target frequency (mandatory) */
-                val = json_object_get_value(txpk_obj,"freq");
-                if (val == NULL) {
-                    MSG("WARNING: [down] no mandatory \"txpk.freq\" object in JSON, TX aborted\n");
-                    json_value_free(root_val);
+                if (i != 0) {
                     continue;
                 }
-                txpkt.freq_hz = (uint32_t)((double)(1.0e6) * json_value_get_number(val));
-                
-                /* parse RF chain used for TX (mandatory) */
-                val = json_object_get_value(txpk_obj,"rfch");
-                if (val == NULL) {
-                    MSG("WARNING: [down] no mandatory \"txpk.rfch\" object in JSON, TX aborted\n");
-                    json_value_free(root_val);
-                    continue;
+                clock_gettime(CLOCK_MONOTONIC, &decode_end);
+                decode_us = difftimespec(decode_end, decode_start);
+                dl_stat->nb++;
+                dl_stat->sum_us += decode_us;
+                if (decode_us > dl_stat->max_us) {
+                    dl_stat->max_us = decode_us;
                 }
-                txpkt.rf_chain = (uint8_t)json_value_get_number(val);
-
-                /* parse TX power (optional field) */
-                val = json_object_get_value(txpk_obj,"powe");
-                if (val != NULL) {
-                    txpkt.rf_power = (int8_t)json_value_get_number(val) - antenna_gain;
-                }
-                
-                /* Parse modulation (mandatory) */
-                str = json_object_get_string(txpk_obj, "modu");
-                if (str == NULL) {
-                    MSG("WARNING: [down] no mandatory \"txpk.modu\" object in JSON, TX aborted\n");
-                    json_value_free(root_val);
-                    continue;
-                }
-                if (strcmp(str, "LORA") == 0) {
-                    /* Lora modulation */
-                    txpkt.modulation = MOD_LORA;
-
-                    /* Parse Lora spreading-factor and modulation bandwidth (mandatory) */
-                    str = json_object_get_string(txpk_obj, "datr");
-                    if (str == NULL) {
-                        MSG("WARNING: [down] no mandatory \"txpk.datr\" object in JSON, TX aborted\n");
-                        json_value_free(root_val);
-                        continue;
-                    }
-                    i = sscanf(str, "SF%2hdBW%3hd", &x0, &x1);
-                    if (i != 2) {
-                        MSG("WARNING: [down] format error in \"txpk.datr\", TX aborted\n");
-                        json_value_free(root_val);
-                        continue;
-                    }
-                    switch (x0) {
-                        case  7: txpkt.datarate = DR_LORA_SF7;  break;
-                        case  8: txpkt.datarate = DR_LORA_SF8;  break;
-                        case  9: txpkt.datarate = DR_LORA_SF9;  break;
-                        case 10: txpkt.datarate = DR_LORA_SF10; break;
-                        case 11: txpkt.datarate = DR_LORA_SF11; break;
-                        case 12: txpkt.datarate = DR_LORA_SF12; break;
-                        default:
-                            MSG("WARNING: [down] format error in \"txpk.datr\", invalid SF, TX aborted\n");
-                            json_value_free(root_val);
-                            continue;
-                    }
-                    switch (x1) {
-                        case 125: txpkt.bandwidth = BW_125KHZ; break;
-                        case 250: txpkt.bandwidth = BW_250KHZ; break;
-                        case 500: txpkt.bandwidth = BW_500KHZ; break;
-                        default:
-                            MSG("WARNING: [down] format error in \"txpk.datr\", invalid BW, TX aborted\n");
-                            json_value_free(root_val);
-                            continue;
-                    }
-
-                    /* Parse ECC coding rate (optional field) */
-                    str = json_object_get_string(txpk_obj, "codr");
-                    if (str == NULL) {
-                        MSG("WARNING: [down] no mandatory \"txpk.codr\" object in json, TX aborted\n");
-                        json_value_free(root_val);
-                        continue;
-                    }
-                    if      (strcmp(str, "4/5") == 0) txpkt.coderate = CR_LORA_4_5;
-                    else if (strcmp(str, "4/6") == 0) txpkt.coderate = CR_LORA_4_6;
-                    else if (strcmp(str, "2/3") == 0) txpkt.coderate = CR_LORA_4_6;
-                    else if (strcmp(str, "4/7") == 0) txpkt.coderate = CR_LORA_4_7;
-                    else if (strcmp(str, "4/8") == 0) txpkt.coderate = CR_LORA_4_8;
-                    else if (strcmp(str, "1/2") == 0) txpkt.coderate = CR_LORA_4_8;
-                    else {
-                        MSG("WARNING: [down] format error in \"txpk.codr\", TX aborted\n");
-                        json_value_free(root_val);
-                        continue;
-                    }
-
-                    /* Parse signal polarity switch (optional field) */
-                    val = json_object_get_value(txpk_obj,"ipol");
-                    if (val != NULL) {
-                        txpkt.invert_pol = (bool)json_value_get_boolean(val);
-                    }
-
-                    /* parse Lora preamble length (optional field, optimum min value enforced) */
-                    val = json_object_get_value(txpk_obj,"prea");
-                    if (val != NULL) {
-                        i = (int)json_value_get_number(val);
-                        if (i >= MIN_LORA_PREAMB) {
-                            txpkt.preamble = (uint16_t)i;
-                        } else {
-                            txpkt.preamble = (uint16_t)MIN_LORA_PREAMB;
-                        }
-                    } else {
-                        txpkt.preamble = (uint16_t)STD_LORA_PREAMB;
-                    }
-
-                } else if (strcmp(str, "FSK") == 0) {
-                    /* TODO FSK modulation */
-                    MSG("WARNING: [down] FSK implementation is required. TX aborted\n");
-                    continue;
-                } else {
-                    MSG("WARNING: [down] invalid modulation in \"txpk.modu\", TX aborted\n");
-                    json_value_free(root_val);
-                    continue;
-                }
-                
-                /* Parse payload length (mandatory) */
-                val = json_object_get_value(txpk_obj,"size");
-                if (val == NULL) {
-                    MSG("WARNING: [down] no mandatory \"txpk.size\" object in JSON, TX aborted\n");
-                    json_value_free(root_val);
-                    continue;
-                }
-                txpkt.size = (uint16_t)json_value_get_number(val);
-                
-                /* Parse payload data (mandatory) */
-                str = json_object_get_string(txpk_obj, "data");
-                if (str == NULL) {
-                    MSG("WARNING: [down] no mandatory \"txpk.data\" object in JSON, TX aborted\n");
-                    json_value_free(root_val);
-                    continue;
-                }
-                i = b64_to_bin(str, strlen(str), txpkt.payload, sizeof txpkt.payload);
-                if (i != txpkt.size) {
-                    MSG("WARNING: [down] mismatch between .size and .data size once converter to binary\n");
-                }
-
-                /* free the JSON parse tree from memory */
-                json_value_free(root_val);
-                /* select TX mode */
-                if (sent_immediate) {
-                    txpkt.tx_mode = IMMEDIATE;
-                } else {
-                    txpkt.tx_mode = TIMESTAMPED;
+                if (((dl_decode_stat[0].nb + dl_decode_stat[1].nb) % DL_STAT_INTERVAL) == 0) {
+                    print_dl_decode_stat();
                 }
  
                 /* TODO: record measurement data */
@@ -1540,6 +1799,14 @@ void thread_down(void) {
                     MSG("ERROR: Packet REJECTED, unsupported RF power for TX - %d\n", txpkt.rf_power);
                 }
                 
+                /* the TX time is on the server clock, bring it to the host one */
+                pthread_mutex_lock(&mx_timesync);
+                sync_ok = tsfOffsetAt(&timesync_filter, &rx_time, &sv_offset_us);
+                pthread_mutex_unlock(&mx_timesync);
+                if (sync_ok == 0) {
+                    timeval_add_us(&tx_unix_timestamp, -llround(sv_offset_us));
+                }
+
                 /* insert packet to be sent into JIT queue */
                 if (jit_result == JIT_ERROR_OK) {
                     jit_result = jit_enqueue(&jit_queue, tx_unix_timestamp, &txpkt, JIT_PKT_TYPE_DOWNLINK);
@@ -1577,6 +1844,7 @@ void thread_down(void) {
 #endif
     }
 
+    print_dl_decode_stat();
     MSG("\nINFO: End of downstream thread\n");
 }
 
@@ -1595,12 +1863,18 @@ void thread_jit(void) {
     struct timeval time_stamp;
     time_t local_current_time;
     struct tm* ptime;
+    struct timeval tx_time;
+    long long late_us;
+    uint32_t wake_late_us;
+    uint32_t count_now;
 
     while (!exit_sig && !quit_sig) {
         /* transfer data and metadata to the concentrator, and schedule TX */
-        jit_result = jit_peek(&jit_queue, NULL, &pkt_index);
+        /* sleep until the earliest downlink is due, no polling */
+        jit_result = jit_wait_next(&jit_queue, &tx_time, &wake_late_us, &pkt_index);
         if (jit_result == JIT_ERROR_OK) {
             if (pkt_index > -1) {
+                latHistRecord(&jit_wake_hist, wake_late_us);
                 jit_result = jit_dequeue(&jit_queue, pkt_index, &pkt, &pkt_type);
                 if (jit_result == JIT_ERROR_OK) {
                     /* check if concentrator is free for sending new packet */
@@ -1622,12 +1896,27 @@ void thread_jit(void) {
                         }
                     }
                     
-                    /* Check timesync before transmit a downlink packet*/
-//                    if((timesync_var.flag != TIMESYNC_DONE)) {
-//                        MSG("Time sync error (offset=%d). Tx aborted!\n", timesync_var.time_offset);
-//                        continue;
-//                    }
                            
+                    /* a TIMESTAMPED downlink fires on the concentrator counter, the conversion uses the latest offset */
+                    if (pkt.tx_mode == TIMESTAMPED) {
+                        gettimeofday(&current_unix_time, NULL);
+                        if (get_concentrator_count(&pkt.count_us, tx_time) != 0) {
+                            pkt.tx_mode = IMMEDIATE;
+                            jit_nb_no_sync++;
+                        } else {
+                            get_concentrator_count(&count_now, current_unix_time);
+                            if ((int32_t)(pkt.count_us - count_now) < TX_COUNT_MIN_LEAD_US) {
+                                /* the counter would only come back to count_us after it wraps */
+                                MSG("WARNING: [jit] count_us %u only %d us ahead, sent IMMEDIATE\n", pkt.count_us,
+                                        (int32_t)(pkt.count_us - count_now));
+                                pkt.tx_mode = IMMEDIATE;
+                                jit_nb_missed++;
+                            } else {
+                                latHistRecord(&jit_lead_hist, pkt.count_us - count_now);
+                            }
+                        }
+                    }
+
                     /* send packet to concentrator */
                     pthread_mutex_lock(&mx_concent); /* may have to wait for a fetch to finish */
                     result = lgw_send(pkt);
@@ -1637,6 +1926,14 @@ void thread_jit(void) {
                         continue;
                     } else {
                         gettimeofday(&current_unix_time, NULL);
+                        late_us = (long long)(current_unix_time.tv_sec - tx_time.tv_sec) * 1000000 + (current_unix_time.tv_usec - tx_time.tv_usec);
+                        if (pkt.tx_mode == TIMESTAMPED) {
+                            /* sent ahead on purpose, the lead is recorded above */
+                        } else if (late_us >= 0) {
+                            latHistRecord(&jit_late_hist, (uint64_t)late_us);
+                        } else {
+                            jit_nb_early++;
+                        }
                         time(&local_current_time);
                         ptime = localtime(&local_current_time);
                         
@@ -1653,11 +1950,8 @@ void thread_jit(void) {
                     MSG("ERROR: jit_dequeue failed with %d\n", jit_result);
                 }
             }
-        } else if (jit_result == JIT_ERROR_EMPTY) {
-            /* Do nothing, it can happen */
-            usleep(10000);
         } else {
-            MSG("ERROR: jit_peek failed with %d\n", jit_result);
+            MSG("ERROR: jit_wait_next failed with %d\n", jit_result);
         }
     }
 }
@@ -1667,63 +1961,54 @@ void thread_jit(void) {
 /* --- THREAD 3: TIME SYNCHRONIZATION WITH THE SERVER ----------------------- */
 
 void thread_timesync_to_server(void) {
-    
-    static unsigned int sync_interval;
-    struct timeval unix_timeval = {0, 0};
-    uint8_t buff_req[20]; /* buffer to compose time sync requests */
-    uint8_t buff_req_size = 0;
+    uint8_t buff_req[FRAME_HDR_SIZE + 8]; /* buffer to compose time sync requests */
+    uint8_t burst_id = 0;
+    TimeSyncFilter_t filter_copy;
+    int i, x;
 
     /* pre-fill the time sync request buffer with fixed fields */
-    buff_req[0] = PROTOCOL_VERSION;
-    buff_req[3] = PKT_TIMESYNC_REQ;
-    *(uint32_t *) (buff_req + 4) = net_mac_h;
-    *(uint32_t *) (buff_req + 8) = net_mac_l;
-
-    /* reset timing variables */
-    timesync_var.token_h = 0;
-    timesync_var.token_l = 0;
-    timesync_var.t0 = (struct timeval){0};
-    timesync_var.t1 = (struct timeval){0};
-    timesync_var.t2 = (struct timeval){0};
-    timesync_var.t3 = (struct timeval){0};
-    timesync_var.time_offset = 0;
-    timesync_var.offset_drift = 0;
-    timesync_var.flag = TIMESYNC_DONE;
-    sync_interval = TIMESYNC_SHORT_INTERVAL;
+    frame_header_write(buff_req, PKT_TIMESYNC_REQ, 0, 0, 8);
+    *(uint32_t *) (buff_req + FRAME_HDR_SIZE) = net_mac_h;
+    *(uint32_t *) (buff_req + FRAME_HDR_SIZE + 4) = net_mac_l;
+
+    pthread_mutex_lock(&mx_timesync);
+    tsfInit(&timesync_filter);
+    pthread_mutex_unlock(&mx_timesync);
+
     while (!exit_sig && !quit_sig) {
-        /* Send TIMESYNC_REQUEST packet*/
-        /* generate random token for request */
-        timesync_var.token_h = (uint8_t) rand(); /* random token */
-        timesync_var.token_l = (uint8_t) rand(); /* random token */
-        buff_req[1] = timesync_var.token_h;
-        buff_req[2] = timesync_var.token_l;
-        buff_req_size = 12;
-        /* Get current unix time */
-        gettimeofday(&unix_timeval, NULL);
-
-        /* send time sync request and record time */
-        send(sock_down, (void *) buff_req, buff_req_size, 0);
-
-        /* record t0 timestamp */
-        timesync_var.t0 = unix_timeval;
-        timesync_var.flag = TIMESYNC_WAITING;
-
-        wait_ms(100);
-        MSG("TIME SYNC TO SERVER INFO:\n");
-        MSG("    offset = %dus\n", timesync_var.time_offset);
-        MSG("    drift = %dus\n", timesync_var.offset_drift);
-        if (timesync_var.flag != TIMESYNC_DONE) {
-            timesync_var.flag = TIMESYNC_ERROR;
-            MSG("    offset > %d us. Timesync ERROR\n", TIMESYNC_MAX_ERROR_TOLERANT);
-            /* delay for short time */
-            wait_ms(TIMESYNC_SHORT_INTERVAL);
-        } else {
-            /* delay for long time */
-            wait_ms(TIMESYNC_LONG_INTERVAL);
+        /* a burst of requests, the filter keeps the one least delayed by the network and the server */
+        burst_id = (burst_id == 255) ? 1 : (burst_id + 1);
+        buff_req[FRAME_OFS_TOKEN_H] = burst_id;
+        pthread_mutex_lock(&mx_timesync);
+        memset(timesync_t0, 0, sizeof timesync_t0);
+        timesync_burst = burst_id;
+        pthread_mutex_unlock(&mx_timesync);
+        for (i = 0; i < TSF_BURST_SIZE; i++) {
+            buff_req[FRAME_OFS_TOKEN_L] = (uint8_t)i;
+            pthread_mutex_lock(&mx_sock_send);
+            pthread_mutex_lock(&mx_timesync);
+            gettimeofday(&timesync_t0[i], NULL); /* t0, as close to the send as possible */
+            pthread_mutex_unlock(&mx_timesync);
+            x = frame_send(sock_down, buff_req, sizeof buff_req);
+            pthread_mutex_unlock(&mx_sock_send);
+            if (x != 0) {
+                MSG("WARNING: [sync] failed to send TIMESYNC_REQ\n");
+            }
+            wait_ms(TIMESYNC_SAMPLE_SPACING_MS);
         }
+        wait_ms(TIMESYNC_BURST_TIMEOUT_MS);
+
+        pthread_mutex_lock(&mx_timesync);
+        timesync_burst = 0;
+        x = tsfEndBurst(&timesync_filter);
+        filter_copy = timesync_filter;
+        pthread_mutex_unlock(&mx_timesync);
+
+        MSG("INFO: [sync] burst %u %s, ", burst_id, (x == 0) ? "kept" : "rejected");
+        tsfPrint(&filter_copy, stdout);
+        /* the skew needs two points, until then sync often */
+        wait_ms((filter_copy.nbPoints >= 2) ? TIMESYNC_LONG_INTERVAL : TIMESYNC_SHORT_INTERVAL);
     }
 }
 
-
-
 /* --- EOF ------------------------------------------------------------------ */
@@ -10,10 +10,13 @@
 
 #include <stdio.h>        /* printf, fprintf, snprintf, fopen, fputs */
 #include <stdint.h>        /* C99 types */
+#include <math.h>          /* llround, fabs */
 #include <pthread.h>
 
 #include "trace.h"
 #include "timersync.h"
+#include "clock_discipline.h"
+#include "latency_hist.h"
 #include "loragw_hal.h"
 #include "loragw_reg.h"
 #include "loragw_aux.h"
@@ -21,24 +24,20 @@
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
 
-/* -------------------------------------------------------------------------- */
-/* --- PRIVATE MACROS ------------------------------------------------------- */
-
-#define timersub(a, b, result)                                                \
-  do {                                                                        \
-    (result)->tv_sec = (a)->tv_sec - (b)->tv_sec;                             \
-    (result)->tv_usec = (a)->tv_usec - (b)->tv_usec;                          \
-    if ((result)->tv_usec < 0) {                                              \
-      --(result)->tv_sec;                                                     \
-      (result)->tv_usec += 1000000;                                           \
-    }                                                                         \
-  } while (0)
+#define TIMERSYNC_INTERVAL_MS   10000       /* well below half a counter wrap (35 minutes), needed to count the wraps */
+#define TIMERSYNC_RETRY_MS      100         /* next try after a slow read */
+#define TIMERSYNC_READ_MAX_US   1000        /* reads of the counter taking longer are not precise enough */
+#define SAMPLE_ERROR_BUDGET_US  100         /* sample errors above are counted as overruns */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
 
-static pthread_mutex_t mx_timersync = PTHREAD_MUTEX_INITIALIZER; /* control access to timer sync offsets */
-static struct timeval offset_unix_concent = {0,0}; /* timer offset between unix host and concentrator */
+static pthread_mutex_t mx_timersync = PTHREAD_MUTEX_INITIALIZER; /* control access to the clock model */
+static ClockDiscipline_t sx1301_clock; /* zero is a model without sample */
+
+/* distance of each sample to the model, the error a TIMESTAMPED downlink sent just before would have had */
+static LatHist_t sample_error_hist = LAT_HIST_INITIALIZER("sx1301 sample error", SAMPLE_ERROR_BUDGET_US);
+static uint32_t nb_slow_reads = 0;
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE SHARED VARIABLES (GLOBAL) ------------------------------------ */
@@ -50,88 +49,118 @@ extern pthread_mutex_t mx_concent;
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
 int get_concentrator_time(struct timeval *concent_time, struct timeval unix_time) {
-    struct timeval local_timeval;
+    uint32_t count_us;
 
     if (concent_time == NULL) {
         MSG("ERROR: %s invalid parameter\n", __FUNCTION__);
         return -1;
     }
+    if (get_concentrator_count(&count_us, unix_time) != 0) {
+        return -1;
+    }
+
+    concent_time->tv_sec = count_us / 1000000UL;
+    concent_time->tv_usec = count_us % 1000000UL;
+
+    MSG_DEBUG(DEBUG_TIMERSYNC, " --> TIME: unix current time is   %ld,%ld\n", unix_time.tv_sec, unix_time.tv_usec);
+    MSG_DEBUG(DEBUG_TIMERSYNC, "           sx1301 current time is %ld,%ld\n", concent_time->tv_sec, concent_time->tv_usec);
+
+    return 0;
+}
+
+int get_concentrator_count(uint32_t *count_us, struct timeval unix_time) {
+    int ret;
+
+    if (count_us == NULL) {
+        MSG("ERROR: %s invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
 
     pthread_mutex_lock(&mx_timersync); /* protect global variable access */
-    timersub(&unix_time, &offset_unix_concent, &local_timeval);
+    ret = clkdUnixToCount(&sx1301_clock, &unix_time, count_us);
     pthread_mutex_unlock(&mx_timersync);
 
-    /* TODO: handle sx1301 coutner wrap-up !! */
-    concent_time->tv_sec = local_timeval.tv_sec;
-    concent_time->tv_usec = local_timeval.tv_usec;
+    return ret;
+}
 
-    MSG_DEBUG(DEBUG_TIMERSYNC, " --> TIME: unix current time is   %ld,%ld\n", unix_time.tv_sec, unix_time.tv_usec);
-    MSG_DEBUG(DEBUG_TIMERSYNC, "           offset is              %ld,%ld\n", offset_unix_concent.tv_sec, offset_unix_concent.tv_usec);
-    MSG_DEBUG(DEBUG_TIMERSYNC, "           sx1301 current time is %ld,%ld\n", local_timeval.tv_sec, local_timeval.tv_usec);
+int get_unix_time(struct timeval *unix_time, uint32_t count_us) {
+    int ret;
 
-    return 0;
+    if (unix_time == NULL) {
+        MSG("ERROR: %s invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    pthread_mutex_lock(&mx_timersync); /* protect global variable access */
+    ret = clkdCountToUnix(&sx1301_clock, count_us, unix_time);
+    pthread_mutex_unlock(&mx_timersync);
+
+    return ret;
+}
+
+void print_timersync_stat(void) {
+    pthread_mutex_lock(&mx_timersync);
+    clkdPrint(&sx1301_clock, stdout);
+    pthread_mutex_unlock(&mx_timersync);
+    if (nb_slow_reads > 0) {
+        printf("sx1301 clock: %u slow counter reads ignored\n", nb_slow_reads);
+    }
+    if (sample_error_hist.total > 0) {
+        latHistPrint(&sample_error_hist, stdout);
+    }
 }
 
 /* ---------------------------------------------------------------------------------------------- */
 /* --- THREAD 6: REGULARLAY MONITOR THE OFFSET BETWEEN UNIX CLOCK AND CONCENTRATOR CLOCK -------- */
 
 void thread_timersync(void) {
-    struct timeval unix_timeval;
-    struct timeval concentrator_timeval;
+    struct timeval before, after, unix_timeval;
     uint32_t sx1301_timecount = 0;
-    struct timeval offset_previous = {0,0};
-    struct timeval offset_drift = {0,0}; /* delta between current and previous offset */
-    MSG("timer sync");
+    int64_t read_us;
+    double error_us;
+    int restart;
+
+    MSG("INFO: [timersync] sampling the sx1301 counter every %u ms\n", TIMERSYNC_INTERVAL_MS);
     while (!exit_sig && !quit_sig) {
-        /* Regularly disable GPS mode of concentrator's counter, in order to get
+        /* Disable GPS mode of concentrator's counter, in order to get
             real timer value for synchronizing with host's unix timer */
-        MSG("\nINFO: Disabling GPS mode for concentrator's counter...\n");
         pthread_mutex_lock(&mx_concent);
         lgw_reg_w(LGW_GPS_EN, 0);
-        pthread_mutex_unlock(&mx_concent);
-
-        /* Get current unix time */
-        gettimeofday(&unix_timeval, NULL);
 
-        /* Get current concentrator counter value (1MHz) */
-        pthread_mutex_lock(&mx_concent);
+        /* Get current concentrator counter value (1MHz), the host time is the middle of the read */
+        gettimeofday(&before, NULL);
         lgw_get_trigcnt(&sx1301_timecount);
+        gettimeofday(&after, NULL);
+
+        lgw_reg_w(LGW_GPS_EN, 1);
         pthread_mutex_unlock(&mx_concent);
-        concentrator_timeval.tv_sec = sx1301_timecount / 1000000UL;
-        concentrator_timeval.tv_usec = sx1301_timecount - (concentrator_timeval.tv_sec * 1000000UL);
 
-        /* Compute offset between unix and concentrator timers, with microsecond precision */
-        offset_previous.tv_sec = offset_unix_concent.tv_sec;
-        offset_previous.tv_usec = offset_unix_concent.tv_usec;
+        read_us = (int64_t)(after.tv_sec - before.tv_sec) * 1000000 + (after.tv_usec - before.tv_usec);
+        if ((read_us < 0) || (read_us > TIMERSYNC_READ_MAX_US)) {
+            /* preempted during the SPI access, or the host clock stepped */
+            nb_slow_reads++;
+            wait_ms(TIMERSYNC_RETRY_MS);
+            continue;
+        }
+        unix_timeval.tv_sec = before.tv_sec + (before.tv_usec + read_us / 2) / 1000000;
+        unix_timeval.tv_usec = (before.tv_usec + read_us / 2) % 1000000;
 
-        /* TODO: handle sx1301 coutner wrap-up */
         pthread_mutex_lock(&mx_timersync); /* protect global variable access */
-        timersub(&unix_timeval, &concentrator_timeval, &offset_unix_concent);
+        restart = clkdAddSample(&sx1301_clock, &unix_timeval, sx1301_timecount);
+        error_us = sx1301_clock.lastErrorUs;
         pthread_mutex_unlock(&mx_timersync);
 
-        timersub(&offset_unix_concent, &offset_previous, &offset_drift);
-
-        MSG_DEBUG(DEBUG_TIMERSYNC, "  sx1301    = %u (µs) - timeval (%ld,%ld)\n",
-            sx1301_timecount,
-            concentrator_timeval.tv_sec,
-            concentrator_timeval.tv_usec);
-        MSG_DEBUG(DEBUG_TIMERSYNC, "  unix_timeval = %ld,%ld\n", unix_timeval.tv_sec, unix_timeval.tv_usec);
-
-        MSG("INFO: host/sx1301 time offset=(%lds:%ldµs) - drift=%ldµs\n",
-            offset_unix_concent.tv_sec,
-            offset_unix_concent.tv_usec,
-            offset_drift.tv_sec * 1000000UL + offset_drift.tv_usec);
-        MSG("INFO: Enabling GPS mode for concentrator's counter.\n\n");
-        pthread_mutex_lock(&mx_concent); /* TODO: Is it necessary to protect here? */
-        lgw_reg_w(LGW_GPS_EN, 1);
-        pthread_mutex_unlock(&mx_concent);
-
-        /* delay next sync */
-        /* If we consider a crystal oscillator precision of about 20ppm worst case, and a clock
-            running at 1MHz, this would mean 1µs drift every 50000µs (10000000/20).
-            As here the time precision is not critical, we should be able to cope with at least 1ms drift,
-            which should occur after 50s (50000µs * 1000).
-            Let's set the thread sleep to 1 minute for now */
-        wait_ms(60000);
+        if (restart) {
+            /* first sample, or the model no longer held: past conversions may be off by the step */
+            MSG("INFO: [timersync] sx1301 clock model restarted, error %.0f us\n", error_us);
+        } else {
+            latHistRecord(&sample_error_hist, (uint64_t)llround(fabs(error_us)));
+        }
+        MSG_DEBUG(DEBUG_TIMERSYNC, "  sx1301 = %u (us), unix_timeval = %ld,%ld, read in %lld us, error %.1f us\n",
+            sx1301_timecount, unix_timeval.tv_sec, unix_timeval.tv_usec, (long long)read_us, error_us);
+
+        /* The model follows the crystal drift, the interval is only bounded by the counter wrap
+            and by how fast the drift changes with temperature */
+        wait_ms(TIMERSYNC_INTERVAL_MS);
     }
 }
@@ -0,0 +1,155 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   timesync_filter.c
+ * Author: LAM-HOANG
+ *
+ * Created on October 17, 2026
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "timesync_filter.h"
+
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static double tsfTimeUs(const struct timeval *t){
+    return (double)t->tv_sec * 1e6 + (double)t->tv_usec;
+}
+
+/* Least squares fit of the window, the offset refers to the latest point */
+static void tsfFit(TimeSyncFilter_t *filter){
+    const TimeSyncPoint_t *latest = &filter->points[(filter->next + TSF_WINDOW - 1) % TSF_WINDOW];
+    double meanX = 0, meanY = 0, sxx = 0, sxy = 0, ssr = 0, minRtt = latest->rttUs;
+    double dx, dy, slope, res;
+    uint32_t i, n = filter->nbPoints;
+
+    /* x relative to the latest point, absolute times in us lose precision once squared */
+    for(i = 0; i < n; i++){
+        meanX += filter->points[i].hostUs - latest->hostUs;
+        meanY += filter->points[i].offsetUs;
+        if(filter->points[i].rttUs < minRtt){
+            minRtt = filter->points[i].rttUs;
+        }
+    }
+    meanX /= n;
+    meanY /= n;
+    for(i = 0; i < n; i++){
+        dx = filter->points[i].hostUs - latest->hostUs - meanX;
+        dy = filter->points[i].offsetUs - meanY;
+        sxx += dx * dx;
+        sxy += dx * dy;
+    }
+    slope = (sxx > 0) ? (sxy / sxx) : 0;
+    for(i = 0; i < n; i++){
+        res = filter->points[i].offsetUs - (meanY + slope * (filter->points[i].hostUs - latest->hostUs - meanX));
+        ssr += res * res;
+    }
+
+    filter->refUs = latest->hostUs;
+    filter->offsetUs = meanY - slope * meanX;
+    filter->skewPpm = slope * 1e6;
+    filter->uncertaintyUs = ((n > 2) ? sqrt(ssr / (n - 2)) : 0) + minRtt / 2;
+    filter->valid = true;
+}
+
+static void tsfRestart(TimeSyncFilter_t *filter){
+    filter->nbPoints = 0;
+    filter->next = 0;
+    filter->nbConsecRejects = 0;
+    filter->nbResets++;
+}
+
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void tsfInit(TimeSyncFilter_t *filter){
+    memset(filter, 0, sizeof(*filter));
+}
+
+int tsfAddSample(TimeSyncFilter_t *filter, const struct timeval *t0, const struct timeval *t1,
+        const struct timeval *t2, const struct timeval *t3){
+    TimeSyncPoint_t p;
+
+    filter->nbSamples++;
+    p.rttUs = (tsfTimeUs(t3) - tsfTimeUs(t0)) - (tsfTimeUs(t2) - tsfTimeUs(t1));
+    if((p.rttUs < 0) || (p.rttUs > TSF_RTT_MAX_US)){
+        filter->nbRejectedSamples++;
+        return -1;
+    }
+    p.offsetUs = ((tsfTimeUs(t1) - tsfTimeUs(t0)) + (tsfTimeUs(t2) - tsfTimeUs(t3))) / 2;
+    p.hostUs = (tsfTimeUs(t0) + tsfTimeUs(t3)) / 2;
+    if((filter->burstNb == 0) || (p.rttUs < filter->burstBest.rttUs)){
+        filter->burstBest = p;
+    }
+    filter->burstNb++;
+    return 0;
+}
+
+int tsfEndBurst(TimeSyncFilter_t *filter){
+    const TimeSyncPoint_t *best = &filter->burstBest;
+    double minRtt, predicted;
+    uint32_t i;
+
+    if(filter->burstNb == 0){
+        return -1;
+    }
+    filter->burstNb = 0;
+    filter->nbBursts++;
+
+    if(filter->nbPoints > 0){
+        /* popcorn filter: a burst whose every sample was queued says nothing about the offset */
+        minRtt = filter->points[0].rttUs;
+        for(i = 1; i < filter->nbPoints; i++){
+            if(filter->points[i].rttUs < minRtt){
+                minRtt = filter->points[i].rttUs;
+            }
+        }
+        if(best->rttUs > TSF_RTT_GATE_FACTOR * minRtt + TSF_RTT_GATE_MARGIN_US){
+            filter->nbRejectedBursts++;
+            if(++filter->nbConsecRejects < TSF_MAX_REJECTS){
+                return -1;
+            }
+            /* the path itself got longer, start again from this burst */
+            tsfRestart(filter);
+        } else {
+            predicted = filter->offsetUs + filter->skewPpm * 1e-6 * (best->hostUs - filter->refUs);
+            if(fabs(best->offsetUs - predicted) > TSF_STEP_US){
+                /* one of the clocks was stepped, the older points no longer apply */
+                tsfRestart(filter);
+            }
+        }
+    }
+
+    filter->nbConsecRejects = 0;
+    filter->points[filter->next] = *best;
+    filter->next = (filter->next + 1) % TSF_WINDOW;
+    if(filter->nbPoints < TSF_WINDOW){
+        filter->nbPoints++;
+    }
+    tsfFit(filter);
+    return 0;
+}
+
+int tsfOffsetAt(const TimeSyncFilter_t *filter, const struct timeval *host, double *offsetUs){
+    if(!filter->valid){
+        return -1;
+    }
+    *offsetUs = filter->offsetUs + filter->skewPpm * 1e-6 * (tsfTimeUs(host) - filter->refUs);
+    return 0;
+}
+
+void tsfPrint(const TimeSyncFilter_t *filter, FILE *out){
+    if(!filter->valid){
+        fprintf(out, "server clock: no estimate, %u samples, %u rejected\n", filter->nbSamples, filter->nbRejectedSamples);
+        return;
+    }
+    fprintf(out, "server clock: offset %.1f us, skew %.3f ppm, uncertainty %.1f us, %u points, "
+            "%u samples (%u rejected), %u bursts (%u rejected), %u restarts\n", filter->offsetUs, filter->skewPpm,
+            filter->uncertaintyUs, filter->nbPoints, filter->nbSamples, filter->nbRejectedSamples, filter->nbBursts,
+            filter->nbRejectedBursts, filter->nbResets);
+}
@@ -34,6 +34,12 @@ Modified at Fri Jul 28 2017.
          We added simple function for LoRa aes128_encryption
            - void AESEncryptBlock(uint8_t *input, uint8_t *output, const uint8_t *key)
 
+Modified on October 17, 2026.
+         The cipher works on a state and round keys passed by the caller, the ones
+         kept for a null key or iv are per thread. AES-128 contexts hold an expanded
+         key for the encryption of many blocks, by the reference code, T-tables or
+         AES-NI when the CPU has it.
+
 */
 
 
@@ -43,8 +49,14 @@ Modified at Fri Jul 28 2017.
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h> // CBC mode, for memset
+#include <pthread.h>
 #include "aes.h"
 
+#if AES_HAVE_AESNI
+  #include <cpuid.h>
+  #include <wmmintrin.h>
+#endif
+
 /*****************************************************************************/
 /* Defines:                                                                  */
 /*****************************************************************************/
@@ -82,19 +94,31 @@ Modified at Fri Jul 28 2017.
 /*****************************************************************************/
 // state - array holding the intermediate results during decryption.
 typedef uint8_t state_t[4][4];
-static state_t* state;
 
-// The array that stores the round keys.
-static uint8_t RoundKey[keyExpSize];
-
-// The Key input to the AES Program
-static const uint8_t* Key;
+// Round keys and IV kept for the calls passing a null key or iv, one set per thread
+static __thread uint8_t RoundKey[keyExpSize];
 
 #if defined(CBC) && CBC
   // Initial Vector used only for CBC mode
-  static uint8_t* Iv;
+  static __thread const uint8_t* Iv;
 #endif
 
+// Context of AESEncryptBlock, kept for the calls passing a null key
+static __thread Aes128Ctx_t BlockCtx;
+
+// T-tables of the encryption rounds, SubBytes and MixColumns of one byte in each
+// column position, built from the sbox on first use
+static uint32_t Te0[256], Te1[256], Te2[256], Te3[256];
+
+// Backend of the AES-128 contexts
+typedef void (*EncryptBlocksFn_t)(const Aes128Ctx_t* ctx, const uint8_t* input, uint8_t* output, uint32_t nbBlocks);
+typedef void (*EncryptBlocksMultiKeyFn_t)(const Aes128Ctx_t* const* ctx, const uint8_t* input, uint8_t* output, uint32_t nbBlocks);
+static EncryptBlocksFn_t EncryptBlocksFn;
+static EncryptBlocksMultiKeyFn_t EncryptBlocksMultiKeyFn;
+static AesBackend_e Backend;
+static pthread_once_t BackendOnce = PTHREAD_ONCE_INIT;
+
+
 // The lookup-tables are marked const so they can be placed in read-only storage instead of RAM
 // The numbers below can be computed dynamically trading ROM for RAM - 
 // This can be useful in (embedded) bootloader applications, where ROM is often limited.
@@ -185,7 +209,7 @@ static uint8_t getSBoxInvert(uint8_t num)
 }
 
 // This function produces Nb(Nr+1) round keys. The round keys are used in each round to decrypt the states. 
-static void KeyExpansion(void)
+static void KeyExpansion(uint8_t* roundKey, const uint8_t* key)
 {
   uint32_t i, k;
   uint8_t tempa[4]; // Used for the column/row operations
@@ -193,10 +217,10 @@ static void KeyExpansion(void)
   // The first round key is the key itself.
   for (i = 0; i < Nk; ++i)
   {
-    RoundKey[(i * 4) + 0] = Key[(i * 4) + 0];
-    RoundKey[(i * 4) + 1] = Key[(i * 4) + 1];
-    RoundKey[(i * 4) + 2] = Key[(i * 4) + 2];
-    RoundKey[(i * 4) + 3] = Key[(i * 4) + 3];
+    roundKey[(i * 4) + 0] = key[(i * 4) + 0];
+    roundKey[(i * 4) + 1] = key[(i * 4) + 1];
+    roundKey[(i * 4) + 2] = key[(i * 4) + 2];
+    roundKey[(i * 4) + 3] = key[(i * 4) + 3];
   }
 
   // All other round keys are found from the previous round keys.
@@ -204,10 +228,10 @@ static void KeyExpansion(void)
   for (; i < Nb * (Nr + 1); ++i)
   {
     {
-      tempa[0]=RoundKey[(i-1) * 4 + 0];
-      tempa[1]=RoundKey[(i-1) * 4 + 1];
-      tempa[2]=RoundKey[(i-1) * 4 + 2];
-      tempa[3]=RoundKey[(i-1) * 4 + 3];
+      tempa[0]=roundKey[(i-1) * 4 + 0];
+      tempa[1]=roundKey[(i-1) * 4 + 1];
+      tempa[2]=roundKey[(i-1) * 4 + 2];
+      tempa[3]=roundKey[(i-1) * 4 + 3];
     }
 
     if (i % Nk == 0)
@@ -249,30 +273,30 @@ static void KeyExpansion(void)
       }
     }
 #endif
-    RoundKey[i * 4 + 0] = RoundKey[(i - Nk) * 4 + 0] ^ tempa[0];
-    RoundKey[i * 4 + 1] = RoundKey[(i - Nk) * 4 + 1] ^ tempa[1];
-    RoundKey[i * 4 + 2] = RoundKey[(i - Nk) * 4 + 2] ^ tempa[2];
-    RoundKey[i * 4 + 3] = RoundKey[(i - Nk) * 4 + 3] ^ tempa[3];
+    roundKey[i * 4 + 0] = roundKey[(i - Nk) * 4 + 0] ^ tempa[0];
+    roundKey[i * 4 + 1] = roundKey[(i - Nk) * 4 + 1] ^ tempa[1];
+    roundKey[i * 4 + 2] = roundKey[(i - Nk) * 4 + 2] ^ tempa[2];
+    roundKey[i * 4 + 3] = roundKey[(i - Nk) * 4 + 3] ^ tempa[3];
   }
 }
 
 // This function adds the round key to state.
 // The round key is added to the state by an XOR function.
-static void AddRoundKey(uint8_t round)
+static void AddRoundKey(uint8_t round, state_t* state, const uint8_t* roundKey)
 {
   uint8_t i,j;
   for (i=0;i<4;++i)
   {
     for (j = 0; j < 4; ++j)
     {
-      (*state)[i][j] ^= RoundKey[round * Nb * 4 + i * Nb + j];
+      (*state)[i][j] ^= roundKey[round * Nb * 4 + i * Nb + j];
     }
   }
 }
 
 // The SubBytes Function Substitutes the values in the
 // state matrix with values in an S-box.
-static void SubBytes(void)
+static void SubBytes(state_t* state)
 {
   uint8_t i, j;
   for (i = 0; i < 4; ++i)
@@ -287,7 +311,7 @@ static void SubBytes(void)
 // The ShiftRows() function shifts the rows in the state to the left.
 // Each row is shifted with different offset.
 // Offset = Row number. So the first row is not shifted.
-static void ShiftRows(void)
+static void ShiftRows(state_t* state)
 {
   uint8_t temp;
 
@@ -321,7 +345,7 @@ static uint8_t xtime(uint8_t x)
 }
 
 // MixColumns function mixes the columns of the state matrix
-static void MixColumns(void)
+static void MixColumns(state_t* state)
 {
   uint8_t i;
   uint8_t Tmp,Tm,t;
@@ -359,7 +383,7 @@ static uint8_t Multiply(uint8_t x, uint8_t y)
 // MixColumns function mixes the columns of the state matrix.
 // The method used to multiply may be difficult to understand for the inexperienced.
 // Please use the references to gain more information.
-static void InvMixColumns(void)
+static void InvMixColumns(state_t* state)
 {
   int i;
   uint8_t a, b, c, d;
@@ -380,7 +404,7 @@ static void InvMixColumns(void)
 
 // The SubBytes Function Substitutes the values in the
 // state matrix with values in an S-box.
-static void InvSubBytes(void)
+static void InvSubBytes(state_t* state)
 {
   uint8_t i,j;
   for (i = 0; i < 4; ++i)
@@ -392,7 +416,7 @@ static void InvSubBytes(void)
   }
 }
 
-static void InvShiftRows(void)
+static void InvShiftRows(state_t* state)
 {
   uint8_t temp;
 
@@ -422,56 +446,302 @@ static void InvShiftRows(void)
 
 
 // Cipher is the main function that encrypts the PlainText.
-static void Cipher(void)
+static void Cipher(state_t* state, const uint8_t* roundKey)
 {
   uint8_t round = 0;
 
   // Add the First round key to the state before starting the rounds.
-  AddRoundKey(0); 
+  AddRoundKey(0, state, roundKey); 
   
   // There will be Nr rounds.
   // The first Nr-1 rounds are identical.
   // These Nr-1 rounds are executed in the loop below.
   for (round = 1; round < Nr; ++round)
   {
-    SubBytes();
-    ShiftRows();
-    MixColumns();
-    AddRoundKey(round);
+    SubBytes(state);
+    ShiftRows(state);
+    MixColumns(state);
+    AddRoundKey(round, state, roundKey);
   }
   
   // The last round is given below.
   // The MixColumns function is not here in the last round.
-  SubBytes();
-  ShiftRows();
-  AddRoundKey(Nr);
+  SubBytes(state);
+  ShiftRows(state);
+  AddRoundKey(Nr, state, roundKey);
 }
 
-static void InvCipher(void)
+static void InvCipher(state_t* state, const uint8_t* roundKey)
 {
   uint8_t round=0;
 
   // Add the First round key to the state before starting the rounds.
-  AddRoundKey(Nr); 
+  AddRoundKey(Nr, state, roundKey); 
 
   // There will be Nr rounds.
   // The first Nr-1 rounds are identical.
   // These Nr-1 rounds are executed in the loop below.
   for (round = (Nr - 1); round > 0; --round)
   {
-    InvShiftRows();
-    InvSubBytes();
-    AddRoundKey(round);
-    InvMixColumns();
+    InvShiftRows(state);
+    InvSubBytes(state);
+    AddRoundKey(round, state, roundKey);
+    InvMixColumns(state);
   }
   
   // The last round is given below.
   // The MixColumns function is not here in the last round.
-  InvShiftRows();
-  InvSubBytes();
-  AddRoundKey(0);
+  InvShiftRows(state);
+  InvSubBytes(state);
+  AddRoundKey(0, state, roundKey);
+}
+
+/*****************************************************************************/
+/* AES-128 context backends:                                                 */
+/*****************************************************************************/
+#define GETU32(p)     (((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | ((uint32_t)(p)[2] << 8) | (uint32_t)(p)[3])
+#define PUTU32(p, v)  do { (p)[0] = (uint8_t)((v) >> 24); (p)[1] = (uint8_t)((v) >> 16); \
+                           (p)[2] = (uint8_t)((v) >> 8); (p)[3] = (uint8_t)(v); } while (0)
+
+// The historical byte oriented code, one block at a time
+static void EncryptBlocksReference(const Aes128Ctx_t* ctx, const uint8_t* input, uint8_t* output, uint32_t nbBlocks)
+{
+  for (; nbBlocks > 0; --nbBlocks)
+  {
+    memmove(output, input, BLOCKLEN);
+    Cipher((state_t*)output, ctx->roundKey);
+    input += BLOCKLEN;
+    output += BLOCKLEN;
+  }
+}
+
+static void BuildTTables(void)
+{
+  uint32_t i, s, s2, s3, t;
+
+  for (i = 0; i < 256; ++i)
+  {
+    s = sbox[i];
+    s2 = xtime((uint8_t)s);
+    s3 = s2 ^ s;
+    t = (s2 << 24) | (s << 16) | (s << 8) | s3;
+    Te0[i] = t;
+    Te1[i] = (t >> 8) | (t << 24);
+    Te2[i] = (t >> 16) | (t << 16);
+    Te3[i] = (t >> 24) | (t << 8);
+  }
+}
+
+// One table lookup per byte and per round instead of the byte operations
+static void EncryptBlocksTTable(const Aes128Ctx_t* ctx, const uint8_t* input, uint8_t* output, uint32_t nbBlocks)
+{
+  const uint32_t* rk;
+  uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+  uint8_t round;
+
+  for (; nbBlocks > 0; --nbBlocks)
+  {
+    rk = ctx->rk;
+    s0 = GETU32(input     ) ^ rk[0];
+    s1 = GETU32(input +  4) ^ rk[1];
+    s2 = GETU32(input +  8) ^ rk[2];
+    s3 = GETU32(input + 12) ^ rk[3];
+
+    for (round = 1; round < Nr; ++round)
+    {
+      rk += 4;
+      t0 = Te0[s0 >> 24] ^ Te1[(s1 >> 16) & 0xff] ^ Te2[(s2 >> 8) & 0xff] ^ Te3[s3 & 0xff] ^ rk[0];
+      t1 = Te0[s1 >> 24] ^ Te1[(s2 >> 16) & 0xff] ^ Te2[(s3 >> 8) & 0xff] ^ Te3[s0 & 0xff] ^ rk[1];
+      t2 = Te0[s2 >> 24] ^ Te1[(s3 >> 16) & 0xff] ^ Te2[(s0 >> 8) & 0xff] ^ Te3[s1 & 0xff] ^ rk[2];
+      t3 = Te0[s3 >> 24] ^ Te1[(s0 >> 16) & 0xff] ^ Te2[(s1 >> 8) & 0xff] ^ Te3[s2 & 0xff] ^ rk[3];
+      s0 = t0;
+      s1 = t1;
+      s2 = t2;
+      s3 = t3;
+    }
+
+    // The last round has no MixColumns
+    rk += 4;
+    t0 = ((uint32_t)sbox[s0 >> 24] << 24) ^ ((uint32_t)sbox[(s1 >> 16) & 0xff] << 16) ^
+         ((uint32_t)sbox[(s2 >> 8) & 0xff] << 8) ^ (uint32_t)sbox[s3 & 0xff] ^ rk[0];
+    t1 = ((uint32_t)sbox[s1 >> 24] << 24) ^ ((uint32_t)sbox[(s2 >> 16) & 0xff] << 16) ^
+         ((uint32_t)sbox[(s3 >> 8) & 0xff] << 8) ^ (uint32_t)sbox[s0 & 0xff] ^ rk[1];
+    t2 = ((uint32_t)sbox[s2 >> 24] << 24) ^ ((uint32_t)sbox[(s3 >> 16) & 0xff] << 16) ^
+         ((uint32_t)sbox[(s0 >> 8) & 0xff] << 8) ^ (uint32_t)sbox[s1 & 0xff] ^ rk[2];
+    t3 = ((uint32_t)sbox[s3 >> 24] << 24) ^ ((uint32_t)sbox[(s0 >> 16) & 0xff] << 16) ^
+         ((uint32_t)sbox[(s1 >> 8) & 0xff] << 8) ^ (uint32_t)sbox[s2 & 0xff] ^ rk[3];
+    PUTU32(output     , t0);
+    PUTU32(output +  4, t1);
+    PUTU32(output +  8, t2);
+    PUTU32(output + 12, t3);
+
+    input += BLOCKLEN;
+    output += BLOCKLEN;
+  }
+}
+
+#if AES_HAVE_AESNI
+// The round keys of the FIPS-197 expansion are used as they are by AESENC.
+// Four independent blocks are interleaved to hide the latency of the instruction.
+__attribute__((target("aes,sse2")))
+static void EncryptBlocksAesNi(const Aes128Ctx_t* ctx, const uint8_t* input, uint8_t* output, uint32_t nbBlocks)
+{
+  __m128i k[Nr + 1];
+  __m128i b0, b1, b2, b3;
+  uint8_t round;
+
+  for (round = 0; round <= Nr; ++round)
+  {
+    k[round] = _mm_loadu_si128((const __m128i*)&ctx->roundKey[round * BLOCKLEN]);
+  }
+
+  for (; nbBlocks >= 4; nbBlocks -= 4)
+  {
+    b0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(input +  0)), k[0]);
+    b1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(input + 16)), k[0]);
+    b2 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(input + 32)), k[0]);
+    b3 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(input + 48)), k[0]);
+    for (round = 1; round < Nr; ++round)
+    {
+      b0 = _mm_aesenc_si128(b0, k[round]);
+      b1 = _mm_aesenc_si128(b1, k[round]);
+      b2 = _mm_aesenc_si128(b2, k[round]);
+      b3 = _mm_aesenc_si128(b3, k[round]);
+    }
+    _mm_storeu_si128((__m128i*)(output +  0), _mm_aesenclast_si128(b0, k[Nr]));
+    _mm_storeu_si128((__m128i*)(output + 16), _mm_aesenclast_si128(b1, k[Nr]));
+    _mm_storeu_si128((__m128i*)(output + 32), _mm_aesenclast_si128(b2, k[Nr]));
+    _mm_storeu_si128((__m128i*)(output + 48), _mm_aesenclast_si128(b3, k[Nr]));
+    input += 4 * BLOCKLEN;
+    output += 4 * BLOCKLEN;
+  }
+
+  for (; nbBlocks > 0; --nbBlocks)
+  {
+    b0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)input), k[0]);
+    for (round = 1; round < Nr; ++round)
+    {
+      b0 = _mm_aesenc_si128(b0, k[round]);
+    }
+    _mm_storeu_si128((__m128i*)output, _mm_aesenclast_si128(b0, k[Nr]));
+    input += BLOCKLEN;
+    output += BLOCKLEN;
+  }
+}
+
+// Same interleaving, each block with the round keys of its own context
+__attribute__((target("aes,sse2")))
+static void EncryptBlocksMultiKeyAesNi(const Aes128Ctx_t* const* ctx, const uint8_t* input, uint8_t* output, uint32_t nbBlocks)
+{
+  const uint8_t *k0, *k1, *k2, *k3;
+  __m128i b0, b1, b2, b3;
+  uint8_t round;
+
+  for (; nbBlocks >= 4; nbBlocks -= 4)
+  {
+    k0 = ctx[0]->roundKey;
+    k1 = ctx[1]->roundKey;
+    k2 = ctx[2]->roundKey;
+    k3 = ctx[3]->roundKey;
+    b0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(input +  0)), _mm_loadu_si128((const __m128i*)k0));
+    b1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(input + 16)), _mm_loadu_si128((const __m128i*)k1));
+    b2 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(input + 32)), _mm_loadu_si128((const __m128i*)k2));
+    b3 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(input + 48)), _mm_loadu_si128((const __m128i*)k3));
+    for (round = 1; round < Nr; ++round)
+    {
+      b0 = _mm_aesenc_si128(b0, _mm_loadu_si128((const __m128i*)&k0[round * BLOCKLEN]));
+      b1 = _mm_aesenc_si128(b1, _mm_loadu_si128((const __m128i*)&k1[round * BLOCKLEN]));
+      b2 = _mm_aesenc_si128(b2, _mm_loadu_si128((const __m128i*)&k2[round * BLOCKLEN]));
+      b3 = _mm_aesenc_si128(b3, _mm_loadu_si128((const __m128i*)&k3[round * BLOCKLEN]));
+    }
+    _mm_storeu_si128((__m128i*)(output +  0), _mm_aesenclast_si128(b0, _mm_loadu_si128((const __m128i*)&k0[Nr * BLOCKLEN])));
+    _mm_storeu_si128((__m128i*)(output + 16), _mm_aesenclast_si128(b1, _mm_loadu_si128((const __m128i*)&k1[Nr * BLOCKLEN])));
+    _mm_storeu_si128((__m128i*)(output + 32), _mm_aesenclast_si128(b2, _mm_loadu_si128((const __m128i*)&k2[Nr * BLOCKLEN])));
+    _mm_storeu_si128((__m128i*)(output + 48), _mm_aesenclast_si128(b3, _mm_loadu_si128((const __m128i*)&k3[Nr * BLOCKLEN])));
+    ctx += 4;
+    input += 4 * BLOCKLEN;
+    output += 4 * BLOCKLEN;
+  }
+
+  for (; nbBlocks > 0; --nbBlocks)
+  {
+    EncryptBlocksAesNi(*ctx++, input, output, 1);
+    input += BLOCKLEN;
+    output += BLOCKLEN;
+  }
+}
+
+static int AesNiSupported(void)
+{
+  unsigned int eax, ebx, ecx, edx;
+
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+  {
+    return 0;
+  }
+  return (ecx & bit_AES) != 0;
+}
+#endif
+
+// Backends without interleaving, one block at a time
+static void EncryptBlocksMultiKeySerial(const Aes128Ctx_t* const* ctx, const uint8_t* input, uint8_t* output, uint32_t nbBlocks)
+{
+  for (; nbBlocks > 0; --nbBlocks)
+  {
+    EncryptBlocksFn(*ctx++, input, output, 1);
+    input += BLOCKLEN;
+    output += BLOCKLEN;
+  }
+}
+
+static void SetBackend(AesBackend_e backend)
+{
+  EncryptBlocksMultiKeyFn = EncryptBlocksMultiKeySerial;
+  switch (backend)
+  {
+    case AES_BACKEND_REFERENCE:
+      EncryptBlocksFn = EncryptBlocksReference;
+      break;
+#if AES_HAVE_AESNI
+    case AES_BACKEND_AESNI:
+      EncryptBlocksFn = EncryptBlocksAesNi;
+      EncryptBlocksMultiKeyFn = EncryptBlocksMultiKeyAesNi;
+      break;
+#endif
+    default:
+      backend = AES_BACKEND_TTABLE;
+      EncryptBlocksFn = EncryptBlocksTTable;
+      break;
+  }
+  Backend = backend;
+}
+
+static void InitBackend(void)
+{
+  BuildTTables();
+#if AES_HAVE_AESNI
+  if (AesNiSupported())
+  {
+    SetBackend(AES_BACKEND_AESNI);
+    return;
+  }
+#endif
+  SetBackend(AES_BACKEND_TTABLE);
 }
 
+// Big endian increment of the 128-bit counter block
+static void CounterIncrement(uint8_t* counter)
+{
+  int i;
+
+  for (i = BLOCKLEN - 1; i >= 0; --i)
+  {
+    if (++counter[i] != 0)
+    {
+      break;
+    }
+  }
+}
 
 /*****************************************************************************/
 /* Public functions:                                                         */
@@ -483,26 +753,22 @@ void AES_ECB_encrypt(const uint8_t* input, const uint8_t* key, uint8_t* output,
 {
   // Copy input to output, and work in-memory on output
   memcpy(output, input, length);
-  state = (state_t*)output;
 
-  Key = key;
-  KeyExpansion();
+  KeyExpansion(RoundKey, key);
 
   // The next function call encrypts the PlainText with the Key using AES algorithm.
-  Cipher();
+  Cipher((state_t*)output, RoundKey);
 }
 
 void AES_ECB_decrypt(const uint8_t* input, const uint8_t* key, uint8_t *output, const uint32_t length)
 {
   // Copy input to output, and work in-memory on output
   memcpy(output, input, length);
-  state = (state_t*)output;
 
   // The KeyExpansion routine must be called before encryption.
-  Key = key;
-  KeyExpansion();
+  KeyExpansion(RoundKey, key);
 
-  InvCipher();
+  InvCipher((state_t*)output, RoundKey);
 }
 
 
@@ -532,21 +798,19 @@ void AES_CBC_encrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, co
   // Skip the key expansion if key is passed as 0
   if (0 != key)
   {
-    Key = key;
-    KeyExpansion();
+    KeyExpansion(RoundKey, key);
   }
 
   if (iv != 0)
   {
-    Iv = (uint8_t*)iv;
+    Iv = iv;
   }
 
   for (i = 0; i < length; i += BLOCKLEN)
   {
     XorWithIv(input);
     memcpy(output, input, BLOCKLEN);
-    state = (state_t*)output;
-    Cipher();
+    Cipher((state_t*)output, RoundKey);
     Iv = output;
     input += BLOCKLEN;
     output += BLOCKLEN;
@@ -556,8 +820,7 @@ void AES_CBC_encrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, co
   if (extra)
   {
     memcpy(output, input, extra);
-    state = (state_t*)output;
-    Cipher();
+    Cipher((state_t*)output, RoundKey);
   }
 }
 
@@ -569,21 +832,19 @@ void AES_CBC_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, co
   // Skip the key expansion if key is passed as 0
   if (0 != key)
   {
-    Key = key;
-    KeyExpansion();
+    KeyExpansion(RoundKey, key);
   }
 
   // If iv is passed as 0, we continue to encrypt without re-setting the Iv
   if (iv != 0)
   {
-    Iv = (uint8_t*)iv;
+    Iv = iv;
   }
 
   for (i = 0; i < length; i += BLOCKLEN)
   {
     memcpy(output, input, BLOCKLEN);
-    state = (state_t*)output;
-    InvCipher();
+    InvCipher((state_t*)output, RoundKey);
     XorWithIv(output);
     Iv = input;
     input += BLOCKLEN;
@@ -593,8 +854,7 @@ void AES_CBC_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, co
   if (extra)
   {
     memcpy(output, input, extra);
-    state = (state_t*)output;
-    InvCipher();
+    InvCipher((state_t*)output, RoundKey);
   }
 }
 
@@ -602,21 +862,107 @@ void AES_CBC_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, co
 
 void AESEncryptBlock(uint8_t *input, uint8_t *output, const uint8_t *key)
 {
-	// Copy input to output, and work in-memory on output
-  int i;
-  
-	memcpy(output, input, 16);
-	state = (state_t*)output;
-
 	// Skip the key expansion if key is passed as 0
 	if (0 != key)
 	{
-		Key = key;
-		KeyExpansion();
+		AES128_InitCtx(&BlockCtx, key);
 	}
 
-	Cipher();
+	AES128_EncryptBlocks(&BlockCtx, input, output, 1);
 }
 
+int AES128_SelectBackend(AesBackend_e backend)
+{
+  pthread_once(&BackendOnce, InitBackend);
+  switch (backend)
+  {
+    case AES_BACKEND_AUTO:
+      InitBackend();
+      return 0;
+#if AES_HAVE_AESNI
+    case AES_BACKEND_AESNI:
+      if (!AesNiSupported())
+      {
+        return -1;
+      }
+      break;
+#else
+    case AES_BACKEND_AESNI:
+      return -1;
+#endif
+    case AES_BACKEND_REFERENCE:
+    case AES_BACKEND_TTABLE:
+      break;
+    default:
+      return -1;
+  }
+  SetBackend(backend);
+  return 0;
+}
+
+const char* AES128_BackendName(void)
+{
+  pthread_once(&BackendOnce, InitBackend);
+  switch (Backend)
+  {
+    case AES_BACKEND_REFERENCE:
+      return "reference";
+    case AES_BACKEND_AESNI:
+      return "AES-NI";
+    default:
+      return "T-table";
+  }
+}
 
+void AES128_InitCtx(Aes128Ctx_t* ctx, const uint8_t* key)
+{
+  uint8_t i;
 
+  pthread_once(&BackendOnce, InitBackend);
+  KeyExpansion(ctx->roundKey, key);
+  for (i = 0; i < Nb * (Nr + 1); ++i)
+  {
+    ctx->rk[i] = GETU32(&ctx->roundKey[i * 4]);
+  }
+}
+
+void AES128_EncryptBlocks(const Aes128Ctx_t* ctx, const uint8_t* input, uint8_t* output, uint32_t nbBlocks)
+{
+  EncryptBlocksFn(ctx, input, output, nbBlocks);
+}
+
+void AES128_EncryptBlocksMultiKey(const Aes128Ctx_t* const* ctx, const uint8_t* input, uint8_t* output, uint32_t nbBlocks)
+{
+  EncryptBlocksMultiKeyFn(ctx, input, output, nbBlocks);
+}
+
+void AES128_CTR_Xor(const Aes128Ctx_t* ctx, uint8_t* counter, const uint8_t* input, uint8_t* output, uint32_t length)
+{
+  uint8_t keystream[AES_CTR_BATCH_BLOCKS * BLOCKLEN];
+  uint32_t nbBlocks, size, i;
+
+  while (length > 0)
+  {
+    // Counter blocks of a whole batch are encrypted at once, the backend interleaves them
+    nbBlocks = (length + BLOCKLEN - 1) / BLOCKLEN;
+    if (nbBlocks > AES_CTR_BATCH_BLOCKS)
+    {
+      nbBlocks = AES_CTR_BATCH_BLOCKS;
+    }
+    for (i = 0; i < nbBlocks; ++i)
+    {
+      memcpy(&keystream[i * BLOCKLEN], counter, BLOCKLEN);
+      CounterIncrement(counter);
+    }
+    EncryptBlocksFn(ctx, keystream, keystream, nbBlocks);
+
+    size = (length < nbBlocks * BLOCKLEN) ? length : nbBlocks * BLOCKLEN;
+    for (i = 0; i < size; ++i)
+    {
+      output[i] = input[i] ^ keystream[i];
+    }
+    input += size;
+    output += size;
+    length -= size;
+  }
+}
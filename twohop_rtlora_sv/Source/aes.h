@@ -12,6 +12,18 @@ Modified at Fri Jul 28 2017.
 
 #include <stdint.h>
 
+// AES-NI backend, selected at runtime when the CPU supports it
+#ifndef AES_HAVE_AESNI
+  #if defined(__x86_64__) || defined(__i386__)
+    #define AES_HAVE_AESNI 1
+  #else
+    #define AES_HAVE_AESNI 0
+  #endif
+#endif
+
+// Counter blocks encrypted in one backend call by AES128_CTR_Xor
+#define AES_CTR_BATCH_BLOCKS 8
+
 
 // #define the macros below to 1/0 to enable/disable the mode of operation.
 //
@@ -48,4 +60,67 @@ void AES_CBC_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, co
 
 void AESEncryptBlock(uint8_t *input, uint8_t *output, const uint8_t *key);
 
+// AES-128 key expanded once, read only afterwards and usable by several threads
+typedef struct Aes128Ctx_
+{
+  uint8_t roundKey[176];    // FIPS-197 round keys, byte order
+  uint32_t rk[44];          // same round keys as big endian words
+} Aes128Ctx_t;
+
+typedef enum AesBackend_
+{
+  AES_BACKEND_AUTO = 0,     // AES-NI when available, T-tables otherwise
+  AES_BACKEND_REFERENCE,
+  AES_BACKEND_TTABLE,
+  AES_BACKEND_AESNI
+} AesBackend_e;
+
+/**
+@brief Select the code encrypting the blocks of every AES-128 context, AES_BACKEND_AUTO by default
+@param backend[in] Backend
+@return 0 on success, -1 if the backend is not available on this CPU
+*/
+int AES128_SelectBackend(AesBackend_e backend);
+
+/**
+@brief Name of the selected backend
+@return "reference", "T-table" or "AES-NI"
+*/
+const char* AES128_BackendName(void);
+
+/**
+@brief Expand a key in a context
+@param ctx[out] Context
+@param key[in] 16 bytes key
+*/
+void AES128_InitCtx(Aes128Ctx_t* ctx, const uint8_t* key);
+
+/**
+@brief Encrypt independent blocks (ECB), the backends interleave them
+@param ctx[in] Context
+@param input[in] nbBlocks * 16 bytes
+@param output[out] nbBlocks * 16 bytes, may be input
+@param nbBlocks[in] Number of blocks
+*/
+void AES128_EncryptBlocks(const Aes128Ctx_t* ctx, const uint8_t* input, uint8_t* output, uint32_t nbBlocks);
+
+/**
+@brief Encrypt independent blocks, each with its own context, the backends interleave them
+@param ctx[in] nbBlocks contexts, one per block
+@param input[in] nbBlocks * 16 bytes
+@param output[out] nbBlocks * 16 bytes, may be input
+@param nbBlocks[in] Number of blocks
+*/
+void AES128_EncryptBlocksMultiKey(const Aes128Ctx_t* const* ctx, const uint8_t* input, uint8_t* output, uint32_t nbBlocks);
+
+/**
+@brief XOR a buffer with the key stream of a counter block, incremented as a 128-bit big endian integer
+@param ctx[in] Context
+@param counter[in/out] 16 bytes counter block, left at the value following the last block used
+@param input[in] Buffer
+@param output[out] Buffer, may be input
+@param length[in] Size of the buffer in bytes, the key stream of a last partial block is discarded
+*/
+void AES128_CTR_Xor(const Aes128Ctx_t* ctx, uint8_t* counter, const uint8_t* input, uint8_t* output, uint32_t length);
+
 #endif //_AES_H_
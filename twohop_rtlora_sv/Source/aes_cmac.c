@@ -8,8 +8,8 @@
 *              : Dae Seung Yoo (ooseyds@etri.re.kr)                           *
 * Description  : Private LoRa AES-CMAC Implementation for MIC                 *
 * Created at   : Wed Aug 02 2017.                                             *
-* Modified by  :                                                              *
-* Modified at  :                                                              *
+* Modified by  : LAM-HOANG                                                    *
+* Modified at  : October 17, 2026, contexts keeping the expanded key          *
 ******************************************************************************/
 
 #include <stdint.h>
@@ -74,150 +74,96 @@ uint8_t const_Rb[16] = {
 
 
 /******************************************************************************
-* Function Name        : SubkeyGeneration
-* Input Parameters     : uint8_t *key             - Primary Key
-*                      : uint8_t *KeyOne          - Sub Key 1
-*                      : uint8_t *KeyTwo          - Sub Key 2
+* Function Name        : ShiftSubkey
+* Input Parameters     : uint8_t *in              - 128-bit value
+*                      : uint8_t *out             - in << 1, XOR Rb if MSB(in) = 1
 * Return Value         : None
-* Function Description : Generate two sub key for CMAC
+* Function Description : Doubling in GF(2^128) of the CMAC subkey derivation
 ******************************************************************************/
-void SubkeyGeneration(uint8_t *key, uint8_t *KeyOne, uint8_t *KeyTwo)
+static void ShiftSubkey(const uint8_t *in, uint8_t *out)
 {
-	uint8_t L[16];
-	uint8_t zero[16];
-	uint8_t keyTmp[16];
 	int8_t loopCnt;
-	uint8_t overflow;
+	uint8_t overflow = 0;
+	uint8_t msb = in[0] & 0x80;
 
-    memset(zero, 0, 16);
-    AESEncryptBlock(zero, L, key);
-
-	if ( (L[0] & 0x80) == 0 ) {
-    	// If MSB(L) = 0, then K1 = L << 1
-		overflow = 0;
-		for ( loopCnt = 15; loopCnt >= 0; loopCnt-- ) {
-			KeyOne[loopCnt] = L[loopCnt] << 1;
-			KeyOne[loopCnt] |= overflow;
-			overflow = (L[loopCnt] & 0x80)?1:0;
-		}
-	} else {
-		// Else K1 = ( L << 1 ) ^ Rb
-		overflow = 0;
-		for ( loopCnt = 15; loopCnt >= 0; loopCnt-- ) {
-			keyTmp[loopCnt] = L[loopCnt] << 1;
-			keyTmp[loopCnt] |= overflow;
-			overflow = (L[loopCnt] & 0x80)?1:0;
-		}
-		for(loopCnt = 0; loopCnt < 16; loopCnt++)
-		{
-			KeyOne[loopCnt] = keyTmp[loopCnt] ^ const_Rb[loopCnt];
-		}
+	for ( loopCnt = 15; loopCnt >= 0; loopCnt-- ) {
+		out[loopCnt] = (uint8_t)(in[loopCnt] << 1) | overflow;
+		overflow = (in[loopCnt] & 0x80)?1:0;
 	}
-
-	if ( (KeyOne[0] & 0x80) == 0 ) {
-		// If MSB(L) = 0, then K1 = L << 1
-    	overflow = 0;
-		for ( loopCnt = 15; loopCnt >= 0; loopCnt-- ) {
-			KeyTwo[loopCnt] = KeyOne[loopCnt] << 1;
-			KeyTwo[loopCnt] |= overflow;
-			overflow = (KeyOne[loopCnt] & 0x80)?1:0;
-		}
-	} else {
-		// Else K1 = ( L << 1 ) ^ Rb
-		overflow = 0;
-		for ( loopCnt = 15; loopCnt >= 0; loopCnt-- ) {
-			keyTmp[loopCnt] = KeyOne[loopCnt] << 1;
-			keyTmp[loopCnt] |= overflow;
-			overflow = (KeyOne[loopCnt] & 0x80)?1:0;
-		}
+	if ( msb != 0 ) {
 		for(loopCnt = 0; loopCnt < 16; loopCnt++)
 		{
-			KeyTwo[loopCnt] = keyTmp[loopCnt] ^ const_Rb[loopCnt];
+			out[loopCnt] ^= const_Rb[loopCnt];
 		}
 	}
-	return;
 }
 
 /******************************************************************************
-* Function Name        : SubkeyGeneration
-* Input Parameters     : uint8_t *key             - Primary Key
-*                      : uint8_t *msg             - msg = MHDR|FHDR|FPORT|FRMPayload
-*                      : uint8_t size             - msg size
-*                      : uint8_t *mic             - MIC code (return value)
+* Function Name        : AES128_CMAC_InitCtx
+* Input Parameters     : AesCmacCtx_t *ctx        - CMAC context (return value)
+*                      : const uint8_t *key       - Primary Key
 * Return Value         : None
-* Function Description : Generate two sub key for CMAC
+* Function Description : Expand the key and generate the two sub keys once
 ******************************************************************************/
-void AES128_CMAC(uint8_t *key, uint8_t *msg, uint8_t size, uint8_t *mic)
+void AES128_CMAC_InitCtx(AesCmacCtx_t *ctx, const uint8_t *key)
+{
+	uint8_t L[16];
+
+	AES128_InitCtx(&ctx->aes, key);
+
+	// L := AES-128(K, const_Zero)
+	memset(L, 0, 16);
+	AES128_EncryptBlocks(&ctx->aes, L, L, 1);
+
+	// K1 := L << 1 (^ Rb), K2 := K1 << 1 (^ Rb)
+	ShiftSubkey(L, ctx->k1);
+	ShiftSubkey(ctx->k1, ctx->k2);
+}
+
+/******************************************************************************
+* Function Name        : AES128_CMAC_Ctx
+* Input Parameters     : const AesCmacCtx_t *ctx  - CMAC context
+*                      : const uint8_t *msg       - Message
+*                      : uint32_t size            - msg size
+*                      : uint8_t *mac             - 16 bytes CMAC (return value)
+* Return Value         : None
+* Function Description : RFC 4493 AES-CMAC with a prepared context
+******************************************************************************/
+void AES128_CMAC_Ctx(const AesCmacCtx_t *ctx, const uint8_t *msg, uint32_t size, uint8_t *mac)
 {
-	uint8_t keyOne[16];
-	uint8_t keyTwo[16];
-	uint8_t nBlock;			// Number of Block;
-	uint8_t completeFlag;	// Last block is complete block (order of 16)
+	uint32_t nBlock;		// Number of Block;
+	uint32_t remainingSize;
+	uint32_t blockCnt;
 	uint8_t mLast[16];
-	uint8_t remainingSize;
 	uint8_t X[16];
-	uint8_t Y[16];
 	uint8_t loopCnt;
-	uint8_t blockCnt;
-
 
-	// Step 1 : Generate Sub Key
-	SubkeyGeneration(key, keyOne, keyTwo);
-
-	// Step 2 : Get number of Blocks using "n := ceil(len/const_Bsize):
-	// n is always more than 1 because we handle bBlock + msg
-	nBlock = (uint8_t)((size+15)/16);	// ceil function
+	// Step 2, 3 : n := ceil(len/const_Bsize), at least one block
+	nBlock = (size + 15) / 16;
 	remainingSize = size % 16;
 
-	// Step 3
-	if(nBlock == 0)
-	{
-		// We will never enter here... b Block Size is 16
-		nBlock = 1;
-		completeFlag = 0;
-	}
-	else
-	{
-		if(remainingSize == 0)
-		{
-			completeFlag = 1;
-		}
-		else
-		{
-			completeFlag = 0;
-		}
-	}
-
 	// Step 4
 	// Last block is complete block   - M_last := M_n XOR K1;
 	// Last block is incomplete block - M_last := padding(M_n) XOR K2;
-
-	if (completeFlag == 1)
+	if ((nBlock != 0) && (remainingSize == 0))
 	{
 		for(loopCnt = 0; loopCnt < 16; loopCnt++)
 		{
-			mLast[loopCnt] = msg[16*(nBlock-1) + loopCnt] ^ keyOne[loopCnt];
+			mLast[loopCnt] = msg[16*(nBlock-1) + loopCnt] ^ ctx->k1[loopCnt];
 		}
 	}
 	else
 	{
-		// Padding..
+		if (nBlock == 0)
+		{
+			nBlock = 1;
+		}
+		memset(mLast, 0, 16);
+		memcpy(mLast, &msg[16*(nBlock-1)], remainingSize);
+		mLast[remainingSize] = 0x80;
 		for(loopCnt = 0; loopCnt < 16; loopCnt++)
 		{
-			if(loopCnt < remainingSize)
-			{
-				mLast[loopCnt] = msg[16*(nBlock-1) + loopCnt];	// Copy block
-			}
-			else if (loopCnt == remainingSize)
-			{
-				mLast[loopCnt] = 0x80;
-			}
-			else
-			{
-				mLast[loopCnt] = 0x0;
-			}
-			// XOR
-			mLast[loopCnt] = mLast[loopCnt] ^ keyTwo[loopCnt];
+			mLast[loopCnt] ^= ctx->k2[loopCnt];
 		}
 	}
 
@@ -225,36 +171,55 @@ void AES128_CMAC(uint8_t *key, uint8_t *msg, uint8_t size, uint8_t *mic)
 	memset(X, 0, 16);
 
 	// Step 6 :  for i := 1 to n-1 do ->  Y := X XOR M_i; ,  X := AES-128(K,Y)
-	// M_0...M_i-1
 	for(blockCnt = 0; blockCnt < (nBlock - 1); blockCnt++)
 	{
-		dprintf("Step 6 [blockCnt=%d] - ", blockCnt);
 		for(loopCnt = 0; loopCnt < 16; loopCnt++)
 		{
-			Y[loopCnt] = msg[16*blockCnt + loopCnt] ^ X[loopCnt];
-			dprintfc("%02x ", Y[loopCnt]);
+			X[loopCnt] ^= msg[16*blockCnt + loopCnt];
 		}
-		dprintfc("\n");
-		AESEncryptBlock(Y, X, key);
+		AES128_EncryptBlocks(&ctx->aes, X, X, 1);
 	}
 
-	//M_Last - Y := M_last XOR X;
-	dprintf("Step 6 [blockCnt=%d] - ", blockCnt);
+	//M_Last - Y := M_last XOR X;, T := AES-128(K,Y);
 	for(loopCnt = 0; loopCnt < 16; loopCnt++)
 	{
-		Y[loopCnt] = mLast[loopCnt] ^ X[loopCnt];
-		dprintfc("%02x ", Y[loopCnt]);
+		X[loopCnt] ^= mLast[loopCnt];
 	}
-	dprintfc("\n");
+	AES128_EncryptBlocks(&ctx->aes, X, mac, 1);
+}
 
-	//T := AES-128(K,Y);
-	AESEncryptBlock(Y, X, key);
+/******************************************************************************
+* Function Name        : SubkeyGeneration
+* Input Parameters     : uint8_t *key             - Primary Key
+*                      : uint8_t *KeyOne          - Sub Key 1
+*                      : uint8_t *KeyTwo          - Sub Key 2
+* Return Value         : None
+* Function Description : Generate two sub key for CMAC
+******************************************************************************/
+void SubkeyGeneration(uint8_t *key, uint8_t *KeyOne, uint8_t *KeyTwo)
+{
+	AesCmacCtx_t ctx;
 
-	// Step 7 : Calculate MIC
-	for(loopCnt = 0; loopCnt < 4; loopCnt++)
-	{
-		mic[loopCnt] = X[loopCnt];
-	}
+	AES128_CMAC_InitCtx(&ctx, key);
+	memcpy(KeyOne, ctx.k1, 16);
+	memcpy(KeyTwo, ctx.k2, 16);
 }
 
+/******************************************************************************
+* Function Name        : AES128_CMAC
+* Input Parameters     : uint8_t *key             - Primary Key
+*                      : uint8_t *msg             - msg = MHDR|FHDR|FPORT|FRMPayload
+*                      : uint8_t size             - msg size
+*                      : uint8_t *mic             - MIC code (return value)
+* Return Value         : None
+* Function Description : Calculate the 4 bytes MIC, the key is expanded at each call
+******************************************************************************/
+void AES128_CMAC(uint8_t *key, uint8_t *msg, uint8_t size, uint8_t *mic)
+{
+	AesCmacCtx_t ctx;
+	uint8_t mac[16];
 
+	AES128_CMAC_InitCtx(&ctx, key);
+	AES128_CMAC_Ctx(&ctx, msg, size, mac);
+	memcpy(mic, mac, 4);
+}
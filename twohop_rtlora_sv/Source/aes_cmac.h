@@ -15,6 +15,16 @@
 #ifndef __AES_CMAC_H
 #define __AES_CMAC_H
 
+#include <stdint.h>
+#include "aes.h"
+
+/* AES-128 key and CMAC sub keys, prepared once per key */
+typedef struct AesCmacCtx_ {
+	Aes128Ctx_t aes;
+	uint8_t k1[16];
+	uint8_t k2[16];
+} AesCmacCtx_t;
+
 /******************************************************************************
 * Function Name        : SubkeyGeneration
 * Input Parameters     : uint8_t *key             - Primary Key
@@ -26,16 +36,36 @@
 void SubkeyGeneration(uint8_t *key, uint8_t *KeyOne, uint8_t *KeyTwo);
 
 /******************************************************************************
-* Function Name        : SubkeyGeneration
+* Function Name        : AES128_CMAC
 * Input Parameters     : uint8_t *key             - Primary Key
 *                      : uint8_t *msg             - msg = MHDR|FHDR|FPORT|FRMPayload
 *                      : uint8_t size             - msg size
 *                      : uint8_t *mic             - MIC code (return value)
 * Return Value         : None
-* Function Description : Generate two sub key for CMAC
+* Function Description : Calculate the 4 bytes MIC, the key is expanded at each call
 ******************************************************************************/
 void AES128_CMAC(uint8_t *key, uint8_t *msg, uint8_t size, uint8_t *mic);
 
+/******************************************************************************
+* Function Name        : AES128_CMAC_InitCtx
+* Input Parameters     : AesCmacCtx_t *ctx        - CMAC context (return value)
+*                      : const uint8_t *key       - Primary Key
+* Return Value         : None
+* Function Description : Expand the key and generate the two sub keys once
+******************************************************************************/
+void AES128_CMAC_InitCtx(AesCmacCtx_t *ctx, const uint8_t *key);
+
+/******************************************************************************
+* Function Name        : AES128_CMAC_Ctx
+* Input Parameters     : const AesCmacCtx_t *ctx  - CMAC context
+*                      : const uint8_t *msg       - Message
+*                      : uint32_t size            - msg size
+*                      : uint8_t *mac             - 16 bytes CMAC (return value)
+* Return Value         : None
+* Function Description : RFC 4493 AES-CMAC with a prepared context
+******************************************************************************/
+void AES128_CMAC_Ctx(const AesCmacCtx_t *ctx, const uint8_t *msg, uint32_t size, uint8_t *mac);
+
 #endif
 
 
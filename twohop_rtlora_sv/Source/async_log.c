@@ -0,0 +1,529 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   async_log.c
+ * Author: LAM-HOANG
+ *
+ * Created on October 17, 2026
+ */
+
+#define _POSIX_C_SOURCE 200809L     /* clock_gettime nanosleep */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "async_log.h"
+#include "trade.h"
+
+#define LOG_LINE_SIZE       512
+#define LOG_SPEC_SIZE       32
+#define LOG_STR_NONE        UINT64_MAX  /* %s argument that did not fit in the record */
+
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+typedef enum LogArgType_{
+    LOG_ARG_NONE,           /* %% */
+    LOG_ARG_INT,
+    LOG_ARG_UINT,
+    LOG_ARG_LONG,
+    LOG_ARG_ULONG,
+    LOG_ARG_LLONG,
+    LOG_ARG_ULLONG,
+    LOG_ARG_SIZE,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STR,
+    LOG_ARG_PTR,
+    LOG_ARG_BAD             /* unsupported, the rest of the format is not printed */
+}LogArgType_e;
+
+typedef union LogArg_{
+    int64_t     i;
+    uint64_t    u;
+    double      d;
+    const void  *p;
+}LogArg_t;
+
+typedef struct LogRecord_{
+    uint64_t    ts;                 /* CLOCK_MONOTONIC, merge key of the rings */
+    const char  *fmt;
+    uint8_t     level;
+    uint8_t     nbArgs;
+    uint16_t    strLen;             /* bytes used in str */
+    LogArg_t    args[ASYNC_LOG_MAX_ARGS];
+    char        str[ASYNC_LOG_STR_SIZE];
+}LogRecord_t;
+
+typedef enum LogRingState_{
+    LOG_RING_USED = 1,
+    LOG_RING_EXITED                 /* owner thread ended, reusable once drained */
+}LogRingState_e;
+
+typedef struct LogRing_{
+    LogRecord_t rec[ASYNC_LOG_RING_SIZE];
+    uint32_t    tail __attribute__((aligned(64)));  /* written by the owner thread */
+    uint64_t    nbDropped;
+    int         state;
+    uint32_t    head __attribute__((aligned(64)));  /* written by the writer thread */
+    uint64_t    nbWritten;
+}LogRing_t;
+
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+extern FILE * log_file;
+extern time_t log_time;
+extern time_t log_start_time;
+
+volatile int asyncLogMaxLevel = LOG_LVL_DEBUG;
+
+static volatile int logFileLevel = LOG_LVL_DEBUG;
+static volatile int logConsoleLevel = LOG_LVL_INFO;
+
+static LogRing_t *rings[ASYNC_LOG_MAX_THREADS];
+static unsigned int nbRings;
+static uint64_t nbLost;             /* records of threads that got no ring */
+static pthread_mutex_t mutexRings = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ringKey;
+static pthread_once_t ringKeyOnce = PTHREAD_ONCE_INIT;
+static __thread LogRing_t *threadRing;
+
+static int logRunning;
+static unsigned int logRotateIntervalS;
+static pthread_t thrid_log_writer;
+
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static uint64_t logNowNs(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/* Length of the conversion starting at fmt[0] == '%', and type of its argument */
+static size_t logParseSpec(const char *fmt, LogArgType_e *type){
+    const char *p = fmt + 1;
+    int length = 0;     /* 0: int or less, 1: l, 2: ll, 3: z */
+
+    while((*p != '\0') && (strchr("-+ #0'", *p) != NULL)){
+        p++;
+    }
+    while((*p >= '0') && (*p <= '9')){
+        p++;
+    }
+    if(*p == '.'){
+        p++;
+        while((*p >= '0') && (*p <= '9')){
+            p++;
+        }
+    }
+    if(*p == 'h'){
+        p += (p[1] == 'h') ? 2 : 1;
+    } else if(*p == 'l'){
+        length = (p[1] == 'l') ? 2 : 1;
+        p += length;
+    } else if(*p == 'z'){
+        length = 3;
+        p++;
+    }
+
+    switch(*p){
+        case '%':
+            *type = LOG_ARG_NONE;
+            break;
+        case 'd':
+        case 'i':
+            *type = (length == 0) ? LOG_ARG_INT : (length == 1) ? LOG_ARG_LONG : (length == 2) ? LOG_ARG_LLONG : LOG_ARG_SIZE;
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            *type = (length == 0) ? LOG_ARG_UINT : (length == 1) ? LOG_ARG_ULONG : (length == 2) ? LOG_ARG_ULLONG : LOG_ARG_SIZE;
+            break;
+        case 'c':
+            *type = (length == 0) ? LOG_ARG_INT : LOG_ARG_BAD;
+            break;
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            *type = (length <= 1) ? LOG_ARG_DOUBLE : LOG_ARG_BAD;
+            break;
+        case 's':
+            *type = (length == 0) ? LOG_ARG_STR : LOG_ARG_BAD;
+            break;
+        case 'p':
+            *type = LOG_ARG_PTR;
+            break;
+        case '\0':
+            *type = LOG_ARG_BAD;
+            return (size_t)(p - fmt);
+        default:
+            /* '*' width, %j %t %L %n ... */
+            *type = LOG_ARG_BAD;
+            break;
+    }
+    return (size_t)(p - fmt) + 1;
+}
+
+/* Copy the arguments of a log call in its record, the format is kept as a pointer */
+static void logCapture(LogRecord_t *rec, const char *fmt, va_list ap){
+    LogArgType_e type;
+    LogArg_t *arg;
+    const char *s;
+    size_t room, n;
+
+    rec->nbArgs = 0;
+    rec->strLen = 0;
+    while((fmt = strchr(fmt, '%')) != NULL){
+        fmt += logParseSpec(fmt, &type);
+        if(type == LOG_ARG_NONE){
+            continue;
+        }
+        if((type == LOG_ARG_BAD) || (rec->nbArgs == ASYNC_LOG_MAX_ARGS)){
+            break;
+        }
+        arg = &rec->args[rec->nbArgs++];
+        switch(type){
+            case LOG_ARG_INT:       arg->i = va_arg(ap, int);                   break;
+            case LOG_ARG_UINT:      arg->u = va_arg(ap, unsigned int);          break;
+            case LOG_ARG_LONG:      arg->i = va_arg(ap, long);                  break;
+            case LOG_ARG_ULONG:     arg->u = va_arg(ap, unsigned long);         break;
+            case LOG_ARG_LLONG:     arg->i = va_arg(ap, long long);             break;
+            case LOG_ARG_ULLONG:    arg->u = va_arg(ap, unsigned long long);    break;
+            case LOG_ARG_SIZE:      arg->u = va_arg(ap, size_t);                break;
+            case LOG_ARG_DOUBLE:    arg->d = va_arg(ap, double);                break;
+            case LOG_ARG_PTR:       arg->p = va_arg(ap, void *);                break;
+            case LOG_ARG_STR:
+                s = va_arg(ap, const char *);
+                if(s == NULL){
+                    s = "(null)";
+                }
+                room = ASYNC_LOG_STR_SIZE - rec->strLen;
+                if(room == 0){
+                    arg->u = LOG_STR_NONE;
+                    break;
+                }
+                for(n = 0; (s[n] != '\0') && (n + 1 < room); n++){
+                }
+                memcpy(&rec->str[rec->strLen], s, n);
+                rec->str[rec->strLen + n] = '\0';
+                arg->u = rec->strLen;
+                rec->strLen += n + 1;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/* Format a record the way printf would have done it at the time of the call */
+static void logFormat(const LogRecord_t *rec, char *out, size_t size){
+    const char *p = rec->fmt, *pct;
+    char spec[LOG_SPEC_SIZE];
+    LogArgType_e type;
+    const LogArg_t *arg;
+    unsigned int argIndex = 0;
+    size_t used = 0, n, specLen;
+    int w = 0;
+
+    while(used + 1 < size){
+        pct = strchr(p, '%');
+        n = (pct == NULL) ? strlen(p) : (size_t)(pct - p);
+        if(n > size - 1 - used){
+            n = size - 1 - used;
+        }
+        memcpy(&out[used], p, n);
+        used += n;
+        if((pct == NULL) || (used + 1 >= size)){
+            break;
+        }
+
+        specLen = logParseSpec(pct, &type);
+        p = pct + specLen;
+        if(type == LOG_ARG_NONE){
+            out[used++] = '%';
+            continue;
+        }
+        if((type == LOG_ARG_BAD) || (argIndex >= rec->nbArgs) || (specLen >= sizeof spec)){
+            break;
+        }
+        memcpy(spec, pct, specLen);
+        spec[specLen] = '\0';
+        arg = &rec->args[argIndex++];
+        switch(type){
+            case LOG_ARG_INT:       w = snprintf(&out[used], size - used, spec, (int)arg->i);                   break;
+            case LOG_ARG_UINT:      w = snprintf(&out[used], size - used, spec, (unsigned int)arg->u);          break;
+            case LOG_ARG_LONG:      w = snprintf(&out[used], size - used, spec, (long)arg->i);                  break;
+            case LOG_ARG_ULONG:     w = snprintf(&out[used], size - used, spec, (unsigned long)arg->u);         break;
+            case LOG_ARG_LLONG:     w = snprintf(&out[used], size - used, spec, (long long)arg->i);             break;
+            case LOG_ARG_ULLONG:    w = snprintf(&out[used], size - used, spec, (unsigned long long)arg->u);    break;
+            case LOG_ARG_SIZE:      w = snprintf(&out[used], size - used, spec, (size_t)arg->u);                break;
+            case LOG_ARG_DOUBLE:    w = snprintf(&out[used], size - used, spec, arg->d);                        break;
+            case LOG_ARG_PTR:       w = snprintf(&out[used], size - used, spec, arg->p);                        break;
+            case LOG_ARG_STR:
+                w = snprintf(&out[used], size - used, spec, (arg->u == LOG_STR_NONE) ? "" : &rec->str[arg->u]);
+                break;
+            default:
+                w = 0;
+                break;
+        }
+        if(w > 0){
+            used += ((size_t)w < size - 1 - used) ? (size_t)w : size - 1 - used;
+        }
+    }
+    out[used] = '\0';
+}
+
+static void logRingExit(void *ring){
+    __atomic_store_n(&((LogRing_t *)ring)->state, LOG_RING_EXITED, __ATOMIC_RELEASE);
+}
+
+static void logCreateKey(void){
+    pthread_key_create(&ringKey, logRingExit);
+}
+
+/* Ring of the calling thread, taken on its first log call */
+static LogRing_t *logThreadRing(void){
+    LogRing_t *ring = NULL;
+    unsigned int i;
+
+    if(threadRing != NULL){
+        return threadRing;
+    }
+    pthread_once(&ringKeyOnce, logCreateKey);
+
+    pthread_mutex_lock(&mutexRings);
+    for(i = 0; i < nbRings; i++){
+        if((__atomic_load_n(&rings[i]->state, __ATOMIC_ACQUIRE) == LOG_RING_EXITED) &&
+                (__atomic_load_n(&rings[i]->head, __ATOMIC_ACQUIRE) == rings[i]->tail)){
+            ring = rings[i];
+            break;
+        }
+    }
+    if((ring == NULL) && (nbRings < ASYNC_LOG_MAX_THREADS)){
+        ring = calloc(1, sizeof(LogRing_t));
+        if(ring != NULL){
+            rings[nbRings] = ring;
+            __atomic_store_n(&nbRings, nbRings + 1, __ATOMIC_RELEASE);
+        }
+    }
+    if(ring != NULL){
+        __atomic_store_n(&ring->state, LOG_RING_USED, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&mutexRings);
+
+    if(ring != NULL){
+        threadRing = ring;
+        pthread_setspecific(ringKey, ring);
+    }
+    return ring;
+}
+
+/* Write every pending record, oldest first across the rings */
+static void logDrain(void){
+    uint32_t tails[ASYNC_LOG_MAX_THREADS];
+    char line[LOG_LINE_SIZE];
+    LogRecord_t *rec, *oldest;
+    LogRing_t *ring;
+    unsigned int n, i, best;
+
+    n = __atomic_load_n(&nbRings, __ATOMIC_ACQUIRE);
+    for(i = 0; i < n; i++){
+        tails[i] = __atomic_load_n(&rings[i]->tail, __ATOMIC_ACQUIRE);
+    }
+
+    while(1){
+        oldest = NULL;
+        best = 0;
+        for(i = 0; i < n; i++){
+            if(rings[i]->head != tails[i]){
+                rec = &rings[i]->rec[rings[i]->head & (ASYNC_LOG_RING_SIZE - 1)];
+                if((oldest == NULL) || (rec->ts < oldest->ts)){
+                    oldest = rec;
+                    best = i;
+                }
+            }
+        }
+        if(oldest == NULL){
+            break;
+        }
+
+        logFormat(oldest, line, sizeof line);
+        if((oldest->level <= logFileLevel) && (log_file != NULL)){
+            fputs(line, log_file);
+        }
+        if(oldest->level <= logConsoleLevel){
+            fputs(line, stdout);
+        }
+        ring = rings[best];
+        ring->nbWritten++;
+        __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+    }
+
+    if(log_file != NULL){
+        fflush(log_file);
+    }
+    fflush(stdout);
+}
+
+static void logRotate(void){
+    if(logRotateIntervalS == 0){
+        return;
+    }
+    time(&log_time);
+    if(difftime(log_time, log_start_time) > logRotateIntervalS){
+        if(log_file != NULL){
+            fclose(log_file);
+        }
+        open_log();
+    }
+}
+
+static void *logWriterThread(void *arg){
+    struct timespec period = { 0, ASYNC_LOG_FLUSH_INTERVAL_MS * 1000000L };
+
+    (void)arg;
+    while(__atomic_load_n(&logRunning, __ATOMIC_ACQUIRE)){
+        nanosleep(&period, NULL);
+        logDrain();
+        logRotate();
+    }
+    logDrain();
+    return NULL;
+}
+
+static void logUpdateMaxLevel(void){
+    asyncLogMaxLevel = (logFileLevel > logConsoleLevel) ? logFileLevel : logConsoleLevel;
+}
+
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int asyncLogStart(unsigned int rotateIntervalS){
+    time(&log_time);
+    if(open_log() == false){
+        return -1;
+    }
+    logRotateIntervalS = rotateIntervalS;
+
+    __atomic_store_n(&logRunning, 1, __ATOMIC_RELEASE);
+    if(pthread_create(&thrid_log_writer, NULL, logWriterThread, NULL) != 0){
+        __atomic_store_n(&logRunning, 0, __ATOMIC_RELEASE);
+        MSG("ERROR: [LOG] impossible to create the log writer thread\n");
+        return -1;
+    }
+    return 0;
+}
+
+void asyncLogStop(void){
+    if(__atomic_exchange_n(&logRunning, 0, __ATOMIC_ACQ_REL) == 0){
+        return;
+    }
+    pthread_join(thrid_log_writer, NULL);
+    if(log_file != NULL){
+        fclose(log_file);
+        log_file = NULL;
+    }
+}
+
+void asyncLogWrite(LogLevel_e level, const char *fmt, ...){
+    LogRing_t *ring;
+    LogRecord_t *rec;
+    uint32_t tail;
+    va_list ap, aq;
+
+    if(!__atomic_load_n(&logRunning, __ATOMIC_ACQUIRE)){
+        /* no writer thread, before the start or in the tests */
+        va_start(ap, fmt);
+        if(((int)level <= logConsoleLevel) && (log_file != NULL) && (log_file != stdout)){
+            va_copy(aq, ap);
+            vprintf(fmt, aq);
+            va_end(aq);
+        }
+        if((int)level <= logFileLevel){
+            vfprintf((log_file != NULL) ? log_file : stdout, fmt, ap);
+        }
+        va_end(ap);
+        return;
+    }
+
+    ring = logThreadRing();
+    if(ring == NULL){
+        __atomic_fetch_add(&nbLost, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    tail = ring->tail;
+    if(tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) >= ASYNC_LOG_RING_SIZE){
+        __atomic_store_n(&ring->nbDropped, ring->nbDropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    rec = &ring->rec[tail & (ASYNC_LOG_RING_SIZE - 1)];
+    rec->ts = logNowNs();
+    rec->fmt = fmt;
+    rec->level = (uint8_t)level;
+    va_start(ap, fmt);
+    logCapture(rec, fmt, ap);
+    va_end(ap);
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+void asyncLogSetFileLevel(LogLevel_e level){
+    if(level < LOG_LVL_NB){
+        logFileLevel = level;
+        logUpdateMaxLevel();
+    }
+}
+
+void asyncLogSetConsoleLevel(LogLevel_e level){
+    if(level < LOG_LVL_NB){
+        logConsoleLevel = level;
+        logUpdateMaxLevel();
+    }
+}
+
+void asyncLogGetCounters(uint64_t *nbWritten, uint64_t *nbDropped){
+    unsigned int n, i;
+
+    *nbWritten = 0;
+    *nbDropped = __atomic_load_n(&nbLost, __ATOMIC_RELAXED);
+    n = __atomic_load_n(&nbRings, __ATOMIC_ACQUIRE);
+    for(i = 0; i < n; i++){
+        *nbWritten += __atomic_load_n(&rings[i]->nbWritten, __ATOMIC_RELAXED);
+        *nbDropped += __atomic_load_n(&rings[i]->nbDropped, __ATOMIC_RELAXED);
+    }
+}
+
+void asyncLogPrintStats(void){
+    static const char *levelNames[LOG_LVL_NB] = { "ERROR", "WARNING", "INFO", "DEBUG" };
+    unsigned int n, i;
+    LogRing_t *ring;
+
+    n = __atomic_load_n(&nbRings, __ATOMIC_ACQUIRE);
+    printf("Log: file level %s, console level %s, writer %s\n", levelNames[logFileLevel], levelNames[logConsoleLevel],
+            __atomic_load_n(&logRunning, __ATOMIC_RELAXED) ? "running" : "stopped");
+    printf(" Ring  State      Written   Pending   Dropped\n");
+    for(i = 0; i < n; i++){
+        ring = rings[i];
+        printf(" %4u  %-6s %11llu %9u %9llu\n", i,
+                (__atomic_load_n(&ring->state, __ATOMIC_RELAXED) == LOG_RING_USED) ? "used" : "exited",
+                (unsigned long long)__atomic_load_n(&ring->nbWritten, __ATOMIC_RELAXED),
+                __atomic_load_n(&ring->tail, __ATOMIC_RELAXED) - __atomic_load_n(&ring->head, __ATOMIC_RELAXED),
+                (unsigned long long)__atomic_load_n(&ring->nbDropped, __ATOMIC_RELAXED));
+    }
+    if(nbLost > 0){
+        printf(" %llu records lost, more than %d logging threads\n", (unsigned long long)nbLost, ASYNC_LOG_MAX_THREADS);
+    }
+    printf("\n");
+}
@@ -0,0 +1,108 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   async_log.h
+ * Author: LAM-HOANG
+ * Description:
+ *          Asynchronous logger. A log call copies its format pointer and its
+ *          arguments in a ring of binary records owned by the calling thread
+ *          and returns, it never formats, locks or touches stdio. A writer
+ *          thread merges the rings in time order, formats the records, writes
+ *          them to the log file, echoes them to the console and rotates the
+ *          log file. Records are dropped, and counted, when a ring is full.
+ *
+ *          Format strings must be string literals, %s arguments are copied
+ *          (truncated to ASYNC_LOG_STR_SIZE bytes per record), '*' widths and the
+ *          %j %t %L %n conversions are not supported.
+ * Created on October 17, 2026
+ */
+
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define ASYNC_LOG_RING_SIZE         1024    /* records per thread, power of 2 */
+#define ASYNC_LOG_MAX_THREADS       24
+#define ASYNC_LOG_MAX_ARGS          10
+#define ASYNC_LOG_STR_SIZE          160     /* bytes for the %s arguments of a record */
+#define ASYNC_LOG_FLUSH_INTERVAL_MS 10
+
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+typedef enum LogLevel_{
+    LOG_LVL_ERROR = 0,
+    LOG_LVL_WARNING,
+    LOG_LVL_INFO,
+    LOG_LVL_DEBUG,
+    LOG_LVL_NB
+}LogLevel_e;
+
+/* --- PUBLIC VARIABLES ----------------------------------------------------- */
+
+/* highest level written to the file or to the console, checked before the call */
+extern volatile int asyncLogMaxLevel;
+
+/* --- PUBLIC MACROS -------------------------------------------------------- */
+
+#define LOG_MSG(level, fmt, ...)                                        \
+            do {                                                        \
+                if ((int)(level) <= asyncLogMaxLevel)                   \
+                    asyncLogWrite((level), fmt, ##__VA_ARGS__);         \
+            } while (0)
+
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Open the log file and start the writer thread. Until then, records are written synchronously to log_file or stdout
+@param rotateIntervalS[in] Seconds after which the writer starts a new log file, 0 for never
+@return 0 on success, -1 if the log file or the thread cannot be created
+*/
+int asyncLogStart(unsigned int rotateIntervalS);
+
+/**
+@brief Stop the writer thread once every pending record is written, and close the log file
+*/
+void asyncLogStop(void);
+
+/**
+@brief Record a log message from the calling thread
+@param level[in] Level of the message
+@param fmt[in] printf format, must stay valid until the record is written
+*/
+void asyncLogWrite(LogLevel_e level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+@brief Change at runtime the highest level written to the log file
+@param level[in] Level
+*/
+void asyncLogSetFileLevel(LogLevel_e level);
+
+/**
+@brief Change at runtime the highest level echoed to the console
+@param level[in] Level
+*/
+void asyncLogSetConsoleLevel(LogLevel_e level);
+
+/**
+@brief Records written and dropped since the start, over every thread ring
+@param nbWritten[out] Records written by the writer thread
+@param nbDropped[out] Records dropped because a ring was full or no ring was left
+*/
+void asyncLogGetCounters(uint64_t *nbWritten, uint64_t *nbDropped);
+
+/**
+@brief Print levels, written and dropped records of every thread ring
+*/
+void asyncLogPrintStats(void);
+
+#endif /* ASYNC_LOG_H */
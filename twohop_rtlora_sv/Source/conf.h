@@ -24,7 +24,7 @@
 //#define APPLICATION_WELCOME_SERVER_PORT			8001		// Default Application Welcome Server Port
 #define LORA_NETWORK_SERVER_VERSION				"v1.3"
 
-#define PROTOCOL_VERSION        2  /* v1.3 */
+// PROTOCOL_VERSION and packet types of the gateway link are in frame_stream.h
 
 //#define LOG
 #define MONITORING_INTERVAL	30
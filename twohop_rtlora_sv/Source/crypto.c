@@ -8,8 +8,8 @@
 *              : Dae Seung Yoo (ooseyds@etri.re.kr)                           *
 * Description  : Private LoRa End Device class X MAC cryptography routine     *
 * Created at   : Fri Jul 28 2017.                                             *
-* Modified by  :                                                              *
-* Modified at  :                                                              *
+* Modified by  : LAM-HOANG                                                    *
+* Modified at  : October 17, 2026, counter mode and session key contexts      *
 ******************************************************************************/
 
 #include <string.h>
@@ -19,6 +19,58 @@
 #include "aes_cmac.h"
 #include "debug.h"
 
+/******************************************************************************
+* Function Name        : BuildFrameBlock
+* Input Parameters     : uint8_t *block            - A or B0 block (Return Value)
+*                      : uint8_t first             - 0x01 for A, 0x49 for B0
+*                      : uint8_t direction         - UPLINK/DOWNLINK
+*                      : LoRaFrameHeader_t fHeader - DevAddress / FrameCounter
+*                      : uint8_t last              - Block counter for A, len(msg) for B0
+* Return Value         : None
+* Function Description : Block of the payload encryption and of the MIC
+******************************************************************************/
+void BuildFrameBlock(uint8_t *block, uint8_t first, uint8_t direction, LoRaFrameHeader_t fHeader, uint8_t last)
+{
+	// 0x01 or 0x49
+	block[0] = first;
+	// 4 x 0x00
+	block[1] = 0x00;
+	block[2] = 0x00;
+	block[3] = 0x00;
+	block[4] = 0x00;
+	// Direction
+	block[5] = direction;
+	// Dev Address
+	memcpy(&block[6], &fHeader.DevAddr.Address, 4);
+	// Frame Counter
+	memcpy(&block[10], &fHeader.FrameCounter, 2);
+	block[12] = 0x00;
+	block[13] = 0x00;
+	// 0x00
+	block[14] = 0x00;
+	// Block counter or len(msg)
+	block[15] = last;
+}
+
+/******************************************************************************
+* Function Name        : EncryptPayloadWithKey
+* Input Parameters     : uint8_t *dest             - Encrypted payload
+*                      : const uint8_t *src        - Original payload
+*                      : uint16_t size             - Size of payload
+*                      : uint8_t direction         - UPLINK/DOWNLINK
+*                      : LoRaFrameHeader_t fHeader - DevAddress / FrameCounter
+*                      : const Aes128Ctx_t *key    - Expanded NWKSKEY or APPSKEY
+* Return Value         : None
+* Function Description : Counter mode over the A blocks, block counter from 1
+******************************************************************************/
+static void EncryptPayloadWithKey(uint8_t *dest, const uint8_t *src, uint16_t size, uint8_t direction, LoRaFrameHeader_t fHeader, const Aes128Ctx_t *key)
+{
+	uint8_t aBlocki[16];
+
+	BuildFrameBlock(aBlocki, 0x01, direction, fHeader, 0x01);
+	AES128_CTR_Xor(key, aBlocki, src, dest, size);
+}
+
 /******************************************************************************
 * Function Name        : EncryptPayload
 * Input Parameters     : uint8_t *dest             - Encrypted payload
@@ -34,73 +86,11 @@
 ******************************************************************************/
 void EncryptPayload (uint8_t *dest, uint8_t *src, uint16_t size, uint8_t direction, LoRaFrameHeader_t fHeader, uint8_t port, uint8_t *nwkSKey, uint8_t *appSKey)
 {
-	uint8_t aBlocki[16], sBlocki[16];
-	uint8_t blockCnt = 1;
-	uint8_t len = 0;
-	uint8_t loopCnt;
-	uint8_t *key;
-
-	// Get key
-	if(port == 0)
-	{
-		// MAC command only port
-		key = nwkSKey;
-	}
-	else
-	{
-		// Application port
-		key = appSKey;
-	}
-
-	// Initialization aBlock
-	// 0x01
-	aBlocki[0] = 0x01;
-	// 4 x 0x00
-	aBlocki[1] = 0x00;
-	aBlocki[2] = 0x00;
-	aBlocki[3] = 0x00;
-	aBlocki[4] = 0x00;
-	// Direction
-	aBlocki[5] = direction;
-	// Dev Address
-	memcpy(&aBlocki[6], &fHeader.DevAddr.Address, 4);
-	// Frame Counter
-	memcpy(&aBlocki[10], &fHeader.FrameCounter, 2);
-	aBlocki[12] = 0x00;
-	aBlocki[13] = 0x00;
-	// 0x00
-	aBlocki[14] = 0x00;
-
-	// Generate encrypted frame
-	while(size >= 16)
-	{
-		aBlocki[15] = blockCnt++;
-
-		// AES Encrypt Block
-		AESEncryptBlock(aBlocki, sBlocki, key);
-
-		for(loopCnt = 0; loopCnt < 16; loopCnt++)
-		{
-			dest[len + loopCnt] = src[len + loopCnt] ^ sBlocki[loopCnt];
-		}
-
-		// update parameters
-		size -= 16;
-		len +=16;
-	}
-	// Remaining frame
-	if(size > 0)
-	{
-		aBlocki[15] = blockCnt++;
-
-		// AES Encrypt Block - same as ECB
-		AESEncryptBlock(aBlocki, sBlocki, key);
-
-		for(loopCnt = 0; loopCnt < size; loopCnt++)
-		{
-			dest[len + loopCnt] = src[len + loopCnt] ^ sBlocki[loopCnt];
-		}
-	}
+	Aes128Ctx_t ctx;
+
+	// Get key, NwkSKey for the MAC command only port, AppSKey for the application ports
+	AES128_InitCtx(&ctx, (port == 0) ? nwkSKey : appSKey);
+	EncryptPayloadWithKey(dest, src, size, direction, fHeader, &ctx);
 }
 
 /******************************************************************************
@@ -170,28 +160,8 @@ void GenerateMIC (uint8_t *msg, uint16_t size, uint8_t direction, LoRaFrameHeade
 {
 	uint8_t bBlocki[256+16];
 
-	// Initialization bBlock
-	// 0x49
-	bBlocki[0] = 0x49;
-	// 4 x 0x00
-	bBlocki[1] = 0x00;
-	bBlocki[2] = 0x00;
-	bBlocki[3] = 0x00;
-	bBlocki[4] = 0x00;
-	// Direction
-	bBlocki[5] = direction;
-	// Dev Address
-	memcpy(&bBlocki[6], &fHeader.DevAddr.Address, 4);
-	// Frame Counter
-	memcpy(&bBlocki[10], &fHeader.FrameCounter, 2);
-	bBlocki[12] = 0x00;
-	bBlocki[13] = 0x00;
-	// 0x00
-	bBlocki[14] = 0x00;
-	// len(msg)
-	bBlocki[15] = size;
-
 	// b Block = b0 | msg
+	BuildFrameBlock(bBlocki, 0x49, direction, fHeader, (uint8_t)size);
 	memcpy(&bBlocki[16], msg, size);
 
 	AES128_CMAC(nwkSKey, bBlocki, size+16, mic);
@@ -223,9 +193,96 @@ void GenerateMICforJoinResponse (uint8_t *msg, uint8_t *appKey, uint8_t *mic)
 	AES128_CMAC(appKey, msg, 13, mic);
 }
 
+/******************************************************************************
+* Function Name        : InitSessionCtx
+* Input Parameters     : LoRaSessionCtx_t *session - Session context (Return Value)
+*                      : const uint8_t *nwkSKey    - NWKSKEY
+*                      : const uint8_t *appSKey    - APPSKEY
+* Return Value         : None
+* Function Description : Expand the session keys and the CMAC sub keys once, at
+*                      : join or provisioning of the device
+******************************************************************************/
+void InitSessionCtx(LoRaSessionCtx_t *session, const uint8_t *nwkSKey, const uint8_t *appSKey)
+{
+	AES128_CMAC_InitCtx(&session->nwkSKey, nwkSKey);
+	AES128_InitCtx(&session->appSKey, appSKey);
+}
+
+/******************************************************************************
+* Function Name        : EncryptPayloadCtx
+* Input Parameters     : uint8_t *dest             - Encrypted payload
+*                      : const uint8_t *src        - Original payload
+*                      : uint16_t size             - Size of payload
+*                      : uint8_t direction         - UPLINK/DOWNLINK
+*                      : LoRaFrameHeader_t fHeader - DevAddress / FrameCounter
+*                      : uint8_t port              - Port
+*                      : const LoRaSessionCtx_t *session - Session context of the device
+* Return Value         : None
+* Function Description : Encrypt LoRa payload with the keys of a session context
+******************************************************************************/
+void EncryptPayloadCtx(uint8_t *dest, const uint8_t *src, uint16_t size, uint8_t direction, LoRaFrameHeader_t fHeader, uint8_t port, const LoRaSessionCtx_t *session)
+{
+	EncryptPayloadWithKey(dest, src, size, direction, fHeader, (port == 0) ? &session->nwkSKey.aes : &session->appSKey);
+}
+
+/******************************************************************************
+* Function Name        : DecryptPayloadCtx
+* Input Parameters     : uint8_t *dest             - Original payload
+*                      : const uint8_t *src        - Encrypted payload
+*                      : uint16_t size             - Size of payload
+*                      : uint8_t direction         - UPLINK/DOWNLINK
+*                      : LoRaFrameHeader_t fHeader - DevAddress / FrameCounter
+*                      : uint8_t port              - Port
+*                      : const LoRaSessionCtx_t *session - Session context of the device
+* Return Value         : None
+* Function Description : Decrypt LoRa payload -> same as Encryption
+******************************************************************************/
+void DecryptPayloadCtx(uint8_t *dest, const uint8_t *src, uint16_t size, uint8_t direction, LoRaFrameHeader_t fHeader, uint8_t port, const LoRaSessionCtx_t *session)
+{
+	EncryptPayloadCtx(dest, src, size, direction, fHeader, port, session);
+}
 
+/******************************************************************************
+* Function Name        : GenerateMICCtx
+* Input Parameters     : const uint8_t *msg        - MHDR | FHDR | FPORT | FRMPayload
+*                      : uint16_t size             - size of msg, up to 255
+*                      : uint8_t direction         - UPLINK/DOWNLINK
+*                      : LoRaFrameHeader_t fHeader - DevAddress / FrameCounter
+*                      : const LoRaSessionCtx_t *session - Session context of the device
+*                      : uint8_t *mic              - Message Integrity Code (Return Value)
+* Return Value         : None
+* Function Description : Calculate MIC with the keys of a session context
+******************************************************************************/
+void GenerateMICCtx(const uint8_t *msg, uint16_t size, uint8_t direction, LoRaFrameHeader_t fHeader, const LoRaSessionCtx_t *session, uint8_t *mic)
+{
+	uint8_t bBlocki[256+16];
+	uint8_t mac[16];
 
+	// b Block = b0 | msg
+	BuildFrameBlock(bBlocki, 0x49, direction, fHeader, (uint8_t)size);
+	memcpy(&bBlocki[16], msg, size);
 
+	AES128_CMAC_Ctx(&session->nwkSKey, bBlocki, size+16, mac);
+	memcpy(mic, mac, 4);
+}
 
+/******************************************************************************
+* Function Name        : CheckMICCtx
+* Input Parameters     : const uint8_t *msg        - MHDR | FHDR | FPORT | FRMPayload
+*                      : uint16_t size             - size of msg, up to 255
+*                      : uint8_t direction         - UPLINK/DOWNLINK
+*                      : LoRaFrameHeader_t fHeader - DevAddress / FrameCounter
+*                      : const LoRaSessionCtx_t *session - Session context of the device
+*                      : const uint8_t *mic        - Received Message Integrity Code
+* Return Value         : uint8_t                   - 1 if the MIC is valid, 0 otherwise
+* Function Description : Verify the MIC of a received frame
+******************************************************************************/
+uint8_t CheckMICCtx(const uint8_t *msg, uint16_t size, uint8_t direction, LoRaFrameHeader_t fHeader, const LoRaSessionCtx_t *session, const uint8_t *mic)
+{
+	uint8_t micCal[4];
 
+	GenerateMICCtx(msg, size, direction, fHeader, session, micCal);
 
+	// Compare every byte, the time does not depend on the first difference
+	return ((micCal[0] ^ mic[0]) | (micCal[1] ^ mic[1]) | (micCal[2] ^ mic[2]) | (micCal[3] ^ mic[3])) == 0;
+}
@@ -8,14 +8,22 @@
 *              : Dae Seung Yoo (ooseyds@etri.re.kr)                           *
 * Description  : Private LoRa End Device class X MAC cryptography header file *
 * Created at   : Fri Jul 28 2017.                                             *
-* Modified by  :                                                              *
-* Modified at  :                                                              *
+* Modified by  : LAM-HOANG                                                    *
+* Modified at  : October 17, 2026, session key contexts                       *
 ******************************************************************************/
 
 #ifndef __CRYPTO_H_
 #define __CRYPTO_H_
 
 #include "lora_mac.h"
+#include "aes.h"
+#include "aes_cmac.h"
+
+/* Session keys of a device, expanded once with their CMAC sub keys */
+typedef struct LoRaSessionCtx {
+	AesCmacCtx_t nwkSKey;	// MIC and port 0 payload
+	Aes128Ctx_t appSKey;	// port 1..255 payload
+}LoRaSessionCtx_t;
 
 
 /******************************************************************************
@@ -104,5 +112,81 @@ void GenerateMICforJoinRequest (uint8_t *msg, uint8_t *appKey, uint8_t *mic);
 ******************************************************************************/
 void GenerateMICforJoinResponse (uint8_t *msg, uint8_t *appKey, uint8_t *mic);
 
-#endif // __CRYPTO_H_
+/******************************************************************************
+* Function Name        : BuildFrameBlock
+* Input Parameters     : uint8_t *block            - A or B0 block (Return Value)
+*                      : uint8_t first             - 0x01 for A, 0x49 for B0
+*                      : uint8_t direction         - UPLINK/DOWNLINK
+*                      : LoRaFrameHeader_t fHeader - DevAddress / FrameCounter
+*                      : uint8_t last              - Block counter for A, len(msg) for B0
+* Return Value         : None
+* Function Description : Block of the payload encryption and of the MIC
+******************************************************************************/
+void BuildFrameBlock(uint8_t *block, uint8_t first, uint8_t direction, LoRaFrameHeader_t fHeader, uint8_t last);
+
+/******************************************************************************
+* Function Name        : InitSessionCtx
+* Input Parameters     : LoRaSessionCtx_t *session - Session context (Return Value)
+*                      : const uint8_t *nwkSKey    - NWKSKEY
+*                      : const uint8_t *appSKey    - APPSKEY
+* Return Value         : None
+* Function Description : Expand the session keys and the CMAC sub keys once, at
+*                      : join or provisioning of the device
+******************************************************************************/
+void InitSessionCtx(LoRaSessionCtx_t *session, const uint8_t *nwkSKey, const uint8_t *appSKey);
+
+/******************************************************************************
+* Function Name        : EncryptPayloadCtx
+* Input Parameters     : uint8_t *dest             - Encrypted payload
+*                      : const uint8_t *src        - Original payload
+*                      : uint16_t size             - Size of payload
+*                      : uint8_t direction         - UPLINK/DOWNLINK
+*                      : LoRaFrameHeader_t fHeader - DevAddress / FrameCounter
+*                      : uint8_t port              - Port
+*                      : const LoRaSessionCtx_t *session - Session context of the device
+* Return Value         : None
+* Function Description : Encrypt LoRa payload with the keys of a session context
+******************************************************************************/
+void EncryptPayloadCtx(uint8_t *dest, const uint8_t *src, uint16_t size, uint8_t direction, LoRaFrameHeader_t fHeader, uint8_t port, const LoRaSessionCtx_t *session);
+
+/******************************************************************************
+* Function Name        : DecryptPayloadCtx
+* Input Parameters     : uint8_t *dest             - Original payload
+*                      : const uint8_t *src        - Encrypted payload
+*                      : uint16_t size             - Size of payload
+*                      : uint8_t direction         - UPLINK/DOWNLINK
+*                      : LoRaFrameHeader_t fHeader - DevAddress / FrameCounter
+*                      : uint8_t port              - Port
+*                      : const LoRaSessionCtx_t *session - Session context of the device
+* Return Value         : None
+* Function Description : Decrypt LoRa payload -> same as Encryption
+******************************************************************************/
+void DecryptPayloadCtx(uint8_t *dest, const uint8_t *src, uint16_t size, uint8_t direction, LoRaFrameHeader_t fHeader, uint8_t port, const LoRaSessionCtx_t *session);
 
+/******************************************************************************
+* Function Name        : GenerateMICCtx
+* Input Parameters     : const uint8_t *msg        - MHDR | FHDR | FPORT | FRMPayload
+*                      : uint16_t size             - size of msg, up to 255
+*                      : uint8_t direction         - UPLINK/DOWNLINK
+*                      : LoRaFrameHeader_t fHeader - DevAddress / FrameCounter
+*                      : const LoRaSessionCtx_t *session - Session context of the device
+*                      : uint8_t *mic              - Message Integrity Code (Return Value)
+* Return Value         : None
+* Function Description : Calculate MIC with the keys of a session context
+******************************************************************************/
+void GenerateMICCtx(const uint8_t *msg, uint16_t size, uint8_t direction, LoRaFrameHeader_t fHeader, const LoRaSessionCtx_t *session, uint8_t *mic);
+
+/******************************************************************************
+* Function Name        : CheckMICCtx
+* Input Parameters     : const uint8_t *msg        - MHDR | FHDR | FPORT | FRMPayload
+*                      : uint16_t size             - size of msg, up to 255
+*                      : uint8_t direction         - UPLINK/DOWNLINK
+*                      : LoRaFrameHeader_t fHeader - DevAddress / FrameCounter
+*                      : const LoRaSessionCtx_t *session - Session context of the device
+*                      : const uint8_t *mic        - Received Message Integrity Code
+* Return Value         : uint8_t                   - 1 if the MIC is valid, 0 otherwise
+* Function Description : Verify the MIC of a received frame
+******************************************************************************/
+uint8_t CheckMICCtx(const uint8_t *msg, uint16_t size, uint8_t direction, LoRaFrameHeader_t fHeader, const LoRaSessionCtx_t *session, const uint8_t *mic);
+
+#endif // __CRYPTO_H_
@@ -22,6 +22,7 @@
 
 //Initial Information Ptr
 GateWayInfo_t GW_HEAD;
+pthread_mutex_t mutexGateWayList = PTHREAD_MUTEX_INITIALIZER;
 EndDeviceInfo_t ED_HEAD;
 
 extern uint8_t Network_ID;
@@ -70,6 +71,7 @@ void DeinitGateWayInfo(void) {
         GW_HEAD.next = gwInfo->next;
         //close socket all remaining client..
         close(gwInfo->socket);
+        pthread_mutex_destroy(&gwInfo->txMutex);
         free(gwInfo);
     }
 }
@@ -78,26 +80,33 @@ void DeinitGateWayInfo(void) {
  * Function Name        : AddGateWay
  * Input Parameters     : int clntsocket                 - Gateway Socket Number
  *                      : struct sockaddr_in clntAddress - Gateway Address Info
- * Return Value         : None
+ * Return Value         : GateWayInfo_t * - Gateway Information Structure pointer, NULL on failure
  * Function Description : New Gateway registration..
  ******************************************************************************/
-void AddGateWay(int clntsocket, struct sockaddr_in clntAddress) {
+GateWayInfo_t *AddGateWay(int clntsocket, struct sockaddr_in clntAddress) {
     GateWayInfo_t *gwInfo;
     // Find exist Gateway Information using socket number..
+    pthread_mutex_lock(&mutexGateWayList);
     gwInfo = FindGateWay(clntsocket);
 
     if (gwInfo == NULL) {
         // New Gateway connects to Network Server..
         gwInfo = malloc(sizeof (GateWayInfo_t));
         if (gwInfo == NULL) {
+            pthread_mutex_unlock(&mutexGateWayList);
             dprintf("Memory allocation fail!!\n");
-            return;
+            return NULL;
         }
         dprintf("Add New GW Information - socket number = %d, IP = %s\n", clntsocket, inet_ntoa(clntAddress.sin_addr));
         gwInfo->socket = clntsocket;
         gwInfo->sockaddr = clntAddress;
         memset(gwInfo->rxBuffer, 0, TCP_STREAM_BUFFER_SIZE);
         gwInfo->currentRxBufferSize = 0;
+        frame_stream_init(&gwInfo->rxStream, gwInfo->rxBuffer, TCP_STREAM_BUFFER_SIZE);
+        gwInfo->linkCaps = 0;
+        gwInfo->worker = 0;
+        pthread_mutex_init(&gwInfo->txMutex, NULL);
+        gwInfo->txBroken = false;
         gwInfo->next = GW_HEAD.next;
         GW_HEAD.next = gwInfo;
     } else {
@@ -107,9 +116,14 @@ void AddGateWay(int clntsocket, struct sockaddr_in clntAddress) {
         gwInfo->sockaddr = clntAddress;
         memset(gwInfo->rxBuffer, 0, TCP_STREAM_BUFFER_SIZE);
         gwInfo->currentRxBufferSize = 0;
-        return;
+        frame_stream_init(&gwInfo->rxStream, gwInfo->rxBuffer, TCP_STREAM_BUFFER_SIZE);
+        gwInfo->linkCaps = 0;
+        gwInfo->worker = 0;
+        gwInfo->txBroken = false;
     }
+    pthread_mutex_unlock(&mutexGateWayList);
 
+    return gwInfo;
 }
 
 /******************************************************************************
@@ -132,6 +146,36 @@ GateWayInfo_t *FindGateWay(int socket) {
     return NULL;
 }
 
+/******************************************************************************
+ * Function Name        : SnapshotGateWays
+ * Input Parameters     : MacSnapshot_t *snap - Snapshot being filled
+ * Return Value         : None
+ * Function Description : Copy the gateway list to a snapshot, under the list lock.
+ *                        The stream counters are those of the ingest workers.
+ ******************************************************************************/
+void SnapshotGateWays(MacSnapshot_t *snap) {
+    GateWayInfo_t *gwInfo;
+    MacSnapGateway_t *row;
+    int n = 0;
+
+    pthread_mutex_lock(&mutexGateWayList);
+    for (gwInfo = GW_HEAD.next; gwInfo != NULL; gwInfo = gwInfo->next) {
+        if (n < MAC_SNAP_MAX_GATEWAYS) {
+            row = &snap->gateways[n];
+            row->socket = gwInfo->socket;
+            row->addr = gwInfo->sockaddr.sin_addr;
+            row->linkCaps = gwInfo->linkCaps;
+            row->worker = gwInfo->worker;
+            row->rxFrames = gwInfo->rxStream.nb_frames;
+            row->rxDropped = gwInfo->rxStream.nb_dropped;
+            row->rxPending = gwInfo->rxStream.len - gwInfo->rxStream.rd;
+        }
+        n++;
+    }
+    pthread_mutex_unlock(&mutexGateWayList);
+    snap->nboGateways = (uint16_t)n;
+}
+
 /******************************************************************************
  * Function Name        : RemoveGateWay
  * Input Parameters     : int socket      - Gateway Socket Number
@@ -141,6 +185,9 @@ GateWayInfo_t *FindGateWay(int socket) {
 void RemoveGateWay(int socket) {
     GateWayInfo_t *gwInfo;
     GateWayInfo_t *gwInfo_prev;
+
+    // Several ingest workers may remove their gateways at the same time
+    pthread_mutex_lock(&mutexGateWayList);
     gwInfo = GW_HEAD.next;
     gwInfo_prev = &GW_HEAD;
 
@@ -148,20 +195,50 @@ void RemoveGateWay(int socket) {
         if (gwInfo->socket == socket) {
             dprintf("Gateway(socket = %d, IP = %s) Information will be removed..\n", gwInfo->socket, inet_ntoa(gwInfo->sockaddr.sin_addr));
             gwInfo_prev->next = gwInfo->next;
+            pthread_mutex_destroy(&gwInfo->txMutex);
             free(gwInfo);
 
             // GW information will be removed in the End Device Information
             RemoveGateWayFromEndDevice(socket);
 
+            pthread_mutex_unlock(&mutexGateWayList);
             return;
         }
         gwInfo_prev = gwInfo;
         gwInfo = gwInfo->next;
     }
+    pthread_mutex_unlock(&mutexGateWayList);
 
     dprintf("We cannot find Gateway information..\n");
 }
 
+/******************************************************************************
+ * Function Name        : SendToGateWay
+ * Input Parameters     : GateWayInfo_t *gwInfo - Gateway Information Structure pointer
+ *                      : const uint8_t *frame  - Frame, header included
+ *                      : uint32_t frame_len    - Frame size
+ * Return Value         : int - 0 on success, -1 if the frame was not (fully) sent
+ * Function Description : Send a whole frame to a gateway, under its own send lock.
+ *                        A gateway that stops reading only costs GW_SEND_TIMEOUT_MS once:
+ *                        part of a frame may be on the stream, so the connection is shut
+ *                        down and its ingest worker removes it on the resulting hang-up.
+ ******************************************************************************/
+int SendToGateWay(GateWayInfo_t *gwInfo, const uint8_t *frame, uint32_t frame_len) {
+    int ret = -1;
+
+    pthread_mutex_lock(&gwInfo->txMutex);
+    if (!gwInfo->txBroken) {
+        ret = frame_send_timeout(gwInfo->socket, frame, frame_len, GW_SEND_TIMEOUT_MS);
+        if (ret != 0) {
+            gwInfo->txBroken = true;
+            shutdown(gwInfo->socket, SHUT_RDWR);
+            dprintf("Gateway(socket = %d, IP = %s) send failed, disconnected\n", gwInfo->socket, inet_ntoa(gwInfo->sockaddr.sin_addr));
+        }
+    }
+    pthread_mutex_unlock(&gwInfo->txMutex);
+    return ret;
+}
+
 
 
 /*
@@ -236,6 +313,7 @@ EndDeviceInfo_t *AddEndDeviceInfo(uint32_t address, int gwSocket, LoRaJoinReqMsg
 
         memcpy(edInfo->DevNonce, rxMsg.DevNonce, 2);
         memcpy(edInfo->DevEUI, deui, 8);
+        SetEndDeviceSessionKeys(edInfo, NwkSKey, AppSKey);
 
         // Primary GW
         edInfo->gw[0].socket = gwSocket;
@@ -322,6 +400,21 @@ EndDeviceInfo_t *AddEndDeviceInfo(uint32_t address, int gwSocket, LoRaJoinReqMsg
     }
 }
 
+/******************************************************************************
+ * Function Name        : SetEndDeviceSessionKeys
+ * Input Parameters     : EndDeviceInfo_t *edInfo - End Device Information
+ *                      : const uint8_t *nwkSKey  - NWKSKEY
+ *                      : const uint8_t *appSKey  - APPSKEY
+ * Return Value         : None
+ * Function Description : Store the session keys of a device and expand them in its
+ *                      : session context, used by every uplink and downlink
+ ******************************************************************************/
+void SetEndDeviceSessionKeys(EndDeviceInfo_t *edInfo, const uint8_t *nwkSKey, const uint8_t *appSKey) {
+    memcpy(edInfo->NwkSKey, nwkSKey, 16);
+    memcpy(edInfo->AppSKey, appSKey, 16);
+    InitSessionCtx(&edInfo->session, edInfo->NwkSKey, edInfo->AppSKey);
+}
+
 /******************************************************************************
  * Function Name        : RxEndDeviceInfoUpdate
  * Input Parameters     : uint32_t address - End Device Address
@@ -359,6 +452,7 @@ void RxEndDeviceInfoUpdate(uint32_t address, int gwSocket, int16_t rssi, int8_t
         edInfo->devsf = sf;
         edInfo->devch = ch;
         edInfo->devbw = bw;
+        SetEndDeviceSessionKeys(edInfo, NwkSKey, AppSKey);
 
         // Primary GW
         edInfo->gw[0].socket = gwSocket;
@@ -672,33 +766,10 @@ void WriteEndDevices(int fd, int gwsocket) {
 }
 
 void ShowGateWays() {
-    GateWayInfo_t *gwInfo;
-    gwInfo = GW_HEAD.next;
-    int i;
-
-    printf("Gateway Information\n");
+    static MacSnapshot_t snap;    // too large for the stack of the input thread
 
-    if (gwInfo == NULL) {
-        printf(" - Empty..\n\n");
-        return;
-    }
-    while (gwInfo != NULL) {
-        printf("GW Socket Number : %d\n", gwInfo->socket);
-        printf("GW IP Address    : %s\n", inet_ntoa(gwInfo->sockaddr.sin_addr));
-        printf("GW Rx Buffer Size: %d\n", gwInfo->currentRxBufferSize);
-        if (gwInfo->currentRxBufferSize > 0) {
-            printf("   00 01 02 03 04 05 06 07 08 09 0A 0B 0C 0D 0E 0F");
-            for (i = 0; i < gwInfo->currentRxBufferSize; i++) {
-                if ((i % 16) == 0) {
-                    printf("\n%01X0 ", (int) (i / 16));
-                }
-                printf("%02X ", gwInfo->rxBuffer[i]);
-            }
-            printf("\n");
-        }
-
-        gwInfo = gwInfo->next;
-    }
+    macSnapshotRead(&macSnapshot, &snap);
+    macSnapshotPrintGateways(&snap, stdout);
 }
 
 void PreConfigNode(void) {
@@ -733,10 +804,7 @@ void PreConfigNode(void) {
         edInfo->DevNonce[0] = 0;
         edInfo->DevNonce[1] = i;
 
-        for (j = 0; j < 16; j++) {
-            edInfo->AppSKey[j] = AppSKey[j];
-            edInfo->NwkSKey[j] = NwkSKey[j];
-        }
+        SetEndDeviceSessionKeys(edInfo, NwkSKey, AppSKey);
 
         edInfo->devcr = 1;
         edInfo->devsf = 7;
@@ -1311,6 +1379,7 @@ void NodeExp(int gwSocket) {
     edInfo->NwkSKey[13] = 0x60;
     edInfo->NwkSKey[14] = 0xf9;
     edInfo->NwkSKey[15] = 0xcc;
+    InitSessionCtx(&edInfo->session, edInfo->NwkSKey, edInfo->AppSKey);
     // Primary GW
     edInfo->gw[0].socket = gwSocket;
     edInfo->gw[0].rssi = -200;
@@ -1393,6 +1462,7 @@ void NodeExp(int gwSocket) {
     edInfo->NwkSKey[13] = 0xb5;
     edInfo->NwkSKey[14] = 0x8b;
     edInfo->NwkSKey[15] = 0x3f;
+    InitSessionCtx(&edInfo->session, edInfo->NwkSKey, edInfo->AppSKey);
 
     // Primary GW
     edInfo->gw[0].socket = gwSocket;
@@ -21,9 +21,14 @@
 #include <sys/socket.h>
 #include <time.h>
 #include <sys/types.h>
+#include <pthread.h>
 #include "lora_mac.h"
+#include "crypto.h"
+#include "frame_stream.h"
+#include "mac_snapshot.h"
 
 #define TCP_STREAM_BUFFER_SIZE	8192
+#define GW_SEND_TIMEOUT_MS	5	// a gateway whose send buffer stays full longer is disconnected
 
 typedef struct GateWayInfo{
 	struct GateWayInfo *next;
@@ -31,8 +36,16 @@ typedef struct GateWayInfo{
 	struct sockaddr_in sockaddr;
 	uint8_t rxBuffer[TCP_STREAM_BUFFER_SIZE];
 	uint32_t currentRxBufferSize;
+	struct frame_stream_s rxStream;	// frame reassembly over rxBuffer
+	uint8_t linkCaps;	// LINK_CAP_xxx accepted at PKT_HELLO
+	uint8_t worker;		// ingest worker owning the socket, and its inbound queue
+	pthread_mutex_t txMutex;	// held by SendToGateWay, frames of the ingest worker and of the downstream thread must not interleave
+	bool txBroken;		// a frame was not fully sent, nothing more is sent until the connection is removed
 }GateWayInfo_t;
 
+/* Taken by AddGateWay/RemoveGateWay, and by the threads walking the gateway list */
+extern pthread_mutex_t mutexGateWayList;
+
 typedef struct GatewayRxInfo{
 	int socket;
 	int16_t rssi;
@@ -63,6 +76,7 @@ typedef struct EndDeviceInfo{
 	uint8_t AppSKey[16];
 	uint8_t DevNonce[2];
 	GateWayRxInfo_t gw[2];
+	LoRaSessionCtx_t session;	// NwkSKey / AppSKey expanded, see SetEndDeviceSessionKeys
 }EndDeviceInfo_t;
 
 
@@ -92,10 +106,10 @@ void DeinitGateWayInfo(void);
 * Function Name        : AddGateWay
 * Input Parameters     : int clntsocket                 - Gateway Socket Number
 *                      : struct sockaddr_in clntAddress - Gateway Address Info
-* Return Value         : None
+* Return Value         : GateWayInfo_t * - Gateway Information Structure pointer, NULL on failure
 * Function Description : New Gateway registration..
 ******************************************************************************/
-void AddGateWay(int clntsocket, struct sockaddr_in clntAddress);
+GateWayInfo_t *AddGateWay(int clntsocket, struct sockaddr_in clntAddress);
 
 /******************************************************************************
 * Function Name        : FindGateWay
@@ -114,6 +128,17 @@ GateWayInfo_t *FindGateWay(int socket);
 ******************************************************************************/
 void RemoveGateWay(int socket);
 
+/******************************************************************************
+* Function Name        : SendToGateWay
+* Input Parameters     : GateWayInfo_t *gwInfo - Gateway Information Structure pointer
+*                      : const uint8_t *frame  - Frame, header included
+*                      : uint32_t frame_len    - Frame size
+* Return Value         : int - 0 on success, -1 if the frame was not (fully) sent
+* Function Description : Send a whole frame to a gateway, the only way to write to its socket.
+*                        On failure the connection is shut down, its ingest worker then removes it.
+******************************************************************************/
+int SendToGateWay(GateWayInfo_t *gwInfo, const uint8_t *frame, uint32_t frame_len);
+
 
 //*********************************************************************************************************
 //*  End Device Related Codes are here..
@@ -147,6 +172,17 @@ void DeinitEndDeviceInfo(void);
 ******************************************************************************/
 EndDeviceInfo_t *AddEndDeviceInfo(uint32_t address, int gwSocket, LoRaJoinReqMsg_t rxMsg, int16_t rssi, int8_t snr, uint8_t cr, uint8_t sf, uint32_t ch, uint8_t bw, uint8_t* deui);
 
+/******************************************************************************
+* Function Name        : SetEndDeviceSessionKeys
+* Input Parameters     : EndDeviceInfo_t *edInfo - End Device Information
+*                      : const uint8_t *nwkSKey  - NWKSKEY
+*                      : const uint8_t *appSKey  - APPSKEY
+* Return Value         : None
+* Function Description : Store the session keys of a device and expand them in its
+*                      : session context, used by every uplink and downlink
+******************************************************************************/
+void SetEndDeviceSessionKeys(EndDeviceInfo_t *edInfo, const uint8_t *nwkSKey, const uint8_t *appSKey);
+
 /******************************************************************************
 * Function Name        : RxEndDeviceInfoUpdate
 * Input Parameters     : uint32_t address - End Device Address
@@ -184,6 +220,14 @@ int FindGWSocket(uint32_t address);
 ******************************************************************************/
 void RemoveGateWayFromEndDevice(int socket);
 
+/******************************************************************************
+* Function Name        : SnapshotGateWays
+* Input Parameters     : MacSnapshot_t *snap - Snapshot being filled
+* Return Value         : None
+* Function Description : Copy the gateway list to a snapshot, under the list lock
+******************************************************************************/
+void SnapshotGateWays(MacSnapshot_t *snap);
+
 //*********************************************************************************************************
 //*  Visualization Related Codes are here..
 //*********************************************************************************************************
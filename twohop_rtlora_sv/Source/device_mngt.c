@@ -16,10 +16,13 @@
 #include "debug.h"
 #include "trade.h"
 #include "rtlora_mac.h"
+#include "async_log.h"
 
 #define POW2(n)             (1 << n)
 
-extern FILE * log_file;
+
+static MngtNode_t mngtNodeStorage[TWOHOP_MNGT_NODE_POOL_SIZE];
+MemPool_t mngtNodePool = MEM_POOL_INITIALIZER("MngtNode", mngtNodeStorage, TWOHOP_MNGT_NODE_POOL_SIZE);
 
 void initNodeList(MngtNodeList_t *lst, _Bool sort) {
 //    dprintf("Init node list %s\n", name);
@@ -29,6 +32,9 @@ void initNodeList(MngtNodeList_t *lst, _Bool sort) {
     lst->size = 0;
     lst->nboSchReq = 0;
     lst->sort = sort;
+    memset(lst->index, 0, sizeof(lst->index));
+    memset(lst->dmnTail, 0, sizeof(lst->dmnTail));
+    memset(lst->dmnMap, 0, sizeof(lst->dmnMap));
 }
 
 void deinitNodeList(MngtNodeList_t *lst) {
@@ -39,15 +45,13 @@ void deinitNodeList(MngtNodeList_t *lst) {
         if(node == NULL)
             break;
         lst->head = node->next;
-        free(node);
+        destroyNode(node);
     }
-    lst->head = NULL;
-    lst->tail = NULL;
-    lst->size = 0;
+    initNodeList(lst, lst->sort);
 }
 
 MngtNode_t * createNewNode(NodeGenInfo_t genInfo, uint16_t parrent){
-    MngtNode_t *newNode = (MngtNode_t *) malloc(sizeof(MngtNode_t));
+    MngtNode_t *newNode = (MngtNode_t *) memPoolAlloc(&mngtNodePool);
     
     if(newNode == NULL){
         MSG_DEBUG(DEBUG_DEVICE_MNGT, "Failed to create a new node\n");
@@ -77,61 +81,108 @@ MngtNode_t * createNewNode(NodeGenInfo_t genInfo, uint16_t parrent){
     return newNode;
 }
 
+void destroyNode(MngtNode_t *node){
+    memPoolFree(&mngtNodePool, node);
+}
+
+/* --- ADDRESS AND DEMAND INDEXES ------------------------------------------- */
+/* 
+ * index[] gives the node of an address in O(1). A sorted list is kept in the
+ * order of decreasing slot demand, nodes of the same demand in insertion
+ * order. dmnTail[] is the last node of each demand present in the list, a new
+ * node is linked after the last node of the nearest demand greater or equal to
+ * its own, found in the dmnMap bitmap.
+ */
+
+static inline MngtNode_t* dmLookup(MngtNodeList_t *lst, uint16_t addr){
+    return (addr < TWOHOP_NODE_ADDR_SPACE) ? lst->index[addr] : NULL;
+}
+
+// Smallest slot demand >= dmn present in the list, -1 if none
+static int dmNextDemand(MngtNodeList_t *lst, unsigned int dmn){
+    unsigned int w = dmn / 64;
+    uint64_t bits = lst->dmnMap[w] & (~(uint64_t)0 << (dmn % 64));
+
+    while(bits == 0){
+        if(++w == DM_NBO_DEMANDS / 64)
+            return -1;
+        bits = lst->dmnMap[w];
+    }
+    return w * 64 + __builtin_ctzll(bits);
+}
+
+// Link node after prev, at the head if prev is NULL
+static void dmLinkAfter(MngtNodeList_t *lst, MngtNode_t *prev, MngtNode_t *node){
+    node->prev = prev;
+    if(prev == NULL){
+        node->next = lst->head;
+        lst->head = node;
+    } else {
+        node->next = prev->next;
+        prev->next = node;
+    }
+    if(node->next != NULL)
+        node->next->prev = node;
+    else
+        lst->tail = node;
+}
+
+static void dmUnlink(MngtNodeList_t *lst, MngtNode_t *node){
+    if(lst->sort && (lst->dmnTail[node->listDmn] == node)){
+        if((node->prev != NULL) && (node->prev->listDmn == node->listDmn)){
+            lst->dmnTail[node->listDmn] = node->prev;
+        } else {
+            lst->dmnTail[node->listDmn] = NULL;
+            lst->dmnMap[node->listDmn / 64] &= ~((uint64_t)1 << (node->listDmn % 64));
+        }
+    }
+    
+    if(node->prev != NULL)
+        node->prev->next = node->next;
+    else
+        lst->head = node->next;
+    if(node->next != NULL)
+        node->next->prev = node->prev;
+    else
+        lst->tail = node->prev;
+    
+    lst->index[node->genInfo.addr] = NULL;
+    node->next = NULL;
+    node->prev = NULL;
+    lst->size --;
+    if(node->schFlag == false)
+        lst->nboSchReq--;
+}
+
 // if push done: return 1
 // if node existed: return 0
 int pushNode(MngtNodeList_t *lst, MngtNode_t *node){
-    MngtNode_t *curNode = lst->head;
+    int above;
+    
     if(isNodeExisted(lst, node->genInfo.addr)){
         dmNodeUpdateGenInfo(lst, node);
-        free(node);
+        destroyNode(node);
         return 0;
     }
-    
-    if(curNode == NULL) { // list is null currently
-        lst->tail = node;
-        lst->head = node;
-        node->next = NULL;
-        node->prev = NULL;
-        goto succeeded;
+    if(node->genInfo.addr >= TWOHOP_NODE_ADDR_SPACE){
+        MSG("[MAC] Node address %hu is out of the address space.\n", node->genInfo.addr);
+        destroyNode(node);
+        return 0;
     }
     
     if(lst->sort == false){
         /* Insert packet at the end of the list */
-        lst->tail->next = node;
-        node->next = NULL;
-        node->prev = lst->tail;
-        lst->tail = node;
-        goto succeeded;
+        dmLinkAfter(lst, lst->tail, node);
+    } else {
+        /* after the nodes of the same or of a greater slot demand */
+        node->listDmn = node->genInfo.slotDmn;
+        above = dmNextDemand(lst, node->listDmn);
+        dmLinkAfter(lst, (above < 0) ? NULL : lst->dmnTail[above], node);
+        lst->dmnTail[node->listDmn] = node;
+        lst->dmnMap[node->listDmn / 64] |= (uint64_t)1 << (node->listDmn % 64);
     }
     
-    while(1) {
-        if(curNode->genInfo.slotDmn < node->genInfo.slotDmn) { 
-            if(curNode == lst->head) {
-                // node becomes list's head
-                lst->head = node;
-                node->prev = NULL;
-            } else {
-                //push in the middle of list
-                MngtNode_t *prev = curNode->prev;
-                node->prev = prev;
-                prev->next = node;
-            }
-            curNode->prev = node;
-            node->next = curNode;
-            goto succeeded;
-        } else {
-            if(curNode->next == NULL) { 
-                // node becomes list's tail
-                lst->tail = node;
-                curNode->next = node;
-                node->prev = curNode;
-                node->next = NULL;
-                goto succeeded;
-            }
-            curNode = curNode->next;
-        }
-    }
-succeeded:
+    lst->index[node->genInfo.addr] = node;
     if(node->schFlag == false)
         lst->nboSchReq++;
     lst->size ++;
@@ -144,66 +195,24 @@ MngtNode_t* popHeadNode(MngtNodeList_t *lst){
     if(retNode == NULL)
         return NULL;
     
-    lst->head = retNode->next;
-    if(lst->head != NULL)
-        lst->head->prev = NULL;
-    
-    retNode->next = NULL;
-    retNode->prev = NULL;
-    lst->size --;
-    if(retNode->schFlag == false)
-        lst->nboSchReq--;
+    dmUnlink(lst, retNode);
     return retNode; 
 }
 
 MngtNode_t* popTailNode(MngtNodeList_t *lst) {
     MngtNode_t* retNode = lst->tail;
-    if(lst->size == 0)
+    if(retNode == NULL)
         return NULL;
     
-    lst->tail = retNode->prev;
-    lst->tail->next = NULL;
-    retNode->next = NULL;
-    retNode->prev = NULL;
-    lst->size --;
-    if(retNode->schFlag == false)
-        lst->nboSchReq--;
+    dmUnlink(lst, retNode);
     return retNode;
 }
 
 MngtNode_t* popNodeByAddress(MngtNodeList_t *lst, uint16_t addr){
-    MngtNode_t* retNode = NULL;
+    MngtNode_t* retNode = dmLookup(lst, addr);
     
-    MngtNode_t *curNode = lst->head;
-    while(1) {
-        if(curNode == NULL)
-            break;
-        
-        if(curNode->genInfo.addr == addr){
-            if(curNode == lst->head)
-                lst->head = curNode->next;
-            
-            if(curNode == lst->tail)
-                lst->tail = curNode->prev;
-            
-            retNode = curNode;
-            
-            if(retNode->prev != NULL)
-                retNode->prev->next = retNode->next;         
-            
-            if(retNode->next != NULL)
-                retNode->next->prev = retNode->prev;
-            
-            retNode->next = NULL;
-            retNode->prev = NULL;
-            if(retNode->schFlag == false)
-                lst->nboSchReq--;
-            
-            lst->size --;
-            break;
-        }
-        curNode = curNode->next;
-    }
+    if(retNode != NULL)
+        dmUnlink(lst, retNode);
     return retNode;
 }
 
@@ -212,13 +221,7 @@ MngtNode_t* dmGetHeadNodeRef(MngtNodeList_t *lst){
 }
 
 MngtNode_t* getNodeReferenceByAddress(MngtNodeList_t *lst, uint16_t addr){
-    MngtNode_t *curNode = lst->head;
-    while(curNode != NULL){
-        if(curNode->genInfo.addr == addr)
-            return curNode;
-        curNode = curNode->next;
-    }
-    return NULL;
+    return dmLookup(lst, addr);
 }
 
 // Return the reference to the next node of curNode
@@ -229,16 +232,10 @@ MngtNode_t* dmGetRefToNextNode(MngtNode_t* curNode){
 }
 
 _Bool dmIsRelayNode(MngtNodeList_t *lst, uint16_t addr){
-    MngtNode_t *curNode = lst->head;
-    while(curNode != NULL){
-        if(curNode->genInfo.addr == addr){
-            if(curNode->nboChildren > 0)
-                return true;
-            else
-                return false;
-        }
-        curNode = curNode->next;
-    }
+    MngtNode_t *curNode = dmLookup(lst, addr);
+    
+    if((curNode != NULL) && (curNode->nboChildren > 0))
+        return true;
     return false;
 }
 
@@ -254,23 +251,19 @@ uint8_t dmGetNboRelays(MngtNodeList_t *lst){
 }
 
 uint8_t dmNodeGetClass(MngtNodeList_t *lst, uint16_t addr){
-    MngtNode_t *curNode = lst->head;
-    while(curNode != NULL){
-        if(curNode->genInfo.addr == addr)
-            return curNode->genInfo.class;
-        curNode = curNode->next;
-    }
+    MngtNode_t *curNode = dmLookup(lst, addr);
+    
+    if(curNode != NULL)
+        return curNode->genInfo.class;
     return 0;
 }
 
 Child_t* dmNodeGetChildList(MngtNodeList_t *lst, uint16_t addr, uint8_t* nboChild){
-    MngtNode_t *curNode = lst->head;
-    while(curNode != NULL){
-        if(curNode->genInfo.addr == addr){
-            *nboChild = curNode->nboChildren;
-            return curNode->children;
-        }
-        curNode = curNode->next;
+    MngtNode_t *curNode = dmLookup(lst, addr);
+    
+    if(curNode != NULL){
+        *nboChild = curNode->nboChildren;
+        return curNode->children;
     }
     return NULL;
 }
@@ -281,7 +274,8 @@ void dmSetChildConnStatus(MngtNodeList_t *lst, MngtNode_t *node, _Bool status){
     for(int i = 0; i < TWOHOP_MAX_NBO_CHILDREN; i++){
         if(node->children[i].addr != 0){
             child = getNodeReferenceByAddress(lst, node->children[i].addr);
-            child->isConnected = status;
+            if(child != NULL)
+                child->isConnected = status;
             nboChild--;
         }
         if(nboChild == 0)
@@ -290,48 +284,43 @@ void dmSetChildConnStatus(MngtNodeList_t *lst, MngtNode_t *node, _Bool status){
 }
 
 void dmNodeUpdateDataInfo(MngtNodeList_t *lst, uint16_t addr, uint16_t seq, bool isDataRelay){
-    MngtNode_t *curNode = lst->head;
+    MngtNode_t *curNode = dmLookup(lst, addr);
     bool duplicated = false;
-    while(curNode != NULL){
-        if(curNode->genInfo.addr == addr){
-            if(curNode->latestSeqNo < seq){
-                curNode->dataCount++;
-                curNode->latestSeqNo = seq;
-                curNode->dataMissCount = 0;
-            } else if (curNode->latestSeqNo > seq){
-                // reset statistic
-                curNode->dataCount = 1;
-                curNode->dataCountMainLink = 0;
-                curNode->dataCountDirectLink = 0;
-                curNode->latestSeqNo = seq;
-                curNode->dataMissCount = 0;
-                curNode->prevSeqNo = seq - 1;
-            } else {
-                // Receive duplicate data, do nothing 
-                duplicated = true;
-            }
-            
-            // Check whether the DATA is receive via main link or support link
-            if(curNode->genInfo.type == Node_Type_Onehop){
-                if(isDataRelay == false){
-                    curNode->dataCountMainLink++;
-                    curNode->dataCountDirectLink++;
-                }
-            }
+    if(curNode == NULL)
+        return;
+    
+    if(curNode->latestSeqNo < seq){
+        curNode->dataCount++;
+        curNode->latestSeqNo = seq;
+        curNode->dataMissCount = 0;
+    } else if (curNode->latestSeqNo > seq){
+        // reset statistic
+        curNode->dataCount = 1;
+        curNode->dataCountMainLink = 0;
+        curNode->dataCountDirectLink = 0;
+        curNode->latestSeqNo = seq;
+        curNode->dataMissCount = 0;
+        curNode->prevSeqNo = seq - 1;
+    } else {
+        // Receive duplicate data, do nothing 
+        duplicated = true;
+    }
+    
+    // Check whether the DATA is receive via main link or support link
+    if(curNode->genInfo.type == Node_Type_Onehop){
+        if(isDataRelay == false){
+            curNode->dataCountMainLink++;
+            curNode->dataCountDirectLink++;
+        }
+    }
 
-            if((curNode->genInfo.type == Node_Type_Twohop) ){
-                if(isDataRelay == true){
-                    curNode->dataCountMainLink++;
-                } else {
-                    curNode->dataCountDirectLink++;
-                }
-            }
-            
-            return;
+    if((curNode->genInfo.type == Node_Type_Twohop) ){
+        if(isDataRelay == true){
+            curNode->dataCountMainLink++;
+        } else {
+            curNode->dataCountDirectLink++;
         }
-        curNode = curNode->next;
     }
-    return;
 }
 
 uint8_t dmCheckDataMissed(MngtNodeList_t *lst){
@@ -367,13 +356,7 @@ void dmSetSchFlagAll(MngtNodeList_t *lst, _Bool val){
 }
 
 _Bool isNodeExisted(MngtNodeList_t *lst, uint16_t addr){
-    MngtNode_t *curNode = lst->head;
-    while(curNode != NULL){
-        if(curNode->genInfo.addr == addr)
-            return true;
-        curNode = curNode->next;
-    }
-    return false;
+    return (dmLookup(lst, addr) != NULL) ? true : false;
 }
 
 _Bool dmNodeUpdateGenInfo(MngtNodeList_t *lst, MngtNode_t *node) {
@@ -459,29 +442,18 @@ void printNodeList(MngtNodeList_t *lst){
     MngtNode_t *curNode = lst->head;
     float PDR, PDRMainLink, PDRDirectLink;
     
-    printf("\t\t\t\t--- NODE INFORMATION (%u NODES) ---\n", lst->size);
-    fprintf(log_file, "\t\t\t\t--- NODE INFORMATION (%u NODES) ---\n", lst->size);
+    LOG_MSG(LOG_LVL_INFO, "\t\t\t\t--- NODE INFORMATION (%u NODES) ---\n", lst->size);
     if(curNode == NULL){
-        printf("Empty ...\n\n");
-        fprintf(log_file, "Empty ...\n\n");
+        LOG_MSG(LOG_LVL_INFO, "Empty ...\n\n");
         return;
     }
-    printf("ONE-HOP NODES\n");
-    fprintf(log_file, "ONE-HOP NODES\n");
-    printf("\tNodeID\t\tSch?\t\tSlotDemand\tClass\t\tDataCount\tLatestSeqNo\tPRD\t\tMissedCnt\n");
-    fprintf(log_file,"\tNodeID\tSch?\t\tSlotDemand\tClass\tDataCount\tLatestSeqNo\tPRD\t\tMissedCnt\n");
+    LOG_MSG(LOG_LVL_INFO, "ONE-HOP NODES\n");
+    LOG_MSG(LOG_LVL_INFO, "\tNodeID\t\tSch?\t\tSlotDemand\tClass\t\tDataCount\tLatestSeqNo\tPRD\t\tMissedCnt\n");
     while(1) {
         if(curNode == NULL){
             break;
         }
         if(curNode->genInfo.type == Node_Type_Onehop){
-            printf("\t%hu", curNode->genInfo.addr);
-            if(curNode->nboChildren > 0)
-                printf(" (R)");
-            printf("\t\t%s", curNode->schFlag ? "true" : "false");
-            printf("\t\t%hhu\t\t%hhu",curNode->genInfo.slotDmn, curNode->genInfo.class);
-            printf("\t\t%hu (%hu) (%hu)\t\t%hu",curNode->dataCount, curNode->dataCountDirectLink, \
-                    curNode->dataCountMainLink, curNode->latestSeqNo);
             if(curNode->latestSeqNo != 0){
                 PDR = (float)curNode->dataCount/(curNode->latestSeqNo * 1.0)*100;
                 PDRDirectLink = (float)curNode->dataCountDirectLink/(curNode->latestSeqNo * 1.0)*100;
@@ -491,45 +463,24 @@ void printNodeList(MngtNodeList_t *lst){
                 PDRDirectLink = 0.0;
                 PDRMainLink = 0.0;
             }
-            printf("\t\t%.1f (%.1f) (%.1f)", PDR, PDRDirectLink, PDRMainLink);
-            
-            printf("\t%u",curNode->dataMissCount);
-            if(curNode->isConnected == false)
-                printf("(DIST)");
-            printf("\n");
-            
-            fprintf(log_file, "\t%hu", curNode->genInfo.addr);
-            if(curNode->nboChildren > 0)
-                fprintf(log_file, " (R)");
-            fprintf(log_file, "\t\t%s", curNode->schFlag ? "true" : "false");
-            fprintf(log_file, "\t\t%hhu\t\t\t%hhu",curNode->genInfo.slotDmn, curNode->genInfo.class);
-            fprintf(log_file, "\t\t%hu (%hu) (%hu)\t\t%hu",curNode->dataCount, curNode->dataCountDirectLink, \
-                    curNode->dataCountMainLink, curNode->latestSeqNo);
-            fprintf(log_file, "\t\t\t%.1f (%.1f) (%.1f)", PDR, PDRDirectLink, PDRMainLink);
-            fprintf(log_file, "\t%u",curNode->dataMissCount);
-            if(curNode->isConnected == false)
-                fprintf(log_file, "(DIST)");
-            fprintf(log_file, "\n");
+            // one record per row, rows of other threads do not cut it
+            LOG_MSG(LOG_LVL_INFO, "\t%hu%s\t\t%s\t\t%hhu\t\t%hhu\t\t%hu (%hu) (%hu)\t\t%hu\t\t%.1f (%.1f) (%.1f)\t%u%s\n", \
+                    curNode->genInfo.addr, (curNode->nboChildren > 0) ? " (R)" : "", curNode->schFlag ? "true" : "false", \
+                    curNode->genInfo.slotDmn, curNode->genInfo.class, curNode->dataCount, curNode->dataCountDirectLink, \
+                    curNode->dataCountMainLink, curNode->latestSeqNo, PDR, PDRDirectLink, PDRMainLink, \
+                    curNode->dataMissCount, (curNode->isConnected == false) ? "(DIST)" : "");
         }
         curNode = curNode->next;
     }
     
     curNode = lst->head;
-    printf("TWO-HOP NODES\n");
-    printf("\tNodeID\t\t\t\tSlotDemand\tClass\t\tDataCount\tLatestSeqNo\tPRD\t\tMissedCnt\n");
-    
-    fprintf(log_file, "TWO-HOP NODES\n");
-    fprintf(log_file, "\tNodeID\t\t\tSlotDemand\tClass\t\tDataCount\tLatestSeqNo\tPRD\t\tMissedCnt\n");
+    LOG_MSG(LOG_LVL_INFO, "TWO-HOP NODES\n");
+    LOG_MSG(LOG_LVL_INFO, "\tNodeID\t\t\t\tSlotDemand\tClass\t\tDataCount\tLatestSeqNo\tPRD\t\tMissedCnt\n");
     while(1) {
         if(curNode == NULL){
             break;
         }
         if(curNode->genInfo.type == Node_Type_Twohop){
-            printf("\t%hu (%hu)", curNode->genInfo.addr, curNode->parrentAddr);
-            printf("\t\t");
-            printf("\t\t%hhu\t\t%hhu", curNode->genInfo.slotDmn, curNode->genInfo.class);
-            printf("\t\t%hu (%hu) (%hu)\t\t%hu",curNode->dataCount, curNode->dataCountDirectLink, \
-                    curNode->dataCountMainLink, curNode->latestSeqNo);
             if(curNode->latestSeqNo != 0){
                 PDR = (float)curNode->dataCount/(curNode->latestSeqNo * 1.0)*100;
                 PDRDirectLink = (float)curNode->dataCountDirectLink/(curNode->latestSeqNo * 1.0)*100;
@@ -539,27 +490,12 @@ void printNodeList(MngtNodeList_t *lst){
                 PDRDirectLink = 0.0;
                 PDRMainLink = 0.0;
             }
-            printf("\t\t%.1f (%.1f) (%.1f)", PDR, PDRDirectLink, PDRMainLink);
-            printf("\t%u",curNode->dataMissCount);
-            if(curNode->isConnected == false)
-                printf("(DIST)");
-            printf("\n");
-            
-            fprintf(log_file, "\t%hu (%hu)", curNode->genInfo.addr, curNode->parrentAddr);
-            fprintf(log_file, "\t\t");
-            fprintf(log_file, "\t\t%hhu\t\t%hhu", curNode->genInfo.slotDmn, curNode->genInfo.class);
-            fprintf(log_file, "\t\t%hu (%hu) (%hu)\t\t%hu",curNode->dataCount, curNode->dataCountDirectLink, \
-                    curNode->dataCountMainLink, curNode->latestSeqNo);
-            fprintf(log_file, "\t\t\t%.1f (%.1f) (%.1f)", PDR, PDRDirectLink, PDRMainLink);
-            fprintf(log_file, "\t\t%u",curNode->dataMissCount);
-            if(curNode->isConnected == false)
-                fprintf(log_file, "(DIST)");
-            fprintf(log_file, "\n");
+            LOG_MSG(LOG_LVL_INFO, "\t%hu (%hu)\t\t\t\t%hhu\t\t%hhu\t\t%hu (%hu) (%hu)\t\t%hu\t\t%.1f (%.1f) (%.1f)\t%u%s\n", \
+                    curNode->genInfo.addr, curNode->parrentAddr, curNode->genInfo.slotDmn, curNode->genInfo.class, \
+                    curNode->dataCount, curNode->dataCountDirectLink, curNode->dataCountMainLink, curNode->latestSeqNo, \
+                    PDR, PDRDirectLink, PDRMainLink, curNode->dataMissCount, (curNode->isConnected == false) ? "(DIST)" : "");
         }
         curNode = curNode->next;
     }
-    printf("\t\t\t\t-----------------------------------\n");
-    printf("\n");
-    fprintf(log_file, "\t\t\t\t-----------------------------------\n");
-    fprintf(log_file, "\n");
+    LOG_MSG(LOG_LVL_INFO, "\t\t\t\t-----------------------------------\n\n");
 }
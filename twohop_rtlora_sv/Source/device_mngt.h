@@ -22,6 +22,7 @@
 //#include <sys/socket.h>
 
 #include "rtlora_mac_conf.h"
+#include "mem_pool.h"
 
 //#define TCP_STREAM_BUFFER_SIZE	8192
 
@@ -69,24 +70,39 @@ typedef struct MngtNode_{
     uint16_t dataCountDirectLink;     // Total data count (both main link and support link (if 2 hop type))
     uint16_t prevSeqNo; // Data count of the previous frame period
 
+    uint8_t listDmn;        // slot demand the node has been sorted with, genInfo.slotDmn may change in place
+
     struct MngtNode_ *next;
     struct MngtNode_ *prev;
 }MngtNode_t;
 
+#define DM_NBO_DEMANDS      256     // slot demand values of a uint8_t
+
 typedef struct MngtNodeList_{
 //    char name[20];
     MngtNode_t *head;
     MngtNode_t *tail;
     unsigned int size;
     unsigned int nboSchReq;    // number of node waiting for (or requesting) scheduling
-    _Bool sort; // if true, the list is always be sorted in the order of increasing slot demand
+    _Bool sort; // if true, the list is always be sorted in the order of decreasing slot demand
+    MngtNode_t *index[TWOHOP_NODE_ADDR_SPACE];  // node by address
+    MngtNode_t *dmnTail[DM_NBO_DEMANDS];        // sorted list: last node of each slot demand
+    uint64_t dmnMap[DM_NBO_DEMANDS / 64];        // sorted list: slot demands present in the list
 }MngtNodeList_t;
 
+/* Nodes of every list come from this pool */
+extern MemPool_t mngtNodePool;
+
 void initNodeList(MngtNodeList_t *lst, _Bool sort);
 
 void deinitNodeList(MngtNodeList_t *lst);
 
 MngtNode_t * createNewNode(NodeGenInfo_t genInfo, uint16_t parrent);
+
+/*
+ * Give a node which is in no list back to the node pool
+ */
+void destroyNode(MngtNode_t *node);
 /*
  * Push node (*node) the list (*lst) in the order of increasing address value
  * Return 1 if push done 
@@ -0,0 +1,348 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   gw_codec.c
+ * Author: LAM-HOANG
+ *
+ * Created on October 17, 2026
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gw_codec.h"
+#include "rtlora_mac.h"
+#include "base64.h"
+#include "trade.h"
+
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static GwcError_e gwcUplinkNextJson(GwcUplinkIter_t *it, struct MsgInfo_ *msg) {
+    JSON_Object *rxpk_obj;
+    JSON_Value *val; /* needed to detect the absence of some fields */
+    const char *str; /* pointer to sub-strings in the JSON data */
+
+    // get the i-th object in rx array
+    rxpk_obj = json_array_get_object(it->rxpk, it->index++);
+    memset(msg, 0, sizeof *msg);
+
+    /* parse rssi value (mandatory) */
+    val = json_object_get_value(rxpk_obj, "rssi");
+    if (val == NULL) {
+        MSG("WARNING: [up] no mandatory \"rxpk.rssi\" object in JSON, packet ignored\n");
+        return GWC_INVALID;
+    }
+    msg->rssi = (float)json_value_get_number(val);
+
+    /* parse snr value (mandatory) */
+    val = json_object_get_value(rxpk_obj, "lsnr");
+    if (val == NULL) {
+        MSG("WARNING: [up] no mandatory \"rxpk.lsnr\" object in JSON, packet ignored\n");
+        return GWC_INVALID;
+    }
+    msg->snr = (float)json_value_get_number(val);
+
+    /* Parse payload length (mandatory) */
+    val = json_object_get_value(rxpk_obj, "size");
+    if (val == NULL) {
+        MSG("WARNING: [up] no mandatory \"rxpk.size\" object in JSON, packet ignored\n");
+        return GWC_INVALID;
+    }
+    msg->size = (uint16_t)json_value_get_number(val);
+
+    /* Parse payload data (mandatory) */
+    str = json_object_get_string(rxpk_obj, "data");
+    if (str == NULL) {
+        MSG("WARNING: [up] no mandatory \"rxpk.data\" object in JSON, packet ignored\n");
+        return GWC_INVALID;
+    }
+    if (b64_to_bin(str, strlen(str), msg->payload, sizeof msg->payload) != msg->size) {
+        MSG("WARNING: [up] mismatch between .size and .data size once converter to binary\n");
+        return GWC_INVALID;
+    }
+
+    return GWC_OK;
+}
+
+static GwcError_e gwcUplinkNextBin(GwcUplinkIter_t *it, struct MsgInfo_ *msg) {
+    const uint8_t *rec = it->pos;
+    uint16_t size;
+
+    it->index++;
+    if ((it->end - rec) < UL_BIN_REC_SIZE) {
+        MSG("WARNING: [up] truncated binary uplink record\n");
+        it->index = it->nboPkt;
+        return GWC_INVALID;
+    }
+    size = frame_get_u16(rec + UL_BIN_OFS_SIZE);
+    if ((size > sizeof msg->payload) || ((it->end - rec) < (UL_BIN_REC_SIZE + size))) {
+        MSG("WARNING: [up] invalid binary uplink record size %u\n", size);
+        it->index = it->nboPkt;
+        return GWC_INVALID;
+    }
+
+    /* downlink only fields are left untouched */
+    msg->freq = frame_get_u32(rec + UL_BIN_OFS_FREQ);
+    msg->if_chain = rec[UL_BIN_OFS_IF_CHAIN];
+    msg->rf_chain = rec[UL_BIN_OFS_RF_CHAIN];
+    msg->status = rec[UL_BIN_OFS_STATUS];
+    msg->modulation = rec[UL_BIN_OFS_MODULATION];
+    msg->bandwidth = rec[UL_BIN_OFS_BANDWIDTH];
+    msg->coderate = rec[UL_BIN_OFS_CODERATE];
+    msg->datarate = frame_get_u32(rec + UL_BIN_OFS_DATARATE);
+    msg->count_us = frame_get_u32(rec + UL_BIN_OFS_COUNT_US);
+    msg->rssi = (float)(int16_t)frame_get_u16(rec + UL_BIN_OFS_RSSI) / 10.0f;
+    msg->snr = (float)(int16_t)frame_get_u16(rec + UL_BIN_OFS_SNR) / 10.0f;
+    msg->crc = frame_get_u16(rec + UL_BIN_OFS_CRC);
+    msg->size = size;
+    memcpy(msg->payload, rec + UL_BIN_REC_SIZE, size);
+
+    it->pos = rec + UL_BIN_REC_SIZE + size;
+    return GWC_OK;
+}
+
+static void gwcDownlinkKey(const struct MsgInfo_ *msg, uint64_t key[2]) {
+    key[0] = ((uint64_t)msg->freq << 32) | msg->datarate;
+    key[1] = ((uint64_t)msg->rf_chain << 56) | ((uint64_t)(uint8_t)msg->rf_power << 48) \
+            | ((uint64_t)msg->modulation << 40) | ((uint64_t)msg->bandwidth << 32) \
+            | ((uint64_t)msg->coderate << 24) | ((uint64_t)((msg->tx_mode << 1) | msg->invert_pol) << 16) \
+            | msg->preamble;
+}
+
+static int gwcDownlinkBuildTemplate(GwcDlTemplate_t *tpl, const struct MsgInfo_ *msg) {
+    const char *sf, *bw, *cr;
+    char datr[48];
+    int j;
+
+    if (msg->modulation == MOD_LORA) {
+        switch (msg->datarate) {
+            case DR_LORA_SF7:  sf = "7";  break;
+            case DR_LORA_SF8:  sf = "8";  break;
+            case DR_LORA_SF9:  sf = "9";  break;
+            case DR_LORA_SF10: sf = "10"; break;
+            case DR_LORA_SF11: sf = "11"; break;
+            case DR_LORA_SF12: sf = "12"; break;
+            default:
+                MSG("ERROR: [down] lora packet with unknown datarate\n");
+                return -1;
+        }
+        switch (msg->bandwidth) {
+            case BW_125KHZ: bw = "125"; break;
+            case BW_250KHZ: bw = "250"; break;
+            case BW_500KHZ: bw = "500"; break;
+            default:
+                MSG("ERROR: [down] lora packet with unknown bandwidth\n");
+                return -1;
+        }
+        switch (msg->coderate) {
+            case CR_LORA_4_5: cr = "4/5"; break;
+            case CR_LORA_4_6: cr = "4/6"; break;
+            case CR_LORA_4_7: cr = "4/7"; break;
+            case CR_LORA_4_8: cr = "4/8"; break;
+            default:
+                MSG("ERROR: [down] lora packet with unknown coderate\n");
+                return -1;
+        }
+        snprintf(datr, sizeof datr, "\"LORA\",\"datr\":\"SF%sBW%s\",\"codr\":\"%s\"", sf, bw, cr);
+    } else if (msg->modulation == MOD_FSK) {
+        snprintf(datr, sizeof datr, "\"FSK\",\"datr\":%u", msg->datarate);
+    } else {
+        MSG("ERROR: [down] packet with unknown modulation\n");
+        return -1;
+    }
+
+    j = snprintf(tpl->json, sizeof tpl->json, ",\"imme\":%s,\"rfch\":%u,\"freq\":%.6lf,\"powe\":%d,\"modu\":%s,\"ipol\":%s,\"prea\":%u",
+            (msg->tx_mode == IMMEDIATE) ? "true" : "false", msg->rf_chain, (double)msg->freq / 1e6, msg->rf_power,
+            datr, msg->invert_pol ? "true" : "false", msg->preamble);
+    if ((j < 0) || (j >= (int)sizeof tpl->json)) {
+        MSG("ERROR: [down] snprintf failed line %u\n", (__LINE__ - 4));
+        return -1;
+    }
+    tpl->jsonLen = (uint8_t)j;
+
+    /* TX time and payload size are patched for every packet */
+    memset(tpl->bin, 0, sizeof tpl->bin);
+    frame_put_u32(tpl->bin + DL_BIN_OFS_FREQ, msg->freq);
+    tpl->bin[DL_BIN_OFS_TX_MODE] = msg->tx_mode;
+    tpl->bin[DL_BIN_OFS_RF_CHAIN] = msg->rf_chain;
+    tpl->bin[DL_BIN_OFS_RF_POWER] = (uint8_t)msg->rf_power;
+    tpl->bin[DL_BIN_OFS_MODULATION] = msg->modulation;
+    tpl->bin[DL_BIN_OFS_BANDWIDTH] = msg->bandwidth;
+    tpl->bin[DL_BIN_OFS_CODERATE] = msg->coderate;
+    frame_put_u32(tpl->bin + DL_BIN_OFS_DATARATE, msg->datarate);
+    tpl->bin[DL_BIN_OFS_INVERT_POL] = msg->invert_pol;
+    frame_put_u16(tpl->bin + DL_BIN_OFS_PREAMBLE, msg->preamble);
+
+    return 0;
+}
+
+static const GwcDlTemplate_t *gwcDownlinkTemplate(GwcDlEncoder_t *enc, const struct MsgInfo_ *msg) {
+    GwcDlTemplate_t *tpl;
+    uint64_t key[2];
+    int i;
+
+    gwcDownlinkKey(msg, key);
+    for (i = 0; i < GWC_DL_TPL_NB; i++) {
+        tpl = &enc->tpl[i];
+        if (tpl->valid && (tpl->key[0] == key[0]) && (tpl->key[1] == key[1])) {
+            enc->nbHit++;
+            return tpl;
+        }
+    }
+
+    /* not cached yet, replace the oldest template */
+    enc->nbMiss++;
+    tpl = &enc->tpl[enc->next];
+    tpl->valid = false;
+    if (gwcDownlinkBuildTemplate(tpl, msg) != 0) {
+        return NULL;
+    }
+    tpl->key[0] = key[0];
+    tpl->key[1] = key[1];
+    tpl->valid = true;
+    enc->next = (enc->next + 1) % GWC_DL_TPL_NB;
+    return tpl;
+}
+
+/* write an unsigned decimal number, return the number of characters */
+static int gwcPutDecimal(char *out, uint32_t v) {
+    char tmp[10];
+    int n = 0, i;
+
+    do {
+        tmp[n++] = (char)('0' + (v % 10));
+        v /= 10;
+    } while (v != 0);
+    for (i = 0; i < n; i++) {
+        out[i] = tmp[n - 1 - i];
+    }
+    return n;
+}
+
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+GwcError_e gwcUplinkOpen(GwcUplinkIter_t *it, const uint8_t *data, uint32_t len) {
+    memset(it, 0, sizeof *it);
+    if (len < 1) {
+        return GWC_INVALID;
+    }
+
+    it->format = data[0];
+    switch (it->format) {
+        case UPLINK_FMT_BIN:
+            if (len < UL_BIN_HDR_SIZE) {
+                return GWC_INVALID;
+            }
+            it->nboPkt = data[1];
+            it->pos = data + UL_BIN_HDR_SIZE;
+            it->end = data + len;
+            return GWC_OK;
+        case UPLINK_FMT_JSON:
+            it->root = json_parse_string_with_comments((const char *)data);
+            if (it->root == NULL) {
+                MSG("WARNING: [up] invalid JSON, uplink ignored\n");
+                return GWC_INVALID;
+            }
+            /* look for JSON sub-object 'rxpk' */
+            it->rxpk = json_object_get_array(json_value_get_object(it->root), "rxpk");
+            if (it->rxpk == NULL) {
+                MSG("WARNING: [up] no \"rxpk\" array in JSON, uplink ignored\n");
+                gwcUplinkClose(it);
+                return GWC_INVALID;
+            }
+            it->nboPkt = (uint8_t)json_array_get_count(it->rxpk);
+            return GWC_OK;
+        default:
+            MSG("WARNING: [up] unknown uplink format 0x%02X\n", it->format);
+            return GWC_INVALID;
+    }
+}
+
+GwcError_e gwcUplinkNext(GwcUplinkIter_t *it, struct MsgInfo_ *msg) {
+    if (it->index >= it->nboPkt) {
+        return GWC_END;
+    }
+    if (it->format == UPLINK_FMT_BIN) {
+        return gwcUplinkNextBin(it, msg);
+    }
+    return gwcUplinkNextJson(it, msg);
+}
+
+void gwcUplinkClose(GwcUplinkIter_t *it) {
+    /* free the JSON parse tree from memory */
+    if (it->root != NULL) {
+        json_value_free(it->root);
+        it->root = NULL;
+        it->rxpk = NULL;
+    }
+}
+
+void gwcDownlinkInit(GwcDlEncoder_t *enc) {
+    memset(enc, 0, sizeof *enc);
+}
+
+int gwcDownlinkEncodeBin(GwcDlEncoder_t *enc, const struct MsgInfo_ *msg, uint8_t *out, uint32_t max_len) {
+    const GwcDlTemplate_t *tpl;
+    uint8_t *rec = out + DL_BIN_HDR_SIZE;
+
+    if ((msg->size > sizeof msg->payload) || (max_len < (DL_BIN_HDR_SIZE + DL_BIN_REC_SIZE + (uint32_t)msg->size))) {
+        return -1;
+    }
+    tpl = gwcDownlinkTemplate(enc, msg);
+    if (tpl == NULL) {
+        return -1;
+    }
+
+    out[0] = DOWNLINK_FMT_BIN;
+    memcpy(rec, tpl->bin, DL_BIN_REC_SIZE);
+    frame_put_u32(rec + DL_BIN_OFS_TM_S, (uint32_t)msg->msg_tx_time.tv_sec);
+    frame_put_u32(rec + DL_BIN_OFS_TM_US, (uint32_t)msg->msg_tx_time.tv_usec);
+    frame_put_u16(rec + DL_BIN_OFS_SIZE, msg->size);
+    memcpy(rec + DL_BIN_REC_SIZE, msg->payload, msg->size);
+
+    return DL_BIN_HDR_SIZE + DL_BIN_REC_SIZE + msg->size;
+}
+
+int gwcDownlinkEncodeJson(GwcDlEncoder_t *enc, const struct MsgInfo_ *msg, uint8_t *out, uint32_t max_len) {
+    const GwcDlTemplate_t *tpl;
+    char *p = (char *)out;
+    int j;
+
+    /* fixed text + 2 timestamps + template + size + base64 payload (255 bytes = 340 chars) */
+    if ((msg->size > 255) || (max_len < (64 + GWC_DL_TPL_JSON_SIZE + 341))) {
+        return -1;
+    }
+    tpl = gwcDownlinkTemplate(enc, msg);
+    if (tpl == NULL) {
+        return -1;
+    }
+
+    memcpy(p, "{\"txpk\":{\"tm_s\":", 16);
+    p += 16;
+    p += gwcPutDecimal(p, (uint32_t)msg->msg_tx_time.tv_sec);
+    memcpy(p, ",\"tm_us\":", 9);
+    p += 9;
+    p += gwcPutDecimal(p, (uint32_t)msg->msg_tx_time.tv_usec);
+    memcpy(p, tpl->json, tpl->jsonLen);
+    p += tpl->jsonLen;
+    memcpy(p, ",\"size\":", 8);
+    p += 8;
+    p += gwcPutDecimal(p, msg->size);
+    memcpy(p, ",\"data\":\"", 9);
+    p += 9;
+    j = bin_to_b64(msg->payload, msg->size, p, 341);
+    if (j < 0) {
+        MSG("ERROR: [down] bin_to_b64 failed line %u\n", (__LINE__ - 2));
+        return -1;
+    }
+    p += j;
+    memcpy(p, "\"}}", 3);
+    p += 3;
+
+    return (int)(p - (char *)out);
+}
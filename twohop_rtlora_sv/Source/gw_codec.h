@@ -0,0 +1,122 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   gw_codec.h
+ * Author: LAM-HOANG
+ * Description:
+ *          Decoding of the gateway uplink payloads (JSON "rxpk" array or
+ *          compact binary records) into MsgInfo_ structures, and encoding
+ *          of the downlink payloads from precomputed header templates
+ * Created on October 17, 2026
+ */
+
+#ifndef GW_CODEC_H
+#define GW_CODEC_H
+
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "packet_queue.h"
+#include "frame_stream.h"
+#include "parson.h"
+
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define GWC_DL_TPL_NB           8       /* number of cached downlink templates */
+#define GWC_DL_TPL_JSON_SIZE    160     /* room for the static "txpk" fields */
+
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+typedef enum GwcError_ {
+    GWC_OK,                 /* A packet has been decoded */
+    GWC_END,                /* No more packet in the payload */
+    GWC_INVALID             /* Malformed packet or payload */
+}GwcError_e;
+
+/* Cursor over the packets of one PKT_UPLINK_DATA payload */
+typedef struct GwcUplinkIter_{
+    uint8_t         format;     /* UPLINK_FMT_JSON or UPLINK_FMT_BIN */
+    uint8_t         nboPkt;     /* number of packets announced in the payload */
+    uint8_t         index;      /* index of the next packet */
+    const uint8_t   *pos;       /* binary format: next record */
+    const uint8_t   *end;       /* binary format: end of payload */
+    JSON_Value      *root;      /* JSON format: parse tree */
+    JSON_Array      *rxpk;      /* JSON format: "rxpk" array */
+}GwcUplinkIter_t;
+
+/* Downlink header template, every field except the TX time and the payload */
+typedef struct GwcDlTemplate_{
+    bool            valid;
+    uint64_t        key[2];                         /* packed TX parameters */
+    uint8_t         bin[DL_BIN_REC_SIZE];           /* DOWNLINK_FMT_BIN record header */
+    char            json[GWC_DL_TPL_JSON_SIZE];     /* "txpk" fields between "tm_us" and "size" */
+    uint8_t         jsonLen;
+}GwcDlTemplate_t;
+
+typedef struct GwcDlEncoder_{
+    GwcDlTemplate_t tpl[GWC_DL_TPL_NB];
+    uint8_t         next;       /* template replaced on the next miss */
+    uint32_t        nbHit;
+    uint32_t        nbMiss;
+}GwcDlEncoder_t;
+
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Start decoding the packets of an uplink payload
+@param it[out] Cursor to be initialized
+@param data[in] Payload following the gateway MAC address. A JSON payload must be NUL terminated.
+@param len[in] Payload size in bytes
+@return GWC_OK if packets can be read with gwcUplinkNext
+*/
+GwcError_e gwcUplinkOpen(GwcUplinkIter_t *it, const uint8_t *data, uint32_t len);
+
+/**
+@brief Decode the next packet of an uplink payload
+Binary records are written field by field into msg, only msg->size payload bytes are copied.
+@param it[in/out] Cursor
+@param msg[out] Decoded packet
+@return GWC_OK if msg is valid, GWC_INVALID if this packet has been skipped, GWC_END otherwise
+*/
+GwcError_e gwcUplinkNext(GwcUplinkIter_t *it, struct MsgInfo_ *msg);
+
+/**
+@brief Release the resources held by a cursor
+@param it[in/out] Cursor
+*/
+void gwcUplinkClose(GwcUplinkIter_t *it);
+
+/**
+@brief Initialize a downlink encoder, all templates are invalid
+@param enc[out] Encoder
+*/
+void gwcDownlinkInit(GwcDlEncoder_t *enc);
+
+/**
+@brief Encode a downlink as a DOWNLINK_FMT_BIN payload
+@param enc[in/out] Encoder holding the templates
+@param msg[in] Downlink to be sent
+@param out[out] Payload, following the frame header
+@param max_len[in] Size of out
+@return payload size in bytes, -1 if the TX parameters are invalid or out is too small
+*/
+int gwcDownlinkEncodeBin(GwcDlEncoder_t *enc, const struct MsgInfo_ *msg, uint8_t *out, uint32_t max_len);
+
+/**
+@brief Encode a downlink as a {"txpk":{...}} JSON payload
+@param enc[in/out] Encoder holding the templates
+@param msg[in] Downlink to be sent
+@param out[out] Payload, following the frame header. It is not NUL terminated.
+@param max_len[in] Size of out
+@return payload size in bytes, -1 if the TX parameters are invalid or out is too small
+*/
+int gwcDownlinkEncodeJson(GwcDlEncoder_t *enc, const struct MsgInfo_ *msg, uint8_t *out, uint32_t max_len);
+
+#endif /* GW_CODEC_H */
+
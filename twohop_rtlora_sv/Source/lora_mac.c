@@ -221,7 +221,41 @@ void NetworkServerReceiveFrame(uint8_t *rxFrameBuffer, int gwSocket) {
             // GW: Confirmed Data Up .. GW received Confirmed Data from End device ..
         case LoRa_Frame_Unconfirm_Data_Up:
         case LoRa_Frame_Confirm_Data_Up:
+            // FHDR .. DevAddr(4) FCtrl(1) FCnt(2) FOpts(0..15)
+            if (size < len + 7 + 4) {
+                dprintf("Frame is too short.. RxError..\n");
+                return;
+            }
+            memcpy(&fHeader.DevAddr.Address, &payload[len], 4);
+            len += 4;
+            fHeader.FCtrl.up.value = payload[len++];
+            memcpy(&fHeader.FrameCounter, &payload[len], 2);
+            len += 2;
+            optlen = fHeader.FCtrl.up.bits.FOptsLen;
+            len += optlen;
+            if (size < len + 4) {
+                dprintf("FOpts exceed the frame.. RxError..\n");
+                return;
+            }
 
+            // The session keys of the device are expanded once, at join or provisioning
+            edInfo = FindEndDevice(fHeader.DevAddr.Address);
+            if (edInfo == NULL) {
+                dprintf("Unknown device %08x.. Ignoring rx frame\n", fHeader.DevAddr.Address);
+                return;
+            }
+            memcpy(mic_rx, &payload[size - 4], 4);
+            if (!CheckMICCtx(payload, size - 4, LoRa_UP_LINK, fHeader, &edInfo->session, mic_rx)) {
+                dprintf("MIC is invalid.. Ignoring rx frame\n");
+                return;
+            }
+
+            // FPort and FRMPayload
+            if (size - 4 > len) {
+                port = payload[len++];
+                DecryptPayloadCtx(appData, &payload[len], size - 4 - len, LoRa_UP_LINK, fHeader, port, &edInfo->session);
+                dprintf("Data Up from %08x, FCnt %d, port %d, %d bytes\n", fHeader.DevAddr.Address, fHeader.FrameCounter, port, size - 4 - len);
+            }
             break;
 
             // Both: Proprietary ..
@@ -380,6 +414,7 @@ uint32_t SendFrame(uint8_t *buffer, uint8_t size, uint8_t port, uint8_t ack_req,
     LoRaMACHeader_t mHeader;
     LoRaFrameHeader_t fHeader;
     uint8_t mic[4];
+    EndDeviceInfo_t *edInfo;
     int gwSocket;
     int result;
 
@@ -444,13 +479,22 @@ uint32_t SendFrame(uint8_t *buffer, uint8_t size, uint8_t port, uint8_t ack_req,
         lorabuffer[lorasize] = port;
         lorasize += 1;
 
-        // Frame Payload and Encrypt
+        // Frame Payload and Encrypt, with the session context of the device when it is known
+        edInfo = FindEndDevice(fHeader.DevAddr.Address);
         memset(&lorabuffer[lorasize], '\0', size);
-        EncryptPayload(&lorabuffer[lorasize], buffer, size, direction, fHeader, port, NwkSKey, AppSKey);
+        if (edInfo != NULL) {
+            EncryptPayloadCtx(&lorabuffer[lorasize], buffer, size, direction, fHeader, port, &edInfo->session);
+        } else {
+            EncryptPayload(&lorabuffer[lorasize], buffer, size, direction, fHeader, port, NwkSKey, AppSKey);
+        }
         lorasize += size;
 
         //MIC .. using LoRa crypto
-        GenerateMIC(lorabuffer, lorasize, direction, fHeader, NwkSKey, mic);
+        if (edInfo != NULL) {
+            GenerateMICCtx(lorabuffer, lorasize, direction, fHeader, &edInfo->session, mic);
+        } else {
+            GenerateMIC(lorabuffer, lorasize, direction, fHeader, NwkSKey, mic);
+        }
 
         lorabuffer[lorasize++] = mic[0];
         lorabuffer[lorasize++] = mic[1];
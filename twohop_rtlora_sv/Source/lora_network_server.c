@@ -17,11 +17,13 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <fcntl.h>
+#include <sys/epoll.h>
 
 #include <pthread.h>
 #include <sys/time.h>
 
 #include "rtlora_mac.h"
+#include "rtlora_mac_conf.h"
 #include "device_management.h"
 #include "application.h"
 #include "conf.h"
@@ -33,15 +35,18 @@
 #include "device_mngt.h"
 #include "packet_queue.h"
 #include "trade.h"
-
-#define PKT_TIMESYNC_REQ        0 // gw -> sv
-#define PKT_TIMESYNC_RES        1 // sv -> gw
-#define PKT_DOWNLINK_DATA       2 // sv -> gw
-#define PKT_DOWNLINK_ACK        3 // gw -> sv
-#define PKT_UPLINK_DATA         4 // gw -> sv
-#define PKT_UPLINK_ACK          5 // sv -> gw
+#include "frame_stream.h"
+#include "gw_codec.h"
+#include "schedule_mngt.h"
+#include "async_log.h"
+#include "uplink_crypto.h"
+#include "mac_snapshot.h"
 
 #define DOWNSTREAM_BUF_SIZE     1024
+#define EPOLL_MAX_EVENTS        64      /* events handled per epoll_wait() */
+
+#define UPLINK_MAC_OFS          FRAME_HDR_SIZE          /* gateway MAC address */
+#define UPLINK_PAYLOAD_OFS      (UPLINK_MAC_OFS + 8)    /* format byte, then JSON or binary records */
 
 #if defined (LOG)
 int logfd; // LOG File Descriptor
@@ -52,32 +57,53 @@ char logmsg[512];
 volatile bool exit_sig = false; /* 1 -> application terminates cleanly (shut down hardware, close open files, etc) */
 volatile bool quit_sig = false; /* 1 -> application terminates without shutting down the hardware */
 
-extern pthread_cond_t condTxMsg;
-extern pthread_cond_t condRxMsg;
-extern pthread_mutex_t mutexTxMsg;
-extern pthread_mutex_t mutexRxMsg;
-extern _Bool flagTxMsg;   // flag indicates it has a packet to transmit
-extern _Bool flagRxMsg;   // flag indicates it receives a packet
+extern struct PktDoorbell txDoorbell; // rung by the MAC for every downlink in outboundMsgQueue
 
-extern struct PktQueue inboundMsgQueue;
+extern struct PktQueue inboundMsgQueues[TWOHOP_MAX_INBOUND_QUEUES];
 extern struct PktQueue outboundMsgQueue;
 
 extern pthread_mutex_t mutexPhaseTrans;
 extern bool phaseTransRequest;
 
-/* clock and log file management */
-extern time_t log_start_time;
-extern FILE * log_file;
-extern time_t log_time;
-extern pthread_mutex_t mutexLogFile;
-
 int guwbsocket;
 
-static int fdmax, fdnum;
-static fd_set reads, cp_reads;
+static int epoll_fd = -1; // event loop of the input thread (terminal and listening socket)
+/* epoll_event.data.ptr of the non gateway descriptors, gateways use their GateWayInfo_t */
+static int epoll_tag_stdin;
+static int epoll_tag_server;
     
 static int server_socket; // LoRa network server socket
 
+extern GateWayInfo_t GW_HEAD;
+
+/* Ingest workers, each one owns the sockets of its gateways and feeds its own
+ * MAC inbound queue. The input thread accepts the connections and hands them
+ * to the worker owning the fewest gateways. */
+typedef struct IngestWorker_{
+    uint8_t     id;
+    pthread_t   thread;
+    int         epollFd;
+    uint32_t    nbGateways;     // updated with atomic builtins, read by the acceptor
+    /* load counters, written by the worker only */
+    uint64_t    nbFrames;
+    uint64_t    nbPackets;
+    uint64_t    nbDecrypted;    // LoRaWAN uplinks with a valid MIC
+    uint64_t    nbBadMic;       // LoRaWAN uplinks dropped for their MIC
+    uint64_t    nbInvalid;      // RT-LoRa uplinks dropped by the decoder
+    uint64_t    nbBytes;
+    uint64_t    busyUs;         // time spent handling events
+    /* counters at the previous load report */
+    uint64_t    lastFrames;
+    uint64_t    lastPackets;
+    uint64_t    lastBusyUs;
+}IngestWorker_t;
+
+static IngestWorker_t ingest_workers[TWOHOP_MAX_INBOUND_QUEUES];
+static struct timespec ingest_report_time; // time of the previous load report
+static struct timespec latency_export_time; // time of the previous latency histograms snapshot
+static MacSnapshot_t mac_snapshot_copy;     // MAC state read by the console and the export, input thread only
+static const char *mac_conf_file = MAC_CONF_FILE;   // MAC configuration reloaded by the 'r' command
+
 /* gateway <-> MAC protocol variables */
 static uint32_t net_mac_h; /* Most Significant Nibble, network order */
 static uint32_t net_mac_l; /* Least Significant Nibble, network order */
@@ -87,10 +113,18 @@ extern int mac_frame_factor;
 extern int mac_ul_slot_size_ms;
 extern int mac_dl_slot_size_ms;
 extern int mac_nbo_channels;
+extern int mac_nbo_inbound_queues; // one per ingest worker
+extern int mac_sch_incremental;
+extern int mac_rt_priority;
 
 /* threads */
 void thread_inputstream(void); // process input data from terminal or from socket
 void thread_downstream(void); // beaconing and downstream messages 
+void *thread_ingest(void *arg); // gateway sockets of one ingest worker, arg is its IngestWorker_t
+
+int load_mac_config(const char *path);
+
+void upstream_data_handle(GateWayInfo_t *gwInfo, uint8_t* buff, int buff_len);
 
 void set_signal(void);
 
@@ -119,9 +153,9 @@ void wait_ms(unsigned long a) {
 int main(int argc, char* argv[]) {
 
     int i;
+    MacConfig_t mac_conf;
     /* clock and log rotation management */
     int log_rotate_interval = 7200; /* by default, rotation every hour */
-    int time_check = 0; /* variable used to limit the number of calls to time() function */
     
     /* threads */
     pthread_t thrid_input;
@@ -132,10 +166,21 @@ int main(int argc, char* argv[]) {
     
     printf("[ LoRa Network Server ]\n");
     
+    /* MAC configuration file first, the command line options that follow it override its parameters */
+    if(access(mac_conf_file, R_OK) == 0 && load_mac_config(mac_conf_file) != 0){
+        exit(0);
+    }
+    
     /* Parse command line options */   
     int c;
-    while((c = getopt(argc, argv, "n:u:d:c:h")) != -1){
+    while((c = getopt(argc, argv, "n:u:d:c:w:s:p:v:f:h")) != -1){
     	switch(c){
+            case 'f': // MAC configuration file
+                mac_conf_file = optarg;
+                if(load_mac_config(mac_conf_file) != 0){
+                    exit(0);
+                }
+                break;
             case 'n': // frame factor N
                 mac_frame_factor = atoi(optarg);
                 if(mac_frame_factor < 1 || mac_frame_factor > 7){
@@ -166,6 +211,35 @@ int main(int argc, char* argv[]) {
                     exit(0);
                 }
                 break;
+            case 'w':
+                mac_nbo_inbound_queues = atoi(optarg);
+                if(mac_nbo_inbound_queues < 1 || mac_nbo_inbound_queues > TWOHOP_MAX_INBOUND_QUEUES){
+                    printf("Number of ingest workers 'w' must greater than 0 and less than %d!\n", TWOHOP_MAX_INBOUND_QUEUES + 1);
+                    exit(0);
+                }
+                break;
+            case 's':
+                mac_sch_incremental = atoi(optarg);
+                if(mac_sch_incremental < 0 || mac_sch_incremental > 1){
+                    printf("Schedule distribution mode 's' must be 0 or 1!\n");
+                    exit(0);
+                }
+                break;
+            case 'p':
+                mac_rt_priority = atoi(optarg);
+                if(mac_rt_priority < 0 || mac_rt_priority > 99){
+                    printf("SCHED_FIFO priority 'p' must range from 0 to 99!\n");
+                    exit(0);
+                }
+                break;
+            case 'v':
+                i = atoi(optarg);
+                if(i < LOG_LVL_ERROR || i > LOG_LVL_DEBUG){
+                    printf("Log file level 'v' must range from %d to %d!\n", LOG_LVL_ERROR, LOG_LVL_DEBUG);
+                    exit(0);
+                }
+                asyncLogSetFileLevel((LogLevel_e)i);
+                break;
             case 'h':
                 printf("\n");
                 printf("***********************************************************\n");
@@ -194,6 +268,27 @@ int main(int argc, char* argv[]) {
                 printf("\t\tconfigured in the 'global_conf.json' file.\n");
                 printf("\t\tDefault value is %u.\n\n", mac_nbo_channels);
                 
+                printf("\t-w\tNumber of gateway ingest worker threads. VALUE ranges from 1 to %d.\n", TWOHOP_MAX_INBOUND_QUEUES);
+                printf("\t\tEach worker reads its own gateways and feeds its own MAC inbound queue.\n");
+                printf("\t\tDefault value is %u.\n\n", mac_nbo_inbound_queues);
+                
+                printf("\t-s\tSchedule distribution mode. VALUE is 0 or 1.\n");
+                printf("\t\t1: nodes keep their LSIs, only new or changed subtrees are scheduled and distributed.\n");
+                printf("\t\t0: the schedule is rebuilt and distributed to every node in each schedule distribution phase.\n");
+                printf("\t\tDefault value is %u.\n\n", mac_sch_incremental);
+                
+                printf("\t-p\tSCHED_FIFO priority of the MAC phase handler. VALUE ranges from 0 to 99.\n");
+                printf("\t\t0 keeps the default scheduling policy. Needs CAP_SYS_NICE.\n");
+                printf("\t\tDefault value is %u.\n\n", mac_rt_priority);
+                
+                printf("\t-f\tMAC configuration file, JSON object \"%s\". The options that follow override it.\n", MAC_CONF_OBJ);
+                printf("\t\tReloaded by the 'r' console command, applied at the next frame boundary.\n");
+                printf("\t\tDefault file is %s, read when present.\n\n", MAC_CONF_FILE);
+                
+                printf("\t-v\tHighest level written to the log file. VALUE ranges from 0 to 3.\n");
+                printf("\t\t0: errors, 1: warnings, 2: information, 3: debug.\n");
+                printf("\t\tDefault value is %d.\n\n", LOG_LVL_DEBUG);
+                
                 printf("\nEXAMPLES:\n");
                 printf("\t./lora_network_server -n 6 -u 150 -d 300 -c 2\n\n");
                 printf("\tWill set the MAC parameters as follows:\n");
@@ -209,39 +304,43 @@ int main(int argc, char* argv[]) {
     }
     
     printf("\nRTLoRa MAC configuration parameters:\n");
-    printf("\tFrame factor N: %d\n", mac_frame_factor);
-    printf("\tUplink slot size: %d ms\n", mac_ul_slot_size_ms);
-    printf("\tDownlink slot size: %d ms\n", mac_dl_slot_size_ms);
-    printf("\tNumber of channels: %d\n", mac_nbo_channels);
+    twohopLoRaMacGetConfig(&mac_conf);
+    macConfPrint(&mac_conf, stdout);
+    printf("\tIngest workers: %d\n", mac_nbo_inbound_queues);
+    if(mac_rt_priority > 0)
+        printf("\tMAC SCHED_FIFO priority: %d\n", mac_rt_priority);
     printf("\n\n");
     
-    /* opening log file and writing CSV header*/
-    pthread_mutex_lock(&mutexLogFile);
-    time(&log_time);
-    if(open_log() == false){
+    /* opening log file and writing CSV header, the log writer thread rotates it */
+    if(asyncLogStart(log_rotate_interval) != 0){
         MSG("Unable to open log file. Exit\n");
-        pthread_mutex_unlock(&mutexLogFile);
         exit(EXIT_FAILURE);
     }
-    pthread_mutex_unlock(&mutexLogFile);
-    
-    // Init some variables
-    flagTxMsg = false;
-    flagRxMsg = false;
     
     twohopLoRaMacInit();
     InitGateWayInfo();
     InitEndDeviceInfo();
     InitApplication();
 
-    FD_ZERO(&reads);
-    FD_SET(0, &reads); // STDIN
-    
     /* process some of the configuration variables */
     net_mac_h = htonl((uint32_t)(0xFFFFFFFF));
     net_mac_l = htonl((uint32_t)(0xFFFFFFFF));
     
     /* spawn threads to manage upstream and downstream */
+    for (i = 0; i < mac_nbo_inbound_queues; i++) {
+        ingest_workers[i].id = i;
+        ingest_workers[i].epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (ingest_workers[i].epollFd == -1) {
+            printf("ERROR: [main] epoll_create1() error for ingest worker %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+        if (pthread_create(&ingest_workers[i].thread, NULL, thread_ingest, &ingest_workers[i]) != 0) {
+            printf("ERROR: [main] impossible to create ingest worker %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ingest_report_time);
+
     i = pthread_create(&thrid_input, NULL, (void * (*)(void *))thread_inputstream, NULL);
     if (i != 0) {
         printf("ERROR: [main] impossible to create upstream thread\n");
@@ -265,7 +364,6 @@ int main(int argc, char* argv[]) {
     // main while loop
     while (!exit_sig && !quit_sig) {
         sleep(1);
-        ++time_check;
         // Handle application data
 //        if((time_check % 8) == 0){
 //            AppParseData();
@@ -275,18 +373,6 @@ int main(int argc, char* argv[]) {
 //        if((time_check % 20) == 0){
 //            AppDisplayData();
 //        }
-        
-        /* check time and rotate log file if necessary */
-        if (time_check >= 60) {
-            pthread_mutex_lock(&mutexLogFile);
-            time_check = 0;
-            time(&log_time);
-            if (difftime(log_time, log_start_time) > log_rotate_interval) {
-                fclose(log_file);
-                open_log();
-            }
-            pthread_mutex_unlock(&mutexLogFile);
-        }
     }
     /* wait for upstream thread to finish (1 fetch cycle max) */
     twohopLoRaMacDeInit();
@@ -295,17 +381,96 @@ int main(int argc, char* argv[]) {
 //    pthread_join(thrid_downstream, NULL); /* don't wait for downstream thread */
     pthread_cancel(thrid_input);
     pthread_cancel(thrid_downstream);
+    for (i = 0; i < mac_nbo_inbound_queues; i++) {
+        pthread_cancel(ingest_workers[i].thread);
+    }
     
-    printf("End of program\n");
-    fprintf(log_file, "End of program\n");
-    
-    pthread_mutex_lock(&mutexLogFile);
-    fclose(log_file);
-    pthread_mutex_unlock(&mutexLogFile);
+    LOG_MSG(LOG_LVL_INFO, "End of program\n");
+    asyncLogStop();
    
     return 1;
 }
 
+/* per worker load since the previous report */
+void show_ingest_workers(void) {
+    struct timespec now;
+    uint64_t elapsed_us;
+    uint64_t frames, packets, busy_us;
+    IngestWorker_t *worker;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed_us = (uint64_t)(now.tv_sec - ingest_report_time.tv_sec) * 1000000 + (now.tv_nsec - ingest_report_time.tv_nsec) / 1000;
+    ingest_report_time = now;
+    if (elapsed_us == 0) {
+        elapsed_us = 1;
+    }
+
+    printf("Ingest Workers (last %.1f s)\n", elapsed_us / 1e6);
+    printf(" ID  GWs   Frames/s  Packets/s   Load      Total frames   Total bytes   Decrypted   Bad MIC   Invalid\n");
+    for (i = 0; i < mac_nbo_inbound_queues; i++) {
+        worker = &ingest_workers[i];
+        frames = worker->nbFrames;
+        packets = worker->nbPackets;
+        busy_us = worker->busyUs;
+        printf(" %2u %4u %10.1f %10.1f %5.1f%% %16llu %13llu %11llu %9llu %9llu\n", worker->id, __atomic_load_n(&worker->nbGateways, __ATOMIC_RELAXED),
+                (frames - worker->lastFrames) * 1e6 / elapsed_us, (packets - worker->lastPackets) * 1e6 / elapsed_us,
+                (busy_us - worker->lastBusyUs) * 100.0 / elapsed_us, (unsigned long long)frames, (unsigned long long)worker->nbBytes,
+                (unsigned long long)worker->nbDecrypted, (unsigned long long)worker->nbBadMic,
+                (unsigned long long)worker->nbInvalid);
+        worker->lastFrames = frames;
+        worker->lastPackets = packets;
+        worker->lastBusyUs = busy_us;
+    }
+    printf("\n");
+}
+
+/* overwrite the latency and MAC snapshot files every TWOHOP_LAT_EXPORT_INTERVAL_S */
+void export_latency(void) {
+    struct timespec now;
+    time_t wall;
+    FILE *f;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec - latency_export_time.tv_sec < TWOHOP_LAT_EXPORT_INTERVAL_S) {
+        return;
+    }
+    latency_export_time = now;
+
+    f = fopen(TWOHOP_LAT_EXPORT_FILE, "w");
+    if (f == NULL) {
+        printf("WARNING: cannot write %s, %s\n", TWOHOP_LAT_EXPORT_FILE, strerror(errno));
+        return;
+    }
+    time(&wall);
+    fprintf(f, "# %s", ctime(&wall));
+    twohopLoRaMacPrintLatency(f);
+    fclose(f);
+
+    f = fopen(TWOHOP_SNAP_EXPORT_FILE, "w");
+    if (f == NULL) {
+        printf("WARNING: cannot write %s, %s\n", TWOHOP_SNAP_EXPORT_FILE, strerror(errno));
+        return;
+    }
+    macSnapshotRead(&macSnapshot, &mac_snapshot_copy);
+    fprintf(f, "# %s", ctime(&wall));
+    macSnapshotPrint(&mac_snapshot_copy, f);
+    fclose(f);
+}
+
+/* read a MAC configuration file over the current configuration and hand it to the MAC */
+int load_mac_config(const char *path) {
+    MacConfig_t conf;
+
+    twohopLoRaMacGetConfig(&conf);
+    if (macConfParseFile(path, &conf) != 0 || twohopLoRaMacRequestConfig(&conf) != 0) {
+        printf("WARNING: MAC configuration of %s not applied\n", path);
+        return -1;
+    }
+    printf("INFO: MAC configuration of %s accepted\n", path);
+    return 0;
+}
+
 void terminal_input_handle(int fd, uint8_t* buff, int buff_len) {
     dprintf("%s", buff);
     if (buff[0] == 'x') {
@@ -316,11 +481,42 @@ void terminal_input_handle(int fd, uint8_t* buff, int buff_len) {
 #if defined (LOG)
         close(logfd);
 #endif
+        asyncLogStop();
         exit(0);
     } else if (buff[0] == 'd') {
         ShowEndDevices();
     } else if (buff[0] == 'g') {
         ShowGateWays();
+    } else if (buff[0] == 'n') {   // nodes, schedules and gateways as of the last frame
+        macSnapshotRead(&macSnapshot, &mac_snapshot_copy);
+        macSnapshotPrint(&mac_snapshot_copy, stdout);
+    } else if (buff[0] == 'r') {   // r [file]: reload the MAC configuration, applied at the next frame boundary
+        char *path = strtok((char *)&buff[1], " \t\r\n");
+        MacConfig_t conf;
+
+        if (load_mac_config((path != NULL) ? path : mac_conf_file) == 0) {
+            twohopLoRaMacGetConfig(&conf);
+            macConfPrint(&conf, stdout);
+        }
+    } else if (buff[0] == 'w') {
+        show_ingest_workers();
+    } else if (buff[0] == 'm') {
+        memPoolPrint(&mngtNodePool);
+        memPoolPrint(&schNodePool);
+    } else if (buff[0] == 't') {
+        twohopLoRaMacPrintTimers();
+    } else if (buff[0] == 'l') {
+        twohopLoRaMacPrintLatency(stdout);
+    } else if (buff[0] == 'v') {   // v: log statistics, v0 to v3: log file level
+        if ((buff[1] >= '0') && (buff[1] <= '3')) {
+            asyncLogSetFileLevel((LogLevel_e)(buff[1] - '0'));
+        }
+        asyncLogPrintStats();
+    } else if (buff[0] == 'e') {   // e0 to e3: console level
+        if ((buff[1] >= '0') && (buff[1] <= '3')) {
+            asyncLogSetConsoleLevel((LogLevel_e)(buff[1] - '0'));
+        }
+        asyncLogPrintStats();
     } else if ((buff[0] == 'P') && (buff[1] == 'T')) {   // Receive phase transition request
         MSG("[SERVER] Receive Phase Transition Request from user\n");
         pthread_mutex_lock(&mutexPhaseTrans);
@@ -331,25 +527,117 @@ void terminal_input_handle(int fd, uint8_t* buff, int buff_len) {
     return;
 }
 
-int new_gw_connection_handle(int server_socket) {
+/* accept every pending gateway connection, the listening socket is edge triggered */
+void new_gw_connection_handle(int server_socket) {
     struct sockaddr_in client_address; // Gateway address
-    static int client_socket; // LoRa network server socket
-    unsigned int client_size;
-
-    memset(&client_address, 0, sizeof (client_address));
-    client_size = sizeof (client_address);
-    client_socket = accept(server_socket, (struct sockaddr*) &client_address, &client_size);
-    printf("Connecting New Gateway(%d): %s\n", client_socket, inet_ntoa(client_address.sin_addr));
-    //    printf("Server (%d): %s\n", server_socket, inet_ntoa(server_address.sin_addr));
-
-    // Call LoRa management function here for first connection..
-    // Register Lora Gateway to Management List
-    AddGateWay(client_socket, client_address);
+    int client_socket; // LoRa network server socket
+    socklen_t client_size;
+    struct epoll_event ev;
+    GateWayInfo_t *gwInfo;
+    IngestWorker_t *worker;
+    int i;
+
+    while (1) {
+        memset(&client_address, 0, sizeof (client_address));
+        client_size = sizeof (client_address);
+        client_socket = accept(server_socket, (struct sockaddr*) &client_address, &client_size);
+        if (client_socket == -1) {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+                printf("WARNING: accept() error, %s\n", strerror(errno));
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        fcntl(client_socket, F_SETFL, fcntl(client_socket, F_GETFL, 0) | O_NONBLOCK);
+        printf("Connecting New Gateway(%d): %s\n", client_socket, inet_ntoa(client_address.sin_addr));
+        //    printf("Server (%d): %s\n", server_socket, inet_ntoa(server_address.sin_addr));
+
+        // Call LoRa management function here for first connection..
+        // Register Lora Gateway to Management List
+        gwInfo = AddGateWay(client_socket, client_address);
+        if (gwInfo == NULL) {
+            close(client_socket);
+            continue;
+        }
+        // Hand the socket to the least loaded worker, it keeps it until the connection is closed
+        worker = &ingest_workers[0];
+        for (i = 1; i < mac_nbo_inbound_queues; i++) {
+            if (__atomic_load_n(&ingest_workers[i].nbGateways, __ATOMIC_RELAXED) < __atomic_load_n(&worker->nbGateways, __ATOMIC_RELAXED)) {
+                worker = &ingest_workers[i];
+            }
+        }
+        gwInfo->worker = worker->id;
+        __atomic_add_fetch(&worker->nbGateways, 1, __ATOMIC_RELAXED);
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = gwInfo;
+        if (epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, client_socket, &ev) == -1) {
+            printf("WARNING: epoll_ctl() error, %s\n", strerror(errno));
+            __atomic_sub_fetch(&worker->nbGateways, 1, __ATOMIC_RELAXED);
+            RemoveGateWay(client_socket);
+            close(client_socket);
+            continue;
+        }
 #if defined (LOG)
-    sprintf(logmsg, "ADD NEW GATEWAY = %d, %s\n", clntsocket, inet_ntoa(clntAddress.sin_addr));
-    write(logfd, logmsg, strlen(logmsg));
+        sprintf(logmsg, "ADD NEW GATEWAY = %d, %s\n", client_socket, inet_ntoa(client_address.sin_addr));
+        write(logfd, logmsg, strlen(logmsg));
 #endif
-    return client_socket;
+    }
+}
+
+/* answer a TIMESYNC_REQ, t1 is when the frame was read so uplinks handled before it do not bias the sample */
+static void timesync_fast_reply(GateWayInfo_t *gwInfo, const uint8_t *frame, const struct timeval *rx_time) {
+    uint8_t buff_out[FRAME_HDR_SIZE + 16];
+    struct timeval tx_time;
+
+    frame_header_write(buff_out, PKT_TIMESYNC_RES, frame[1], frame[2], 16);
+    *(uint32_t *) (buff_out + FRAME_HDR_SIZE) = rx_time->tv_sec;
+    *(uint32_t *) (buff_out + FRAME_HDR_SIZE + 4) = rx_time->tv_usec;
+    /* t2 as late as possible */
+    gettimeofday(&tx_time, NULL);
+    *(uint32_t *) (buff_out + FRAME_HDR_SIZE + 8) = tx_time.tv_sec;
+    *(uint32_t *) (buff_out + FRAME_HDR_SIZE + 12) = tx_time.tv_usec;
+    SendToGateWay(gwInfo, buff_out, sizeof buff_out);
+}
+
+/* drain a gateway socket, return false once the connection is closed */
+static bool gw_input_handle(IngestWorker_t *worker, GateWayInfo_t *gwInfo) {
+    uint8_t *rx_ptr;
+    uint32_t rx_room;
+    uint8_t *frame;
+    uint32_t frame_len;
+    ssize_t rx_len;
+    struct timeval rx_time;
+
+    while (1) {
+        /* read straight into the reassembly buffer of the gateway */
+        rx_ptr = frame_stream_wptr(&gwInfo->rxStream, &rx_room);
+        rx_len = read(gwInfo->socket, rx_ptr, rx_room);
+        if (rx_len == 0) {
+            dprintf("LoRa Gateway connection is closed..\n");
+            return false;
+        } else if (rx_len == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            /* socket drained, wait for the next edge */
+            return (errno == EAGAIN) || (errno == EWOULDBLOCK);
+        }
+        // Rx from LoRa Gateway, a read may hold several frames or only a part of one
+        gettimeofday(&rx_time, NULL);
+        frame_stream_commit(&gwInfo->rxStream, rx_len);
+        worker->nbBytes += rx_len;
+        while ((frame = frame_stream_next(&gwInfo->rxStream, &frame_len)) != NULL) {
+            worker->nbFrames++;
+            if ((frame_len >= UPLINK_PAYLOAD_OFS) && (frame[0] == PROTOCOL_VERSION) && (frame[3] == PKT_TIMESYNC_REQ)) {
+                // fast path, no logging nor decoding before the answer
+                timesync_fast_reply(gwInfo, frame, &rx_time);
+            } else {
+                upstream_data_handle(gwInfo, frame, frame_len);
+            }
+        }
+    }
 }
 
 /******************************************************************************
@@ -436,26 +724,68 @@ void receive_frame_from_gateway(uint8_t *rxFrame, int size, int gwSocket) {
     return;
 }
 
-void upstream_data_handle(int sock, uint8_t* buff, int buff_len) {
+/* MIC check and decryption of the LoRaWAN uplinks of a batch, then decoding of the RT-LoRa
+ * uplinks. The frames with an invalid MIC and the frames that are neither a verified LoRaWAN
+ * uplink nor a valid RT-LoRa uplink are removed and the following ones moved down,
+ * return the frames kept */
+static int uplink_decode_stage(IngestWorker_t *worker, struct MsgInfo_ **batch, int nb) {
+    UlCryptoFrame_t frames[UL_CRYPTO_BATCH_MAX];
+    EndDeviceInfo_t *edInfo;
+    int i, kept = 0;
+
+    for (i = 0; i < nb; i++) {
+        if (ulCryptoParse(&frames[i], batch[i]->payload, batch[i]->size) == UL_CRYPTO_OK) {
+            // Session keys of the device, expanded at join or provisioning
+            edInfo = FindEndDevice(frames[i].fHeader.DevAddr.Address);
+            if (edInfo != NULL) {
+                frames[i].session = &edInfo->session;
+            }
+        }
+    }
+    ulCryptoRun(frames, nb);
+
+    for (i = 0; i < nb; i++) {
+        if (frames[i].result == UL_CRYPTO_BAD_MIC) {
+            worker->nbBadMic++;
+            LOG_MSG(LOG_LVL_WARNING, "WARNING: invalid MIC, uplink of %08X FCnt %u dropped\n",
+                    frames[i].fHeader.DevAddr.Address, (unsigned int)frames[i].fHeader.FrameCounter);
+            continue;
+        }
+        if (frames[i].result == UL_CRYPTO_OK) {
+            worker->nbDecrypted++;
+            batch[i]->twohop.type = TWM_UL_INVALID;
+        } else if (twmDecodeUplink(batch[i]->payload, batch[i]->size, &batch[i]->twohop) != 0) {
+            worker->nbInvalid++;
+            LOG_MSG(LOG_LVL_DEBUG, "Invalid RT-LoRa uplink of %u bytes, type %u, dropped\n", batch[i]->size,
+                    (batch[i]->size > 0) ? (unsigned int)(batch[i]->payload[0] >> 4) : 0);
+            continue;
+        }
+        batch[i]->ulCrypto = (uint8_t)frames[i].result;
+        if (kept != i) {
+            memcpy(batch[kept], batch[i], pktCopySize(batch[i]));
+        }
+        kept++;
+    }
+    return kept;
+}
+
+void upstream_data_handle(GateWayInfo_t *gwInfo, uint8_t* buff, int buff_len) {
+    int sock = gwInfo->socket;
     int i; /* loop variables */
     int payload_len;
     
     /* protocol variables */
-    uint8_t token_h; /* random token for acknowledgement matching */
-    uint8_t token_l; /* random token for acknowledgement matching */
-    int j;
     uint8_t buff_out[512];
-    int buff_out_len;
     struct timeval buff_timeval = {0, 0};  
-    struct MsgInfo_ ulMsg;
+    struct MsgInfo_ *ulMsg;
+    struct PktQueue *ulQueue;
     
-    /* JSON parsing variables */
-    JSON_Value *root_val = NULL;
-    JSON_Object *rxpk_obj = NULL;
-    JSON_Array *rxpk_arr = NULL;
-    int arr_len;
-    JSON_Value *val = NULL; /* needed to detect the absence of some fields */
-    const char *str; /* pointer to sub-strings in the JSON data */
+    /* uplink decoding variables */
+    GwcUplinkIter_t ulIter;
+    GwcError_e ulErr;
+    struct MsgInfo_ *ulBatch[UL_CRYPTO_BATCH_MAX];
+    int nb_batch;
+    bool ulEnd;
     short x0, x1;
     
 //    dprintf("[%d/%d] : ", sock, buff_len);
@@ -463,12 +793,10 @@ void upstream_data_handle(int sock, uint8_t* buff, int buff_len) {
 //        dprintfc("%02x ", buff[j]);
 //    dprintfc("\n");
 
-    /* if the datagram does not respect protocol, just ignore it */
-    if ((buff_len < 12) || (buff[0] != PROTOCOL_VERSION) || ((buff[3] != PKT_TIMESYNC_REQ) \
-                                            && (buff[3] != PKT_UPLINK_DATA))) {
-        printf("WARNING: ignoring invalid packet len=%d, protocol_version=%hhu, id=%hhu\n",
-                buff_len, buff[0], buff[3]);
-        fprintf(log_file, "WARNING: ignoring invalid packet len=%d, protocol_version=%hhu, id=%hhu\n",
+    /* if the frame does not respect protocol, just ignore it */
+    if ((buff_len < UPLINK_PAYLOAD_OFS) || (buff[0] != PROTOCOL_VERSION) || ((buff[3] != PKT_TIMESYNC_REQ) \
+                                            && (buff[3] != PKT_UPLINK_DATA) && (buff[3] != PKT_HELLO))) {
+        LOG_MSG(LOG_LVL_WARNING, "WARNING: ignoring invalid packet len=%d, protocol_version=%hhu, id=%hhu\n",
                 buff_len, buff[0], buff[3]);
         return;
     }
@@ -477,117 +805,71 @@ void upstream_data_handle(int sock, uint8_t* buff, int buff_len) {
 
     /* pre-fill the out buffer with fixed fields */
     buff_out[0] = PROTOCOL_VERSION;
-    buff_out_len = 0;
 
     switch (buff[3]) {
         case PKT_TIMESYNC_REQ:
-            printf("Received TIMESYNC_REQ from GW (sock %d)\n", sock);
-            /* Get receiving timestamp */
-            gettimeofday(&buff_timeval, NULL);
-            buff_len = 0;
-            /* respond timesync */
-            buff_out[1] = buff[1];
-            buff_out[2] = buff[2];
-            buff_out[3] = PKT_TIMESYNC_RES;
-            buff_out_len += 4;
-            *(uint32_t *) (buff_out + 4) = buff_timeval.tv_sec;
-            *(uint32_t *) (buff_out + 8) = buff_timeval.tv_usec;
-            buff_out_len += 8;
-            /* Get transmitting timestamp */
+            /* normally answered by gw_input_handle as soon as read */
             gettimeofday(&buff_timeval, NULL);
-            *(uint32_t *) (buff_out + 12) = buff_timeval.tv_sec;
-            *(uint32_t *) (buff_out + 16) = buff_timeval.tv_usec;
-            buff_out_len += 8;
-
-            /* send the response message to the gateway*/
-            write(sock, buff_out, buff_out_len);
-            printf("Sent TIMESYNC_RES\n");
+            timesync_fast_reply(gwInfo, buff, &buff_timeval);
             break;
-        case PKT_UPLINK_DATA:
-            /* Parse JSON data*/
-            buff[buff_len] = 0; /* add string terminator, just to be safe */
-//            printf("\nJSON up: %s\n", (char *)(buff + 12)); /* DEBUG: display JSON payload */
-            /* initialize TX struct and try to parse JSON */
-            memset(&ulMsg, 0, sizeof ulMsg);
-            root_val = json_parse_string_with_comments((const char *)(buff + 12)); /* JSON offset */
-            if (root_val == NULL) {
-                printf("WARNING: [down] invalid JSON, TX aborted\n");
-                return;
+        case PKT_HELLO:
+            /* accept the requested capabilities this server implements */
+            if (buff_len < (UPLINK_PAYLOAD_OFS + 1)) {
+                LOG_MSG(LOG_LVL_WARNING, "WARNING: ignoring truncated HELLO from GW (sock %d)\n", sock);
+                break;
             }
-            
-            /* look for JSON sub-object 'rxpk' */
-            rxpk_arr = json_object_get_array(json_value_get_object(root_val), "rxpk");
-            if (rxpk_arr == NULL) {
-                printf("WARNING: [down] no \"rxpk\" array in JSON, TX aborted\n");
-                json_value_free(root_val);
+            gwInfo->linkCaps = buff[UPLINK_PAYLOAD_OFS] & (LINK_CAP_BIN_UPLINK | LINK_CAP_BIN_DOWNLINK);
+            frame_header_write(buff_out, PKT_HELLO_ACK, buff[1], buff[2], 1);
+            buff_out[FRAME_HDR_SIZE] = gwInfo->linkCaps;
+            SendToGateWay(gwInfo, buff_out, FRAME_HDR_SIZE + 1);
+            LOG_MSG(LOG_LVL_INFO, "Received HELLO from GW (sock %d), link capabilities 0x%02X\n", sock, gwInfo->linkCaps);
+            break;
+        case PKT_UPLINK_DATA:
+            /* JSON payloads are already NUL terminated by the stream decoder */
+//            printf("\nJSON up: %s\n", (char *)(buff + UPLINK_PAYLOAD_OFS)); /* DEBUG: display JSON payload */
+            if (gwcUplinkOpen(&ulIter, buff + UPLINK_PAYLOAD_OFS, buff_len - UPLINK_PAYLOAD_OFS) != GWC_OK) {
                 return;
             }
-            
-            arr_len = json_array_get_count(rxpk_arr);
-            if(arr_len == 0){
-                printf("Rx JSON array has no member\n");
-                return;
-            } 
-            for( i = 0; i < arr_len ; i++){
-                // get the i-th object in rx array
-                rxpk_obj = json_array_get_object(rxpk_arr, i);
-                /* parse rssi value (mandatory) */
-                val = json_object_get_value(rxpk_obj,"rssi");
-                if (val == NULL) {
-                    printf("WARNING: [down] no mandatory \"rxpk.rssi\" object in JSON, TX aborted\n");
-                    json_value_free(root_val);
-                    continue;
-                }
-                ulMsg.rssi = (float)json_value_get_number(val);
-
-                /* parse rssi value (mandatory) */
-                val = json_object_get_value(rxpk_obj,"lsnr");
-                if (val == NULL) {
-                    printf("WARNING: [down] no mandatory \"rxpk.lsnr\" object in JSON, TX aborted\n");
-                    json_value_free(root_val);
-                    continue;
-                }
-                ulMsg.snr = (float)json_value_get_number(val);
-
-                /* Parse payload length (mandatory) */
-                val = json_object_get_value(rxpk_obj,"size");
-                if (val == NULL) {
-                    printf("WARNING: [down] no mandatory \"rxpk.size\" object in JSON, TX aborted\n");
-                    json_value_free(root_val);
-                    continue;
+            ulQueue = &inboundMsgQueues[gwInfo->worker];
+            i = 0;
+            ulEnd = false;
+            while (!ulEnd) {
+                // Decode a batch straight into the next slots of the worker queue, they are published once valid
+                nb_batch = 0;
+                while (nb_batch < UL_CRYPTO_BATCH_MAX) {
+                    ulMsg = pktQueueReserveAt(ulQueue, nb_batch);
+                    if (ulMsg == NULL) {
+                        LOG_MSG(LOG_LVL_WARNING, "WARNING: inbound queue of worker %u is full, uplink packets dropped\n", gwInfo->worker);
+                        ulEnd = true;
+                        break;
+                    }
+                    ulErr = gwcUplinkNext(&ulIter, ulMsg);
+                    if (ulErr == GWC_END) {
+                        ulEnd = true;
+                        break;
+                    }
+                    if (ulErr != GWC_OK) {
+                        continue;
+                    }
+                    ulMsg->sock = sock;
+                    ulBatch[nb_batch++] = ulMsg;
                 }
-                ulMsg.size = (uint16_t)json_value_get_number(val);
+                nb_batch = uplink_decode_stage(&ingest_workers[gwInfo->worker], ulBatch, nb_batch);
+                i += nb_batch;
 
-                /* Parse payload data (mandatory) */
-                str = json_object_get_string(rxpk_obj, "data");
-                if (str == NULL) {
-                    printf("WARNING: no mandatory \"rxpk.data\" object in JSON, TX aborted\n");
-                    json_value_free(root_val);
-                    continue;
-                }
-                if (b64_to_bin(str, strlen(str), ulMsg.payload, sizeof ulMsg.payload) != ulMsg.size) {
-                    printf("WARNING: mismatch between .size and .data size once converter to binary\n");
-                    continue;
-                }
-                
-                ulMsg.sock = sock;
-                
-//                MSG_DEBUG(DEBUG_LOG,"Parse pkt %d from JSON done\n", i);
-                // Enqueue msg and notify MAC thread that a packet has been input to the RX queue
-                pthread_mutex_lock(&mutexRxMsg);
-                pktEnqueue(&inboundMsgQueue, &ulMsg);
-                flagRxMsg = true;
-                pthread_cond_signal(&condRxMsg);
-                pthread_mutex_unlock(&mutexRxMsg);
+//                MSG_DEBUG(DEBUG_LOG,"Parse pkt %d done\n", i);
+                // Notify MAC thread that packets have been input
+                pktQueueCommitN(ulQueue, nb_batch);
 //                MSG_DEBUG(DEBUG_LOG,"Receive UP_DATA from sock: %d\n", sock);
             }
-            
-            /* free the JSON parse tree from memory */
-            json_value_free(root_val);
+            gwcUplinkClose(&ulIter);
+            ingest_workers[gwInfo->worker].nbPackets += i;
+            if (i == 0) {
+                LOG_MSG(LOG_LVL_WARNING, "Rx uplink has no valid packet\n");
+            }
             break;
         default:
-            printf("WARNING: ignoring weird packet len=%d, id=%hhu\n", buff_len, buff[3]);
-            fprintf(log_file, "WARNING: ignoring weird packet len=%d, id=%hhu\n", buff_len, buff[3]);
+            LOG_MSG(LOG_LVL_WARNING, "WARNING: ignoring weird packet len=%d, id=%hhu\n", buff_len, buff[3]);
             break;
     }
 
@@ -600,13 +882,15 @@ void upstream_data_handle(int sock, uint8_t* buff, int buff_len) {
 
 void thread_inputstream(void) {
     static struct sockaddr_in server_address; // LoRa network server
-    static int client_socket; // LoRa network server socket
     int option = 1; // address reusable option
-    struct timeval timeout = {0, 0};
 
     uint8_t buff_in[512];
     int buff_in_len;
 
+    struct epoll_event ev;
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    int nb_events;
+
     int i;
 
     // 1. Generate LoRa Network Server welcome socket
@@ -615,6 +899,7 @@ void thread_inputstream(void) {
         printf("TCP socket() error!\n");
         exit(0);
     }
+    fcntl(server_socket, F_SETFL, fcntl(server_socket, F_GETFL, 0) | O_NONBLOCK);
     printf("  Server socket is %d\n", server_socket);
 
     // Option for LoRa Network Server address reusable
@@ -632,335 +917,187 @@ void thread_inputstream(void) {
     }
 
     // 2. Wait for LoRa Gateway connection
-    if (listen(server_socket, 30) == -1) {
+    if (listen(server_socket, SOMAXCONN) == -1) {
         printf("TCP listen() error!\n");
         exit(1);
     }
 
-    FD_SET(server_socket, &reads);
-    fdmax = server_socket;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) {
+        printf("epoll_create1() error!\n");
+        exit(1);
+    }
+    /* terminal stays level triggered, one command per read */
+    ev.events = EPOLLIN;
+    ev.data.ptr = &epoll_tag_stdin;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, 0, &ev);
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = &epoll_tag_server;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_socket, &ev) == -1) {
+        printf("epoll_ctl() error!\n");
+        exit(1);
+    }
 
     while (!exit_sig && !quit_sig) {
-        cp_reads = reads;
-        timeout.tv_sec = 5;
-        timeout.tv_usec = 0;
-
-        if ((fdnum = select(fdmax + 1, &cp_reads, 0, 0, &timeout)) < 0) {
-            // Select returns error..
+        nb_events = epoll_wait(epoll_fd, events, EPOLL_MAX_EVENTS, 5000);
+        if (nb_events < 0) {
             if (errno == EINTR) {
                 continue;
             }
-            //            printf("select() error!\n");
+            //            printf("epoll_wait() error!\n");
             break;
         }
-        if (fdnum == 0) {
-            // Select Timeout
-            //            dprintf("select() timeout retry\n");
-            continue;
-        }
-        // 3. LoRa network server received data
-        for (i = 0; i < fdmax + 1; i++) {
-            if (FD_ISSET(i, &cp_reads)) {
-                if (i == 0) {
-                    // Receive input data from terminal
-                    buff_in_len = read(i, buff_in, sizeof (buff_in));
-                    buff_in[buff_in_len] = 0;
-
-                    terminal_input_handle(i, buff_in, buff_in_len);
-
-                } else if (i == server_socket) {
-                    // 3-1. New connection from LoRa gateway
-                    client_socket = new_gw_connection_handle(server_socket);
-                    FD_SET(client_socket, &reads);
-                    if (fdmax < client_socket)
-                        fdmax = client_socket;
-#if defined (LOG)
-                } else if (i == logfd) {
-                    // TODO: 
-#endif
-                } else {
-                    // 3-3. New encapsulated Pkt arrived from LoRa gateway
-                    if (FindGateWay(i) != NULL) {
-                        buff_in_len = read(i, buff_in, sizeof (buff_in) - 1);
-                        // Just test..
-                        if (buff_in_len == 0) {
-                            dprintf("LoRa Gateway connection is closed..\n");
-                            // Clear LoRa Gateway from Management List
-                            RemoveGateWay(i);
-                            FD_CLR(i, &reads);
-                            close(i);
-                        } else if (buff_in_len == -1) {
-                            /* if no message was received, got back to listening socket */
-                            continue;
-                        } else {
-                            // Rx from LoRa Gateway..
-                            upstream_data_handle(i, buff_in, buff_in_len);
-                        }
-                        //write(i, msg, strlen(msg) + 1);
-                    } // 3-4. New encapsulated Pkt arrived from Application Server
+        export_latency();
+        // 3. LoRa network server received data, only the ready descriptors are visited
+        for (i = 0; i < nb_events; i++) {
+            if (events[i].data.ptr == &epoll_tag_stdin) {
+                // Receive input data from terminal
+                buff_in_len = read(0, buff_in, sizeof (buff_in) - 1);
+                if (buff_in_len <= 0) {
+                    /* no terminal (daemon), stop watching it */
+                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, 0, NULL);
+                    continue;
                 }
+                buff_in[buff_in_len] = 0;
+
+                terminal_input_handle(0, buff_in, buff_in_len);
+
+            } else if (events[i].data.ptr == &epoll_tag_server) {
+                // 3-1. New connections from LoRa gateways, handed to the ingest workers
+                new_gw_connection_handle(server_socket);
             }
         }
     }
     printf("\nINFO: End of input thread\n");
 }
 
+// receive the encapsulated Pkts of the gateways owned by one worker
+
+void *thread_ingest(void *arg) {
+    IngestWorker_t *worker = arg;
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    int nb_events;
+    GateWayInfo_t *gwInfo;
+    struct timespec start, end;
+    int sock;
+    int i;
+
+    while (!exit_sig && !quit_sig) {
+        nb_events = epoll_wait(worker->epollFd, events, EPOLL_MAX_EVENTS, 5000);
+        if (nb_events < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < nb_events; i++) {
+            // New encapsulated Pkt arrived from LoRa gateway
+            gwInfo = events[i].data.ptr;
+            if (!gw_input_handle(worker, gwInfo) || (events[i].events & (EPOLLERR | EPOLLHUP))) {
+                // Clear LoRa Gateway from Management List
+                sock = gwInfo->socket;
+                epoll_ctl(worker->epollFd, EPOLL_CTL_DEL, sock, NULL);
+                RemoveGateWay(sock);
+                close(sock);
+                __atomic_sub_fetch(&worker->nbGateways, 1, __ATOMIC_RELAXED);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        worker->busyUs += (uint64_t)(end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+    }
+    printf("\nINFO: End of ingest worker %u\n", worker->id);
+    return NULL;
+}
+
 // downstream messages 
 
 void thread_downstream(void) {
-    int j;
-    struct timeval current_time;
-    struct timeval temp_time;
-    struct timeval tx_timestamp;
-    uint32_t time_to_SF_mil;
-    struct MsgInfo_ dlMsg;
+    struct MsgInfo_ *dlMsg;
+    GateWayInfo_t *gwInfo;
 //    int downlink_ready;
     
     /* protocol variables */
     uint8_t token_h; /* random token for acknowledgement matching */
     uint8_t token_l; /* random token for acknowledgement matching */
     
-    /* data buffers */
-    uint8_t buff_down[DOWNSTREAM_BUF_SIZE]; /* buffer to compose the downstream packet */
-    int buff_index;
+    /* data buffers, each encoding is built at most once per downlink */
+    static GwcDlEncoder_t dlEncoder; /* header templates, only the TX time and payload change */
+    uint8_t buff_json[DOWNSTREAM_BUF_SIZE]; /* JSON downstream packet */
+    uint8_t buff_bin[DOWNSTREAM_BUF_SIZE]; /* binary downstream packet */
+    int json_len, bin_len;
+    uint64_t sent_ns;
     
-    memset(buff_down, 0, sizeof (buff_down));
-    /* pre-fill the data buffer with fixed fields */
-    buff_down[0] = PROTOCOL_VERSION;
-    buff_down[3] = PKT_DOWNLINK_DATA;
+    gwcDownlinkInit(&dlEncoder);
     
 //    wait_ms(1000);
 
     while (!exit_sig && !quit_sig) {
         // Get next start of the next superframe time, named next_SF_time from RT-LoRa MAC
 //        downlink_ready = RtLoRaGetReadyDownlinkPacket(&pkt);
-        pthread_mutex_lock(&mutexTxMsg);
-        flagTxMsg = false;
-        while(flagTxMsg == false)
-            pthread_cond_wait(&condTxMsg, &mutexTxMsg);
-        pthread_mutex_unlock(&mutexTxMsg);
+        /* returns at once while downlinks are pending, one is sent per loop */
+        pktDoorbellWait(&txDoorbell, &outboundMsgQueue, 1);
         
-        if (pktDequeue(&outboundMsgQueue, &dlMsg) != PKT_ERROR_OK){
+        /* the downlink is encoded from its queue slot, released once sent */
+        dlMsg = pktQueuePeek(&outboundMsgQueue);
+        if (dlMsg == NULL){
             continue;
         }
+        dlMsg->stamp[MSG_STAMP_DEQUEUE] = latHistNowNs();
        
         // Prepare downstream packet to send to gw
         /* start composing datagram with the header */
         token_h = (uint8_t)rand(); /* random token */
         token_l = (uint8_t)rand(); /* random token */
-        buff_down[1] = token_h;
-        buff_down[2] = token_l;
-        buff_index = 4; /* 4-byte header */
-        
-        /* start of JSON structure */
-        memcpy((void *)(buff_down + buff_index), (void *)"{\"txpk\":", 8);
-        buff_index += 8;
-        
-        /* Start of packet, add inter-packet separator if necessary */
-        buff_down[buff_index] = '{';
-        ++buff_index;
-        
-        /* Network protocol metadata */
-        /* TX Time stamp */
-        j = snprintf((char *)(buff_down + buff_index), DOWNSTREAM_BUF_SIZE-buff_index, "\"tm_s\":%u,\"tm_us\":%6u", \
-                dlMsg.msg_tx_time.tv_sec, dlMsg.msg_tx_time.tv_usec);
-        if (j > 0) {
-            buff_index += j;
-        } else {
-            printf("ERROR: [down] snprintf failed line %u\n", (__LINE__ - 4));
-            exit(EXIT_FAILURE);
-        }
-        
-        // Tx packet metadata
-        switch (dlMsg.tx_mode) {
-            case IMMEDIATE:
-            default:
-            memcpy((void *)(buff_down + buff_index), (void *)",\"imme\":true", 12);
-            buff_index += 12;
-            break;
-        }
-        
-        /* RF chain & RX frequency, 34-36 useful chars */
-        j = snprintf((char *)(buff_down + buff_index), DOWNSTREAM_BUF_SIZE-buff_index, ",\"rfch\":%1u,\"freq\":%.6lf", dlMsg.rf_chain, (double)dlMsg.freq/1e6);
-        if (j > 0) {
-            buff_index += j;
-        } else {
-            printf("ERROR: [down] snprintf failed line %u\n", (__LINE__ - 4));
-            exit(EXIT_FAILURE);
-        }
-        
-        /* TX power */
-        j = snprintf((char *)(buff_down + buff_index), DOWNSTREAM_BUF_SIZE-buff_index, ",\"powe\":%1u", dlMsg.rf_power);
-        if (j > 0) {
-            buff_index += j;
-        } else {
-            printf("ERROR: [down] snprintf failed line %u\n", (__LINE__ - 4));
-            exit(EXIT_FAILURE);
-        }
-        
-        if (dlMsg.modulation == MOD_LORA) {
-            memcpy((void *)(buff_down + buff_index), (void *)",\"modu\":\"LORA\"", 14);
-            buff_index += 14;
-
-            /* Lora datarate & bandwidth, 16-19 useful chars */
-            switch (dlMsg.datarate) {
-                case DR_LORA_SF7:
-                    memcpy((void *)(buff_down + buff_index), (void *)",\"datr\":\"SF7", 12);
-                    buff_index += 12;
-                    break;
-                case DR_LORA_SF8:
-                    memcpy((void *)(buff_down + buff_index), (void *)",\"datr\":\"SF8", 12);
-                    buff_index += 12;
-                    break;
-                case DR_LORA_SF9:
-                    memcpy((void *)(buff_down + buff_index), (void *)",\"datr\":\"SF9", 12);
-                    buff_index += 12;
-                    break;
-                case DR_LORA_SF10:
-                    memcpy((void *)(buff_down + buff_index), (void *)",\"datr\":\"SF10", 13);
-                    buff_index += 13;
-                    break;
-                case DR_LORA_SF11:
-                    memcpy((void *)(buff_down + buff_index), (void *)",\"datr\":\"SF11", 13);
-                    buff_index += 13;
-                    break;
-                case DR_LORA_SF12:
-                    memcpy((void *)(buff_down + buff_index), (void *)",\"datr\":\"SF12", 13);
-                    buff_index += 13;
-                    break;
-                default:
-                    printf("ERROR: [down] lora packet with unknown datarate\n");
-                    memcpy((void *)(buff_down + buff_index), (void *)",\"datr\":\"SF?", 12);
-                    buff_index += 12;
-                    exit(EXIT_FAILURE);
-            }
-            
-            switch (dlMsg.bandwidth) {
-                case BW_125KHZ:
-                    memcpy((void *)(buff_down + buff_index), (void *)"BW125\"", 6);
-                    buff_index += 6;
-                    break;
-                case BW_250KHZ:
-                    memcpy((void *)(buff_down + buff_index), (void *)"BW250\"", 6);
-                    buff_index += 6;
-                    break;
-                case BW_500KHZ:
-                    memcpy((void *)(buff_down + buff_index), (void *)"BW500\"", 6);
-                    buff_index += 6;
-                    break;
-                default:
-                    printf("ERROR: [up] lora packet with unknown bandwidth\n");
-                    memcpy((void *)(buff_down + buff_index), (void *)"BW?\"", 4);
-                    buff_index += 4;
-                    exit(EXIT_FAILURE);
-            }
-
-            /* Packet ECC coding rate, 11-13 useful chars */
-            switch (dlMsg.coderate) {
-                case CR_LORA_4_5:
-                    memcpy((void *)(buff_down + buff_index), (void *)",\"codr\":\"4/5\"", 13);
-                    buff_index += 13;
-                    break;
-                case CR_LORA_4_6:
-                    memcpy((void *)(buff_down + buff_index), (void *)",\"codr\":\"4/6\"", 13);
-                    buff_index += 13;
-                    break;
-                case CR_LORA_4_7:
-                    memcpy((void *)(buff_down + buff_index), (void *)",\"codr\":\"4/7\"", 13);
-                    buff_index += 13;
-                    break;
-                case CR_LORA_4_8:
-                    memcpy((void *)(buff_down + buff_index), (void *)",\"codr\":\"4/8\"", 13);
-                    buff_index += 13;
-                    break;
-                case 0: /* treat the CR0 case (mostly false sync) */
-                    memcpy((void *)(buff_down + buff_index), (void *)",\"codr\":\"OFF\"", 13);
-                    buff_index += 13;
-                    break;
-                default:
-                    printf("ERROR: [up] lora packet with unknown coderate\n");
-                    memcpy((void *)(buff_down + buff_index), (void *)",\"codr\":\"?\"", 11);
-                    buff_index += 11;
-                    exit(EXIT_FAILURE);
-            }
-        } else if (dlMsg.modulation == MOD_FSK) {
-            memcpy((void *)(buff_down + buff_index), (void *)",\"modu\":\"FSK\"", 13);
-            buff_index += 13;
-
-            /* FSK datarate, 11-14 useful chars */
-            j = snprintf((char *)(buff_down + buff_index), DOWNSTREAM_BUF_SIZE-buff_index, ",\"datr\":%u", dlMsg.datarate);
-            if (j > 0) {
-                buff_index += j;
-            } else {
-                printf("ERROR: [up] snprintf failed line %u\n", (__LINE__ - 4));
-                exit(EXIT_FAILURE);
-            }
-        } else {
-            printf("ERROR: [up] received packet with unknown modulation\n");
-            exit(EXIT_FAILURE);
-        }
-        
-        switch (dlMsg.invert_pol) {
-            case true:
-                memcpy((void *)(buff_down + buff_index), (void *)",\"ipol\":true", 12);
-                buff_index += 13;
-            case false:
-            default:
-                memcpy((void *)(buff_down + buff_index), (void *)",\"ipol\":false", 13);
-                buff_index += 13;
-            break;
-        }
-        
-        /* Preamble size, payload size */
-        j = snprintf((char *)(buff_down + buff_index), DOWNSTREAM_BUF_SIZE-buff_index, ",\"prea\":%u,\"size\":%u", dlMsg.preamble, dlMsg.size);
-        if (j > 0) {
-            buff_index += j;
-        } else {
-            printf("ERROR: [down] snprintf failed line %u\n", (__LINE__ - 4));
-            exit(EXIT_FAILURE);
-        }
-
-        /* Packet payload */
-        memcpy((void *)(buff_down + buff_index), (void *)",\"data\":\"", 9);
-        buff_index += 9;
+        json_len = 0;
+        bin_len = 0;
         
 //        printf("MSG: ");
-//        for(int k = 0; k < dlMsg.size; k++){
-//            printf("%x ", dlMsg.payload[k]);
+//        for(int k = 0; k < dlMsg->size; k++){
+//            printf("%x ", dlMsg->payload[k]);
 //        }
 //        printf("\n");
-                
-        j = bin_to_b64(dlMsg.payload, dlMsg.size, (char *)(buff_down + buff_index), 341); /* 255 bytes = 340 chars in b64 + null char */
-        if (j>=0) {
-            buff_index += j;
-        } else {
-            printf("ERROR: [up] bin_to_b64 failed line %u\n", (__LINE__ - 5));
-            exit(EXIT_FAILURE);
-        }
-
-        buff_down[buff_index] = '"';
-        ++buff_index;
         
-        buff_down[buff_index] = '}';
-        ++buff_index;
-        
-        /* End of packet serialization */
-        buff_down[buff_index] = '}';
-        ++buff_index;
-
-//        printf("JSON: %s\n", buff_down);
-//        for(j = 0; j < buff_index; j++ ){
-//            printf("%x.",buff_down[j]);
-//        }
-//        printf("\n");
+        /* Send data to all gateways in the networks, in the encoding each one accepted,
+           a stalled gateway is disconnected after GW_SEND_TIMEOUT_MS instead of delaying the others */
+        pthread_mutex_lock(&mutexGateWayList);
+        for (gwInfo = GW_HEAD.next; gwInfo != NULL; gwInfo = gwInfo->next){
+            if (gwInfo->linkCaps & LINK_CAP_BIN_DOWNLINK) {
+                if (bin_len == 0) {
+                    bin_len = gwcDownlinkEncodeBin(&dlEncoder, dlMsg, buff_bin + FRAME_HDR_SIZE, DOWNSTREAM_BUF_SIZE - FRAME_HDR_SIZE);
+                    if (bin_len < 0) {
+                        LOG_MSG(LOG_LVL_ERROR, "ERROR: [down] invalid downlink parameters, packet dropped\n");
+                        break;
+                    }
+                    frame_header_write(buff_bin, PKT_DOWNLINK_DATA, token_h, token_l, bin_len);
+                }
+                SendToGateWay(gwInfo, buff_bin, FRAME_HDR_SIZE + bin_len);
+            } else {
+                if (json_len == 0) {
+                    json_len = gwcDownlinkEncodeJson(&dlEncoder, dlMsg, buff_json + FRAME_HDR_SIZE, DOWNSTREAM_BUF_SIZE - FRAME_HDR_SIZE);
+                    if (json_len < 0) {
+                        LOG_MSG(LOG_LVL_ERROR, "ERROR: [down] invalid downlink parameters, packet dropped\n");
+                        break;
+                    }
+                    frame_header_write(buff_json, PKT_DOWNLINK_DATA, token_h, token_l, json_len);
+//                    printf("JSON: %.*s\n", json_len, buff_json + FRAME_HDR_SIZE);
+                }
+                SendToGateWay(gwInfo, buff_json, FRAME_HDR_SIZE + json_len);
+            }
+//            printf("Send DOWNLINK msg to GW with sock %d\n", gwInfo->socket);
+        }
+        pthread_mutex_unlock(&mutexGateWayList);
         
-        /* Send JSON data to all gateways in the networks */
-        for (j = 0; j < fdmax + 1; j++){
-            if (FindGateWay(j) != NULL) {
-                write(j, buff_down, buff_index);
-//                printf("Send DOWNLINK msg to GW with sock %d\n", j);
+        /* written to every gateway */
+        if (dlMsg->stamp[MSG_STAMP_PERIOD] != 0) {
+            sent_ns = latHistNowNs();
+            latHistRecord(&dlLatHist[DL_LAT_QUEUE], (dlMsg->stamp[MSG_STAMP_DEQUEUE] - dlMsg->stamp[MSG_STAMP_ENQUEUE]) / 1000);
+            latHistRecord(&dlLatHist[DL_LAT_SEND], (sent_ns - dlMsg->stamp[MSG_STAMP_DEQUEUE]) / 1000);
+            if (dlMsg->latClass < DL_LAT_NB_HIST) {
+                latHistRecord(&dlLatHist[dlMsg->latClass], (sent_ns - dlMsg->stamp[MSG_STAMP_PERIOD]) / 1000);
             }
         }
+        pktQueueRelease(&outboundMsgQueue);
         
     }
     printf("\nINFO: End of downstream thread\n");
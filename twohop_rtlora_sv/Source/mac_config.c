@@ -0,0 +1,194 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   mac_config.c
+ * Author: LAM-HOANG
+ *
+ * Created on October 17, 2026
+ */
+
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+
+#include "mac_config.h"
+#include "parson.h"
+#include "trade.h"
+
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+typedef enum MacConfType_{
+    MAC_CONF_INT,           /* int field, same unit as the JSON value */
+    MAC_CONF_MS_TO_US,      /* uint32_t field in us, JSON value in ms */
+    MAC_CONF_U32,           /* uint32_t field, same unit as the JSON value */
+}MacConfType_e;
+
+typedef struct MacConfParam_{
+    const char *name;
+    size_t offset;
+    MacConfType_e type;
+}MacConfParam_t;
+
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+static const MacConfParam_t macConfParams[] = {
+    {"frame_factor",        offsetof(MacConfig_t, frameFactor),     MAC_CONF_INT},
+    {"ul_slot_size_ms",     offsetof(MacConfig_t, ulSlotSizeMs),    MAC_CONF_INT},
+    {"dl_slot_size_ms",     offsetof(MacConfig_t, dlSlotSizeMs),    MAC_CONF_INT},
+    {"nbo_channels",        offsetof(MacConfig_t, nboChannels),     MAC_CONF_INT},
+    {"sch_incremental",     offsetof(MacConfig_t, schIncremental),  MAC_CONF_INT},
+    {"max_children",        offsetof(MacConfig_t, maxNboChildren),  MAC_CONF_INT},
+    {"rnl_interval_ms",     offsetof(MacConfig_t, rnlIntervalUs),   MAC_CONF_MS_TO_US},
+    {"sch1_slot_size_ms",   offsetof(MacConfig_t, sch1SlotSizeUs),  MAC_CONF_MS_TO_US},
+    {"sch2_slot_size_ms",   offsetof(MacConfig_t, sch2SlotSizeUs),  MAC_CONF_MS_TO_US},
+    {"dl_freq_hz",          offsetof(MacConfig_t, dlFreqHz),        MAC_CONF_U32},
+    {"dl_power",            offsetof(MacConfig_t, dlPowerDbm),      MAC_CONF_INT},
+};
+
+#define MAC_CONF_NB_PARAMS      (sizeof(macConfParams) / sizeof(macConfParams[0]))
+
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static const MacConfParam_t *macConfFindParam(const char *name){
+    unsigned int i;
+
+    for(i = 0; i < MAC_CONF_NB_PARAMS; i++){
+        if(strcmp(macConfParams[i].name, name) == 0){
+            return &macConfParams[i];
+        }
+    }
+    return NULL;
+}
+
+/* Set the parameters of the "mac_conf" object in a copy, conf only changes if everything is valid */
+static int macConfParseValue(JSON_Value *rootVal, const char *from, MacConfig_t *conf){
+    JSON_Object *obj;
+    JSON_Value *val;
+    const MacConfParam_t *param;
+    MacConfig_t newConf = *conf;
+    double num;
+    size_t i;
+
+    obj = json_object_get_object(json_value_get_object(rootVal), MAC_CONF_OBJ);
+    if(obj == NULL){
+        MSG("ERROR: [MAC] %s does not contain a JSON object named %s\n", from, MAC_CONF_OBJ);
+        return -1;
+    }
+    for(i = 0; i < json_object_get_count(obj); i++){
+        param = macConfFindParam(json_object_get_name(obj, i));
+        if(param == NULL){
+            MSG("ERROR: [MAC] unknown parameter %s in %s\n", json_object_get_name(obj, i), from);
+            return -1;
+        }
+        val = json_object_get_value(obj, param->name);
+        num = json_value_get_number(val);
+        if(json_value_get_type(val) != JSONNumber || num < 0 || num != floor(num)){
+            MSG("ERROR: [MAC] %s must be a non-negative integer\n", param->name);
+            return -1;
+        }
+        if(num > UINT32_MAX){
+            MSG("ERROR: [MAC] %s is out of range\n", param->name);
+            return -1;
+        }
+        switch(param->type){
+            case MAC_CONF_INT:
+                if(num > INT32_MAX){
+                    MSG("ERROR: [MAC] %s is out of range\n", param->name);
+                    return -1;
+                }
+                *(int *)((uint8_t *)&newConf + param->offset) = (int)num;
+                break;
+            case MAC_CONF_MS_TO_US:
+                if(num > UINT32_MAX / 1000){
+                    MSG("ERROR: [MAC] %s is out of range\n", param->name);
+                    return -1;
+                }
+                *(uint32_t *)((uint8_t *)&newConf + param->offset) = (uint32_t)num * 1000;
+                break;
+            case MAC_CONF_U32:
+                *(uint32_t *)((uint8_t *)&newConf + param->offset) = (uint32_t)num;
+                break;
+        }
+    }
+    if(macConfValidate(&newConf) != 0){
+        return -1;
+    }
+    *conf = newConf;
+    return 0;
+}
+
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int macConfValidate(const MacConfig_t *conf){
+    if(conf->frameFactor < 1 || conf->frameFactor > 7){
+        MSG("ERROR: [MAC] frame factor must range from 1 to 7\n");
+    } else if(conf->ulSlotSizeMs < 30 || conf->ulSlotSizeMs > 310 || (conf->ulSlotSizeMs % 10 != 0)){
+        MSG("ERROR: [MAC] uplink slot size must range from 30 to 310 ms, by steps of 10 ms\n");
+    } else if(conf->dlSlotSizeMs < 30 || conf->dlSlotSizeMs > 310 || (conf->dlSlotSizeMs % 10 != 0)){
+        MSG("ERROR: [MAC] downlink slot size must range from 30 to 310 ms, by steps of 10 ms\n");
+    } else if(conf->nboChannels < 1 || conf->nboChannels > TWOHOP_MAX_NBO_CHANNELS){
+        MSG("ERROR: [MAC] number of channels must range from 1 to %d\n", TWOHOP_MAX_NBO_CHANNELS);
+    } else if(conf->schIncremental < 0 || conf->schIncremental > 1){
+        MSG("ERROR: [MAC] schedule distribution mode must be 0 or 1\n");
+    } else if(conf->maxNboChildren < 0 || conf->maxNboChildren > TWOHOP_MAX_NBO_CHILDREN){
+        MSG("ERROR: [MAC] children per relay must range from 0 to %d\n", TWOHOP_MAX_NBO_CHILDREN);
+    } else if(conf->rnlIntervalUs < 100000 || conf->rnlIntervalUs > 60000000){
+        MSG("ERROR: [MAC] RNL interval must range from 100 ms to 60 s\n");
+    } else if(conf->sch1SlotSizeUs < 10000 || conf->sch1SlotSizeUs > 1000000){
+        MSG("ERROR: [MAC] SCH1 slot size must range from 10 ms to 1 s\n");
+    } else if(conf->sch2SlotSizeUs < 10000 || conf->sch2SlotSizeUs > 1000000){
+        MSG("ERROR: [MAC] SCH2 slot size must range from 10 ms to 1 s\n");
+    } else if(conf->dlFreqHz < 137000000 || conf->dlFreqHz > 1020000000){
+        MSG("ERROR: [MAC] downlink frequency must range from 137 to 1020 MHz\n");
+    } else if(conf->dlPowerDbm < 0 || conf->dlPowerDbm > 30){
+        MSG("ERROR: [MAC] downlink power must range from 0 to 30 dBm\n");
+    } else {
+        return 0;
+    }
+    return -1;
+}
+
+int macConfParseString(const char *json, MacConfig_t *conf){
+    JSON_Value *rootVal;
+    int ret;
+
+    rootVal = json_parse_string_with_comments(json);
+    if(rootVal == NULL){
+        MSG("ERROR: [MAC] configuration is not valid JSON\n");
+        return -1;
+    }
+    ret = macConfParseValue(rootVal, "configuration", conf);
+    json_value_free(rootVal);
+    return ret;
+}
+
+int macConfParseFile(const char *path, MacConfig_t *conf){
+    JSON_Value *rootVal;
+    int ret;
+
+    rootVal = json_parse_file_with_comments(path);
+    if(rootVal == NULL){
+        MSG("ERROR: [MAC] %s is not a readable JSON file\n", path);
+        return -1;
+    }
+    ret = macConfParseValue(rootVal, path, conf);
+    json_value_free(rootVal);
+    return ret;
+}
+
+void macConfPrint(const MacConfig_t *conf, FILE *out){
+    fprintf(out, "\tFrame factor N: %d\n", conf->frameFactor);
+    fprintf(out, "\tUplink slot size: %d ms\n", conf->ulSlotSizeMs);
+    fprintf(out, "\tDownlink slot size: %d ms\n", conf->dlSlotSizeMs);
+    fprintf(out, "\tNumber of channels: %d\n", conf->nboChannels);
+    fprintf(out, "\tIncremental schedule distribution: %d\n", conf->schIncremental);
+    fprintf(out, "\tChildren per relay: %d\n", conf->maxNboChildren);
+    fprintf(out, "\tRNL interval: %u ms\n", conf->rnlIntervalUs / 1000);
+    fprintf(out, "\tSCH1 slot size: %u ms\n", conf->sch1SlotSizeUs / 1000);
+    fprintf(out, "\tSCH2 slot size: %u ms\n", conf->sch2SlotSizeUs / 1000);
+    fprintf(out, "\tDownlink channel: %u Hz, %d dBm\n", conf->dlFreqHz, conf->dlPowerDbm);
+}
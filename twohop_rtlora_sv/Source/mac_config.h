@@ -0,0 +1,81 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   mac_config.h
+ * Author: LAM-HOANG
+ * Description:
+ *          MAC parameters that can be changed while the network runs, read
+ *          from the "mac_conf" object of a JSON file. A file only has to
+ *          hold the parameters it changes, the others keep their value. The
+ *          MAC applies a new configuration at its next frame boundary.
+ * Created on October 17, 2026
+ */
+
+#ifndef MAC_CONFIG_H
+#define MAC_CONFIG_H
+
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdio.h>
+#include <stdint.h>     /* C99 types */
+
+#include "rtlora_mac_conf.h"
+
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define MAC_CONF_FILE           "mac_conf.json"     // read at startup when present, and by the reload command
+#define MAC_CONF_OBJ            "mac_conf"
+
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+typedef struct MacConfig_{
+    int frameFactor;            /* N, 2^N uplink slots (LSIs) per frame, 1 to 7 */
+    int ulSlotSizeMs;           /* 30 to 310, multiple of 10 */
+    int dlSlotSizeMs;           /* 30 to 310, multiple of 10 */
+    int nboChannels;            /* schedule groups, 1 to TWOHOP_MAX_NBO_CHANNELS */
+    int schIncremental;         /* 1: schedule distribution keeps the LSIs already assigned */
+    int maxNboChildren;         /* children accepted per relay, up to TWOHOP_MAX_NBO_CHILDREN */
+    uint32_t rnlIntervalUs;
+    uint32_t sch1SlotSizeUs;
+    uint32_t sch2SlotSizeUs;
+    uint32_t dlFreqHz;          /* downlink channel */
+    int dlPowerDbm;
+}MacConfig_t;
+
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Check the range of every parameter, the first error is printed
+@param conf[in] Configuration
+@return 0 if valid, -1 otherwise
+*/
+int macConfValidate(const MacConfig_t *conf);
+
+/**
+@brief Override parameters with those of the "mac_conf" object of a JSON text
+@param json[in] JSON text, comments allowed
+@param conf[in/out] Current configuration, left untouched on error
+@return 0 if succeeded, -1 if the text, a type or a range is wrong (printed)
+*/
+int macConfParseString(const char *json, MacConfig_t *conf);
+
+/**
+@brief Override parameters with those of the "mac_conf" object of a JSON file
+@param path[in] File name
+@param conf[in/out] Current configuration, left untouched on error
+@return 0 if succeeded, -1 otherwise (printed)
+*/
+int macConfParseFile(const char *path, MacConfig_t *conf);
+
+/**
+@brief Print a configuration, one parameter per line
+@param conf[in] Configuration
+@param out[in] output stream
+*/
+void macConfPrint(const MacConfig_t *conf, FILE *out);
+
+#endif /* MAC_CONFIG_H */
@@ -0,0 +1,262 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   mac_snapshot.c
+ * Author: LAM-HOANG
+ *
+ * Created on October 17, 2026
+ */
+
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "mac_snapshot.h"
+#include "async_log.h"
+
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define MAC_SNAP_ROW_SIZE       160
+
+/* --- PUBLIC VARIABLES ----------------------------------------------------- */
+
+MacSnapshotStore_t macSnapshot;
+
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* Packet delivery ratios of a node, in percent of its latest sequence number */
+static void macSnapshotPdr(const MacSnapNode_t *node, float *pdr, float *pdrDirect, float *pdrMain){
+    if(node->latestSeqNo != 0){
+        *pdr = (float)node->dataCount / (node->latestSeqNo * 1.0) * 100;
+        *pdrDirect = (float)node->dataCountDirectLink / (node->latestSeqNo * 1.0) * 100;
+        *pdrMain = (float)node->dataCountMainLink / (node->latestSeqNo * 1.0) * 100;
+    } else {
+        *pdr = 0.0;
+        *pdrDirect = 0.0;
+        *pdrMain = 0.0;
+    }
+}
+
+/* One row of the node table, the columns of printNodeList */
+static void macSnapshotNodeRow(char *row, const MacSnapNode_t *node){
+    float pdr, pdrDirect, pdrMain;
+
+    macSnapshotPdr(node, &pdr, &pdrDirect, &pdrMain);
+    if(node->type == Node_Type_Onehop){
+        snprintf(row, MAC_SNAP_ROW_SIZE, "\t%hu%s\t\t%s\t\t%hhu\t\t%hhu\t\t%hu (%hu) (%hu)\t\t%hu\t\t%.1f (%.1f) (%.1f)\t%u%s\n",
+                node->addr, (node->nboChildren > 0) ? " (R)" : "", node->schFlag ? "true" : "false",
+                node->slotDmn, node->class, node->dataCount, node->dataCountDirectLink, node->dataCountMainLink,
+                node->latestSeqNo, pdr, pdrDirect, pdrMain, node->dataMissCount,
+                (node->isConnected == false) ? "(DIST)" : "");
+    } else {
+        snprintf(row, MAC_SNAP_ROW_SIZE, "\t%hu (%hu)\t\t\t\t%hhu\t\t%hhu\t\t%hu (%hu) (%hu)\t\t%hu\t\t%.1f (%.1f) (%.1f)\t%u%s\n",
+                node->addr, node->parentAddr, node->slotDmn, node->class, node->dataCount,
+                node->dataCountDirectLink, node->dataCountMainLink, node->latestSeqNo, pdr, pdrDirect, pdrMain,
+                node->dataMissCount, (node->isConnected == false) ? "(DIST)" : "");
+    }
+}
+
+static const char *macSnapshotNodeTitle(uint8_t type){
+    if(type == Node_Type_Onehop){
+        return "ONE-HOP NODES\n\tNodeID\t\tSch?\t\tSlotDemand\tClass\t\tDataCount\tLatestSeqNo\tPRD\t\tMissedCnt\n";
+    }
+    return "TWO-HOP NODES\n\tNodeID\t\t\t\tSlotDemand\tClass\t\tDataCount\tLatestSeqNo\tPRD\t\tMissedCnt\n";
+}
+
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+MacSnapshot_t *macSnapshotBegin(MacSnapshotStore_t *store){
+    uint32_t cur = store->published;
+    uint32_t back = cur ^ 1;
+
+    // odd sequence before the first byte of the buffer is changed
+    __atomic_store_n(&store->seq[back], store->seq[back] + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    store->buf[back].generation = store->buf[cur].generation + 1;
+    return &store->buf[back];
+}
+
+void macSnapshotPublish(MacSnapshotStore_t *store){
+    uint32_t back = store->published ^ 1;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    store->buf[back].stampUs = (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+    __atomic_store_n(&store->seq[back], store->seq[back] + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&store->published, back, __ATOMIC_RELEASE);
+}
+
+int macSnapshotRead(MacSnapshotStore_t *store, MacSnapshot_t *snap){
+    uint32_t idx, seq;
+    int nbRetries = 0;
+
+    while(true){
+        idx = __atomic_load_n(&store->published, __ATOMIC_ACQUIRE);
+        seq = __atomic_load_n(&store->seq[idx], __ATOMIC_ACQUIRE);
+        if((seq & 1) == 0){
+            memcpy(snap, &store->buf[idx], sizeof(*snap));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if(__atomic_load_n(&store->seq[idx], __ATOMIC_RELAXED) == seq){
+                break;
+            }
+        }
+        // the writer went twice around the double buffer during the copy
+        nbRetries++;
+        __atomic_fetch_add(&store->nbRetries, 1, __ATOMIC_RELAXED);
+    }
+    if(snap->phase == NULL){
+        snap->phase = "NONE";
+    }
+    return nbRetries;
+}
+
+void macSnapshotFillNodes(MacSnapshot_t *snap, const MngtNodeList_t *lst){
+    const MngtNode_t *node;
+    MacSnapNode_t *row;
+    int n = 0;
+
+    for(node = lst->head; node != NULL && n < MAC_SNAP_MAX_NODES; node = node->next){
+        row = &snap->nodes[n++];
+        row->addr = node->genInfo.addr;
+        row->parentAddr = node->parrentAddr;
+        row->type = (uint8_t)node->genInfo.type;
+        row->class = node->genInfo.class;
+        row->slotDmn = node->genInfo.slotDmn;
+        row->nboChildren = node->nboChildren;
+        row->schFlag = node->schFlag;
+        row->isConnected = node->isConnected;
+        row->dataMissCount = node->dataMissCount;
+        row->latestSeqNo = node->latestSeqNo;
+        row->dataCount = node->dataCount;
+        row->dataCountMainLink = node->dataCountMainLink;
+        row->dataCountDirectLink = node->dataCountDirectLink;
+    }
+    snap->nboNodes = (uint16_t)n;
+}
+
+void macSnapshotFillSchedules(MacSnapshot_t *snap, const SchList_t *schedules, int nboGroups){
+    const SchNode_t *node;
+    MacSnapSchGroup_t *group;
+    MacSnapSchNode_t *row;
+    int g, n = 0;
+
+    if(nboGroups > TWOHOP_MAX_NBO_CHANNELS){
+        nboGroups = TWOHOP_MAX_NBO_CHANNELS;
+    }
+    for(g = 0; g < nboGroups; g++){
+        group = &snap->schGroups[g];
+        group->first = (uint16_t)n;
+        group->nboTotSlots = (uint16_t)schedules[g].nboTotSlots;
+        group->nboAsgSlots = (uint16_t)schedules[g].nboAsgSlots;
+        group->nboDistReq = (uint16_t)schedules[g].nboDistReq;
+        for(node = schedules[g].head; node != NULL && n < MAC_SNAP_MAX_SCH_NODES; node = node->next){
+            row = &snap->schNodes[n++];
+            row->addr = node->addr;
+            row->startLSI = node->startLSI;
+            row->slotDemand = node->slotDemand;
+            row->nboSchDist = node->nboSchDist;
+        }
+        group->nboNode = (uint16_t)(n - group->first);
+    }
+    snap->nboSchGroups = (uint16_t)nboGroups;
+    snap->nboSchNodes = (uint16_t)n;
+}
+
+void macSnapshotLogNodes(const MacSnapshot_t *snap){
+    char row[MAC_SNAP_ROW_SIZE];
+    uint8_t type;
+    int i;
+
+    LOG_MSG(LOG_LVL_INFO, "\t\t\t\t--- NODE INFORMATION (%u NODES) ---\n", snap->nboNodes);
+    if(snap->nboNodes == 0){
+        LOG_MSG(LOG_LVL_INFO, "Empty ...\n\n");
+        return;
+    }
+    for(type = Node_Type_Onehop; type <= Node_Type_Twohop; type++){
+        LOG_MSG(LOG_LVL_INFO, "%s", macSnapshotNodeTitle(type));
+        for(i = 0; i < snap->nboNodes; i++){
+            if(snap->nodes[i].type == type){
+                macSnapshotNodeRow(row, &snap->nodes[i]);
+                LOG_MSG(LOG_LVL_INFO, "%s", row);
+            }
+        }
+    }
+    LOG_MSG(LOG_LVL_INFO, "\t\t\t\t-----------------------------------\n\n");
+}
+
+void macSnapshotLogSchedules(const MacSnapshot_t *snap){
+    const MacSnapSchGroup_t *group;
+    const MacSnapSchNode_t *node;
+    int g, i;
+
+    for(g = 0; g < snap->nboSchGroups; g++){
+        group = &snap->schGroups[g];
+        LOG_MSG(LOG_LVL_INFO, "SCHEDULE GROUP %d, NBO SCH DIST REQUEST %u\n", g, group->nboDistReq);
+        LOG_MSG(LOG_LVL_INFO, "\t\t======== SCHEDULE =======\n");
+        LOG_MSG(LOG_LVL_INFO, "\tNode\tAsgLsi\tDemand\tNboSchDist\n");
+        for(i = 0; i < group->nboNode; i++){
+            node = &snap->schNodes[group->first + i];
+            LOG_MSG(LOG_LVL_INFO, "\t%hu\t%hu\t%hu\t%hu\n", node->addr, node->startLSI, node->slotDemand, node->nboSchDist);
+        }
+    }
+}
+
+void macSnapshotPrintGateways(const MacSnapshot_t *snap, FILE *out){
+    const MacSnapGateway_t *gw;
+    int i, n;
+
+    fprintf(out, "Gateway Information\n");
+    if(snap->nboGateways == 0){
+        fprintf(out, " - Empty..\n\n");
+        return;
+    }
+    n = (snap->nboGateways < MAC_SNAP_MAX_GATEWAYS) ? snap->nboGateways : MAC_SNAP_MAX_GATEWAYS;
+    for(i = 0; i < n; i++){
+        gw = &snap->gateways[i];
+        fprintf(out, "GW Socket Number : %d\n", gw->socket);
+        fprintf(out, "GW IP Address    : %s\n", inet_ntoa(gw->addr));
+        fprintf(out, "GW Link Caps     : 0x%02X\n", gw->linkCaps);
+        fprintf(out, "GW Ingest Worker : %u\n", gw->worker);
+        fprintf(out, "GW Rx Frames     : %u (%u bytes dropped)\n", gw->rxFrames, gw->rxDropped);
+        fprintf(out, "GW Rx Buffer Size: %u\n", gw->rxPending);
+    }
+    if(snap->nboGateways > n){
+        fprintf(out, " - %u more gateways not copied\n", snap->nboGateways - n);
+    }
+}
+
+void macSnapshotPrint(const MacSnapshot_t *snap, FILE *out){
+    const MacSnapSchGroup_t *group;
+    const MacSnapSchNode_t *node;
+    char row[MAC_SNAP_ROW_SIZE];
+    uint8_t type;
+    int g, i;
+
+    fprintf(out, "MAC snapshot %u: %s phase, period %hu, %llu.%06llu\n", snap->generation, snap->phase,
+            snap->period, (unsigned long long)(snap->stampUs / 1000000), (unsigned long long)(snap->stampUs % 1000000));
+    fprintf(out, "\t\t\t\t--- NODE INFORMATION (%u NODES) ---\n", snap->nboNodes);
+    for(type = Node_Type_Onehop; type <= Node_Type_Twohop && snap->nboNodes > 0; type++){
+        fputs(macSnapshotNodeTitle(type), out);
+        for(i = 0; i < snap->nboNodes; i++){
+            if(snap->nodes[i].type == type){
+                macSnapshotNodeRow(row, &snap->nodes[i]);
+                fputs(row, out);
+            }
+        }
+    }
+    for(g = 0; g < snap->nboSchGroups; g++){
+        group = &snap->schGroups[g];
+        fprintf(out, "SCHEDULE GROUP %d: %u nodes, %u/%u LSIs assigned, %u to distribute\n", g, group->nboNode,
+                group->nboAsgSlots, group->nboTotSlots, group->nboDistReq);
+        fprintf(out, "\tNode\tAsgLsi\tDemand\tNboSchDist\n");
+        for(i = 0; i < group->nboNode; i++){
+            node = &snap->schNodes[group->first + i];
+            fprintf(out, "\t%hu\t%hu\t%hu\t%hu\n", node->addr, node->startLSI, node->slotDemand, node->nboSchDist);
+        }
+    }
+    macSnapshotPrintGateways(snap, out);
+}
@@ -0,0 +1,176 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   mac_snapshot.h
+ * Author: LAM-HOANG
+ * Description:
+ *          Read-mostly copy of the MAC state (NODES, SCHEDULES and the gateway
+ *          table) for the console, the statistics and the export. The phase
+ *          thread fills the back buffer of a double buffer once per frame and
+ *          publishes it, readers copy the published buffer under a sequence
+ *          counter and retry if it was overwritten meanwhile. Readers never
+ *          take a lock and never hold up the MAC.
+ * Created on October 17, 2026
+ */
+
+#ifndef MAC_SNAPSHOT_H
+#define MAC_SNAPSHOT_H
+
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdio.h>
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>
+#include <netinet/in.h>
+
+#include "rtlora_mac_conf.h"
+#include "device_mngt.h"
+#include "schedule_mngt.h"
+
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define MAC_SNAP_MAX_NODES      TWOHOP_MNGT_NODE_POOL_SIZE
+#define MAC_SNAP_MAX_SCH_NODES  TWOHOP_SCH_NODE_POOL_SIZE
+#define MAC_SNAP_MAX_GATEWAYS   64  /* further gateways are counted, not copied */
+
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+typedef struct MacSnapNode_{
+    uint16_t addr;
+    uint16_t parentAddr;        /* two hop node only */
+    uint8_t type;               /* NodeType_e */
+    uint8_t class;
+    uint8_t slotDmn;
+    uint8_t nboChildren;        /* relay node only */
+    bool schFlag;
+    bool isConnected;
+    uint16_t dataMissCount;
+    uint16_t latestSeqNo;
+    uint16_t dataCount;
+    uint16_t dataCountMainLink;
+    uint16_t dataCountDirectLink;
+}MacSnapNode_t;
+
+typedef struct MacSnapSchNode_{
+    uint16_t addr;
+    uint16_t startLSI;
+    uint16_t slotDemand;
+    uint16_t nboSchDist;
+}MacSnapSchNode_t;
+
+typedef struct MacSnapSchGroup_{
+    uint16_t first;             /* index of the first node of the group in schNodes */
+    uint16_t nboNode;           /* nodes of the group copied in schNodes */
+    uint16_t nboTotSlots;
+    uint16_t nboAsgSlots;
+    uint16_t nboDistReq;
+}MacSnapSchGroup_t;
+
+typedef struct MacSnapGateway_{
+    int socket;
+    struct in_addr addr;
+    uint8_t linkCaps;
+    uint8_t worker;
+    uint32_t rxFrames;
+    uint32_t rxDropped;         /* bytes skipped to resynchronize */
+    uint32_t rxPending;         /* bytes of a partial frame */
+}MacSnapGateway_t;
+
+typedef struct MacSnapshot_{
+    uint32_t generation;        /* number of the publication, 0 before the first one */
+    const char *phase;          /* name of the MAC phase, a string literal */
+    uint16_t period;            /* RNL interval or frame period of the phase */
+    uint64_t stampUs;           /* CLOCK_MONOTONIC time of the publication */
+
+    uint16_t nboNodes;
+    MacSnapNode_t nodes[MAC_SNAP_MAX_NODES];        /* in the order of NODES */
+
+    uint16_t nboSchGroups;
+    MacSnapSchGroup_t schGroups[TWOHOP_MAX_NBO_CHANNELS];
+    uint16_t nboSchNodes;
+    MacSnapSchNode_t schNodes[MAC_SNAP_MAX_SCH_NODES];  /* groups one after the other, ascending LSI */
+
+    uint16_t nboGateways;       /* connected gateways, possibly more than copied */
+    MacSnapGateway_t gateways[MAC_SNAP_MAX_GATEWAYS];
+}MacSnapshot_t;
+
+typedef struct MacSnapshotStore_{
+    MacSnapshot_t buf[2];
+    uint32_t seq[2];            /* odd while buf[i] is being written */
+    uint32_t published;         /* index of the buffer readers copy */
+    uint32_t nbRetries;         /* reads restarted because the writer came by */
+}MacSnapshotStore_t;
+
+/* Snapshot of the phase thread */
+extern MacSnapshotStore_t macSnapshot;
+
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Get the buffer to fill for the next publication, its content is the previous but one snapshot
+Single writer: only one thread may fill a store.
+@param store[in/out] Snapshot store
+@return back buffer, readers retry until macSnapshotPublish
+*/
+MacSnapshot_t *macSnapshotBegin(MacSnapshotStore_t *store);
+
+/**
+@brief Publish the buffer returned by macSnapshotBegin
+@param store[in/out] Snapshot store
+*/
+void macSnapshotPublish(MacSnapshotStore_t *store);
+
+/**
+@brief Copy the latest published snapshot, lock free
+@param store[in] Snapshot store
+@param snap[out] Copy, generation 0 if nothing was published yet
+@return number of retries
+*/
+int macSnapshotRead(MacSnapshotStore_t *store, MacSnapshot_t *snap);
+
+/**
+@brief Copy the nodes of a list, the caller holds the lock of the list
+@param snap[out] Snapshot being filled
+@param lst[in] NODES
+*/
+void macSnapshotFillNodes(MacSnapshot_t *snap, const MngtNodeList_t *lst);
+
+/**
+@brief Copy the schedule groups, the caller holds the lock of the schedules
+@param snap[out] Snapshot being filled
+@param schedules[in] SCHEDULES
+@param nboGroups[in] Number of schedule groups
+*/
+void macSnapshotFillSchedules(MacSnapshot_t *snap, const SchList_t *schedules, int nboGroups);
+
+/**
+@brief Log the nodes of a snapshot, the layout of printNodeList
+@param snap[in] Snapshot
+*/
+void macSnapshotLogNodes(const MacSnapshot_t *snap);
+
+/**
+@brief Log the schedule groups of a snapshot, the layout of smPrintSchedule
+@param snap[in] Snapshot
+*/
+void macSnapshotLogSchedules(const MacSnapshot_t *snap);
+
+/**
+@brief Print the gateways of a snapshot
+@param snap[in] Snapshot
+@param out[in] output stream, stdout or the export file
+*/
+void macSnapshotPrintGateways(const MacSnapshot_t *snap, FILE *out);
+
+/**
+@brief Print a whole snapshot: header, nodes, schedule groups and gateways
+@param snap[in] Snapshot
+@param out[in] output stream, stdout or the export file
+*/
+void macSnapshotPrint(const MacSnapshot_t *snap, FILE *out);
+
+#endif /* MAC_SNAPSHOT_H */
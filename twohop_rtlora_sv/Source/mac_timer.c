@@ -0,0 +1,157 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   mac_timer.c
+ * Author: LAM-HOANG
+ *
+ * Created on October 17, 2026
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "mac_timer.h"
+#include "trade.h"
+
+#define NSEC_PER_SEC    1000000000LL
+
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* Last deadline reached by a timer, the next phase starts from it */
+static struct timespec timeline;
+
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static int64_t tsToNs(const struct timespec *ts){
+    return (int64_t)ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+static struct timespec nsToTs(int64_t ns){
+    struct timespec ts;
+
+    ts.tv_sec = ns / NSEC_PER_SEC;
+    ts.tv_nsec = ns % NSEC_PER_SEC;
+    return ts;
+}
+
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void macTimerStart(MacTimer_t *timer, const char *name, uint64_t periodUs){
+    struct timespec now;
+    int64_t base;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    timer->name = name;
+    timer->periodNs = periodUs * 1000;
+
+    base = tsToNs(&timeline);
+    if((base == 0) || (tsToNs(&now) - base >= (int64_t)timer->periodNs)){
+        /* first timer, or nothing ran on the timeline for a while */
+        base = tsToNs(&now);
+    }
+    timer->start = nsToTs(base);
+    timer->next = nsToTs(base + (int64_t)timer->periodNs);
+    if(timer->nbWakeUps == 0){
+        timer->minJitterNs = INT64_MAX;
+        timer->maxJitterNs = INT64_MIN;
+    }
+}
+
+void macTimerSetPeriod(MacTimer_t *timer, uint64_t periodUs){
+    timer->periodNs = periodUs * 1000;
+    timer->next = nsToTs(tsToNs(&timer->start) + (int64_t)timer->periodNs);
+}
+
+unsigned int macTimerWait(MacTimer_t *timer){
+    struct timespec now;
+    int64_t deadline, late, jitter;
+    unsigned int skipped = 0;
+    int err;
+
+    deadline = tsToNs(&timer->next);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    late = tsToNs(&now) - deadline;
+
+    if(late >= 0){
+        /* the work of the period went past its deadline, the next period starts now */
+        timer->nbOverruns++;
+        if((uint64_t)late > timer->maxOverrunNs){
+            timer->maxOverrunNs = (uint64_t)late;
+        }
+        skipped = (unsigned int)(late / (int64_t)timer->periodNs);
+        deadline += (int64_t)skipped * (int64_t)timer->periodNs;
+        timer->nbSkipped += skipped;
+    } else {
+        do {
+            err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &timer->next, NULL);
+        } while(err == EINTR);
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        jitter = tsToNs(&now) - deadline;
+        if(jitter < timer->minJitterNs){
+            timer->minJitterNs = jitter;
+        }
+        if(jitter > timer->maxJitterNs){
+            timer->maxJitterNs = jitter;
+        }
+        timer->sumJitterNs += jitter;
+        timer->nbWakeUps++;
+    }
+
+    timer->nbPeriods++;
+    timer->start = nsToTs(deadline);
+    timer->next = nsToTs(deadline + (int64_t)timer->periodNs);
+    timeline = timer->start;
+    return skipped;
+}
+
+struct timeval macTimerToRealtime(const struct timespec *mono){
+    struct timespec nowMono, nowReal;
+    struct timeval tv;
+    int64_t real;
+
+    clock_gettime(CLOCK_MONOTONIC, &nowMono);
+    clock_gettime(CLOCK_REALTIME, &nowReal);
+    real = tsToNs(&nowReal) - (tsToNs(&nowMono) - tsToNs(mono));
+
+    tv.tv_sec = real / NSEC_PER_SEC;
+    tv.tv_usec = (real % NSEC_PER_SEC) / 1000;
+    return tv;
+}
+
+int macTimerSetRealtime(int priority){
+    struct sched_param param;
+    int err;
+
+    memset(&param, 0, sizeof param);
+    param.sched_priority = priority;
+    err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if(err != 0){
+        MSG("WARNING: [MAC] SCHED_FIFO priority %d not applied, %s\n", priority, strerror(err));
+        return -1;
+    }
+    return 0;
+}
+
+void macTimerPrint(const MacTimer_t *timer){
+    if(timer->name == NULL){
+        return;
+    }
+    printf("%-10s: period %7.1f ms, %8llu periods, %6llu overruns (max %7.3f ms), %6llu skipped",
+            timer->name, (double)timer->periodNs / 1e6, (unsigned long long)timer->nbPeriods,
+            (unsigned long long)timer->nbOverruns, (double)timer->maxOverrunNs / 1e6,
+            (unsigned long long)timer->nbSkipped);
+    if(timer->nbWakeUps > 0){
+        printf(", jitter min/avg/max %.1f/%.1f/%.1f us\n", (double)timer->minJitterNs / 1e3,
+                (double)timer->sumJitterNs / 1e3 / timer->nbWakeUps, (double)timer->maxJitterNs / 1e3);
+    } else {
+        printf("\n");
+    }
+}
@@ -0,0 +1,94 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   mac_timer.h
+ * Author: LAM-HOANG
+ * Description:
+ *          Periodic MAC events on absolute CLOCK_MONOTONIC deadlines. Every
+ *          period starts exactly one period after the previous one, whatever
+ *          the time spent in the work of the period, and a timer started by
+ *          a phase continues from the last deadline of the previous phase,
+ *          so frame boundaries stay phase locked.
+ * Created on October 17, 2026
+ */
+
+#ifndef MAC_TIMER_H
+#define MAC_TIMER_H
+
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <time.h>       /* struct timespec */
+#include <sys/time.h>   /* struct timeval */
+
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+typedef struct MacTimer_{
+    const char      *name;
+    uint64_t        periodNs;
+    struct timespec start;          /* deadline the current period started at */
+    struct timespec next;           /* deadline ending the current period */
+    /* statistics */
+    uint64_t        nbPeriods;
+    uint64_t        nbOverruns;     /* periods whose work ended after their deadline */
+    uint64_t        nbSkipped;      /* whole periods dropped to catch up after an overrun */
+    uint64_t        maxOverrunNs;
+    int64_t         minJitterNs;    /* wake up time minus deadline */
+    int64_t         maxJitterNs;
+    int64_t         sumJitterNs;
+    uint64_t        nbWakeUps;
+}MacTimer_t;
+
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Start the first period of a timer
+The period starts at the last deadline reached by a timer when it is less than one period ago,
+at the current time otherwise. The statistics are kept across starts.
+@param timer[in/out] Timer
+@param name[in] Name in the statistics, static string
+@param periodUs[in] Period in microseconds
+*/
+void macTimerStart(MacTimer_t *timer, const char *name, uint64_t periodUs);
+
+/**
+@brief Change the period of a running timer, from the current period on
+The current period then ends periodUs after its start, already passed deadlines are caught up by macTimerWait.
+@param timer[in/out] Timer
+@param periodUs[in] Period in microseconds
+*/
+void macTimerSetPeriod(MacTimer_t *timer, uint64_t periodUs);
+
+/**
+@brief Wait for the end of the current period, which becomes the start of the next one
+A period overrun by its work is not waited for, whole periods that are already over are skipped.
+@param timer[in/out] Timer
+@return number of periods skipped
+*/
+unsigned int macTimerWait(MacTimer_t *timer);
+
+/**
+@brief Convert a CLOCK_MONOTONIC time to the wall clock of gettimeofday
+@param mono[in] CLOCK_MONOTONIC time, e.g. the start of a period
+@return the same instant on the wall clock
+*/
+struct timeval macTimerToRealtime(const struct timespec *mono);
+
+/**
+@brief Run the calling thread under SCHED_FIFO
+@param priority[in] SCHED_FIFO priority, 1 to 99
+@return 0 if succeeded, -1 otherwise (priority kept, a warning is printed)
+*/
+int macTimerSetRealtime(int priority);
+
+/**
+@brief Print the period, overrun and jitter counters of a timer on console
+@param timer[in] Timer
+*/
+void macTimerPrint(const MacTimer_t *timer);
+
+#endif /* MAC_TIMER_H */
@@ -0,0 +1,80 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   mem_pool.c
+ * Author: LAM-HOANG
+ *
+ * Created on October 17, 2026
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "mem_pool.h"
+
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static bool memPoolOwns(const MemPool_t *pool, const void *obj){
+    const uint8_t *p = obj;
+
+    return (p >= pool->base) && (p < pool->base + pool->objSize * pool->capacity);
+}
+
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void *memPoolAlloc(MemPool_t *pool){
+    void *obj;
+
+    pthread_mutex_lock(&pool->mutex);
+    if(pool->freeList != NULL){
+        obj = pool->freeList;
+        pool->freeList = *(void **)obj;
+    } else if(pool->nbCarved < pool->capacity){
+        /* storage is handed out in order the first time, no init loop is needed */
+        obj = pool->base + pool->objSize * pool->nbCarved;
+        pool->nbCarved++;
+    } else {
+        obj = malloc(pool->objSize);
+        if(obj == NULL){
+            pthread_mutex_unlock(&pool->mutex);
+            return NULL;
+        }
+        pool->nbOverflow++;
+    }
+    pool->nbUsed++;
+    if(pool->nbUsed > pool->highWater){
+        pool->highWater = pool->nbUsed;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return obj;
+}
+
+void memPoolFree(MemPool_t *pool, void *obj){
+    if(obj == NULL){
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->nbUsed--;
+    if(memPoolOwns(pool, obj)){
+        *(void **)obj = pool->freeList;
+        pool->freeList = obj;
+        obj = NULL;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    /* overflow object */
+    free(obj);
+}
+
+void memPoolPrint(MemPool_t *pool){
+    pthread_mutex_lock(&pool->mutex);
+    printf("%-10s: %4u used, high-water %4u / %4u, %u overflow (malloc), %zu bytes/object\n",
+            pool->name, pool->nbUsed, pool->highWater, pool->capacity, pool->nbOverflow, pool->objSize);
+    pthread_mutex_unlock(&pool->mutex);
+}
@@ -0,0 +1,72 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   mem_pool.h
+ * Author: LAM-HOANG
+ * Description:
+ *          Fixed capacity object pools over static storage, O(1) allocation
+ *          and release. The MAC node and schedule lists take their nodes from
+ *          here so that the steady state does no heap allocation.
+ * Created on October 17, 2026
+ */
+
+#ifndef MEM_POOL_H
+#define MEM_POOL_H
+
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stddef.h>     /* size_t */
+#include <pthread.h>
+
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+typedef struct MemPool_{
+    const char      *name;
+    uint8_t         *base;          /* storage of capacity objects */
+    size_t          objSize;        /* at least sizeof(void *), free objects hold the list link */
+    uint32_t        capacity;
+    void            *freeList;      /* released objects */
+    uint32_t        nbCarved;       /* objects of the storage handed out at least once */
+    /* debug counters */
+    uint32_t        nbUsed;
+    uint32_t        highWater;      /* highest nbUsed, pool included */
+    uint32_t        nbOverflow;     /* allocations served by malloc because the pool was empty */
+    pthread_mutex_t mutex;
+}MemPool_t;
+
+/* --- PUBLIC MACROS -------------------------------------------------------- */
+
+/* Static initializer of a pool over an array of objects, no init call is needed */
+#define MEM_POOL_INITIALIZER(name, storage, capacity) \
+    { (name), (uint8_t *)(storage), sizeof((storage)[0]), (capacity), NULL, 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER }
+
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Take an object from a pool
+Once the storage is exhausted the object comes from malloc, and is counted in nbOverflow.
+@param pool[in/out] Pool
+@return uninitialized object, NULL if the pool is empty and malloc fails
+*/
+void *memPoolAlloc(MemPool_t *pool);
+
+/**
+@brief Give an object back to its pool
+@param pool[in/out] Pool the object was taken from
+@param obj[in] Object returned by memPoolAlloc, NULL is ignored
+*/
+void memPoolFree(MemPool_t *pool, void *obj);
+
+/**
+@brief Print the usage counters of a pool on console
+@param pool[in] Pool
+*/
+void memPoolPrint(MemPool_t *pool);
+
+#endif /* MEM_POOL_H */
@@ -14,112 +14,176 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 #include "packet_queue.h"
 #include "trade.h"
 
-void pktQueueInit(struct PktQueue *queue){
-    pthread_mutex_init(&queue->mutex, NULL);
-    pthread_mutex_lock(&queue->mutex);
-    queue->size = 0;
-    queue->head = NULL;
-    queue->tail = NULL;
-    pthread_mutex_unlock(&queue->mutex);
+/* Indexes run freely, the slot is the index modulo PKT_QUEUE_MAX. The producer
+ * publishes a slot with a release store of tail, the consumer frees it with a
+ * release store of head. Each side caches the index of the other one and only
+ * reloads it when the queue looks full (producer) or empty (consumer). */
+#define PKT_QUEUE_MASK          (PKT_QUEUE_MAX - 1)
+
+#if (PKT_QUEUE_MAX & PKT_QUEUE_MASK) != 0
+#error "PKT_QUEUE_MAX must be a power of 2"
+#endif
+
+int pktDoorbellInit(struct PktDoorbell *doorbell){
+    doorbell->sleeping = 0;
+    doorbell->fd = eventfd(0, EFD_CLOEXEC);
+    if(doorbell->fd == -1){
+        MSG("ERROR: cannot create packet queue doorbell, %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
 }
 
-bool isPktQueueFull(struct PktQueue *queue){
-    bool result;
+void pktDoorbellRing(struct PktDoorbell *doorbell){
+    uint64_t one = 1;
+    
+    /* pairs with the fence of pktDoorbellWait: either the consumer sees the
+     * new tail, or this thread sees it sleeping and writes the eventfd */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&doorbell->sleeping, __ATOMIC_RELAXED) == 0){
+        return;
+    }
+    while((write(doorbell->fd, &one, sizeof one) == -1) && (errno == EINTR))
+        ;
+}
+
+void pktDoorbellWait(struct PktDoorbell *doorbell, struct PktQueue *queues, int nbo_queues){
+    uint64_t count;
+    int i;
+    
+    __atomic_store_n(&doorbell->sleeping, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for(i = 0; i < nbo_queues; i++){
+        if(!isPktQueueEmpty(&queues[i])){
+            __atomic_store_n(&doorbell->sleeping, 0, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+    while((read(doorbell->fd, &count, sizeof count) == -1) && (errno == EINTR))
+        ;
+    __atomic_store_n(&doorbell->sleeping, 0, __ATOMIC_RELAXED);
+}
 
-    pthread_mutex_lock(&queue->mutex);
+void pktQueueInit(struct PktQueue *queue, struct PktDoorbell *doorbell){
+    queue->tail = 0;
+    queue->headCache = 0;
+    queue->doorbell = doorbell;
+    queue->head = 0;
+    queue->tailCache = 0;
+}
 
-    result = (queue->size == PKT_QUEUE_MAX) ? true : false;
+bool isPktQueueFull(struct PktQueue *queue){
+    uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
 
-    pthread_mutex_unlock(&queue->mutex);
+    if((tail - queue->headCache) < PKT_QUEUE_MAX){
+        return false;
+    }
+    queue->headCache = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
 
-    return result;
+    return ((tail - queue->headCache) >= PKT_QUEUE_MAX) ? true : false;
 }
 
 bool isPktQueueEmpty(struct PktQueue *queue) {
-    bool result;
+    return (__atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) == __atomic_load_n(&queue->head, __ATOMIC_RELAXED)) ? true : false;
+}
 
-    pthread_mutex_lock(&queue->mutex);
+struct MsgInfo_ *pktQueueReserve(struct PktQueue *queue){
+    return pktQueueReserveAt(queue, 0);
+}
 
-    result = (queue->size == 0) ? true : false;
+struct MsgInfo_ *pktQueueReserveAt(struct PktQueue *queue, uint32_t offset){
+    uint32_t tail = queue->tail + offset;
 
-    pthread_mutex_unlock(&queue->mutex);
+    if((tail - queue->headCache) >= PKT_QUEUE_MAX){
+        queue->headCache = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+        if((tail - queue->headCache) >= PKT_QUEUE_MAX){
+            return NULL;
+        }
+    }
+    return &queue->slot[tail & PKT_QUEUE_MASK];
+}
 
-    return result;
+void pktQueueCommit(struct PktQueue *queue){
+    pktQueueCommitN(queue, 1);
+}
+
+void pktQueueCommitN(struct PktQueue *queue, uint32_t nbo_packets){
+    if(nbo_packets == 0){
+        return;
+    }
+    __atomic_store_n(&queue->tail, queue->tail + nbo_packets, __ATOMIC_RELEASE);
+    if(queue->doorbell != NULL){
+        pktDoorbellRing(queue->doorbell);
+    }
+}
+
+struct MsgInfo_ *pktQueuePeek(struct PktQueue *queue){
+    uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+
+    if(head == queue->tailCache){
+        queue->tailCache = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+        if(head == queue->tailCache){
+            return NULL;
+        }
+    }
+    return &queue->slot[head & PKT_QUEUE_MASK];
+}
+
+void pktQueueRelease(struct PktQueue *queue){
+    __atomic_store_n(&queue->head, queue->head + 1, __ATOMIC_RELEASE);
 }
 
 PktError_e pktEnqueue(struct PktQueue *queue, struct MsgInfo_ *packet){
-    struct PktNode *newPktNode;
+    struct MsgInfo_ *slot;
     
     if(packet == NULL){
         MSG("ERROR: cannot enqueue packet, packet is invalid\n");
         return PKT_ERROR_INVALID;
     }
     
-    if (isPktQueueFull(queue)) {
+    slot = pktQueueReserve(queue);
+    if (slot == NULL) {
         MSG("ERROR: cannot enqueue packet, packet queue is full\n");
         return PKT_ERROR_FULL;
     }
     
-    pthread_mutex_lock(&queue->mutex);
-    newPktNode = (struct PktNode *)malloc(sizeof(struct PktNode));
-    memcpy(&(newPktNode->pkt), packet, sizeof(struct MsgInfo_));
-    
-    if(queue->head == NULL){
-        /* Queue is empty. Insert packet at the head of the queue */
-        queue->head = newPktNode;
-        queue->tail = newPktNode;
-        newPktNode->next = NULL;
-        newPktNode->prev = NULL;
-    } else {
-        /* Insert packet at the end of the queue */
-        queue->tail->next = newPktNode;
-        newPktNode->next = NULL;
-        newPktNode->prev = queue->tail;
-        queue->tail = newPktNode;
-    }
-    queue->size++;
-    pthread_mutex_unlock(&queue->mutex);
+    memcpy(slot, packet, pktCopySize(packet));
+    pktQueueCommit(queue);
 
     // printPktQueue(queue, false, DEBUG_PKT_QUEUE);
 
-    MSG_DEBUG(DEBUG_PKT_QUEUE, "Enqueued packet succeeded. Queue size %hu\n", queue->size);
+    MSG_DEBUG(DEBUG_PKT_QUEUE, "Enqueued packet succeeded. Queue size %u\n", queue->tail - queue->headCache);
 
     return PKT_ERROR_OK;
 }
 
 PktError_e pktDequeue(struct PktQueue *queue, struct MsgInfo_ *packet){
-    struct PktNode *tmpPktNode;
+    struct MsgInfo_ *slot;
     
     if (packet == NULL) {
         MSG_DEBUG(DEBUG_PKT_QUEUE, "ERROR: invalid parameter\n");
         return PKT_ERROR_INVALID;
     }
     
-    if (isPktQueueEmpty(queue)) {
+    slot = pktQueuePeek(queue);
+    if (slot == NULL) {
         return PKT_ERROR_EMPTY;
     }
     
-    pthread_mutex_lock(&queue->mutex);
-    tmpPktNode = queue->head;
-    queue->head = tmpPktNode->next;
-    if(queue->head != NULL)
-        queue->head->prev = NULL;
-    
-    queue->size--;
-    
-    memcpy(packet, &(tmpPktNode->pkt), sizeof(struct MsgInfo_));
-    
-    free(tmpPktNode);
-     
-    pthread_mutex_unlock(&queue->mutex);
+    memcpy(packet, slot, pktCopySize(slot));
+    pktQueueRelease(queue);
 
     // printPktQueue(queue, false, DEBUG_PKT_QUEUE);
 
-    MSG_DEBUG(DEBUG_PKT_QUEUE, "Dequeued packet succeed. Queue size %hu\n", queue->size);
+    MSG_DEBUG(DEBUG_PKT_QUEUE, "Dequeued packet succeed. Queue size %u\n", queue->tailCache - queue->head);
 
     return PKT_ERROR_OK;
 }
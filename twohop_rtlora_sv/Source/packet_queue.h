@@ -8,7 +8,9 @@
  * File:   packet_queue.h
  * Author: LAM-HOANG
  * Description: 
- *          TX and RX packet queue
+ *          TX and RX packet queue, a bounded single producer / single consumer
+ *          ring of preallocated slots. The consumer sleeps on an eventfd
+ *          doorbell which may be shared by several queues.
  * Created on June 4, 2021, 10:32 AM
  */
 
@@ -19,11 +21,15 @@
 
 #include <stdint.h>     /* C99 types */
 #include <stdbool.h>    /* bool type */
+#include <stddef.h>     /* offsetof */
 #include <pthread.h>
 #include <sys/time.h>
 
+#include "twohop_msg.h"
+
 /* --- PUBLIC CONSTANTS ----------------------------------------------------- */
-#define PKT_QUEUE_MAX           16  /* Maximum number of packets to be stored in queue */
+#define PKT_QUEUE_MAX           64  /* Maximum number of packets to be stored in queue, power of 2 */
+#define PKT_QUEUE_CACHE_LINE    64  /* producer and consumer indexes are kept on their own line */
 
 /* --- PUBLIC TYPES --------------------------------------------------------- */
 
@@ -34,6 +40,14 @@ typedef enum PktError_ {
     PKT_ERROR_INVALID       /* Packet is invalid */
 }PktError_e;
 
+/* Stages of a downlink, stamped with the CLOCK_MONOTONIC time in nanoseconds */
+typedef enum MsgStamp_ {
+    MSG_STAMP_PERIOD,       /* start of the MAC period the downlink belongs to */
+    MSG_STAMP_ENQUEUE,      /* queued by the MAC */
+    MSG_STAMP_DEQUEUE,      /* taken by the downstream thread */
+    MSG_STAMP_NB
+}MsgStamp_e;
+
 // Include packet metadata, packet payload and payload size (size)
 typedef struct MsgInfo_{
     /* Downlink packet only*/
@@ -51,6 +65,8 @@ typedef struct MsgInfo_{
     float       rssi;           /*!> average packet RSSI in dB */
     float       snr;            /*!> average packet SNR, in dB (LoRa only) */
     uint16_t    crc;            /*!> CRC that was received in the payload */
+    uint8_t     ulCrypto;       /*!> UlCryptoResult_e, UL_CRYPTO_OK once the LoRaWAN payload is verified and decrypted */
+    TwohopUlFrame_t twohop;     /*!> RT-LoRa uplink decoded by the ingest worker, type TWM_UL_INVALID if none */
     
     /* Common fields */
     uint32_t    freq;           /*!> center frequency of TX */
@@ -60,30 +76,72 @@ typedef struct MsgInfo_{
     uint32_t    datarate;       /*!> TX datarate (baudrate for FSK, SF for LoRa) */
     uint8_t     coderate;       /*!> error-correcting code of the packet (LoRa only) */
     uint16_t    size;           /*!> payload size in bytes */
+    uint8_t     latClass;       /*!> latency histogram of the whole downlink path, DlLatHist_e */
+    uint64_t    stamp[MSG_STAMP_NB]; /*!> time of each stage, 0 if not stamped */
     uint8_t     payload[256];   /*!> buffer containing the payload */
 }MsgInfo_s;
 
-struct PktNode{
-    struct MsgInfo_ pkt;
-    struct PktNode *next;
-    struct PktNode *prev;
+/* Wakes up the consumer of one or several queues */
+struct PktDoorbell{
+    int fd;                 /* eventfd, -1 if the doorbell could not be created */
+    int sleeping;           /* the consumer is blocked, or about to block, on fd */
 };
 
+/* Only one thread may enqueue and only one thread may dequeue on a queue */
 struct PktQueue{
-    uint8_t size;
-    pthread_mutex_t mutex; /* control access to packet queue */
-    struct PktNode *head;
-    struct PktNode *tail;
+    /* producer side */
+    uint32_t tail __attribute__((aligned(PKT_QUEUE_CACHE_LINE)));   /* next slot to be written */
+    uint32_t headCache;     /* consumer index seen at the last full check */
+    struct PktDoorbell *doorbell;
+    /* consumer side */
+    uint32_t head __attribute__((aligned(PKT_QUEUE_CACHE_LINE)));   /* next slot to be read */
+    uint32_t tailCache;     /* producer index seen at the last empty check */
+    struct MsgInfo_ slot[PKT_QUEUE_MAX] __attribute__((aligned(PKT_QUEUE_CACHE_LINE)));
 };
 
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
+/**
+@brief Bytes of a packet to be copied, the metadata and the used part of the payload
+@param packet[in] Packet
+@return size in bytes
+*/
+static inline size_t pktCopySize(const struct MsgInfo_ *packet){
+    if(packet->size > sizeof packet->payload){
+        return sizeof(struct MsgInfo_);
+    }
+    return offsetof(struct MsgInfo_, payload) + packet->size;
+}
+
+/**
+@brief Initialize a doorbell.
+@param doorbell[out] Doorbell to be initialized
+@return 0 on success, -1 if the eventfd cannot be created
+*/
+int pktDoorbellInit(struct PktDoorbell *doorbell);
+
+/**
+@brief Wake up the consumer if it is sleeping, called by pktQueueCommit.
+@param doorbell[in/out] Doorbell of the queue
+*/
+void pktDoorbellRing(struct PktDoorbell *doorbell);
+
+/**
+@brief Block the consumer until one of the queues holds a packet.
+Wakeups may be spurious, the caller has to dequeue until the queues are empty.
+@param doorbell[in/out] Doorbell shared by the queues
+@param queues[in] Queues consumed by the calling thread
+@param nbo_queues[in] Number of queues
+*/
+void pktDoorbellWait(struct PktDoorbell *doorbell, struct PktQueue *queues, int nbo_queues);
+
 /**
 @brief Initialize a packet queue.
 @param queue[in] Packet queue to be initialized. Memory should have been allocated already.
+@param doorbell[in] Doorbell rung at every commit, NULL if the consumer polls
 This function is used to reset every elements in the allocated queue.
 */
-void pktQueueInit(struct PktQueue *queue);
+void pktQueueInit(struct PktQueue *queue, struct PktDoorbell *doorbell);
 
 /**
 @brief Check if a packet queue is full.
@@ -99,6 +157,48 @@ bool isPktQueueFull(struct PktQueue *queue);
 */
 bool isPktQueueEmpty(struct PktQueue *queue);
 
+/**
+@brief Reserve the slot at the END of the queue, for the producer to fill in place
+@param queue[in/out] Packet queue
+@return slot to be written then published with pktQueueCommit, NULL if the queue is full.
+Reserving again before committing returns the same slot.
+*/
+struct MsgInfo_ *pktQueueReserve(struct PktQueue *queue);
+
+/**
+@brief Reserve the slot following the END of the queue by offset slots, to fill a batch in place
+@param queue[in/out] Packet queue
+@param offset[in] Slots already reserved before this one
+@return slot to be written then published with pktQueueCommitN, NULL if the queue is full.
+*/
+struct MsgInfo_ *pktQueueReserveAt(struct PktQueue *queue, uint32_t offset);
+
+/**
+@brief Publish the slot returned by pktQueueReserve and ring the doorbell
+@param queue[in/out] Packet queue
+*/
+void pktQueueCommit(struct PktQueue *queue);
+
+/**
+@brief Publish the first slots returned by pktQueueReserveAt and ring the doorbell once
+@param queue[in/out] Packet queue
+@param nbo_packets[in] Number of slots to publish, 0 publishes nothing
+*/
+void pktQueueCommitN(struct PktQueue *queue, uint32_t nbo_packets);
+
+/**
+@brief Get the packet at the HEAD of the queue without removing it
+@param queue[in] Packet queue
+@return packet, valid until pktQueueRelease, NULL if the queue is empty
+*/
+struct MsgInfo_ *pktQueuePeek(struct PktQueue *queue);
+
+/**
+@brief Remove the packet returned by pktQueuePeek
+@param queue[in/out] Packet queue
+*/
+void pktQueueRelease(struct PktQueue *queue);
+
 /**
 @brief Add a packet in a packet queue (at the END of the queue)
 @param queue[in/out] Packet queue in which the packet should be inserted
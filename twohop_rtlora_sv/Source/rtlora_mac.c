@@ -40,6 +40,12 @@
 #include "packet_queue.h"
 #include "time_conversion.h"
 #include "schedule_mngt.h"
+#include "mac_timer.h"
+#include "async_log.h"
+#include "twohop_msg.h"
+#include "mac_snapshot.h"
+#include "mac_config.h"
+#include "device_management.h"
 
 #include "application.h"
 
@@ -60,123 +66,30 @@ typedef enum OperationPhase_{
     TWOHOP_DATA_COLL_PHASE,
 }OperationPhase_e;
 
-/* MESSAGE STRUCTURE */
-/* Packet type definition */
-typedef enum TwohopMsgType_ {
-	/* Downlink */
-    Twohop_MsgType_DL_RNL,  /* Registration Node List */
-	Twohop_MsgType_DL_SM,   /* Scheduling message */
-	Twohop_MsgType_DL_CM,   /* Command message*/
-    
-	/* Uplink */
-    Twohop_MsgType_UL_RR,   /* registration request */
-	Twohop_MsgType_UL_DATA, /* up-link data */
-            
-    /* Between 1-hop and 2-hop nodes */
-    Twohop_MsgType_RRACK,   /* registration confirmation */
-}TwohopMsgType_e;
-
-typedef union TwohopNodeAddrFormat_{   // Node addressing format
-    uint16_t value;
-    struct AddrFormat_{
-        uint16_t address    : 13;
-        uint16_t class      : 3;
-    }bits;
-}TwohopNodeAddrFormat_u;
-
-typedef union TwohopMacHeader_ {
-	uint8_t value;
-	struct MacHeaderValue {
-		uint8_t RFU         :4;
-		uint8_t pktType     :4;
-	} bits;
-}TwohopMacHeader_u;
-
-typedef union TwohopMsgRnlCtrl_{
-    uint8_t value;
-    struct RnlCtrl_{
-        uint8_t netReadyFlag    : 1; // bit 0
-        uint8_t nboAddedNodes   : 7; // bit 1 ~ 7
-    }bits;
-}TwohopMsgRnlCtrl_u;
-
-typedef union TwohopMsgRrCtrl_{
-    uint8_t value;
-    struct RrCtrl_{
-        uint8_t rrType1         : 1; // bit 0
-        uint8_t rrType2         : 1; // bit 0
-        uint8_t nboChild        : 6; // bit 1 ~ 7
-    }bits;
-}TwohopMsgRrCtrl_u;
-
-typedef union TwohopMsgSmCtrl_{
-    uint8_t value;
-    struct SmCtrl_{
-        uint8_t smCount        : 4;
-        uint8_t sch1Size       : 4;
-    }bits;
-}TwohopMsgSmCtrl_u;
-
-typedef union TwohopMsgCmCtrl_{
-    uint8_t value;
-    struct CmCtrl_{
-        uint8_t usiFlag         : 1;
-        uint8_t nboNodesInUsi   : 4;
-        uint8_t unuse           : 3;
-    }bits;
-}TwohopMsgCmCtrl_u;
-
-typedef union TwohopMsgDataCtrl_{
-    uint8_t value;
-    struct DataCtrl_{
-        uint8_t ctrl0           : 1;
-        uint8_t ctrl1           : 1;
-        uint8_t ctrl2           : 1;
-        uint8_t unuse           : 5;
-    }bits;
-}TwohopMsgDataCtrl_u;
-
-typedef union TwohopMacParams_{   // Mac configuration parameters
-    uint16_t value;
-    struct Params_{
-        uint16_t frameFactor        : 3;
-        uint16_t uplinkSlotSize     : 5;
-        uint16_t downlinkSlotSize   : 5;
-        uint16_t nboChannels        : 3;
-    }bits;
-}TwohopMacParams_u;
-
-typedef struct TwohopFrameHeader_ {
-    uint16_t srcAddr;
-    uint16_t destAddr;
-    uint16_t seqNumber;
-    TwohopMacParams_u macParams;
-    TwohopMsgRnlCtrl_u rnlCtrl;
-    TwohopMsgRrCtrl_u rrCtrl;
-    TwohopMsgSmCtrl_u smCtrl;
-    TwohopMsgCmCtrl_u cmCtrl;
-    TwohopMsgDataCtrl_u dataCtrl;
-}TwohopFrameHeader_s;
-
 /* --- GLOBAL VARIABLES ----------------------------------------------------- */
 /* MAC remotely configurable parameters */
 int mac_frame_factor = 6;       // N = 6 by default
 int mac_ul_slot_size_ms = 100;     // 100 ms by default
 int mac_dl_slot_size_ms = 200;     // 200 ms by default
 int mac_nbo_channels = 1;       // = 1 by default
+int mac_nbo_inbound_queues = 2; // = 2 by default, one per ingest worker
+int mac_sch_incremental = 1;    // = 1 by default, schedule distribution keeps the LSIs already assigned
+int mac_rt_priority = 0;        // = 0 by default, SCHED_FIFO priority of the phase handler when > 0
+int mac_max_nbo_children = TWOHOP_MAX_NBO_CHILDREN;     // children accepted per relay
+uint32_t mac_rnl_interval_us = TWOHOP_RNL_INTERVAL_US;
+uint32_t mac_sch1_slot_size_us = TWOHOP_SCH1_SLOT_SIZE_US;
+uint32_t mac_sch2_slot_size_us = TWOHOP_SCH2_SLOT_SIZE_US;
+uint32_t mac_dl_freq_hz = TWOHOP_DOWNLINK_CHANNEL;
+int mac_dl_power = TWOHOP_DL_POWER;
 
 int mac_nbo_sch_groups; // determined after the number of channels is confirmed via input command options
 
 /* --- PRIVATE SHARED VARIABLES (GLOBAL) ------------------------------------ */
-// Condition variable, mutex, and flag for packet exchange between lora server threads and other threads
-pthread_cond_t condTxMsg = PTHREAD_COND_INITIALIZER;
-pthread_cond_t condRxMsg = PTHREAD_COND_INITIALIZER;
-pthread_mutex_t mutexTxMsg = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t mutexRxMsg = PTHREAD_MUTEX_INITIALIZER;
-_Bool flagTxMsg;   // flag indicates it has a packet to transmit
-_Bool flagRxMsg;   // flag indicates it receives a packet
-
-struct PktQueue inboundMsgQueue;
+// Doorbells waking up the consumer of the packet queues between lora server threads and MAC threads
+struct PktDoorbell rxDoorbell;     // rung by the ingest workers, shared by every inbound queue
+struct PktDoorbell txDoorbell;     // rung by the MAC when a downlink is ready to transmit
+
+struct PktQueue inboundMsgQueues[TWOHOP_MAX_INBOUND_QUEUES]; // FIFO per ingest worker, keeps the order of each gateway
 struct PktQueue outboundMsgQueue;
 
 pthread_mutex_t mutexPhaseTrans = PTHREAD_MUTEX_INITIALIZER;
@@ -185,13 +98,35 @@ _Bool phaseTransRequest;     // true indicates the network will move to anther p
 extern bool exit_sig;
 extern bool quit_sig;
 
-extern FILE * log_file;
 
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
 static pthread_t moThId; // MAC operation thread ID
 
+/* Configuration waiting for the next frame boundary, applied at once before the MAC starts */
+static pthread_mutex_t mutexMacConf = PTHREAD_MUTEX_INITIALIZER;
+static MacConfig_t pendingMacConf;
+static bool macConfPending;
+static bool macStarted;
+
 //static pthread_mutex_t mutexPhase;
 static OperationPhase_e phase;
+static const char * const phaseNames[] = {"INIT", "SCHEDULE DIST", "DATA COLL"};
+
+/* Downlink latency, recorded by the MAC and the downstream thread */
+LatHist_t dlLatHist[DL_LAT_NB_HIST] = {
+    LAT_HIST_INITIALIZER("MAC", 0),
+    LAT_HIST_INITIALIZER("Queue", 0),
+    LAT_HIST_INITIALIZER("Send", 0),
+    LAT_HIST_INITIALIZER("RNL total", MAC_SHIFT_DELAY_MS * 1000),
+    LAT_HIST_INITIALIZER("SM total", MAC_SHIFT_DELAY_MS * 1000),
+    LAT_HIST_INITIALIZER("CM total", MAC_SHIFT_DELAY_MS * 1000),
+};
+
+/* Phase timers, all on the same CLOCK_MONOTONIC timeline */
+static MacTimer_t rnlTimer;     // RNL interval of the init phase
+static MacTimer_t sch1Timer;    // SCH1 slots
+static MacTimer_t sch2Timer;    // SCH2, one period for all the slots
+static MacTimer_t frameTimer;   // frame period of the data collection phase
 
 /* Node management */
 MngtNodeList_t RNL;         // Registration node list
@@ -218,13 +153,29 @@ static void checkDataMissed(void);
 
 static void prepareDownlinkMsgMetaData(struct MsgInfo_ *packet, struct timeval TxTimestamp);
 
-static void prepareDownlinkMsgPayload(MsgInfo_s *msg, TwohopMsgType_e type, uint16_t seq, void *addInfo);
+static void prepareDownlinkMsgPayload(MsgInfo_s *msg, TwohopMsgType_e type, const void *snapshot);
+
+static void snapshotRnlMsg(TwohopRnlMsg_t *rnl, uint16_t seq, bool netReady);
+
+static void snapshotSmMsg(TwohopSmMsg_t *sm, uint8_t smCount, uint8_t *sch2Sslot);
+
+static void snapshotCmMsg(TwohopCmMsg_t *cm, uint16_t seq);
+
+static void enqueueDownlinkMsg(MsgInfo_s *msg, const MacTimer_t *period, DlLatHist_e latClass);
+
+static const MacSnapshot_t *publishMacSnapshot(OperationPhase_e curPhase, uint16_t period);
+
+static bool applyPendingMacConfig(void);
+
+static void applyMacConfig(const MacConfig_t *conf);
 
 static void *inputMsgHandlerThread(void *args);
 
 static _Bool addNodeToNodeList(MngtNodeList_t *lst, MngtNode_t *node);
 
-static unsigned short schedule(OperationPhase_e phase);
+static unsigned short schedule(OperationPhase_e phase, unsigned short *nboFailed);
+
+static int getScheduleGroupOfNode(uint16_t addr);
 
 static void removeNodeFromSchedule(uint16_t addr);
 
@@ -234,21 +185,18 @@ static int ipow(int base, int exp);
 
 static unsigned short slotDemandCalculation(unsigned short class);
 
-static uint64_t getTimeOffetTimeval(struct timeval start, struct timeval end){
-    uint64_t offset;
-    // TODO: check condition start < end
-    TIMEVAL_SUB(end, start); // end = end - start
-    TIMEVAL_TO_MICROSECONDS(end, offset);
-    return offset;
-}
 
 void twohopLoRaMacInit(void) {
     int i;
     unsigned short maxLsi;
     
     /* Init MAC parameters */
-    pktQueueInit(&inboundMsgQueue);
-    pktQueueInit(&outboundMsgQueue);
+    if(pktDoorbellInit(&rxDoorbell) != 0 || pktDoorbellInit(&txDoorbell) != 0){
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < mac_nbo_inbound_queues; i++)
+        pktQueueInit(&inboundMsgQueues[i], &rxDoorbell);
+    pktQueueInit(&outboundMsgQueue, &txDoorbell);
     
     pthread_mutex_lock(&mutexRNL);
     initNodeList(&RNL, false); // nodes in the RNL list are not sorted
@@ -268,6 +216,11 @@ void twohopLoRaMacInit(void) {
     }
 //    pthread_mutex_unlock(&mutexSCHEDULES);
     
+    // From now on a new configuration waits for a frame boundary
+    pthread_mutex_lock(&mutexMacConf);
+    macStarted = true;
+    pthread_mutex_unlock(&mutexMacConf);
+    
     phaseTransRequest = false;
     
     //phase = TWOHOP_NETWORK_INIT_PHASE;
@@ -286,6 +239,55 @@ void twohopLoRaMacDeInit(void){
     pthread_join(moThId, NULL);
 }
 
+void twohopLoRaMacPrintLatency(FILE *out){
+    fprintf(out, "Downlink latency, frame start to gateways (budget MAC_SHIFT_DELAY_MS = %u ms)\n", MAC_SHIFT_DELAY_MS);
+    for(int i = 0; i < DL_LAT_NB_HIST; i++){
+        latHistPrint(&dlLatHist[i], out);
+    }
+}
+
+void twohopLoRaMacGetConfig(MacConfig_t *conf){
+    pthread_mutex_lock(&mutexMacConf);
+    if(macConfPending){
+        *conf = pendingMacConf;
+    } else {
+        conf->frameFactor = mac_frame_factor;
+        conf->ulSlotSizeMs = mac_ul_slot_size_ms;
+        conf->dlSlotSizeMs = mac_dl_slot_size_ms;
+        conf->nboChannels = mac_nbo_channels;
+        conf->schIncremental = mac_sch_incremental;
+        conf->maxNboChildren = mac_max_nbo_children;
+        conf->rnlIntervalUs = mac_rnl_interval_us;
+        conf->sch1SlotSizeUs = mac_sch1_slot_size_us;
+        conf->sch2SlotSizeUs = mac_sch2_slot_size_us;
+        conf->dlFreqHz = mac_dl_freq_hz;
+        conf->dlPowerDbm = mac_dl_power;
+    }
+    pthread_mutex_unlock(&mutexMacConf);
+}
+
+int twohopLoRaMacRequestConfig(const MacConfig_t *conf){
+    if(macConfValidate(conf) != 0){
+        return -1;
+    }
+    pthread_mutex_lock(&mutexMacConf);
+    if(macStarted){
+        pendingMacConf = *conf;
+        macConfPending = true;
+    } else {
+        applyMacConfig(conf);
+    }
+    pthread_mutex_unlock(&mutexMacConf);
+    return 0;
+}
+
+void twohopLoRaMacPrintTimers(void){
+    macTimerPrint(&rnlTimer);
+    macTimerPrint(&sch1Timer);
+    macTimerPrint(&sch2Timer);
+    macTimerPrint(&frameTimer);
+}
+
 static void* macMainThread(void){ // create from MacInit function
     int i;
     pthread_t phThId;           // phase handler thread ID
@@ -293,8 +295,7 @@ static void* macMainThread(void){ // create from MacInit function
     pthread_t testThId;           // test thread ID
 
     sleep(5);
-    MSG("[MAC] TWO-HOP RT-LORA MAC START\n");
-    fputs("[MAC] TWO-HOP RT-LORA MAC START\n", log_file);
+    LOG_MSG(LOG_LVL_INFO, "[MAC] TWO-HOP RT-LORA MAC START\n");
     
     i = pthread_create(&phThId, NULL, (void * (*)(void *))phaseHandlerThread, NULL);
     if (i != 0) {
@@ -314,11 +315,14 @@ static void* macMainThread(void){ // create from MacInit function
 	}
     pthread_cancel(phThId);
     pthread_cancel(imhThId);
-    fprintf(log_file, "\n[MAC] PROGRAM STOP!\n");
+    LOG_MSG(LOG_LVL_INFO, "\n[MAC] PROGRAM STOP!\n");
 	// Print exiting message
 }
 
 static void *phaseHandlerThread(void *arg){
+    if(mac_rt_priority > 0 && macTimerSetRealtime(mac_rt_priority) == 0){
+        MSG("[MAC] Phase handler runs under SCHED_FIFO priority %d\n", mac_rt_priority);
+    }
     while(1){
         switch(phase){
             case TWOHOP_NETWORK_INIT_PHASE:
@@ -361,16 +365,22 @@ struct timeval getDownlinkTxTimestamp(struct timeval fromTime){
 }
 
 static void initNetworkPhase(void){
-    struct timeval mac_start_rnl_int_time, current_time;
-    uint64_t delayUsec;
+    struct timeval mac_start_rnl_int_time;
     uint16_t rnlIntCount;
     uint16_t phaseTransCount = TWOHOP_NBO_PHASE_TRANS_PERIOD;
     MsgInfo_s dlMsg;
+    TwohopRnlMsg_t rnlMsg;
+    const MacSnapshot_t *snap;
+    bool netReady;
     rnlIntCount = 0;
-    MSG("\n[MAC] NETWORK INIT PHASE START!\n");
-    fprintf(log_file, "\n[MAC] NETWORK INIT PHASE START!\n");
+    LOG_MSG(LOG_LVL_INFO, "\n[MAC] NETWORK INIT PHASE START!\n");
+    applyPendingMacConfig();
+    macTimerStart(&rnlTimer, "RNL", mac_rnl_interval_us);
     while(true){
-        gettimeofday(&mac_start_rnl_int_time, NULL);
+        if(applyPendingMacConfig()){
+            macTimerSetPeriod(&rnlTimer, mac_rnl_interval_us);
+        }
+        mac_start_rnl_int_time = macTimerToRealtime(&rnlTimer.start);
         /* periodically  transmit RNLint */
         pthread_mutex_lock(&mutexPhaseTrans);
             
@@ -388,107 +398,95 @@ static void initNetworkPhase(void){
             rnlIntCount++;
         }
         
-        prepareDownlinkMsgPayload(&dlMsg, Twohop_MsgType_DL_RNL, rnlIntCount, (void*)&phaseTransRequest);
+        netReady = phaseTransRequest;
         pthread_mutex_unlock(&mutexPhaseTrans);
         
+        snapshotRnlMsg(&rnlMsg, rnlIntCount, netReady);
+        prepareDownlinkMsgPayload(&dlMsg, Twohop_MsgType_DL_RNL, &rnlMsg);
+        
         if(dlMsg.size != 0){
             struct timeval msg_tx_time = getDownlinkTxTimestamp(mac_start_rnl_int_time);
             prepareDownlinkMsgMetaData(&dlMsg, msg_tx_time);
-            // Add packet to the queue and trigger signal to the waiting threads
-            pktEnqueue(&outboundMsgQueue, &dlMsg);
+            // Add packet to the queue, the doorbell notifies lora server thread that the packet is ready to transmit
+            enqueueDownlinkMsg(&dlMsg, &rnlTimer, DL_LAT_RNL);
 
-            // Notify lora server thread that the packet is ready to transmit
-            pthread_mutex_lock(&mutexTxMsg);
-            flagTxMsg = true;
-            pthread_cond_signal(&condTxMsg);
-            pthread_mutex_unlock(&mutexTxMsg);
-
-            MSG("\n[MAC] NetReady = %hu. Transmit RNLint %hu\n", (phaseTransRequest ? 1 : 0), rnlIntCount);
-            fprintf(log_file, "\n[MAC] NetReady = %hu. Transmit RNLint %hu\n", (phaseTransRequest ? 1 : 0), rnlIntCount);
+            LOG_MSG(LOG_LVL_INFO, "\n[MAC] NetReady = %hu. Transmit RNLint %hu\n", (netReady ? 1 : 0), rnlIntCount);
         }
         
+        snap = publishMacSnapshot(TWOHOP_NETWORK_INIT_PHASE, rnlIntCount);
         if(rnlIntCount %3 == 0){
-            pthread_mutex_lock(&mutexNODES);
-            printNodeList(&NODES);
-            pthread_mutex_unlock(&mutexNODES);
+            macSnapshotLogNodes(snap);
         }
         
-        gettimeofday(&current_time, NULL);
-        delayUsec = (uint64_t) TWOHOP_RNL_INTERVAL_US - getTimeOffetTimeval(mac_start_rnl_int_time, current_time);
-        usleep((__useconds_t)delayUsec);
+        macTimerWait(&rnlTimer);
     }
-    MSG("\n[MAC] NETWORK INIT PHASE DONE!\n");
-    fprintf(log_file, "\n[MAC] NETWORK INIT PHASE DONE!\n");
+    LOG_MSG(LOG_LVL_INFO, "\n[MAC] NETWORK INIT PHASE DONE!\n");
     
-    pthread_mutex_lock(&mutexNODES);
-    printNodeList(&NODES);
-    pthread_mutex_unlock(&mutexNODES);
+    macSnapshotLogNodes(publishMacSnapshot(TWOHOP_NETWORK_INIT_PHASE, rnlIntCount));
 }
 
 static void scheduleDistributionPhase(void){
     int sch1Cnt;
     struct timeval mac_start_sd_slot_time;
-    struct timeval current_time;
-    uint64_t delayUsec;
     MsgInfo_s dlMsg;
+    TwohopSmMsg_t smMsg;
     uint8_t sch2Sslot = 1;   // SCH2 start slot
+    unsigned short nboSchNodes, nboFailed = 0;
     
-    MSG("\n[MAC] SCHEDULE DISTRIBUTION PHASE START!\n");
-    fprintf(log_file, "\n[MAC] SCHEDULE DISTRIBUTION PHASE START!\n");
-    // Must reset schedule flag to false before generate a new schedule
-    dmSetSchFlagAll(&NODES, false);
-    // Remove old schedule
-    clearSchedule();
-
-    unsigned short nboSchNodes = schedule(TWOHOP_SCHEDULE_DIST_PHASE);
-    MSG_DEBUG(DEBUG_RTLORA_MAC, "Generate schedule for %u nodes\n", nboSchNodes);
-    fprintf(log_file, "Generate schedule for %u nodes\n", nboSchNodes);
-    for(unsigned short i = 0; i < mac_nbo_sch_groups; i++){
-//        pthread_mutex_lock(&mutexSCHEDULES);
-        printf("SCHEDULE GROUP %hu, NBO SCH DIST REQUEST %u\n", i, SCHEDULES[i].nboDistReq);
-        fprintf(log_file, "SCHEDULE GROUP %hu, NBO SCH DIST REQUEST %u\n", i, SCHEDULES[i].nboDistReq);
-        smPrintSchedule(&SCHEDULES[i]);
-//        pthread_mutex_unlock(&mutexSCHEDULES);
+    LOG_MSG(LOG_LVL_INFO, "\n[MAC] SCHEDULE DISTRIBUTION PHASE START!\n");
+    applyPendingMacConfig();
+    if(mac_sch_incremental){
+        // Keep the LSIs already assigned, only new or changed subtrees are placed and distributed
+        nboSchNodes = schedule(TWOHOP_SCHEDULE_DIST_PHASE, &nboFailed);
+        if(nboFailed > 0){
+            LOG_MSG(LOG_LVL_WARNING, "[MAC] %u nodes do not fit in the holes of the schedule, rebuild it\n", nboFailed);
+        }
     }
+    if(!mac_sch_incremental || nboFailed > 0){
+        // Must reset schedule flag to false before generate a new schedule
+        pthread_mutex_lock(&mutexNODES);
+        dmSetSchFlagAll(&NODES, false);
+        pthread_mutex_unlock(&mutexNODES);
+        // Remove old schedule
+        clearSchedule();
+
+        nboSchNodes = schedule(TWOHOP_SCHEDULE_DIST_PHASE, &nboFailed);
+    }
+    LOG_MSG(LOG_LVL_DEBUG, "Generate schedule for %u nodes\n", nboSchNodes);
+    macSnapshotLogSchedules(publishMacSnapshot(TWOHOP_SCHEDULE_DIST_PHASE, 0));
     
-    MSG("\n[MAC] Start SCH1 (%hu slots of %u ms)\n", TWOHOP_NBO_SLOTS_IN_SCH1, (unsigned int)(TWOHOP_SCH1_SLOT_SIZE_US/1000));
-    fprintf(log_file, "\n[MAC] Start SCH1 (%hu slots of %u ms)\n", TWOHOP_NBO_SLOTS_IN_SCH1, (unsigned int)(TWOHOP_SCH1_SLOT_SIZE_US/1000));
+    LOG_MSG(LOG_LVL_INFO, "\n[MAC] Start SCH1 (%hu slots of %u ms)\n", TWOHOP_NBO_SLOTS_IN_SCH1, (unsigned int)(mac_sch1_slot_size_us/1000));
     // Distribute schedule to one hop nodes in SCH1
+    macTimerStart(&sch1Timer, "SCH1 slot", mac_sch1_slot_size_us);
     for(sch1Cnt = 1; sch1Cnt <= TWOHOP_NBO_SLOTS_IN_SCH1; sch1Cnt++){
-        gettimeofday(&mac_start_sd_slot_time, NULL);
+        mac_start_sd_slot_time = macTimerToRealtime(&sch1Timer.start);
         
-        // Get number of node in the SM payload
-        prepareDownlinkMsgPayload(&dlMsg, Twohop_MsgType_DL_SM, sch1Cnt, (void*)&sch2Sslot);
+        // Nothing is sent when no node is left to distribute
+        snapshotSmMsg(&smMsg, (uint8_t)sch1Cnt, &sch2Sslot);
+        dlMsg.size = 0;
+        if(smMsg.nboNodes > 0)
+            prepareDownlinkMsgPayload(&dlMsg, Twohop_MsgType_DL_SM, &smMsg);
         
         if(dlMsg.size != 0){
             struct timeval msg_tx_time = getDownlinkTxTimestamp(mac_start_sd_slot_time);
             
             prepareDownlinkMsgMetaData(&dlMsg, msg_tx_time);
         
-            // Add packet to the queue and trigger signal to the waiting threads
-            pktEnqueue(&outboundMsgQueue, &dlMsg);
-
-            // Notify lora server thread that the packet is ready to transmit
-            pthread_mutex_lock(&mutexTxMsg);
-            flagTxMsg = true;
-            pthread_cond_signal(&condTxMsg);
-            pthread_mutex_unlock(&mutexTxMsg);
-            MSG("\n[MAC] Transmit SM_%hu\n", sch1Cnt);
-            fprintf(log_file, "\n[MAC] Transmit SM_%hu\n", sch1Cnt);
+            // Add packet to the queue, the doorbell notifies lora server thread that the packet is ready to transmit
+            enqueueDownlinkMsg(&dlMsg, &sch1Timer, DL_LAT_SM);
+            LOG_MSG(LOG_LVL_INFO, "\n[MAC] Transmit SM_%hu\n", sch1Cnt);
         }
-        gettimeofday(&current_time, NULL);
-        delayUsec = (uint64_t) TWOHOP_SCH1_SLOT_SIZE_US - getTimeOffetTimeval(mac_start_sd_slot_time, current_time);
-        usleep((__useconds_t)delayUsec);
+        macTimerWait(&sch1Timer);
     }
     
     // SCH2 phase
     uint8_t nboSch2Slot = sch2Sslot - 1;
-    MSG("\n[MAC] Start SCH2 (%hu slots of %u ms)\n", nboSch2Slot, (unsigned int)(TWOHOP_SCH2_SLOT_SIZE_US/1000));
-    fprintf(log_file, "\n[MAC] Start SCH2 (%hu slots of %u ms)\n", nboSch2Slot, (unsigned int)(TWOHOP_SCH2_SLOT_SIZE_US/1000));
-    __useconds_t sch2Interval = (__useconds_t)(TWOHOP_SCH2_SLOT_SIZE_US * nboSch2Slot);
-    usleep((__useconds_t)sch2Interval);
-    MSG("\n[MAC] SCHEDULE DISTRIBUTION PHASE DONE!\n");
-    fprintf(log_file, "\n[MAC] SCHEDULE DISTRIBUTION PHASE DONE!\n");
+    LOG_MSG(LOG_LVL_INFO, "\n[MAC] Start SCH2 (%hu slots of %u ms)\n", nboSch2Slot, (unsigned int)(mac_sch2_slot_size_us/1000));
+    if(nboSch2Slot > 0){
+        macTimerStart(&sch2Timer, "SCH2", (uint64_t)mac_sch2_slot_size_us * nboSch2Slot);
+        macTimerWait(&sch2Timer);
+    }
+    LOG_MSG(LOG_LVL_INFO, "\n[MAC] SCHEDULE DISTRIBUTION PHASE DONE!\n");
 }
 
 uint64_t calculateFrameLength(void){
@@ -501,25 +499,31 @@ uint64_t calculateFrameLength(void){
 }
 
 static void dataCollectionPhase(void){
-    uint64_t delayUsec;
     uint16_t phaseTransCount = TWOHOP_NBO_PHASE_TRANS_PERIOD;
     MsgInfo_s dlMsg;
+    TwohopCmMsg_t cmMsg;
+    const MacSnapshot_t *snap;
     uint16_t framePeriodCnt = 0;
     uint64_t frameLength;
     
     struct timeval mac_start_fp_time;
-    struct timeval current_time;
     time_t local_current_time;
     struct tm* ptime;
     
-    MSG("\n[MAC] DATA COLLECTION PHASE START!\n");
-    fprintf(log_file, "\n[MAC] DATA COLLECTION PHASE START!\n");
+    LOG_MSG(LOG_LVL_INFO, "\n[MAC] DATA COLLECTION PHASE START!\n");
+    applyPendingMacConfig();
     frameLength = calculateFrameLength();
-    MSG("[MAC] Frame period: %u ms\n", (unsigned int)frameLength/1000);
-    fprintf(log_file, "[MAC] Frame period: %u ms\n", (unsigned int)frameLength/1000);
+    LOG_MSG(LOG_LVL_INFO, "[MAC] Frame period: %u ms\n", (unsigned int)frameLength/1000);
     
+    macTimerStart(&frameTimer, "Frame", frameLength);
     while(true){      
-        gettimeofday(&mac_start_fp_time, NULL);
+        // Frame boundary: the frame that starts already has the new length, its CM announces the new parameters
+        if(applyPendingMacConfig()){
+            frameLength = calculateFrameLength();
+            macTimerSetPeriod(&frameTimer, frameLength);
+            LOG_MSG(LOG_LVL_INFO, "[MAC] Frame period: %u ms\n", (unsigned int)frameLength/1000);
+        }
+        mac_start_fp_time = macTimerToRealtime(&frameTimer.start);
         time(&local_current_time);
         ptime = localtime(&local_current_time);
         // Determine whether to terminate the current phase
@@ -537,15 +541,9 @@ static void dataCollectionPhase(void){
             framePeriodCnt++;
         }
         pthread_mutex_unlock(&mutexPhaseTrans);
-        MSG("\n\n ----------- FRAME PERIOD %hu ----------\n", framePeriodCnt);
-        MSG("TIMESTAMP: %ld.%06ld", mac_start_fp_time.tv_sec, mac_start_fp_time.tv_usec);
-        MSG(" (%d-%02d-%02d %2d:%02d:%02d)\n",ptime->tm_year + 1900, ptime->tm_mon + 1, ptime->tm_mday, \
-                (ptime->tm_hour) % 24, ptime->tm_min, ptime->tm_sec);
-        
-        fprintf(log_file, "\n\n ----------- FRAME PERIOD %hu ----------\n", framePeriodCnt);
-        fprintf(log_file, "TIMESTAMP: %ld.%06ld", mac_start_fp_time.tv_sec, mac_start_fp_time.tv_usec);
-        fprintf(log_file, " (%d-%02d-%02d %2d:%02d:%02d)\n",ptime->tm_year + 1900, ptime->tm_mon + 1, ptime->tm_mday, \
-                (ptime->tm_hour) % 24, ptime->tm_min, ptime->tm_sec);
+        LOG_MSG(LOG_LVL_INFO, "\n\n ----------- FRAME PERIOD %hu ----------\nTIMESTAMP: %ld.%06ld (%d-%02d-%02d %2d:%02d:%02d)\n", \
+                framePeriodCnt, mac_start_fp_time.tv_sec, mac_start_fp_time.tv_usec, ptime->tm_year + 1900, ptime->tm_mon + 1, \
+                ptime->tm_mday, (ptime->tm_hour) % 24, ptime->tm_min, ptime->tm_sec);
         
         checkDataMissed();
         
@@ -568,18 +566,10 @@ static void dataCollectionPhase(void){
         }
         
         // Schedule for unscheduled nodes in NODES
-        nboNodes = schedule(TWOHOP_DATA_COLL_PHASE);
+        nboNodes = schedule(TWOHOP_DATA_COLL_PHASE, NULL);
         
-        if(nboNodes > 0){
-            for(unsigned short i = 0; i < mac_nbo_sch_groups; i++){
-//                pthread_mutex_lock(&mutexSCHEDULES);
-                smPrintSchedule(&SCHEDULES[i]);
-//                pthread_mutex_unlock(&mutexSCHEDULES);
-            }
-        }
-          
-        // Get number of node in the CM payload
-        prepareDownlinkMsgPayload(&dlMsg, Twohop_MsgType_DL_CM, framePeriodCnt, NULL);
+        snapshotCmMsg(&cmMsg, framePeriodCnt);
+        prepareDownlinkMsgPayload(&dlMsg, Twohop_MsgType_DL_CM, &cmMsg);
         if(dlMsg.size != 0){
             struct timeval msg_tx_time = getDownlinkTxTimestamp(mac_start_fp_time);
 //            printf("DL Tx time: %ld.%06ld\n", msg_tx_time.tv_sec, msg_tx_time.tv_usec);
@@ -587,14 +577,8 @@ static void dataCollectionPhase(void){
             
             prepareDownlinkMsgMetaData(&dlMsg, msg_tx_time);
 
-            // Add packet to the queue and trigger signal to the waiting threads
-            pktEnqueue(&outboundMsgQueue, &dlMsg);
-
-            // Notify lora server thread that the packet is ready to transmit
-            pthread_mutex_lock(&mutexTxMsg);
-            flagTxMsg = true;
-            pthread_cond_signal(&condTxMsg);
-            pthread_mutex_unlock(&mutexTxMsg);
+            // Add packet to the queue, the doorbell notifies lora server thread that the packet is ready to transmit
+            enqueueDownlinkMsg(&dlMsg, &frameTimer, DL_LAT_CM);
         }
         
         // parse data every frame period
@@ -602,20 +586,22 @@ static void dataCollectionPhase(void){
         
         //AppPushDataToAppServer();
         
+        // Published after the CM, the schedule counts those still to distribute
+        snap = publishMacSnapshot(TWOHOP_DATA_COLL_PHASE, framePeriodCnt);
+        if(nboNodes > 0){
+            macSnapshotLogSchedules(snap);
+        }
         if(framePeriodCnt %5 == 0){
-            pthread_mutex_lock(&mutexNODES);
-            printNodeList(&NODES);
-            pthread_mutex_unlock(&mutexNODES);
+            macSnapshotLogNodes(snap);
             
             //AppDisplayData();
         }
         
-        gettimeofday(&current_time, NULL);
-        delayUsec = (uint64_t) frameLength - getTimeOffetTimeval(mac_start_fp_time, current_time);
-        usleep((__useconds_t)delayUsec);
+        if(macTimerWait(&frameTimer) > 0){
+            LOG_MSG(LOG_LVL_WARNING, "WARNING: [MAC] frame period %hu overran the next frames\n", framePeriodCnt);
+        }
     }
-    MSG("\n[MAC] DATA COLLECTION PHASE END!\n");
-    fprintf(log_file, "\n[MAC] DATA COLLECTION PHASE END!\n");
+    LOG_MSG(LOG_LVL_INFO, "\n[MAC] DATA COLLECTION PHASE END!\n");
 }
 
 static void checkDataMissed(void){
@@ -630,8 +616,7 @@ static void checkDataMissed(void){
         while(mngtNode != NULL){
             if(mngtNode->genInfo.type == Node_Type_Onehop && mngtNode->isConnected == false){
                 removeNodeFromSchedule(mngtNode->genInfo.addr);
-                MSG("NODE %hu: Remove from schedule\n", mngtNode->genInfo.addr);
-                fprintf(log_file, "NODE %hu: Remove from schedule\n", mngtNode->genInfo.addr);
+                LOG_MSG(LOG_LVL_INFO, "NODE %hu: Remove from schedule\n", mngtNode->genInfo.addr);
             }
             mngtNode = dmGetRefToNextNode(mngtNode);
         }
@@ -653,28 +638,26 @@ static unsigned int getIndexOfLowestLoadSch(void){
     return index;
 }
 
-static unsigned short schedule(OperationPhase_e phase){
-    unsigned int group;
-    unsigned short count;
+// Schedule the one hop nodes not scheduled yet, a node keeps its LSIs when its slot demand did not change.
+// Return the number of nodes processed, nboFailed (optional) receives the number of nodes that did not fit.
+static unsigned short schedule(OperationPhase_e phase, unsigned short *nboFailed){
+    int group;
+    unsigned short count, failed;
     MngtNode_t *mngtNode;
-    SchNode_t schNode;
+    SchNode_t schNode, *asgNode;
+    SchErr_t schCheck;
     
     pthread_mutex_lock(&mutexNODES);
     mngtNode = dmGetHeadNodeRef(&NODES);
     
     count = 0;
+    failed = 0;
     while(true){
         // Schedule all unscheduled nodes (scheduleFlag = false) in NODES
         if(mngtNode == NULL)
             break;
         
         if(mngtNode->genInfo.type == Node_Type_Onehop && mngtNode->schFlag == false){
-            // Remove schedule of this node first
-//            pthread_mutex_lock(&mutexSCHEDULES);
-            removeNodeFromSchedule(mngtNode->genInfo.addr);
-            group = getIndexOfLowestLoadSch();
-//            pthread_mutex_unlock(&mutexSCHEDULES);
-            
             schNode.addr = mngtNode->genInfo.addr;
             schNode.class = mngtNode->genInfo.class;
             schNode.slotDemand = mngtNode->genInfo.slotDmn;
@@ -686,9 +669,19 @@ static unsigned short schedule(OperationPhase_e phase){
             else
                schNode.nboSchDist = TWOHOP_NBO_SCH_UPDATE_DEFAULT;
             
-//            pthread_mutex_lock(&mutexSCHEDULES);
-            SchErr_t schCheck = smScheduleOneNode(&SCHEDULES[group], schNode);
-//            pthread_mutex_unlock(&mutexSCHEDULES);
+            group = getScheduleGroupOfNode(mngtNode->genInfo.addr);
+            asgNode = (group < 0) ? NULL : smGetRefToNode(&SCHEDULES[group], schNode.addr);
+            if(asgNode != NULL && asgNode->slotDemand == schNode.slotDemand){
+                // Same LSIs, the schedule is only distributed again
+                asgNode->class = schNode.class;
+                smNodeSetNboSchDist(&SCHEDULES[group], schNode.addr, schNode.nboSchDist);
+                schCheck = SCH_SUCCEEDED;
+            } else {
+                // Remove schedule of this node first
+                removeNodeFromSchedule(mngtNode->genInfo.addr);
+                group = getIndexOfLowestLoadSch();
+                schCheck = smScheduleOneNode(&SCHEDULES[group], schNode);
+            }
             
             if(schCheck == SCH_SUCCEEDED){
                 mngtNode->schFlag = true;
@@ -697,20 +690,35 @@ static unsigned short schedule(OperationPhase_e phase){
                 dmSetChildConnStatus(&NODES, mngtNode, true);
 //                MSG("NODE %u: Scheduled to GROUP %u\n", mngtNode->genInfo.addr, group);
 //                fprintf(log_file, "NODE %u: Scheduled to GROUP %u\n", mngtNode->genInfo.addr, group);
+            } else {
+                failed++;
             }
             count++;
         }
         mngtNode = dmGetRefToNextNode(mngtNode);
     }
     pthread_mutex_unlock(&mutexNODES);
+    if(nboFailed != NULL)
+        *nboFailed = failed;
     return count;
 }
 
-static void removeNodeFromSchedule(uint16_t addr){
-    for(unsigned int i = 0; i < mac_nbo_sch_groups; i++){
-        smRemoveOneNode(&SCHEDULES[i], (unsigned short)addr);
+// Return the group the node is scheduled in, -1 if none
+static int getScheduleGroupOfNode(uint16_t addr){
+    for(int i = 0; i < mac_nbo_sch_groups; i++){
+        if(smGetRefToNode(&SCHEDULES[i], (unsigned short)addr) != NULL)
+            return i;
     }
-    return;
+    return -1;
+}
+
+static void removeNodeFromSchedule(uint16_t addr){
+    int group;
+    
+    // A node is scheduled in one group at most
+    group = getScheduleGroupOfNode(addr);
+    if(group >= 0)
+        smRemoveOneNode(&SCHEDULES[group], (unsigned short)addr);
 }
 
 static void clearSchedule(void){
@@ -722,13 +730,23 @@ static void clearSchedule(void){
 //    pthread_mutex_unlock(&mutexSCHEDULES);
 }
 
+// Stamp the downlink with the start of its period and queue it for the downstream thread
+static void enqueueDownlinkMsg(MsgInfo_s *msg, const MacTimer_t *period, DlLatHist_e latClass){
+    msg->latClass = (uint8_t)latClass;
+    msg->stamp[MSG_STAMP_PERIOD] = (uint64_t)period->start.tv_sec * 1000000000 + (uint64_t)period->start.tv_nsec;
+    msg->stamp[MSG_STAMP_ENQUEUE] = latHistNowNs();
+    msg->stamp[MSG_STAMP_DEQUEUE] = 0;
+    latHistRecord(&dlLatHist[DL_LAT_MAC], (msg->stamp[MSG_STAMP_ENQUEUE] - msg->stamp[MSG_STAMP_PERIOD]) / 1000);
+    pktEnqueue(&outboundMsgQueue, msg);
+}
+
 static void prepareDownlinkMsgMetaData(struct MsgInfo_ *packet, struct timeval TxTimestamp){
-    packet->tx_mode = IMMEDIATE;
-    packet->rf_power = TWOHOP_DL_POWER;
+    packet->tx_mode = TIMESTAMPED;    // the gateway fires it on the concentrator counter, not on its host clock
+    packet->rf_power = mac_dl_power;
     packet->invert_pol = false;
     packet->preamble = 8;
     
-    packet->freq = TWOHOP_DOWNLINK_CHANNEL;
+    packet->freq = mac_dl_freq_hz;
     packet->rf_chain = 0;
 //    packet.if_chain;
     packet->modulation = MOD_LORA;
@@ -739,293 +757,273 @@ static void prepareDownlinkMsgMetaData(struct MsgInfo_ *packet, struct timeval T
     packet->msg_tx_time.tv_usec = TxTimestamp.tv_usec;
 }
 
-static void prepareDownlinkMsgPayload(MsgInfo_s *msg, TwohopMsgType_e type, uint16_t seq, void *addInfo){
-    TwohopMacHeader_u macHeader;
-    TwohopFrameHeader_s frmHeader;
-    TwohopNodeAddrFormat_u addrFormat;
-    SchNode_t *schNode;
-    uint8_t grpIndex;
-    uint8_t payloadLen;
-    
-    payloadLen = 0;
-    macHeader.bits.pktType = type;
-    macHeader.bits.RFU = 0;
-    memcpy(&msg->payload[payloadLen], &macHeader.value, 1);
-    payloadLen += 1;
+// Encode the snapshot of a message in the payload of the downlink, no lock held. Size 0 if it cannot be encoded.
+static void prepareDownlinkMsgPayload(MsgInfo_s *msg, TwohopMsgType_e type, const void *snapshot){
+    TwohopMsgHdr_t hdr;
+    int len;
     
-    frmHeader.srcAddr = TWOHOP_SERVER_ADDR;
-    memcpy(&msg->payload[payloadLen], &frmHeader.srcAddr, 2);
-    payloadLen += 2;
+    hdr.type = type;
+    hdr.srcAddr = TWOHOP_SERVER_ADDR;
+    hdr.destAddr = TWOHOP_BROADCAST_ADDR;
+    hdr.macParams.bits.frameFactor = mac_frame_factor;
+    hdr.macParams.bits.uplinkSlotSize = mac_ul_slot_size_ms/10;
+    hdr.macParams.bits.downlinkSlotSize = mac_dl_slot_size_ms/10;
+    hdr.macParams.bits.nboChannels = mac_nbo_channels;
     
-    frmHeader.destAddr = TWOHOP_BROADCAST_ADDR;
-    memcpy(&msg->payload[payloadLen], &frmHeader.destAddr, 2);
-    payloadLen += 2;
+    switch(type){
+        case Twohop_MsgType_DL_RNL:
+            len = twmEncodeRnl(msg->payload, sizeof(msg->payload), &hdr, (const TwohopRnlMsg_t *)snapshot);
+            break;
+        case Twohop_MsgType_DL_SM:
+            len = twmEncodeSm(msg->payload, sizeof(msg->payload), &hdr, (const TwohopSmMsg_t *)snapshot);
+            break;
+        case Twohop_MsgType_DL_CM:
+            len = twmEncodeCm(msg->payload, sizeof(msg->payload), &hdr, (const TwohopCmMsg_t *)snapshot);
+            break;
+        default:
+            len = -1;
+            break;
+    }
+    if(len < 0){
+        LOG_MSG(LOG_LVL_WARNING, "WARNING: [MAC] message type %d cannot be encoded, not sent\n", (int)type);
+        len = 0;
+    }
+    msg->size = (uint16_t)len;
+}
+
+// Move up to TWOHOP_MAX_NBO_NODES_IN_RNL nodes from RNL to NODES and keep them for the RNL message.
+// Both lists are locked once, mutexRNL first.
+static void snapshotRnlMsg(TwohopRnlMsg_t *rnl, uint16_t seq, bool netReady){
+    MngtNode_t *tempNode;
+    TwohopMsgNode_t *node;
+    int i;
     
-    frmHeader.macParams.bits.frameFactor = mac_frame_factor;
-    frmHeader.macParams.bits.uplinkSlotSize = mac_ul_slot_size_ms/10;
-    frmHeader.macParams.bits.downlinkSlotSize = mac_dl_slot_size_ms/10;
-    frmHeader.macParams.bits.nboChannels = mac_nbo_channels;
+    rnl->seq = seq;
+    rnl->netReady = netReady;
+    rnl->nboNodes = 0;
     
-    memcpy(&msg->payload[payloadLen], &frmHeader.macParams, 2);
-    payloadLen += 2;
+    pthread_mutex_lock(&mutexRNL);
+    pthread_mutex_lock(&mutexNODES);
+    while(rnl->nboNodes < TWOHOP_MAX_NBO_NODES_IN_RNL){
+        tempNode = popHeadNode(&RNL);
+        if(tempNode == NULL)
+            break;
+        node = &rnl->nodes[rnl->nboNodes++];
+        node->addr = tempNode->genInfo.addr;
+        node->class = tempNode->genInfo.class;
+        node->slotDemand = 0;
+        addNodeToNodeList(&NODES, tempNode);
+    }
+    pthread_mutex_unlock(&mutexNODES);
+    pthread_mutex_unlock(&mutexRNL);
     
-//    printf("Mac params: %d %d %d %d\n", frmHeader.macParams.bits.frameFactor, frmHeader.macParams.bits.uplinkSlotSize, \
-//         frmHeader.macParams.bits.downlinkSlotSize, frmHeader.macParams.bits.nboChannels);
+    for(i = 0; i < rnl->nboNodes; i++){
+        LOG_MSG(LOG_LVL_INFO, "NODE %u: Added to RNL msg\n", rnl->nodes[i].addr);
+    }
+}
 
-    switch(type){
-        case Twohop_MsgType_DL_RNL:
-            frmHeader.seqNumber = seq;
-            memcpy(&msg->payload[payloadLen], &frmHeader.seqNumber, 2);
-            payloadLen += 2;
-            
-            // Insert RNLCtrl field
-            frmHeader.rnlCtrl.bits.netReadyFlag = *((_Bool *)addInfo) ? 1 : 0;
-            pthread_mutex_lock(&mutexRNL);
-            frmHeader.rnlCtrl.bits.nboAddedNodes = (RNL.size > TWOHOP_MAX_NBO_NODES_IN_RNL) \
-                                                    ? TWOHOP_MAX_NBO_NODES_IN_RNL : RNL.size;
-            pthread_mutex_unlock(&mutexRNL);
-            memcpy(&msg->payload[payloadLen], &frmHeader.rnlCtrl, 1);
-            payloadLen += 1;
-            
-            // Insert RNL field
-            MngtNode_t *tempNode;
-            for(int i = 0; i < frmHeader.rnlCtrl.bits.nboAddedNodes; i++){
-                pthread_mutex_lock(&mutexRNL);
-                tempNode = popHeadNode(&RNL);
-                pthread_mutex_unlock(&mutexRNL);
-                
-                if(tempNode != NULL){
-                    pthread_mutex_lock(&mutexNODES);
-                    addrFormat.bits.address = (uint16_t) tempNode->genInfo.addr;
-                    addrFormat.bits.class = (uint16_t) tempNode->genInfo.class;
-                    addNodeToNodeList(&NODES, tempNode);
-                    pthread_mutex_unlock(&mutexNODES);
-                } else {
-                    addrFormat.bits.address = 0;
-                    addrFormat.bits.class = 0;
-                }
-                memcpy(&msg->payload[payloadLen], &addrFormat, 2);
-                payloadLen += 2;
-                
-                MSG("NODE %u: Added to RNL msg\n", addrFormat.bits.address);
-                fprintf(log_file, "NODE %u: Added to RNL msg\n", addrFormat.bits.address);
-            }
-            msg->size = payloadLen;
+// Take the next run of nodes to distribute of the first group that has one, NODES locked once.
+// The SM carries sch2Sslot, which then moves past the SCH2 slots of the relays of the run.
+static void snapshotSmMsg(TwohopSmMsg_t *sm, uint8_t smCount, uint8_t *sch2Sslot){
+    SchNode_t *schNode;
+    TwohopMsgNode_t *node;
+    uint8_t grpIndex;
+    int i;
+    
+    sm->smCount = smCount;
+    sm->sch1Size = TWOHOP_NBO_SLOTS_IN_SCH1;
+    sm->sch2Sslot = *sch2Sslot;
+    sm->groupId = 0;
+    sm->nboNodes = 0;
+    sm->startLSI = 0;
+    
+    pthread_mutex_lock(&mutexNODES);
+    sm->nboRelays = dmGetNboRelays(&NODES);
+    
+    // Get group's schedule to be distributed
+    for(grpIndex = 0; grpIndex < mac_nbo_sch_groups; grpIndex++){
+        if(SCHEDULES[grpIndex].nboDistReq > 0)
             break;
-
-        case Twohop_MsgType_DL_SM:
-            frmHeader.smCtrl.bits.smCount = seq;
-            frmHeader.smCtrl.bits.sch1Size = TWOHOP_NBO_SLOTS_IN_SCH1;
-            memcpy(&msg->payload[payloadLen], &frmHeader.smCtrl, 1);
-            payloadLen += 1;
-            
-            uint8_t sch2Sslot = *(uint8_t *)addInfo; // SCH2 start slot
-            memcpy(&msg->payload[payloadLen], &sch2Sslot, 1);
-            payloadLen += 1;
-            
-            uint8_t nboRelaysSm = dmGetNboRelays(&NODES);
-            memcpy(&msg->payload[payloadLen], &nboRelaysSm, 1);
-            payloadLen++;
-            
-            // Get group's schedule to be distributed
-//            pthread_mutex_lock(&mutexSCHEDULES);
-            for(grpIndex = 0; grpIndex < mac_nbo_sch_groups; grpIndex++){
-                if(SCHEDULES[grpIndex].nboDistReq > 0)
-                    break;
-            }
+    }
+    if(grpIndex < mac_nbo_sch_groups){
+        sm->groupId = grpIndex;
+        // First node that has schedule need to be distributed
+        schNode = smGetHeadNodeRef(&SCHEDULES[grpIndex]);
+        while(schNode != NULL && schNode->nboSchDist == 0){
+            schNode = smGetNextNodeRef(schNode);
+        }
+        if(schNode != NULL)
+            sm->startLSI = (uint8_t)schNode->startLSI;
+        
+        // A SM gives the start LSI then the demand of each node, it carries a run of
+        // nodes to distribute on consecutive LSIs. The nodes kept from the previous schedule end the run.
+        while(schNode != NULL && schNode->nboSchDist > 0 && sm->nboNodes < TWOHOP_MAX_NBO_NODES_IN_SM){
+            node = &sm->nodes[sm->nboNodes++];
+            node->addr = (uint16_t)schNode->addr;
+            node->class = (uint8_t)schNode->class;
+            node->slotDemand = (uint8_t)schNode->slotDemand;
+            smNodeSetNboSchDist(&SCHEDULES[grpIndex], schNode->addr, schNode->nboSchDist - 1);
             
-            bool add_node_to_sm_done = false;
+            // increase nbo slot 
+            if(dmIsRelayNode(&NODES, schNode->addr) == true)
+                *sch2Sslot += 1;
             
-            if(grpIndex < mac_nbo_sch_groups){
-                union smPlCtrl_{
-                    uint8_t value;
-                    struct plCtrl{
-                        uint8_t groupId     : 3;
-                        uint8_t nboNodes    : 5;
-                    }bits;
-                }smPlCtrl;
-                
-                // Add scheduling information header to the packet
-                smPlCtrl.bits.groupId = grpIndex;
-                smPlCtrl.bits.nboNodes = (SCHEDULES[grpIndex].nboDistReq > TWOHOP_MAX_NBO_NODES_IN_SM) \
-                                        ? TWOHOP_MAX_NBO_NODES_IN_SM : SCHEDULES[grpIndex].nboDistReq;
-                memcpy(&msg->payload[payloadLen], &smPlCtrl.value, 1);
-                payloadLen += 1;
-                
-                if(smPlCtrl.bits.nboNodes > 0){
-                    MSG("GROUP %hu: %hu nodes will be added to SM\n", grpIndex, smPlCtrl.bits.nboNodes);
-                    fprintf(log_file, "GROUP %hu: %hu nodes will be added to SM\n", grpIndex, smPlCtrl.bits.nboNodes);
-                }
-                
-                // To add nodes in the schedule to SM, first, find the first node that has schedule need to be distributed
-                schNode = smGetHeadNodeRef(&SCHEDULES[grpIndex]);
-
-                while(schNode != NULL && schNode->nboSchDist == 0){ // This implementation is dangerous, refine later
-                    schNode = smGetNextNodeRef(schNode);
-                }
+            if(schNode->next != NULL && schNode->next->startLSI != schNode->startLSI + schNode->slotDemand)
+                break;
+            schNode = smGetNextNodeRef(schNode);
+        }
+    }
+    pthread_mutex_unlock(&mutexNODES);
     
-                if(schNode != NULL){
-
-                    // Up to here, schNode is the first node that has schedule need to be distributed
-                    // Add start LSI information
-                    uint8_t startLSI = schNode->startLSI;
-                    memcpy(&msg->payload[payloadLen], &startLSI, 1);
-                    payloadLen += 1;
-
-                    MSG("START LSI: %u\n", startLSI);
-                    fprintf(log_file, "START LSI: %u\n", startLSI);
-
-                    while(smPlCtrl.bits.nboNodes--){
-                        addrFormat.bits.address = (uint16_t) schNode->addr;
-                        addrFormat.bits.class = (uint16_t) schNode->class;
-                        memcpy(&msg->payload[payloadLen], &addrFormat, 2);
-                        payloadLen += 2;
-
-                        uint8_t slotDemand = (uint8_t)schNode->slotDemand;
-                        memcpy(&msg->payload[payloadLen], &slotDemand, 1);
-                        payloadLen += 1;
-
-                        uint8_t nboSchDist = schNode->nboSchDist;
-
-                        if(nboSchDist != 0)
-                            nboSchDist--;
+    if(sm->nboNodes > 0){
+        LOG_MSG(LOG_LVL_INFO, "GROUP %hu: %hu nodes will be added to SM\n", sm->groupId, sm->nboNodes);
+        LOG_MSG(LOG_LVL_INFO, "START LSI: %u\n", sm->startLSI);
+        for(i = 0; i < sm->nboNodes; i++){
+            LOG_MSG(LOG_LVL_INFO, "NODE %u: Added to SM\n", sm->nodes[i].addr);
+        }
+    }
+}
 
-                        smNodeSetNboSchDist(&SCHEDULES[grpIndex], schNode->addr, nboSchDist);
+// Apply the configuration requested since the previous boundary, true if there was one
+static bool applyPendingMacConfig(void){
+    MacConfig_t conf;
+    bool pending;
+    
+    pthread_mutex_lock(&mutexMacConf);
+    pending = macConfPending;
+    conf = pendingMacConf;
+    macConfPending = false;
+    pthread_mutex_unlock(&mutexMacConf);
+    if(pending){
+        applyMacConfig(&conf);
+    }
+    return pending;
+}
 
-                        // increase nbo slot 
-                        pthread_mutex_lock(&mutexNODES);
-                        if(dmIsRelayNode(&NODES, schNode->addr) == true)
-                            *(uint8_t*)addInfo += 1;
-                        pthread_mutex_unlock(&mutexNODES);
+// Set the MAC parameters and fit SCHEDULES to the new frame factor and number of channels.
+// Nodes keep their LSIs when they still fit, the others are scheduled again by the next schedule().
+static void applyMacConfig(const MacConfig_t *conf){
+    MngtNode_t *node;
+    unsigned int nboMoved = 0;
+    unsigned short maxLsi;
+    int i;
+    
+    mac_frame_factor = conf->frameFactor;
+    mac_ul_slot_size_ms = conf->ulSlotSizeMs;
+    mac_dl_slot_size_ms = conf->dlSlotSizeMs;
+    mac_nbo_channels = conf->nboChannels;
+    mac_sch_incremental = conf->schIncremental;
+    mac_max_nbo_children = conf->maxNboChildren;
+    mac_rnl_interval_us = conf->rnlIntervalUs;
+    mac_sch1_slot_size_us = conf->sch1SlotSizeUs;
+    mac_sch2_slot_size_us = conf->sch2SlotSizeUs;
+    mac_dl_freq_hz = conf->dlFreqHz;
+    mac_dl_power = conf->dlPowerDbm;
+    
+    maxLsi = (unsigned short)ipow(2, mac_frame_factor);
+    pthread_mutex_lock(&mutexNODES);
+    for(i = mac_nbo_channels; i < mac_nbo_sch_groups; i++){
+        nboMoved += SCHEDULES[i].nboNode;
+        smClearSchedule(&SCHEDULES[i]);
+    }
+    for(i = mac_nbo_sch_groups; i < mac_nbo_channels; i++){
+        smInitSchedule(&SCHEDULES[i], maxLsi);
+    }
+    // the groups of a MAC not started yet are initialized by twohopLoRaMacInit
+    if(mac_nbo_sch_groups > 0){
+        mac_nbo_sch_groups = mac_nbo_channels;
+    }
+    for(i = 0; i < mac_nbo_sch_groups; i++){
+        nboMoved += smResizeSchedule(&SCHEDULES[i], maxLsi);
+    }
+    if(nboMoved > 0){
+        for(node = dmGetHeadNodeRef(&NODES); node != NULL; node = dmGetRefToNextNode(node)){
+            if(node->genInfo.type == Node_Type_Onehop && node->schFlag && getScheduleGroupOfNode(node->genInfo.addr) < 0){
+                dmNodeSetSchFlag(node, false);
+            }
+        }
+    }
+    pthread_mutex_unlock(&mutexNODES);
+    
+    LOG_MSG(LOG_LVL_INFO, "[MAC] New configuration: N=%d, UL %d ms, DL %d ms, %d channels, %u nodes to schedule again\n",
+            mac_frame_factor, mac_ul_slot_size_ms, mac_dl_slot_size_ms, mac_nbo_channels, nboMoved);
+}
 
-                        MSG("NODE %u: Added to SM\n", schNode->addr);
-                        fprintf(log_file, "NODE %u: Added to SM\n", schNode->addr);
+/* Publish the MAC state for the console and the statistics, the returned copy stays valid until the next call */
+static const MacSnapshot_t *publishMacSnapshot(OperationPhase_e curPhase, uint16_t period){
+    MacSnapshot_t *snap;
+    
+    snap = macSnapshotBegin(&macSnapshot);
+    snap->phase = phaseNames[curPhase];
+    snap->period = period;
+    pthread_mutex_lock(&mutexNODES);
+    macSnapshotFillNodes(snap, &NODES);
+    macSnapshotFillSchedules(snap, SCHEDULES, mac_nbo_sch_groups);
+    pthread_mutex_unlock(&mutexNODES);
+    SnapshotGateWays(snap);
+    macSnapshotPublish(&macSnapshot);
+    return snap;
+}
 
-                        schNode = smGetNextNodeRef(schNode);
-                    }
-                    add_node_to_sm_done = true;
-                }
-            }
-            
-            if(!add_node_to_sm_done) {
-                memset(&msg->payload, 0, sizeof(msg->payload));
-                payloadLen = 0;
-            }
-//            pthread_mutex_unlock(&mutexSCHEDULES);
-            msg->size = payloadLen;
+// Last LSI of every group and the relays of the uSI with their children, NODES locked once
+static void snapshotCmMsg(TwohopCmMsg_t *cm, uint16_t seq){
+    SchNode_t *schNode;
+    TwohopUsi_t *usi;
+    Child_t *child;
+    uint8_t grpIndex, nboChild, childIndex;
+    uint8_t nboRelaysUsi = 0;
+    int i, j;
+    
+    cm->seq = seq;
+    cm->nboUsi = 0;
+    
+    pthread_mutex_lock(&mutexNODES);
+    for(grpIndex = 0; grpIndex < mac_nbo_sch_groups; grpIndex++){
+        cm->lastLSI[grpIndex] = (uint8_t)smGetLastAsgLsi(&SCHEDULES[grpIndex]);
+    }
+    
+    // Determine number of relays will be added in uSI
+    for(grpIndex = 0; grpIndex < mac_nbo_sch_groups; grpIndex++){
+        if (nboRelaysUsi + SCHEDULES[grpIndex].nboDistReq > TWOHOP_MAX_NBO_RELAYS_IN_USI) {
+            nboRelaysUsi = TWOHOP_MAX_NBO_RELAYS_IN_USI;
             break;
-        
-        case Twohop_MsgType_DL_CM:
-            frmHeader.seqNumber = seq;
-            memcpy(&msg->payload[payloadLen], &frmHeader.seqNumber, 2);
-            payloadLen += 2;
-            
-            //pthread_mutex_lock(&mutexSCHEDULES);
-            uint8_t lastLSI;
-            for(grpIndex = 0; grpIndex < mac_nbo_sch_groups; grpIndex++){
-                lastLSI = smGetLastAsgLsi(&SCHEDULES[grpIndex]);
-                memcpy(&msg->payload[payloadLen], &lastLSI, 1);
-                payloadLen += 1;
-            }
-            
-            // Determine number of relays will be added in uSI
-            uint8_t nboRelaysUsi = 0;
-            for(grpIndex = 0; grpIndex < mac_nbo_sch_groups; grpIndex++){
-                if (nboRelaysUsi + SCHEDULES[grpIndex].nboDistReq > TWOHOP_MAX_NBO_RELAYS_IN_USI) {
-                    nboRelaysUsi = TWOHOP_MAX_NBO_RELAYS_IN_USI;
-                    break;
-                }
-                nboRelaysUsi += SCHEDULES[grpIndex].nboDistReq;
-            }
-            
-            if(nboRelaysUsi > 0){
-                frmHeader.cmCtrl.bits.usiFlag = 1;
-                frmHeader.cmCtrl.bits.nboNodesInUsi = nboRelaysUsi;
-                frmHeader.cmCtrl.bits.unuse = 0;
-                memcpy(&msg->payload[payloadLen], &frmHeader.cmCtrl.value, 1);
-                payloadLen += 1;
-                
-                union cmUsiCtrl_{
-                    uint8_t value;
-                    struct usiCtrl{
-                        uint8_t groupId     : 3;
-                        uint8_t nboChild    : 5;
-                    }bits;
-                }cmUsiCtrl;
-                
-                // Add uSI for relays in each group
-                for(grpIndex = 0; grpIndex < mac_nbo_sch_groups; grpIndex++){
-                    schNode = smGetHeadNodeRef(&SCHEDULES[grpIndex]);
-                    while(nboRelaysUsi){
-                        if(schNode == NULL)
-                            break;
-                        
-                        if(schNode->nboSchDist > 0){
-                            nboRelaysUsi--;
-
-                            MSG("NODE %u: Added to USI\n", schNode->addr);
-                            fprintf(log_file, "NODE %u: Added to USI\n", schNode->addr);
-                            
-                            uint8_t nboChild;
-                            pthread_mutex_lock(&mutexNODES);
-                            Child_t* child = dmNodeGetChildList(&NODES, (uint16_t) schNode->addr, &nboChild);
-                            pthread_mutex_unlock(&mutexNODES);
-                            cmUsiCtrl.bits.groupId = grpIndex;
-                            cmUsiCtrl.bits.nboChild = nboChild;
-
-                            memcpy(&msg->payload[payloadLen], &cmUsiCtrl.value, 1);
-                            payloadLen += 1;
-
-                            uint8_t startLSI = (uint8_t) schNode->startLSI;
-                            memcpy(&msg->payload[payloadLen], &startLSI, 1);
-                            payloadLen += 1;
-
-                            // Add parent info
-                            addrFormat.bits.address = (uint16_t) schNode->addr;
-                            addrFormat.bits.class = (uint16_t) schNode->class;
-                            memcpy(&msg->payload[payloadLen], &addrFormat, 2);
-                            payloadLen += 2; 
-
-                            // Add child
-                            pthread_mutex_lock(&mutexNODES);
-                            for(uint8_t childIndex = 0; childIndex < TWOHOP_MAX_NBO_CHILDREN; childIndex++){
-                                if(child[childIndex].addr != 0){
-                                    addrFormat.bits.address = (uint16_t) child[childIndex].addr;
-                                    addrFormat.bits.class = (uint16_t) child[childIndex].class;
-                                    memcpy(&msg->payload[payloadLen], &addrFormat, 2);
-                                    payloadLen += 2;
-                                    MSG("CHILD %u: Added to USI\n", child[childIndex].addr);
-                                    fprintf(log_file, "CHILD %u: Added to USI\n", child[childIndex].addr);
-                                }
-                            }
-                            pthread_mutex_unlock(&mutexNODES);
-
-                            uint8_t nboSchDist = schNode->nboSchDist;
-
-                            if(nboSchDist != 0)
-                                nboSchDist--;
-
-                            smNodeSetNboSchDist(&SCHEDULES[grpIndex], schNode->addr, nboSchDist);
-                        }
-                        
-                        schNode = smGetNextNodeRef(schNode);
+        }
+        nboRelaysUsi += SCHEDULES[grpIndex].nboDistReq;
+    }
+    
+    // Add uSI for relays in each group
+    for(grpIndex = 0; grpIndex < mac_nbo_sch_groups && cm->nboUsi < nboRelaysUsi; grpIndex++){
+        schNode = smGetHeadNodeRef(&SCHEDULES[grpIndex]);
+        while(schNode != NULL && cm->nboUsi < nboRelaysUsi){
+            if(schNode->nboSchDist > 0){
+                usi = &cm->usi[cm->nboUsi++];
+                usi->groupId = grpIndex;
+                usi->startLSI = (uint8_t)schNode->startLSI;
+                usi->parent.addr = (uint16_t)schNode->addr;
+                usi->parent.class = (uint8_t)schNode->class;
+                usi->parent.slotDemand = 0;
+                usi->nboChild = 0;
+                child = dmNodeGetChildList(&NODES, (uint16_t)schNode->addr, &nboChild);
+                for(childIndex = 0; child != NULL && childIndex < TWOHOP_MAX_NBO_CHILDREN; childIndex++){
+                    if(child[childIndex].addr != 0){
+                        usi->children[usi->nboChild].addr = child[childIndex].addr;
+                        usi->children[usi->nboChild].class = child[childIndex].class;
+                        usi->children[usi->nboChild].slotDemand = 0;
+                        usi->nboChild++;
                     }
                 }
-            } else {
-                frmHeader.cmCtrl.bits.usiFlag = 0;
-                frmHeader.cmCtrl.bits.nboNodesInUsi = 0;
-                frmHeader.cmCtrl.bits.unuse = 0;
-                memcpy(&msg->payload[payloadLen], &frmHeader.cmCtrl.value, 1);
-                payloadLen += 1;
+                smNodeSetNboSchDist(&SCHEDULES[grpIndex], schNode->addr, schNode->nboSchDist - 1);
             }
-            
-            //pthread_mutex_unlock(&mutexSCHEDULES);
-            
-            msg->size = payloadLen;
-            break;
-        
-        default:
-            break;
+            schNode = smGetNextNodeRef(schNode);
+        }
+    }
+    pthread_mutex_unlock(&mutexNODES);
+    
+    for(i = 0; i < cm->nboUsi; i++){
+        LOG_MSG(LOG_LVL_INFO, "NODE %u: Added to USI\n", cm->usi[i].parent.addr);
+        for(j = 0; j < cm->usi[i].nboChild; j++){
+            LOG_MSG(LOG_LVL_INFO, "CHILD %u: Added to USI\n", cm->usi[i].children[j].addr);
+        }
     }
 }
 
@@ -1046,138 +1044,106 @@ static unsigned short slotDemandCalculation(unsigned short class){
     return (unsigned short)ipow(2, (int) class);
 }
 
+/* take one packet from the inbound queues in turn, so a busy worker cannot starve the others */
+static bool inboundMsgDequeue(MsgInfo_s *msg){
+    static int next = 0;
+    int i;
+    
+    for(i = 0; i < mac_nbo_inbound_queues; i++){
+        if(pktDequeue(&inboundMsgQueues[next], msg) == PKT_ERROR_OK){
+            next = (next + 1) % mac_nbo_inbound_queues;
+            return true;
+        }
+        next = (next + 1) % mac_nbo_inbound_queues;
+    }
+    return false;
+}
+
+// Add the nodes of a registration request to RNL, mutexRNL taken once
+static void handleRegistrationRequest(const MsgInfo_s *msg){
+    const TwohopUlFrame_t *frame = &msg->twohop;
+    const TwohopRrMsg_t *rr = &frame->body.rr;
+    MngtNode_t *nodes[TWM_RR_MAX_NODES];
+    NodeGenInfo_t nodeGenInfo;
+    int i, nboChildren = 0;
+    
+    if(frame->destAddr != TWOHOP_SERVER_ADDR)
+        return;
+    
+    for(i = 0; i < rr->nboNodes; i++){
+        nodes[i] = NULL;
+        if(rr->viaRelay && rr->nodes[i].addr != frame->srcAddr && ++nboChildren > mac_max_nbo_children){
+            LOG_MSG(LOG_LVL_WARNING, "NODE %u: Refused, NODE %u already has %d children\n", rr->nodes[i].addr,
+                    frame->srcAddr, mac_max_nbo_children);
+            continue;
+        }
+        nodeGenInfo.addr = rr->nodes[i].addr;
+        nodeGenInfo.class = rr->nodes[i].class;
+        nodeGenInfo.slotDmn = slotDemandCalculation(rr->nodes[i].class);
+        // registration itself, or for the node and its child
+        if(!rr->viaRelay || nodeGenInfo.addr == frame->srcAddr){
+            nodeGenInfo.type = Node_Type_Onehop;
+            nodes[i] = createNewNode(nodeGenInfo, 0);
+        } else {
+            nodeGenInfo.type = Node_Type_Twohop;
+            nodes[i] = createNewNode(nodeGenInfo, frame->srcAddr);
+        }
+    }
+    
+    pthread_mutex_lock(&mutexRNL);
+    for(i = 0; i < rr->nboNodes; i++){
+        addNodeToNodeList(&RNL, nodes[i]);
+    }
+    pthread_mutex_unlock(&mutexRNL);
+    
+    for(i = 0; i < rr->nboNodes; i++){
+        if(nodes[i] == NULL)
+            continue;
+        if(!rr->viaRelay){
+            LOG_MSG(LOG_LVL_INFO, "NODE %u: Receive RR (%.2f, %.2f)\n", rr->nodes[i].addr, msg->rssi, msg->snr);
+        } else {
+            LOG_MSG(LOG_LVL_INFO, "NODE %u: Receive RR via NODE %u\n", rr->nodes[i].addr, frame->srcAddr);
+        }
+    }
+}
+
+// Hand the data to the application and update the data counters of the node
+static void handleUplinkData(const MsgInfo_s *msg){
+    const TwohopUlFrame_t *frame = &msg->twohop;
+    const TwohopDataMsg_t *data = &frame->body.data;
+    
+    if(data->relayed){
+        LOG_MSG(LOG_LVL_INFO, "NODE %hu: Receive DATA %hu (via NODE %hu)\n", data->dataSrcAddr, \
+                data->seq, frame->srcAddr);
+    } else {
+        LOG_MSG(LOG_LVL_INFO, "NODE %hu: Rx DATA %hu - DL(%d,%d) UL(%.2f,%.2f)\n", data->dataSrcAddr, data->seq, \
+                data->dlRssi, data->dlSnr, msg->rssi, msg->snr);
+    }
+    
+    // process app data
+    AppInputDataHandle(data->dataSrcAddr, (uint8_t *)&msg->payload[data->payloadOfs], data->payloadSize);
+    
+    pthread_mutex_lock(&mutexNODES);
+    dmNodeUpdateDataInfo(&NODES, data->dataSrcAddr, data->seq, data->relayed);
+    pthread_mutex_unlock(&mutexNODES);
+}
+
+/* Uplink handlers by message type, the frames are decoded and validated by the ingest workers */
+static void (* const uplinkHandlers[TWM_NB_MSG_TYPES])(const MsgInfo_s *msg) = {
+    [Twohop_MsgType_UL_RR]      = handleRegistrationRequest,
+    [Twohop_MsgType_UL_DATA]    = handleUplinkData,
+};
+
 static void *inputMsgHandlerThread(void *args){
     MsgInfo_s msg;
-    TwohopMacHeader_u rxMacHdr;
-    TwohopFrameHeader_s rxFrmHdr;
-    MngtNode_t *node;
-    uint8_t pktLen;
-    int i;
     
     while(true){
-        pthread_mutex_lock(&mutexRxMsg);
-        flagRxMsg = false;
-        while(flagRxMsg == false)
-            pthread_cond_wait(&condRxMsg, &mutexRxMsg);
-        pthread_mutex_unlock(&mutexRxMsg);
+        /* sleep until an ingest worker commits a packet in one of the queues */
+        pktDoorbellWait(&rxDoorbell, inboundMsgQueues, mac_nbo_inbound_queues);
         
-        while(pktDequeue(&inboundMsgQueue, &msg) == PKT_ERROR_OK){
-            // Process input message
-            pktLen = 0;
-            memcpy(&rxMacHdr, &msg.payload[pktLen], 1);
-            pktLen += 1;
-
-            memcpy(&rxFrmHdr.srcAddr, &msg.payload[pktLen], 2);
-            pktLen += 2;
-
-            memcpy(&rxFrmHdr.destAddr, &msg.payload[pktLen], 2);
-            pktLen += 2;
-
-            switch(rxMacHdr.bits.pktType){
-                case Twohop_MsgType_UL_RR:
-                    if(rxFrmHdr.destAddr != TWOHOP_SERVER_ADDR)
-                        continue;
-
-                    memcpy(&rxFrmHdr.rrCtrl.value, &msg.payload[pktLen], 1);
-                    pktLen += 1;
-                    // Add registered nodes to RNL
-                    TwohopNodeAddrFormat_u addFmt;
-                    NodeGenInfo_t nodeGenInfo;
-                    if(rxFrmHdr.rrCtrl.bits.rrType1 == 0){  // registration itself
-                        memcpy(&addFmt.value, &msg.payload[pktLen], 2);
-                        pktLen += 2;
-                        nodeGenInfo.addr = (uint16_t)addFmt.bits.address;
-                        nodeGenInfo.class = (uint8_t)addFmt.bits.class;
-                        nodeGenInfo.slotDmn = slotDemandCalculation((uint8_t)addFmt.bits.class);
-                        nodeGenInfo.type = Node_Type_Onehop;
-                        node = createNewNode(nodeGenInfo, 0);
-                        
-                        if(node != NULL){
-                            pthread_mutex_lock(&mutexRNL);
-                            addNodeToNodeList(&RNL, node);
-                            pthread_mutex_unlock(&mutexRNL);
-                            MSG("NODE %u: Receive RR (%.2f, %.2f)\n", node->genInfo.addr, msg.rssi, msg.snr);
-                            fprintf(log_file, "NODE %u: Receive RR (%.2f, %.2f)\n", node->genInfo.addr, msg.rssi, msg.snr);
-                        } 
-                    } else { // registration for the node and its child
-                        uint8_t nboAddedNode = rxFrmHdr.rrCtrl.bits.nboChild;
-
-                        // Update information for two hop node
-                        for(i = 0; i < nboAddedNode; i++){
-                            memcpy(&addFmt.value, &msg.payload[pktLen], 2);
-                            pktLen += 2;
-                            nodeGenInfo.addr = (uint16_t)addFmt.bits.address;
-                            nodeGenInfo.class = (uint8_t)addFmt.bits.class;
-                            nodeGenInfo.slotDmn = slotDemandCalculation((uint8_t)addFmt.bits.class);
-                            
-                            if(nodeGenInfo.addr == rxFrmHdr.srcAddr){
-                                nodeGenInfo.type = Node_Type_Onehop;
-                                node = createNewNode(nodeGenInfo, 0);
-                            } else {
-                                nodeGenInfo.type = Node_Type_Twohop;
-                                node = createNewNode(nodeGenInfo, rxFrmHdr.srcAddr);
-                            }
-
-                            if(node != NULL){
-                                pthread_mutex_lock(&mutexRNL);
-                                addNodeToNodeList(&RNL, node);
-                                pthread_mutex_unlock(&mutexRNL);
-                                MSG("NODE %u: Receive RR via NODE %u\n", node->genInfo.addr, rxFrmHdr.srcAddr);
-                                fprintf(log_file, "NODE %u: Receive RR via NODE %u\n", node->genInfo.addr, rxFrmHdr.srcAddr);
-                            }
-                        }
-                    }
-                    break;
-                case Twohop_MsgType_UL_DATA:
-                    memcpy(&rxFrmHdr.seqNumber, &msg.payload[pktLen], 2);
-                    pktLen += 2;
-
-                    memcpy(&rxFrmHdr.dataCtrl.value, &msg.payload[pktLen], 1);
-                    pktLen += 1;
-
-                    if(rxFrmHdr.dataCtrl.bits.ctrl1 == 1)
-                        pktLen += 1; // skip Jslot field
-
-                    uint16_t dataSrcAddr;
-                    if(rxFrmHdr.dataCtrl.bits.ctrl0 == 1){
-                        memcpy(&dataSrcAddr, &msg.payload[pktLen], 2);
-                        pktLen += 2; 
-                        MSG("NODE %hu: Receive DATA %hu (via NODE %hu)\n", dataSrcAddr, \
-                                rxFrmHdr.seqNumber, rxFrmHdr.srcAddr);
-                        fprintf(log_file, "NODE %hu: Receive DATA %hu (via NODE %hu)\n", dataSrcAddr, \
-                                rxFrmHdr.seqNumber, rxFrmHdr.srcAddr);
-                    } else {
-                        int8_t snr = 0.0;
-                        int16_t rssi = 0.0;
-                        if(rxFrmHdr.dataCtrl.bits.ctrl2 == 1){
-                            memcpy(&rssi, &msg.payload[pktLen], 2);
-                            pktLen += 2; 
-                            memcpy(&snr, &msg.payload[pktLen], 1);
-                            pktLen += 1; 
-                        }
-                        dataSrcAddr = rxFrmHdr.srcAddr;
-                        MSG("NODE %hu: Rx DATA %hu - DL(%d,%d) UL(%.2f,%.2f)\n", dataSrcAddr, rxFrmHdr.seqNumber, rssi, snr, msg.rssi, msg.snr);
-                        fprintf(log_file, "NODE %hu: Rx DATA %hu - DL(%d,%d) UL(%.2f,%.2f)\n", dataSrcAddr, rxFrmHdr.seqNumber, rssi, snr, msg.rssi, msg.snr);
-                    }
-
-                    uint8_t payloadSize;
-                    memcpy(&payloadSize, &msg.payload[pktLen], 1);
-                    pktLen++;
-                    
-                    // process app data
-                    AppInputDataHandle(dataSrcAddr, &msg.payload[pktLen], payloadSize);
-                    
-                    bool isRelayData = false;
-                    if(rxFrmHdr.dataCtrl.bits.ctrl0 == 1){
-                        isRelayData = true;
-                    }
-                    pthread_mutex_lock(&mutexNODES);
-                    dmNodeUpdateDataInfo(&NODES, dataSrcAddr, rxFrmHdr.seqNumber, isRelayData);
-                    pthread_mutex_unlock(&mutexNODES);
-                    break;
-                default:
-                    break;
-            }
+        while(inboundMsgDequeue(&msg)){
+            if(msg.twohop.type < TWM_NB_MSG_TYPES && uplinkHandlers[msg.twohop.type] != NULL)
+                uplinkHandlers[msg.twohop.type](&msg);
         }
     }
 }
@@ -1234,15 +1200,14 @@ static _Bool addNodeToNodeList(MngtNodeList_t *lst, MngtNode_t *node){
                 } else {
                     // Add parent back to the list
                     pushNode(lst, parent);
-                    free(node);
+                    destroyNode(node);
                     return false;
                 }
                 // Finally, add node to the list
                 pushNode(lst, node);
             } else {
-                MSG("[MAC] Parent of %hu not found.\n", node->genInfo.addr);
-                fprintf(log_file, "[MAC] Parent of %hu not found.\n", node->genInfo.addr);
-                free(node);
+                LOG_MSG(LOG_LVL_WARNING, "[MAC] Parent of %hu not found.\n", node->genInfo.addr);
+                destroyNode(node);
                 return false;
             }
         }
@@ -10,6 +10,9 @@
    
 #include <stdbool.h>    /* bool type */
 #include <time.h>       /* time clock_gettime strftime gmtime clock_nanosleep*/
+
+#include "latency_hist.h"
+#include "mac_config.h"
     
 #ifndef VERSION_STRING
 #define VERSION_STRING "undefined"
@@ -23,6 +26,23 @@
 
 #define TWOHOP_MAX_MISS_DATA_ALLOWED    65535
 
+#define TWOHOP_LAT_EXPORT_FILE          "dl_latency.txt"    // snapshot of the downlink latency histograms
+#define TWOHOP_LAT_EXPORT_INTERVAL_S    60
+#define TWOHOP_SNAP_EXPORT_FILE         "mac_state.txt"     // copy of the MAC snapshot, written with the latency
+
+/* Downlink latency histograms, one per stage then one per message type for the whole path */
+typedef enum DlLatHist_{
+    DL_LAT_MAC,         // period start -> queued by the MAC
+    DL_LAT_QUEUE,       // queued -> taken by the downstream thread
+    DL_LAT_SEND,        // taken -> written to every gateway
+    DL_LAT_RNL,         // period start -> written, for each message type, MAC_SHIFT_DELAY_MS budget
+    DL_LAT_SM,
+    DL_LAT_CM,
+    DL_LAT_NB_HIST
+}DlLatHist_e;
+
+extern LatHist_t dlLatHist[DL_LAT_NB_HIST];
+
 /* values available for the 'modulation' parameters */
 /* NOTE: arbitrary values */
 #define MOD_UNDEFINED   0
@@ -71,6 +91,32 @@ void twohopLoRaMacInit(void);
 
 void twohopLoRaMacDeInit(void);
 
+/**
+ * @brief Get the MAC configuration, the one waiting for the next frame boundary if any
+ * @param conf[out] configuration
+ */
+void twohopLoRaMacGetConfig(MacConfig_t *conf);
+
+/**
+ * @brief Reconfigure the MAC: applied at once before twohopLoRaMacInit, at the next frame boundary after
+ * SCHEDULES follow the new frame factor and number of channels, nodes that no longer fit are scheduled again.
+ * A request replaces the one still waiting.
+ * @param conf[in] configuration
+ * @return 0 if accepted, -1 if a parameter is out of range (printed)
+ */
+int twohopLoRaMacRequestConfig(const MacConfig_t *conf);
+
+/**
+ * @brief Print the period, overrun and jitter counters of the MAC phase timers on console
+ */
+void twohopLoRaMacPrintTimers(void);
+
+/**
+ * @brief Print the downlink latency histograms
+ * @param out[in] output stream, stdout or the export file
+ */
+void twohopLoRaMacPrintLatency(FILE *out);
+
 //int RtLoRaGetReadyDownlinkPacket(struct pkt_dl_s *pkt);
 //
 //void rtlora_receive_frame_handle(struct pkt_ul_s *p);
@@ -39,6 +39,17 @@
 //#define TWOHOP_NBO_CHANNELS             1
 #define TWOHOP_MAX_NBO_CHANNELS         7
 
+#define TWOHOP_NODE_ADDR_SPACE          8192 // 13-bit node address of TwohopNodeAddrFormat_u
+
+#define TWOHOP_MAX_NBO_LSI              128 // LSIs of a schedule group, 2^7 at the largest frame factor
+
+#define TWOHOP_MAX_INBOUND_QUEUES       8   // one inbound queue per ingest worker of the server
+
+/* Node pools, sized for every channel holding a full group of one LSI nodes, each relay with all its children */
+#define TWOHOP_SCH_NODE_POOL_SIZE       (TWOHOP_MAX_NBO_CHANNELS * TWOHOP_MAX_NBO_LSI)
+#define TWOHOP_MNGT_NODE_POOL_SIZE      (TWOHOP_MAX_NBO_NODES_IN_RNL + \
+                                         TWOHOP_SCH_NODE_POOL_SIZE * (1 + TWOHOP_MAX_NBO_CHILDREN))
+
 /* Channel 1 of GL, chan_multiSF_4 in global_conf.json file */
 #define TWOHOP_CHANNEL_1                ((uint32_t)(922.1*1e6))    
 /* Channel 2 of GL, chan_multiSF_5 in global_conf.json file */
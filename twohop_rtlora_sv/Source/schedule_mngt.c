@@ -17,20 +17,41 @@
 
 #include "schedule_mngt.h"
 #include "trade.h"
+#include "async_log.h"
 
 static unsigned short smAssignLsiToNode(SchList_t *list, unsigned short demandSlot);
 
 static SchNode_t* smAddNodeToScheduleList(SchList_t *list, SchNode_t node);
 
-extern FILE * log_file;
+static int smFindLsiBit(const uint64_t *map, int from, int end, bool assigned);
+
+static int smFindPrevAsgLsiBit(const uint64_t *map, int before);
+
+static void smMarkLsi(SchList_t *list, SchNode_t *node, bool assigned);
+
+static int smIndexFind(SchList_t *list, unsigned short addr);
+
+static void smIndexAdd(SchList_t *list, SchNode_t *node);
+
+static void smIndexRemove(SchList_t *list, int pos);
+
+
+static SchNode_t schNodeStorage[TWOHOP_SCH_NODE_POOL_SIZE];
+MemPool_t schNodePool = MEM_POOL_INITIALIZER("SchNode", schNodeStorage, TWOHOP_SCH_NODE_POOL_SIZE);
 
 void smInitSchedule(SchList_t *list, unsigned int nboTotSlots){
+    if(nboTotSlots > TWOHOP_MAX_NBO_LSI)
+        nboTotSlots = TWOHOP_MAX_NBO_LSI;
+
     list->head = NULL;
     list->nboNode = 0;
     list->nboTotSlots = nboTotSlots;
-    list->nboRmnSlots = 0;
+    list->nboRmnSlots = nboTotSlots;
     list->nboAsgSlots = 0;
     list->nboDistReq = 0;
+    memset(list->lsiMap, 0, sizeof(list->lsiMap));
+    memset(list->lsiOwner, 0, sizeof(list->lsiOwner));
+    memset(list->addrIndex, 0, sizeof(list->addrIndex));
 }
 
 SchErr_t smScheduleOneNode(SchList_t *list, SchNode_t node){
@@ -44,43 +65,40 @@ SchErr_t smScheduleOneNode(SchList_t *list, SchNode_t node){
     tmpNode = smAddNodeToScheduleList(list, node);
             
     if(tmpNode != NULL){
-        MSG_DEBUG(DEBUG_SCH_MNGT,"NODE %u: Scheduled to LSI=%u\n", tmpNode->addr, tmpNode->startLSI);
-        fprintf(log_file, "NODE %u: Scheduled to LSI=%u\n", tmpNode->addr, tmpNode->startLSI);
+        LOG_MSG(LOG_LVL_DEBUG, "NODE %u: Scheduled to LSI=%u\n", tmpNode->addr, tmpNode->startLSI);
         return SCH_SUCCEEDED;
     } else
         return SCH_FAILED;
 }
 
-void smRemoveOneNode(SchList_t *list, unsigned short addr){
+SchErr_t smRemoveOneNode(SchList_t *list, unsigned short addr){
     SchNode_t *curNode, *prevNode;
-    
-    prevNode = NULL;
-    curNode = list->head;
-    while(true){
-        if(curNode == NULL)
-            break;
-        
-        if(curNode->addr == addr){ // curNode will be removed
-            if(prevNode == NULL){
-                list->head = curNode->next;
-            } else{
-                prevNode->next = curNode->next;
-                curNode->next = NULL;
-            }
-            
-            list->nboNode--;
-            list->nboRmnSlots += curNode->slotDemand;
-            list->nboAsgSlots -= curNode->slotDemand;
-            if(curNode->nboSchDist > 0)
-                list->nboDistReq--;
-            
-            free(curNode);
-            break;
-        } else {
-            prevNode = curNode;
-            curNode = curNode->next;
-        }
+    int pos;
+
+    pos = smIndexFind(list, addr);
+    if(pos < 0)
+        return SCH_FAILED;
+    curNode = list->addrIndex[pos];
+    smIndexRemove(list, pos);
+
+    // The previous node in the list holds the last assigned LSI before curNode
+    pos = smFindPrevAsgLsiBit(list->lsiMap, curNode->startLSI - 1);
+    prevNode = (pos < 0) ? NULL : list->lsiOwner[pos];
+    if(prevNode == NULL){
+        list->head = curNode->next;
+    } else{
+        prevNode->next = curNode->next;
     }
+    smMarkLsi(list, curNode, false);
+
+    list->nboNode--;
+    list->nboRmnSlots += curNode->slotDemand;
+    list->nboAsgSlots -= curNode->slotDemand;
+    if(curNode->nboSchDist > 0)
+        list->nboDistReq--;
+
+    memPoolFree(&schNodePool, curNode);
+    return SCH_SUCCEEDED;
 }
 
 void smClearSchedule(SchList_t *list){
@@ -90,12 +108,37 @@ void smClearSchedule(SchList_t *list){
             break;
         curNode = list->head;
         list->head = curNode->next;
-        free(curNode);
+        memPoolFree(&schNodePool, curNode);
     }
     list->nboNode = 0;
     list->nboAsgSlots = 0;
-    list->nboRmnSlots = 0;
+    list->nboRmnSlots = list->nboTotSlots;
     list->nboDistReq = 0;
+    memset(list->lsiMap, 0, sizeof(list->lsiMap));
+    memset(list->lsiOwner, 0, sizeof(list->lsiOwner));
+    memset(list->addrIndex, 0, sizeof(list->addrIndex));
+}
+
+unsigned int smResizeSchedule(SchList_t *list, unsigned int nboTotSlots){
+    SchNode_t *node;
+    unsigned int nboRemoved = 0;
+
+    if(nboTotSlots > TWOHOP_MAX_NBO_LSI)
+        nboTotSlots = TWOHOP_MAX_NBO_LSI;
+
+    // Nodes are in the order of ascending LSI, the first one past the end is followed by the others
+    node = list->head;
+    while(node != NULL && (unsigned int)node->startLSI + node->slotDemand <= nboTotSlots + 1)
+        node = node->next;
+    while(node != NULL){
+        unsigned short addr = node->addr;
+        node = node->next;
+        smRemoveOneNode(list, addr);
+        nboRemoved++;
+    }
+    list->nboTotSlots = nboTotSlots;
+    list->nboRmnSlots = nboTotSlots - list->nboAsgSlots;
+    return nboRemoved;
 }
 
 //SchNode_t * smGetRefToFirstNodeForSchDist(SchList_t *list){
@@ -113,6 +156,13 @@ void smClearSchedule(SchList_t *list){
 //    return curNode;
 //}
 
+SchNode_t* smGetRefToNode(SchList_t *list, unsigned short addr){
+    int pos;
+
+    pos = smIndexFind(list, addr);
+    return (pos < 0) ? NULL : list->addrIndex[pos];
+}
+
 SchNode_t* smGetHeadNodeRef(SchList_t *list){
     return list->head;
 }
@@ -127,109 +177,69 @@ SchNode_t* smGetNextNodeRef(SchNode_t* curNode){
 
 void smNodeSetNboSchDist(SchList_t *list, unsigned short addr, uint8_t nboSchDist){
     SchNode_t *curNode;
-    curNode = list->head;
-    while(true){
-        if(curNode == NULL){
-            break;
-        }
-        if(curNode->addr == addr){
-            if(curNode->nboSchDist > 0 && nboSchDist == 0){
-                // No more schedule update needed
-                list->nboDistReq--;
-            }
-            if (curNode->nboSchDist == 0 && nboSchDist > 0) {
-                // Need to update schedule
-                list->nboDistReq++;
-            }
-            curNode->nboSchDist = nboSchDist;
-            break;
-        }
-        curNode = curNode->next;
+
+    curNode = smGetRefToNode(list, addr);
+    if(curNode == NULL){
+        return;
     }
+    if(curNode->nboSchDist > 0 && nboSchDist == 0){
+        // No more schedule update needed
+        list->nboDistReq--;
+    }
+    if (curNode->nboSchDist == 0 && nboSchDist > 0) {
+        // Need to update schedule
+        list->nboDistReq++;
+    }
+    curNode->nboSchDist = nboSchDist;
 }
 
 unsigned short smGetLastAsgLsi(SchList_t *list){
-    SchNode_t *curNode = list->head;
-    
-    if(curNode == NULL)
-        return 0;
-    
-    while(curNode){
-        if(curNode->next == NULL)
-            return (unsigned short)(curNode->startLSI + curNode->slotDemand - 1);
-        curNode = curNode->next;
-    }
-    return 0;
+    // 0 when nothing is assigned
+    return (unsigned short)(smFindPrevAsgLsiBit(list->lsiMap, TWOHOP_MAX_NBO_LSI) + 1);
 }
 
 void smPrintSchedule(SchList_t *list){
     SchNode_t *node;
     node = list->head;
-    printf("\t\t======== SCHEDULE =======\n");
-    printf("\tNode\tAsgLsi\tDemand\tNboSchDist\n");
-    
-    fprintf(log_file, "\t\t======== SCHEDULE =======\n");
-    fprintf(log_file, "\tNode\tAsgLsi\tDemand\tNboSchDist\n");
+    LOG_MSG(LOG_LVL_INFO, "\t\t======== SCHEDULE =======\n");
+    LOG_MSG(LOG_LVL_INFO, "\tNode\tAsgLsi\tDemand\tNboSchDist\n");
     while(true){
         if(node == NULL)
             return;
-        printf("\t%hu\t%hu\t%hu", node->addr, node->startLSI, node->slotDemand);
-        printf("\t%hu\n", node->nboSchDist);
-        
-        fprintf(log_file, "\t%hu\t%hu\t%hu", node->addr, node->startLSI, node->slotDemand);
-        fprintf(log_file, "\t%hu\n", node->nboSchDist);
+        LOG_MSG(LOG_LVL_INFO, "\t%hu\t%hu\t%hu\t%hu\n", node->addr, node->startLSI, node->slotDemand, node->nboSchDist);
         node = node->next;
     }
 }
 
 /************************* PRIVATE FUNCTION DEFINITION *************************/
 
+// First fit: the lowest run of demandSlot free LSIs, each run of the group is skipped at once
 static unsigned short smAssignLsiToNode(SchList_t *list, unsigned short demandSlot){
-    SchNode_t *curNode;
-    unsigned short asgLsi, lastLsi;
+    int start, used, end;
 
-    curNode = list->head;
-    
-    if(curNode == NULL){
-        asgLsi = 1;
-        return asgLsi;
-    }
- 
-    if(curNode->startLSI > demandSlot){
-        asgLsi = 1;
-        return asgLsi;
-    }
-    
-    asgLsi = 0;
+    end = (int)list->nboTotSlots;
+    if(demandSlot == 0 || demandSlot > end)
+        return 0;
+
+    start = 0;
     while(true){
-        if(curNode == NULL) // Cannot find the schedule
-           break;
-        
-        // Calculate the last LSI assigned to curNode
-        lastLsi = curNode->startLSI + curNode->slotDemand - 1;
-
-        if(curNode->next == NULL){ // This node is the last one in the list
-            // If the number of free slots in this group is enough to schedule the node
-            if(list->nboTotSlots - lastLsi >= demandSlot)
-                asgLsi = lastLsi + 1;
-            break;
-        } else { // This node is in the middle of the list
-            if(curNode->next->startLSI - lastLsi > demandSlot){
-                asgLsi = lastLsi + 1;
-                break;
-            }
-        }
-        curNode = curNode->next;
+        start = smFindLsiBit(list->lsiMap, start, end, false);
+        if(start < 0 || start + demandSlot > end) // Cannot find the schedule
+            return 0;
+
+        used = smFindLsiBit(list->lsiMap, start, start + demandSlot, true);
+        if(used < 0)
+            return (unsigned short)(start + 1);
+        start = used;
     }
-    return asgLsi;
 }
 
 // Insert node to the list in the order of ascending LSI
 static SchNode_t* smAddNodeToScheduleList(SchList_t *list, SchNode_t node){
-    SchNode_t *newNode;
-    SchNode_t *curNode, *prevNode;
-        
-    newNode = (SchNode_t *)malloc(sizeof(SchNode_t));
+    SchNode_t *newNode, *prevNode;
+    int pos;
+
+    newNode = (SchNode_t *)memPoolAlloc(&schNodePool);
     if(newNode != NULL){
         newNode->addr = node.addr;
         newNode->class = node.class;
@@ -240,46 +250,121 @@ static SchNode_t* smAddNodeToScheduleList(SchList_t *list, SchNode_t node){
     } else {
         return NULL;
     }
-    
-    if(list->head == NULL){
+
+    // The node holding the last assigned LSI before the new one precedes it in the list
+    pos = smFindPrevAsgLsiBit(list->lsiMap, newNode->startLSI - 1);
+    prevNode = (pos < 0) ? NULL : list->lsiOwner[pos];
+    if(prevNode == NULL){ // node will be the list's head
+        newNode->next = list->head;
         list->head = newNode;
-        goto succeeded;
+    } else {
+        newNode->next = prevNode->next;
+        prevNode->next = newNode;
     }
-    
-    prevNode = NULL;
-    curNode = list->head;
+    smMarkLsi(list, newNode, true);
+    smIndexAdd(list, newNode);
 
-    while(true){
-        if(curNode == NULL){
-            free(newNode);
-            return NULL;
-        }
-        
-        if(curNode->startLSI > newNode->startLSI){ // found the right position to add the node
-            if(prevNode == NULL){ // node will be the list's head
-                newNode->next = list->head;
-                list->head = newNode;
-            } else {
-                prevNode->next = newNode;
-                newNode->next = curNode;
-            }
-            goto succeeded;
-        } else {
-            if(curNode->next == NULL){
-                // node becomes list's tail
-                curNode->next = newNode;
-                newNode->next = NULL;
-                goto succeeded;
-            } 
-        }
-        prevNode = curNode;
-        curNode = curNode->next;
-    }
-    
-succeeded:
     list->nboNode++;
     list->nboAsgSlots += newNode->slotDemand;
     list->nboRmnSlots -= newNode->slotDemand;
     list->nboDistReq++;
     return newNode;
-}
\ No newline at end of file
+}
+
+// Index of the first bit in [from, end) that is assigned (or free), -1 if none
+static int smFindLsiBit(const uint64_t *map, int from, int end, bool assigned){
+    uint64_t bits;
+    int word;
+
+    while(from < end){
+        word = from >> 6;
+        bits = assigned ? map[word] : ~map[word];
+        bits &= ~0ULL << (from & 63);
+        if(bits != 0){
+            from = (word << 6) + __builtin_ctzll(bits);
+            return (from < end) ? from : -1;
+        }
+        from = (word + 1) << 6;
+    }
+    return -1;
+}
+
+// Index of the last assigned bit below before, -1 if none
+static int smFindPrevAsgLsiBit(const uint64_t *map, int before){
+    uint64_t bits;
+    int word, last;
+
+    while(before > 0){
+        last = before - 1;
+        word = last >> 6;
+        bits = map[word];
+        if((last & 63) != 63)
+            bits &= (2ULL << (last & 63)) - 1;
+        if(bits != 0)
+            return (word << 6) + 63 - __builtin_clzll(bits);
+        before = word << 6;
+    }
+    return -1;
+}
+
+// Set or clear the LSIs of node, one word at a time
+static void smMarkLsi(SchList_t *list, SchNode_t *node, bool assigned){
+    uint64_t mask;
+    int bit, end, nb;
+
+    bit = node->startLSI - 1;
+    end = bit + node->slotDemand;
+    list->lsiOwner[bit] = assigned ? node : NULL;
+    list->lsiOwner[end - 1] = assigned ? node : NULL;
+
+    while(bit < end){
+        nb = 64 - (bit & 63);
+        if(nb > end - bit)
+            nb = end - bit;
+        mask = (nb == 64) ? ~0ULL : (((1ULL << nb) - 1) << (bit & 63));
+        if(assigned)
+            list->lsiMap[bit >> 6] |= mask;
+        else
+            list->lsiMap[bit >> 6] &= ~mask;
+        bit += nb;
+    }
+}
+
+static unsigned int smAddrHash(unsigned short addr){
+    return (((uint32_t)addr * 2654435761u) >> 16) & (SM_ADDR_INDEX_SIZE - 1);
+}
+
+static int smIndexFind(SchList_t *list, unsigned short addr){
+    unsigned int pos;
+
+    for(pos = smAddrHash(addr); list->addrIndex[pos] != NULL; pos = (pos + 1) & (SM_ADDR_INDEX_SIZE - 1)){
+        if(list->addrIndex[pos]->addr == addr)
+            return (int)pos;
+    }
+    return -1;
+}
+
+static void smIndexAdd(SchList_t *list, SchNode_t *node){
+    unsigned int pos;
+
+    // A group holds TWOHOP_MAX_NBO_LSI nodes at most, the index is never full
+    for(pos = smAddrHash(node->addr); list->addrIndex[pos] != NULL; pos = (pos + 1) & (SM_ADDR_INDEX_SIZE - 1))
+        ;
+    list->addrIndex[pos] = node;
+}
+
+// Empty a position, the following nodes of the probe sequence move back into the hole
+static void smIndexRemove(SchList_t *list, int pos){
+    unsigned int hole, cur, home;
+
+    hole = (unsigned int)pos;
+    list->addrIndex[hole] = NULL;
+    for(cur = (hole + 1) & (SM_ADDR_INDEX_SIZE - 1); list->addrIndex[cur] != NULL; cur = (cur + 1) & (SM_ADDR_INDEX_SIZE - 1)){
+        home = smAddrHash(list->addrIndex[cur]->addr);
+        if(((cur - home) & (SM_ADDR_INDEX_SIZE - 1)) >= ((cur - hole) & (SM_ADDR_INDEX_SIZE - 1))){
+            list->addrIndex[hole] = list->addrIndex[cur];
+            list->addrIndex[cur] = NULL;
+            hole = cur;
+        }
+    }
+}
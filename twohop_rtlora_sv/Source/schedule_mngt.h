@@ -19,6 +19,7 @@
 #include <stdbool.h>
 
 #include "rtlora_mac_conf.h"
+#include "mem_pool.h"
 
 typedef enum SchErr_{
     SCH_SUCCEEDED,
@@ -40,24 +41,48 @@ typedef struct SchNode_{
     struct SchNode_ *next;
 }SchNode_t;
 
+#define SM_LSI_MAP_WORDS        ((TWOHOP_MAX_NBO_LSI + 63) / 64)
+#define SM_ADDR_INDEX_SIZE      256     // power of 2, twice the nodes a group can hold (one LSI each)
+
 typedef struct SchList_{
-    SchNode_t *head;
+    SchNode_t *head;            // nodes in the order of ascending LSI
     unsigned int nboNode;  // Number of one hop members
     unsigned int nboTotSlots;   // Number of total slots
     unsigned int nboAsgSlots;   // Number of assigned slots
     unsigned int nboRmnSlots;   // Number of remaining slots
     unsigned int nboDistReq;    // Number of schedule node need to be distributed
+    uint64_t lsiMap[SM_LSI_MAP_WORDS];          // bit (LSI - 1) set when the LSI is assigned
+    SchNode_t *lsiOwner[TWOHOP_MAX_NBO_LSI];    // node of an LSI, set on the first and last LSI of each node
+    SchNode_t *addrIndex[SM_ADDR_INDEX_SIZE];   // nodes by address, open addressing with linear probing
 }SchList_t;
 
+/* Nodes of every schedule come from this pool */
+extern MemPool_t schNodePool;
+
 void smInitSchedule(SchList_t *list, unsigned int nboTotSlots);
 
 // Schedule one hop node to one of the schedule groups
 SchErr_t smScheduleOneNode(SchList_t *list, SchNode_t newNode);
 
-void smRemoveOneNode(SchList_t *list, unsigned short addr);
+/**
+ * @brief Remove a node from the schedule and release its LSIs
+ * @param list[in]  schedule group
+ * @param addr[in]  address of the node
+ * @return SCH_SUCCEEDED if the node was in this group, SCH_FAILED otherwise
+ */
+SchErr_t smRemoveOneNode(SchList_t *list, unsigned short addr);
 
 void smClearSchedule(SchList_t *list);
 
+/**
+ * @brief Change the number of LSIs of a group, the nodes that no longer fit are removed
+ * The other nodes keep their LSIs, the caller schedules the removed ones again.
+ * @param list[in/out] Schedule group
+ * @param nboTotSlots[in] New number of LSIs, up to TWOHOP_MAX_NBO_LSI
+ * @return number of nodes removed
+ */
+unsigned int smResizeSchedule(SchList_t *list, unsigned int nboTotSlots);
+
 SchNode_t* smGetRefToNode(SchList_t *list, unsigned short addr);
 
 SchNode_t* smGetHeadNodeRef(SchList_t *list);
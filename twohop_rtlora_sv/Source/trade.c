@@ -12,8 +12,6 @@ time_t log_start_time;
 FILE * log_file = NULL;
 time_t log_time;
 
-pthread_mutex_t mutexLogFile = PTHREAD_MUTEX_INITIALIZER;
-
 _Bool open_log(void) {
     int i;
     char iso_date[20];
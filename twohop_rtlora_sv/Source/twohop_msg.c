@@ -0,0 +1,304 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   twohop_msg.c
+ * Author: LAM-HOANG
+ *
+ * Created on October 17, 2026
+ */
+
+#include <string.h>
+
+#include "twohop_msg.h"
+
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static void twmPutHdr(TwohopMsgWriter_t *w, const TwohopMsgHdr_t *hdr){
+    TwohopMacHeader_u macHeader;
+
+    macHeader.bits.pktType = hdr->type;
+    macHeader.bits.RFU = 0;
+    twmPutU8(w, macHeader.value);
+    twmPutU16(w, hdr->srcAddr);
+    twmPutU16(w, hdr->destAddr);
+    twmPutU16(w, hdr->macParams.value);
+}
+
+static int twmWriterEnd(const TwohopMsgWriter_t *w){
+    return w->overflow ? -1 : w->len;
+}
+
+/* the whole payload has been read, nothing more */
+static int twmReaderEnd(const TwohopMsgReader_t *r){
+    return (r->error || r->pos != r->size) ? -1 : 0;
+}
+
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int twmEncodeRnl(uint8_t *buf, uint16_t size, const TwohopMsgHdr_t *hdr, const TwohopRnlMsg_t *rnl){
+    TwohopMsgWriter_t w;
+    TwohopMsgRnlCtrl_u rnlCtrl;
+    int i;
+
+    if(hdr->type != Twohop_MsgType_DL_RNL || rnl->nboNodes > TWOHOP_MAX_NBO_NODES_IN_RNL){
+        return -1;
+    }
+    twmWriterInit(&w, buf, size);
+    twmPutHdr(&w, hdr);
+    twmPutU16(&w, rnl->seq);
+    rnlCtrl.bits.netReadyFlag = rnl->netReady ? 1 : 0;
+    rnlCtrl.bits.nboAddedNodes = rnl->nboNodes;
+    twmPutU8(&w, rnlCtrl.value);
+    for(i = 0; i < rnl->nboNodes; i++){
+        twmPutAddr(&w, rnl->nodes[i].addr, rnl->nodes[i].class);
+    }
+    return twmWriterEnd(&w);
+}
+
+int twmEncodeSm(uint8_t *buf, uint16_t size, const TwohopMsgHdr_t *hdr, const TwohopSmMsg_t *sm){
+    TwohopMsgWriter_t w;
+    TwohopMsgSmCtrl_u smCtrl;
+    TwohopMsgSmPlCtrl_u smPlCtrl;
+    int i;
+
+    if(hdr->type != Twohop_MsgType_DL_SM || sm->smCount > 15 || sm->sch1Size > 15
+            || sm->groupId >= TWOHOP_MAX_NBO_CHANNELS || sm->nboNodes > TWOHOP_MAX_NBO_NODES_IN_SM){
+        return -1;
+    }
+    twmWriterInit(&w, buf, size);
+    twmPutHdr(&w, hdr);
+    smCtrl.bits.smCount = sm->smCount;
+    smCtrl.bits.sch1Size = sm->sch1Size;
+    twmPutU8(&w, smCtrl.value);
+    twmPutU8(&w, sm->sch2Sslot);
+    twmPutU8(&w, sm->nboRelays);
+    smPlCtrl.bits.groupId = sm->groupId;
+    smPlCtrl.bits.nboNodes = sm->nboNodes;
+    twmPutU8(&w, smPlCtrl.value);
+    if(sm->nboNodes > 0){
+        // start LSI then the demand of each node
+        twmPutU8(&w, sm->startLSI);
+        for(i = 0; i < sm->nboNodes; i++){
+            twmPutAddr(&w, sm->nodes[i].addr, sm->nodes[i].class);
+            twmPutU8(&w, sm->nodes[i].slotDemand);
+        }
+    }
+    return twmWriterEnd(&w);
+}
+
+int twmEncodeCm(uint8_t *buf, uint16_t size, const TwohopMsgHdr_t *hdr, const TwohopCmMsg_t *cm){
+    TwohopMsgWriter_t w;
+    TwohopMsgCmCtrl_u cmCtrl;
+    TwohopMsgUsiCtrl_u usiCtrl;
+    const TwohopUsi_t *usi;
+    int i, j;
+
+    if(hdr->type != Twohop_MsgType_DL_CM || cm->nboUsi > TWOHOP_MAX_NBO_RELAYS_IN_USI){
+        return -1;
+    }
+    for(i = 0; i < cm->nboUsi; i++){
+        if(cm->usi[i].groupId >= TWOHOP_MAX_NBO_CHANNELS || cm->usi[i].nboChild > TWOHOP_MAX_NBO_CHILDREN){
+            return -1;
+        }
+    }
+    twmWriterInit(&w, buf, size);
+    twmPutHdr(&w, hdr);
+    twmPutU16(&w, cm->seq);
+    for(i = 0; i < hdr->macParams.bits.nboChannels; i++){
+        twmPutU8(&w, cm->lastLSI[i]);
+    }
+    cmCtrl.bits.usiFlag = (cm->nboUsi > 0) ? 1 : 0;
+    cmCtrl.bits.nboNodesInUsi = cm->nboUsi;
+    cmCtrl.bits.unuse = 0;
+    twmPutU8(&w, cmCtrl.value);
+    for(i = 0; i < cm->nboUsi; i++){
+        usi = &cm->usi[i];
+        usiCtrl.bits.groupId = usi->groupId;
+        usiCtrl.bits.nboChild = usi->nboChild;
+        twmPutU8(&w, usiCtrl.value);
+        twmPutU8(&w, usi->startLSI);
+        twmPutAddr(&w, usi->parent.addr, usi->parent.class);
+        for(j = 0; j < usi->nboChild; j++){
+            twmPutAddr(&w, usi->children[j].addr, usi->children[j].class);
+        }
+    }
+    return twmWriterEnd(&w);
+}
+
+int twmDecodeHdr(TwohopMsgReader_t *r, TwohopMsgHdr_t *hdr){
+    TwohopMacHeader_u macHeader;
+
+    macHeader.value = twmGetU8(r);
+    hdr->type = (TwohopMsgType_e)macHeader.bits.pktType;
+    hdr->srcAddr = twmGetU16(r);
+    hdr->destAddr = twmGetU16(r);
+    hdr->macParams.value = twmGetU16(r);
+    return (r->error || macHeader.bits.RFU != 0) ? -1 : 0;
+}
+
+int twmDecodeRnl(const uint8_t *buf, uint16_t size, TwohopMsgHdr_t *hdr, TwohopRnlMsg_t *rnl){
+    TwohopMsgReader_t r;
+    TwohopMsgRnlCtrl_u rnlCtrl;
+    int i;
+
+    twmReaderInit(&r, buf, size);
+    if(twmDecodeHdr(&r, hdr) != 0 || hdr->type != Twohop_MsgType_DL_RNL){
+        return -1;
+    }
+    rnl->seq = twmGetU16(&r);
+    rnlCtrl.value = twmGetU8(&r);
+    rnl->netReady = rnlCtrl.bits.netReadyFlag;
+    rnl->nboNodes = rnlCtrl.bits.nboAddedNodes;
+    if(rnl->nboNodes > TWOHOP_MAX_NBO_NODES_IN_RNL){
+        return -1;
+    }
+    for(i = 0; i < rnl->nboNodes; i++){
+        twmGetAddr(&r, &rnl->nodes[i]);
+        rnl->nodes[i].slotDemand = 0;
+    }
+    return twmReaderEnd(&r);
+}
+
+int twmDecodeSm(const uint8_t *buf, uint16_t size, TwohopMsgHdr_t *hdr, TwohopSmMsg_t *sm){
+    TwohopMsgReader_t r;
+    TwohopMsgSmCtrl_u smCtrl;
+    TwohopMsgSmPlCtrl_u smPlCtrl;
+    int i;
+
+    twmReaderInit(&r, buf, size);
+    if(twmDecodeHdr(&r, hdr) != 0 || hdr->type != Twohop_MsgType_DL_SM){
+        return -1;
+    }
+    smCtrl.value = twmGetU8(&r);
+    sm->smCount = smCtrl.bits.smCount;
+    sm->sch1Size = smCtrl.bits.sch1Size;
+    sm->sch2Sslot = twmGetU8(&r);
+    sm->nboRelays = twmGetU8(&r);
+    smPlCtrl.value = twmGetU8(&r);
+    sm->groupId = smPlCtrl.bits.groupId;
+    sm->nboNodes = smPlCtrl.bits.nboNodes;
+    sm->startLSI = 0;
+    if(sm->groupId >= TWOHOP_MAX_NBO_CHANNELS){
+        return -1;
+    }
+    if(sm->nboNodes > 0){
+        sm->startLSI = twmGetU8(&r);
+        for(i = 0; i < sm->nboNodes; i++){
+            twmGetAddr(&r, &sm->nodes[i]);
+            sm->nodes[i].slotDemand = twmGetU8(&r);
+        }
+    }
+    return twmReaderEnd(&r);
+}
+
+int twmDecodeCm(const uint8_t *buf, uint16_t size, TwohopMsgHdr_t *hdr, TwohopCmMsg_t *cm){
+    TwohopMsgReader_t r;
+    TwohopMsgCmCtrl_u cmCtrl;
+    TwohopMsgUsiCtrl_u usiCtrl;
+    TwohopUsi_t *usi;
+    int i, j;
+
+    twmReaderInit(&r, buf, size);
+    if(twmDecodeHdr(&r, hdr) != 0 || hdr->type != Twohop_MsgType_DL_CM){
+        return -1;
+    }
+    cm->seq = twmGetU16(&r);
+    memset(cm->lastLSI, 0, sizeof(cm->lastLSI));
+    for(i = 0; i < hdr->macParams.bits.nboChannels; i++){
+        cm->lastLSI[i] = twmGetU8(&r);
+    }
+    cmCtrl.value = twmGetU8(&r);
+    if(cmCtrl.bits.unuse != 0 || cmCtrl.bits.usiFlag != (cmCtrl.bits.nboNodesInUsi > 0)){
+        return -1;
+    }
+    cm->nboUsi = cmCtrl.bits.nboNodesInUsi;
+    for(i = 0; i < cm->nboUsi; i++){
+        usi = &cm->usi[i];
+        usiCtrl.value = twmGetU8(&r);
+        usi->groupId = usiCtrl.bits.groupId;
+        usi->nboChild = usiCtrl.bits.nboChild;
+        if(usi->groupId >= TWOHOP_MAX_NBO_CHANNELS || usi->nboChild > TWOHOP_MAX_NBO_CHILDREN){
+            return -1;
+        }
+        usi->startLSI = twmGetU8(&r);
+        twmGetAddr(&r, &usi->parent);
+        usi->parent.slotDemand = 0;
+        for(j = 0; j < usi->nboChild; j++){
+            twmGetAddr(&r, &usi->children[j]);
+            usi->children[j].slotDemand = 0;
+        }
+        if(r.error){
+            return -1;
+        }
+    }
+    return twmReaderEnd(&r);
+}
+
+int twmDecodeUplink(const uint8_t *buf, uint16_t size, TwohopUlFrame_t *frame){
+    TwohopMsgReader_t r;
+    TwohopMacHeader_u macHeader;
+    TwohopMsgRrCtrl_u rrCtrl;
+    TwohopMsgDataCtrl_u dataCtrl;
+    TwohopRrMsg_t *rr = &frame->body.rr;
+    TwohopDataMsg_t *data = &frame->body.data;
+    int i;
+
+    frame->type = TWM_UL_INVALID;
+    twmReaderInit(&r, buf, size);
+    macHeader.value = twmGetU8(&r);
+    frame->srcAddr = twmGetU16(&r);
+    frame->destAddr = twmGetU16(&r);
+
+    switch(macHeader.bits.pktType){
+        case Twohop_MsgType_UL_RR:
+            rrCtrl.value = twmGetU8(&r);
+            rr->viaRelay = rrCtrl.bits.rrType1;
+            // registration itself, or for the node and its child
+            rr->nboNodes = (rrCtrl.bits.rrType1 == 0) ? 1 : rrCtrl.bits.nboChild;
+            if(rr->nboNodes > TWM_RR_MAX_NODES){
+                return -1;
+            }
+            for(i = 0; i < rr->nboNodes; i++){
+                twmGetAddr(&r, &rr->nodes[i]);
+                rr->nodes[i].slotDemand = 0;
+            }
+            break;
+        case Twohop_MsgType_UL_DATA:
+            data->seq = twmGetU16(&r);
+            dataCtrl.value = twmGetU8(&r);
+            if(dataCtrl.bits.ctrl1 == 1){
+                twmGetU8(&r);   // skip Jslot field
+            }
+            data->relayed = dataCtrl.bits.ctrl0;
+            data->hasLinkInfo = false;
+            data->dlRssi = 0;
+            data->dlSnr = 0;
+            if(data->relayed){
+                data->dataSrcAddr = twmGetU16(&r);
+            } else {
+                data->dataSrcAddr = frame->srcAddr;
+                if(dataCtrl.bits.ctrl2 == 1){
+                    data->hasLinkInfo = true;
+                    data->dlRssi = (int16_t)twmGetU16(&r);
+                    data->dlSnr = (int8_t)twmGetU8(&r);
+                }
+            }
+            data->payloadSize = twmGetU8(&r);
+            data->payloadOfs = (uint8_t)r.pos;
+            if(r.pos + data->payloadSize > size){
+                return -1;
+            }
+            break;
+        default:
+            return -1;
+    }
+    if(r.error){
+        return -1;
+    }
+    frame->type = macHeader.bits.pktType;
+    return 0;
+}
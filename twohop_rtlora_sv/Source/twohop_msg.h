@@ -0,0 +1,386 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   twohop_msg.h
+ * Author: LAM-HOANG
+ * Description:
+ *          Two-hop RT-LoRa message format. The MAC takes a snapshot of the
+ *          nodes and schedules carried by a downlink (RNL, SM or CM) under
+ *          its locks, the encoders then write it field by field into the
+ *          payload of the packet with bounds-checked writers, no lock held.
+ *          The matching decoders accept exactly what the encoders produce.
+ *          The RR and DATA uplinks are decoded and validated by the ingest
+ *          workers, the MAC gets them parsed along with the packet.
+ * Created on October 17, 2026
+ */
+
+#ifndef TWOHOP_MSG_H
+#define TWOHOP_MSG_H
+
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "rtlora_mac_conf.h"
+
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define TWM_HDR_SIZE            7   /* MHDR, source, destination, MAC parameters */
+#define TWM_UL_HDR_SIZE         5   /* MHDR, source, destination */
+#define TWM_NB_MSG_TYPES        16  /* pktType of the MAC header */
+#define TWM_UL_INVALID          0xFF    /* TwohopUlFrame_t type of a packet that is not a valid uplink */
+#define TWM_RR_MAX_NODES        (1 + TWOHOP_MAX_NBO_CHILDREN)   /* a relay and its children */
+
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* Packet type definition */
+typedef enum TwohopMsgType_ {
+	/* Downlink */
+    Twohop_MsgType_DL_RNL,  /* Registration Node List */
+	Twohop_MsgType_DL_SM,   /* Scheduling message */
+	Twohop_MsgType_DL_CM,   /* Command message*/
+
+	/* Uplink */
+    Twohop_MsgType_UL_RR,   /* registration request */
+	Twohop_MsgType_UL_DATA, /* up-link data */
+
+    /* Between 1-hop and 2-hop nodes */
+    Twohop_MsgType_RRACK,   /* registration confirmation */
+}TwohopMsgType_e;
+
+typedef union TwohopNodeAddrFormat_{   // Node addressing format
+    uint16_t value;
+    struct AddrFormat_{
+        uint16_t address    : 13;
+        uint16_t class      : 3;
+    }bits;
+}TwohopNodeAddrFormat_u;
+
+typedef union TwohopMacHeader_ {
+	uint8_t value;
+	struct MacHeaderValue {
+		uint8_t RFU         :4;
+		uint8_t pktType     :4;
+	} bits;
+}TwohopMacHeader_u;
+
+typedef union TwohopMsgRnlCtrl_{
+    uint8_t value;
+    struct RnlCtrl_{
+        uint8_t netReadyFlag    : 1; // bit 0
+        uint8_t nboAddedNodes   : 7; // bit 1 ~ 7
+    }bits;
+}TwohopMsgRnlCtrl_u;
+
+typedef union TwohopMsgRrCtrl_{
+    uint8_t value;
+    struct RrCtrl_{
+        uint8_t rrType1         : 1; // bit 0
+        uint8_t rrType2         : 1; // bit 0
+        uint8_t nboChild        : 6; // bit 1 ~ 7
+    }bits;
+}TwohopMsgRrCtrl_u;
+
+typedef union TwohopMsgSmCtrl_{
+    uint8_t value;
+    struct SmCtrl_{
+        uint8_t smCount        : 4;
+        uint8_t sch1Size       : 4;
+    }bits;
+}TwohopMsgSmCtrl_u;
+
+typedef union TwohopMsgSmPlCtrl_{   // schedule information header of a SM
+    uint8_t value;
+    struct SmPlCtrl_{
+        uint8_t groupId         : 3;
+        uint8_t nboNodes        : 5;
+    }bits;
+}TwohopMsgSmPlCtrl_u;
+
+typedef union TwohopMsgCmCtrl_{
+    uint8_t value;
+    struct CmCtrl_{
+        uint8_t usiFlag         : 1;
+        uint8_t nboNodesInUsi   : 4;
+        uint8_t unuse           : 3;
+    }bits;
+}TwohopMsgCmCtrl_u;
+
+typedef union TwohopMsgUsiCtrl_{    // header of a relay in the uSI of a CM
+    uint8_t value;
+    struct UsiCtrl_{
+        uint8_t groupId         : 3;
+        uint8_t nboChild        : 5;
+    }bits;
+}TwohopMsgUsiCtrl_u;
+
+typedef union TwohopMsgDataCtrl_{
+    uint8_t value;
+    struct DataCtrl_{
+        uint8_t ctrl0           : 1;
+        uint8_t ctrl1           : 1;
+        uint8_t ctrl2           : 1;
+        uint8_t unuse           : 5;
+    }bits;
+}TwohopMsgDataCtrl_u;
+
+typedef union TwohopMacParams_{   // Mac configuration parameters
+    uint16_t value;
+    struct Params_{
+        uint16_t frameFactor        : 3;
+        uint16_t uplinkSlotSize     : 5;
+        uint16_t downlinkSlotSize   : 5;
+        uint16_t nboChannels        : 3;
+    }bits;
+}TwohopMacParams_u;
+
+/* Header common to the downlinks */
+typedef struct TwohopMsgHdr_{
+    TwohopMsgType_e     type;
+    uint16_t            srcAddr;
+    uint16_t            destAddr;
+    TwohopMacParams_u   macParams;  /* nboChannels gives the number of LSIs in a CM */
+}TwohopMsgHdr_t;
+
+typedef struct TwohopMsgNode_{
+    uint16_t    addr;
+    uint8_t     class;
+    uint8_t     slotDemand;         /* SM only */
+}TwohopMsgNode_t;
+
+/* Registration Node List */
+typedef struct TwohopRnlMsg_{
+    uint16_t        seq;
+    bool            netReady;
+    uint8_t         nboNodes;
+    TwohopMsgNode_t nodes[TWOHOP_MAX_NBO_NODES_IN_RNL];
+}TwohopRnlMsg_t;
+
+/* Scheduling message, a run of nodes of one group on consecutive LSIs */
+typedef struct TwohopSmMsg_{
+    uint8_t         smCount;
+    uint8_t         sch1Size;
+    uint8_t         sch2Sslot;      /* SCH2 start slot */
+    uint8_t         nboRelays;
+    uint8_t         groupId;
+    uint8_t         nboNodes;
+    uint8_t         startLSI;       /* present when nboNodes > 0 */
+    TwohopMsgNode_t nodes[TWOHOP_MAX_NBO_NODES_IN_SM];
+}TwohopSmMsg_t;
+
+/* uSI entry of a CM: a relay and its children */
+typedef struct TwohopUsi_{
+    uint8_t         groupId;
+    uint8_t         startLSI;
+    TwohopMsgNode_t parent;
+    uint8_t         nboChild;
+    TwohopMsgNode_t children[TWOHOP_MAX_NBO_CHILDREN];
+}TwohopUsi_t;
+
+/* Command message */
+typedef struct TwohopCmMsg_{
+    uint16_t        seq;
+    uint8_t         lastLSI[TWOHOP_MAX_NBO_CHANNELS];   /* one per channel of the header */
+    uint8_t         nboUsi;
+    TwohopUsi_t     usi[TWOHOP_MAX_NBO_RELAYS_IN_USI];
+}TwohopCmMsg_t;
+
+/* Registration request, the node itself or a relay with its children */
+typedef struct TwohopRrMsg_{
+    bool            viaRelay;       /* rrType1 */
+    uint8_t         nboNodes;
+    TwohopMsgNode_t nodes[TWM_RR_MAX_NODES];
+}TwohopRrMsg_t;
+
+/* Uplink data, the application payload stays in the packet */
+typedef struct TwohopDataMsg_{
+    uint16_t    seq;
+    uint16_t    dataSrcAddr;    /* node of the data, the source of the frame unless relayed */
+    bool        relayed;        /* ctrl0 */
+    bool        hasLinkInfo;    /* ctrl2, downlink RSSI and SNR seen by the node */
+    int16_t     dlRssi;
+    int8_t      dlSnr;
+    uint8_t     payloadOfs;     /* application payload offset in the packet */
+    uint8_t     payloadSize;
+}TwohopDataMsg_t;
+
+/* Uplink decoded by the ingest workers, handed to the MAC with the packet */
+typedef struct TwohopUlFrame_{
+    uint8_t     type;           /* TwohopMsgType_e, TWM_UL_INVALID if not decoded */
+    uint16_t    srcAddr;
+    uint16_t    destAddr;
+    union TwohopUlBody_{
+        TwohopRrMsg_t   rr;
+        TwohopDataMsg_t data;
+    }body;
+}TwohopUlFrame_t;
+
+/* Bounds-checked writer over a payload buffer */
+typedef struct TwohopMsgWriter_{
+    uint8_t     *buf;
+    uint16_t    size;       /* room in buf */
+    uint16_t    len;        /* bytes written */
+    bool        overflow;   /* a field did not fit, the message is not valid */
+}TwohopMsgWriter_t;
+
+/* Bounds-checked reader over a received payload */
+typedef struct TwohopMsgReader_{
+    const uint8_t   *buf;
+    uint16_t        size;
+    uint16_t        pos;
+    bool            error;  /* a field was read past the end */
+}TwohopMsgReader_t;
+
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+static inline void twmWriterInit(TwohopMsgWriter_t *w, uint8_t *buf, uint16_t size){
+    w->buf = buf;
+    w->size = size;
+    w->len = 0;
+    w->overflow = false;
+}
+
+static inline void twmPutU8(TwohopMsgWriter_t *w, uint8_t val){
+    if(w->len + 1 > w->size){
+        w->overflow = true;
+        return;
+    }
+    w->buf[w->len++] = val;
+}
+
+/* little endian, as the nodes read it */
+static inline void twmPutU16(TwohopMsgWriter_t *w, uint16_t val){
+    if(w->len + 2 > w->size){
+        w->overflow = true;
+        return;
+    }
+    w->buf[w->len++] = (uint8_t)val;
+    w->buf[w->len++] = (uint8_t)(val >> 8);
+}
+
+static inline void twmPutAddr(TwohopMsgWriter_t *w, uint16_t addr, uint8_t class){
+    TwohopNodeAddrFormat_u addrFormat;
+
+    addrFormat.bits.address = addr;
+    addrFormat.bits.class = class;
+    twmPutU16(w, addrFormat.value);
+}
+
+static inline void twmReaderInit(TwohopMsgReader_t *r, const uint8_t *buf, uint16_t size){
+    r->buf = buf;
+    r->size = size;
+    r->pos = 0;
+    r->error = false;
+}
+
+static inline uint8_t twmGetU8(TwohopMsgReader_t *r){
+    if(r->pos + 1 > r->size){
+        r->error = true;
+        return 0;
+    }
+    return r->buf[r->pos++];
+}
+
+static inline uint16_t twmGetU16(TwohopMsgReader_t *r){
+    uint16_t val;
+
+    if(r->pos + 2 > r->size){
+        r->error = true;
+        return 0;
+    }
+    val = (uint16_t)(r->buf[r->pos] | (r->buf[r->pos + 1] << 8));
+    r->pos += 2;
+    return val;
+}
+
+static inline void twmGetAddr(TwohopMsgReader_t *r, TwohopMsgNode_t *node){
+    TwohopNodeAddrFormat_u addrFormat;
+
+    addrFormat.value = twmGetU16(r);
+    node->addr = addrFormat.bits.address;
+    node->class = addrFormat.bits.class;
+}
+
+/**
+@brief Encode a Registration Node List
+@param buf[out] Payload of the downlink
+@param size[in] Size of buf
+@param hdr[in] Common header, type Twohop_MsgType_DL_RNL
+@param rnl[in] Snapshot of the nodes added to the network
+@return message size in bytes, -1 if the snapshot is out of range or buf is too small
+*/
+int twmEncodeRnl(uint8_t *buf, uint16_t size, const TwohopMsgHdr_t *hdr, const TwohopRnlMsg_t *rnl);
+
+/**
+@brief Encode a Scheduling message
+@param buf[out] Payload of the downlink
+@param size[in] Size of buf
+@param hdr[in] Common header, type Twohop_MsgType_DL_SM
+@param sm[in] Snapshot of the run of nodes to distribute
+@return message size in bytes, -1 if the snapshot is out of range or buf is too small
+*/
+int twmEncodeSm(uint8_t *buf, uint16_t size, const TwohopMsgHdr_t *hdr, const TwohopSmMsg_t *sm);
+
+/**
+@brief Encode a Command message
+@param buf[out] Payload of the downlink
+@param size[in] Size of buf
+@param hdr[in] Common header, type Twohop_MsgType_DL_CM, one last LSI per channel
+@param cm[in] Snapshot of the last LSIs and of the relays of the uSI
+@return message size in bytes, -1 if the snapshot is out of range or buf is too small
+*/
+int twmEncodeCm(uint8_t *buf, uint16_t size, const TwohopMsgHdr_t *hdr, const TwohopCmMsg_t *cm);
+
+/**
+@brief Decode the common header of a message
+@param r[in/out] Reader at the start of the payload, left after the header
+@param hdr[out] Common header
+@return 0 if the header is valid, -1 otherwise
+*/
+int twmDecodeHdr(TwohopMsgReader_t *r, TwohopMsgHdr_t *hdr);
+
+/**
+@brief Decode a Registration Node List
+@param buf[in] Payload
+@param size[in] Payload size, the message must fill it exactly
+@param hdr[out] Common header
+@param rnl[out] Message content
+@return 0 if the message is valid, -1 otherwise
+*/
+int twmDecodeRnl(const uint8_t *buf, uint16_t size, TwohopMsgHdr_t *hdr, TwohopRnlMsg_t *rnl);
+
+/**
+@brief Decode a Scheduling message
+@param buf[in] Payload
+@param size[in] Payload size, the message must fill it exactly
+@param hdr[out] Common header
+@param sm[out] Message content
+@return 0 if the message is valid, -1 otherwise
+*/
+int twmDecodeSm(const uint8_t *buf, uint16_t size, TwohopMsgHdr_t *hdr, TwohopSmMsg_t *sm);
+
+/**
+@brief Decode a Command message
+@param buf[in] Payload
+@param size[in] Payload size, the message must fill it exactly
+@param hdr[out] Common header
+@param cm[out] Message content
+@return 0 if the message is valid, -1 otherwise
+*/
+int twmDecodeCm(const uint8_t *buf, uint16_t size, TwohopMsgHdr_t *hdr, TwohopCmMsg_t *cm);
+
+/**
+@brief Decode and validate a RR or DATA uplink, bytes after the application payload are ignored
+@param buf[in] Packet payload
+@param size[in] Packet payload size
+@param frame[out] Decoded frame, type TWM_UL_INVALID on error
+@return 0 if the uplink is valid, -1 otherwise
+*/
+int twmDecodeUplink(const uint8_t *buf, uint16_t size, TwohopUlFrame_t *frame);
+
+#endif /* TWOHOP_MSG_H */
@@ -0,0 +1,189 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   uplink_crypto.c
+ * Author: LAM-HOANG
+ *
+ * Created on October 17, 2026
+ */
+
+#include <string.h>
+
+#include "uplink_crypto.h"
+
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define UL_CRYPTO_FHDR_SIZE     7   /* DevAddr, FCtrl, FCnt */
+#define UL_CRYPTO_MAX_BLOCKS    (UL_CRYPTO_BATCH_MAX * 16)  /* FRMPayload blocks of a batch */
+
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* dst ^= src on 16 bytes, as two 64-bit words */
+static inline void ulCryptoXor16(uint8_t *dst, const uint8_t *src){
+    uint64_t d[2], v[2];
+
+    memcpy(d, dst, 16);
+    memcpy(v, src, 16);
+    d[0] ^= v[0];
+    d[1] ^= v[1];
+    memcpy(dst, d, 16);
+}
+
+/* Block r of B0 | msg as fed to the CMAC, the last one padded and masked with K1 or K2 */
+static void ulCryptoCmacBlock(const UlCryptoFrame_t *frame, const uint8_t *b0, uint32_t r, uint32_t nbBlocks,
+        uint8_t *block){
+    uint32_t msgLen = frame->size - UL_CRYPTO_MIC_SIZE;
+    uint32_t rem;
+
+    if(r == 0){
+        memcpy(block, b0, 16);
+        rem = 16;
+    } else {
+        rem = msgLen - (r - 1) * 16;
+        if(rem >= 16){
+            memcpy(block, &frame->msg[(r - 1) * 16], 16);
+            rem = 16;
+        } else {
+            memcpy(block, &frame->msg[(r - 1) * 16], rem);
+            memset(&block[rem], 0, 16 - rem);
+            block[rem] = 0x80;
+        }
+    }
+    if(r == nbBlocks - 1){
+        ulCryptoXor16(block, (rem == 16) ? frame->session->nwkSKey.k1 : frame->session->nwkSKey.k2);
+    }
+}
+
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+UlCryptoResult_e ulCryptoParse(UlCryptoFrame_t *frame, uint8_t *msg, uint16_t size){
+    LoRaMACHeader_t macHeader;
+    uint16_t msgLen;
+
+    memset(frame, 0, sizeof(*frame));
+    frame->msg = msg;
+    frame->size = size;
+    frame->result = UL_CRYPTO_PLAIN;
+    if(size < 1){
+        return frame->result;
+    }
+    macHeader.value = msg[0];
+    if((macHeader.bits.Major != LoRa_MAC_LoRaWAN_R1) || ((macHeader.bits.MType != LoRa_Frame_Unconfirm_Data_Up)
+            && (macHeader.bits.MType != LoRa_Frame_Confirm_Data_Up))){
+        return frame->result;
+    }
+
+    frame->result = UL_CRYPTO_INVALID;
+    if(size < 1 + UL_CRYPTO_FHDR_SIZE + UL_CRYPTO_MIC_SIZE){
+        return frame->result;
+    }
+    msgLen = size - UL_CRYPTO_MIC_SIZE;
+    memcpy(&frame->fHeader.DevAddr.Address, &msg[1], 4);
+    frame->fHeader.FCtrl.up.value = msg[5];
+    memcpy(&frame->fHeader.FrameCounter, &msg[6], 2);
+    frame->payloadOfs = 1 + UL_CRYPTO_FHDR_SIZE + frame->fHeader.FCtrl.up.bits.FOptsLen;
+    if(frame->payloadOfs > msgLen){
+        return frame->result;
+    }
+    if(frame->payloadOfs < msgLen){
+        frame->port = msg[frame->payloadOfs++];
+    }
+    frame->result = UL_CRYPTO_OK;
+    return frame->result;
+}
+
+void ulCryptoRun(UlCryptoFrame_t *frames, int nbFrames){
+    uint8_t b0[UL_CRYPTO_BATCH_MAX][16];
+    uint8_t x[UL_CRYPTO_BATCH_MAX][16];
+    uint32_t nbCmacBlocks[UL_CRYPTO_BATCH_MAX];
+    uint8_t lane[UL_CRYPTO_MAX_BLOCKS];
+    const Aes128Ctx_t *keys[UL_CRYPTO_MAX_BLOCKS];
+    uint8_t blocks[UL_CRYPTO_MAX_BLOCKS * 16];
+    uint32_t r, n, maxBlocks = 0;
+    uint32_t msgLen, len, off;
+    uint8_t diff;
+    int i, j;
+
+    /* CMAC of B0 | msg, block r of every frame encrypted at once */
+    for(i = 0; i < nbFrames; i++){
+        if(frames[i].result != UL_CRYPTO_OK){
+            continue;
+        }
+        if(frames[i].session == NULL){
+            frames[i].result = UL_CRYPTO_PLAIN;
+            continue;
+        }
+        msgLen = frames[i].size - UL_CRYPTO_MIC_SIZE;
+        BuildFrameBlock(b0[i], 0x49, LoRa_UP_LINK, frames[i].fHeader, (uint8_t)msgLen);
+        memset(x[i], 0, 16);
+        nbCmacBlocks[i] = (msgLen + 16 + 15) / 16;
+        if(nbCmacBlocks[i] > maxBlocks){
+            maxBlocks = nbCmacBlocks[i];
+        }
+    }
+    for(r = 0; r < maxBlocks; r++){
+        n = 0;
+        for(i = 0; i < nbFrames; i++){
+            if((frames[i].result != UL_CRYPTO_OK) || (r >= nbCmacBlocks[i])){
+                continue;
+            }
+            ulCryptoCmacBlock(&frames[i], b0[i], r, nbCmacBlocks[i], &blocks[n * 16]);
+            ulCryptoXor16(&blocks[n * 16], x[i]);
+            keys[n] = &frames[i].session->nwkSKey.aes;
+            lane[n] = (uint8_t)i;
+            n++;
+        }
+        AES128_EncryptBlocksMultiKey(keys, blocks, blocks, n);
+        for(j = 0; j < (int)n; j++){
+            memcpy(x[lane[j]], &blocks[j * 16], 16);
+        }
+    }
+
+    /* MIC check, every byte compared */
+    for(i = 0; i < nbFrames; i++){
+        if(frames[i].result != UL_CRYPTO_OK){
+            continue;
+        }
+        msgLen = frames[i].size - UL_CRYPTO_MIC_SIZE;
+        diff = 0;
+        for(j = 0; j < UL_CRYPTO_MIC_SIZE; j++){
+            diff |= x[i][j] ^ frames[i].msg[msgLen + j];
+        }
+        if(diff != 0){
+            frames[i].result = UL_CRYPTO_BAD_MIC;
+        }
+    }
+
+    /* key stream of every FRMPayload block of the batch, then XOR in place */
+    n = 0;
+    for(i = 0; i < nbFrames; i++){
+        if(frames[i].result != UL_CRYPTO_OK){
+            continue;
+        }
+        len = frames[i].size - UL_CRYPTO_MIC_SIZE - frames[i].payloadOfs;
+        for(r = 0; r * 16 < len; r++){
+            BuildFrameBlock(&blocks[n * 16], 0x01, LoRa_UP_LINK, frames[i].fHeader, (uint8_t)(r + 1));
+            keys[n] = (frames[i].port == 0) ? &frames[i].session->nwkSKey.aes : &frames[i].session->appSKey;
+            n++;
+        }
+    }
+    AES128_EncryptBlocksMultiKey(keys, blocks, blocks, n);
+    off = 0;
+    for(i = 0; i < nbFrames; i++){
+        if(frames[i].result != UL_CRYPTO_OK){
+            continue;
+        }
+        len = frames[i].size - UL_CRYPTO_MIC_SIZE - frames[i].payloadOfs;
+        for(j = 0; j + 16 <= (int)len; j += 16){
+            ulCryptoXor16(&frames[i].msg[frames[i].payloadOfs + j], &blocks[off + j]);
+        }
+        for(; j < (int)len; j++){
+            frames[i].msg[frames[i].payloadOfs + j] ^= blocks[off + j];
+        }
+        off += (len + 15) & ~15u;
+    }
+}
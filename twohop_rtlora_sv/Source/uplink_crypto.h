@@ -0,0 +1,70 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   uplink_crypto.h
+ * Author: LAM-HOANG
+ * Description:
+ *          Batch crypto stage of the uplinks of a gateway message. The MICs
+ *          of the LoRaWAN data frames are checked and their FRMPayload is
+ *          decrypted in place, the AES blocks of every frame of the batch,
+ *          each with the key of its device, are encrypted together so that
+ *          the backend interleaves them (4 lanes with AES-NI).
+ * Created on October 17, 2026
+ */
+
+#ifndef UPLINK_CRYPTO_H
+#define UPLINK_CRYPTO_H
+
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+
+#include "crypto.h"
+
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define UL_CRYPTO_BATCH_MAX     8   /* frames per batch, NB_PKT_MAX of the gateway */
+#define UL_CRYPTO_MIC_SIZE      4
+
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+typedef enum UlCryptoResult_{
+    UL_CRYPTO_PLAIN = 0,    /* not a data frame of a known device, left untouched */
+    UL_CRYPTO_OK,           /* MIC valid, FRMPayload decrypted in place */
+    UL_CRYPTO_BAD_MIC,      /* MIC invalid, frame left untouched */
+    UL_CRYPTO_INVALID       /* data frame shorter than its headers */
+}UlCryptoResult_e;
+
+typedef struct UlCryptoFrame_{
+    uint8_t             *msg;       /* MHDR | FHDR | FPort | FRMPayload | MIC */
+    uint16_t            size;       /* msg size, MIC included */
+    LoRaFrameHeader_t   fHeader;    /* filled by ulCryptoParse */
+    uint16_t            payloadOfs; /* offset of FRMPayload, size - MIC if there is no FPort */
+    uint8_t             port;
+    const LoRaSessionCtx_t *session;/* keys of the device, NULL for a frame to pass through */
+    UlCryptoResult_e    result;
+}UlCryptoFrame_t;
+
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Parse the headers of a frame, the caller then sets the session of the device of fHeader.DevAddr
+@param frame[out] Frame of the batch, session set to NULL
+@param msg[in/out] PHY payload, decrypted in place by ulCryptoRun
+@param size[in] PHY payload size
+@return UL_CRYPTO_OK for an uplink data frame, UL_CRYPTO_INVALID if it is truncated, UL_CRYPTO_PLAIN otherwise
+*/
+UlCryptoResult_e ulCryptoParse(UlCryptoFrame_t *frame, uint8_t *msg, uint16_t size);
+
+/**
+@brief Check the MICs and decrypt the payloads of a batch of frames, and set their result
+@param frames[in/out] Frames parsed by ulCryptoParse, frames without session get UL_CRYPTO_PLAIN
+@param nbFrames[in] Number of frames, up to UL_CRYPTO_BATCH_MAX
+*/
+void ulCryptoRun(UlCryptoFrame_t *frames, int nbFrames);
+
+#endif /* UPLINK_CRYPTO_H */
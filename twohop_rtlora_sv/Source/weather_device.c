@@ -17,6 +17,7 @@
 #include <netinet/in.h>     /* INET constants and stuff */
 #include <arpa/inet.h>      /* IP address conversion stuff */
 #include "weather_device.h"
+#include "async_log.h"
 
 #define MSG(args...) fprintf(stderr, args) /* message that is destined to the user */
 
@@ -74,7 +75,6 @@ typedef union {
     } raw;
 } myfloat;
 
-extern FILE * log_file;
 
 enum ws_error_e open_connection_to_app_server(void);
 
@@ -245,7 +245,7 @@ enum ws_error_e open_connection_to_app_server(void){
     sock_db_server = socket(AF_INET, SOCK_STREAM, 0);
     if (sock_db_server == -1) {
         MSG("ERROR: open socket error!\n");
-        fprintf(log_file, "ERROR: open socket error!\n");
+        LOG_MSG(LOG_LVL_ERROR, "ERROR: open socket error!\n");
         return WS_CONNECT_TO_SERVER_FAILED;
     }
     
@@ -253,7 +253,7 @@ enum ws_error_e open_connection_to_app_server(void){
     i = setsockopt(sock_db_server, SOL_SOCKET, SO_RCVTIMEO, (struct timeval *)&sock_timeout, sizeof(struct timeval));
     if (i != 0) {
         MSG("ERROR: setsockopt error\n");
-        fprintf(log_file, "ERROR: setsockopt error\n");
+        LOG_MSG(LOG_LVL_ERROR, "ERROR: setsockopt error\n");
         return WS_CONNECT_TO_SERVER_FAILED;
     }
     
@@ -264,15 +264,15 @@ enum ws_error_e open_connection_to_app_server(void){
     sock_db_address.sin_port = htons(DATABASE_PORT);
     
     MSG("Connecting to the DB server (%s)...", inet_ntoa(sock_db_address.sin_addr));
-    fprintf(log_file, "Connecting to the DB server (%s)...", inet_ntoa(sock_db_address.sin_addr));
+    LOG_MSG(LOG_LVL_INFO, "Connecting to the DB server (%s)...", inet_ntoa(sock_db_address.sin_addr));
     i = connect(sock_db_server, (struct sockaddr *) &sock_db_address, sizeof (sock_db_address));
     if (i != 0) {
         MSG("Failed!\n");
-        fprintf(log_file, "Failed!\n");
+        LOG_MSG(LOG_LVL_INFO, "Failed!\n");
         return WS_CONNECT_TO_SERVER_FAILED;
     } else {
         printf("Succeed!\n");
-        fprintf(log_file, "Succeed!\n");
+        LOG_MSG(LOG_LVL_INFO, "Succeed!\n");
         return WS_OK;
     }
     
@@ -726,7 +726,7 @@ enum ws_error_e ws_push_data_to_server(void){
     /* send datagram to server */
     send(sock_db_server, (void *)buff_up, buff_index, 0);
     MSG("DATA -> SEVER: OK\n");
-    fprintf(log_file, "DATA -> SEVER: OK\n");
+    LOG_MSG(LOG_LVL_INFO, "DATA -> SEVER: OK\n");
     
     //close_connection_to_app_server();
     
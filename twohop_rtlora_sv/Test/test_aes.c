@@ -0,0 +1,265 @@
+/*
+ * File:   test_aes.c
+ * Author: LAM-HOANG
+ * Description:
+ *          Known answers of AES-128, CTR and CMAC on every backend, cross
+ *          checks against the reference code, and cost of a block and of a
+ *          MIC with and without a cached key.
+ * Created on October 17, 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "aes.h"
+#include "aes_cmac.h"
+#include "crypto.h"
+
+#define NB_RANDOM       2000
+#define NB_BENCH_BLOCKS 200000
+#define NB_BENCH_MIC    50000
+
+extern FILE *log_file;
+
+static int fail = 0;
+
+static const uint8_t key_38a[16] = {
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+
+/* SP 800-38A F.1.1 and RFC 4493 message */
+static const uint8_t plain_38a[64] = {
+    0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+    0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+    0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+    0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10
+};
+
+static const uint8_t ecb_38a[64] = {
+    0x3a, 0xd7, 0x7b, 0xb4, 0x0d, 0x7a, 0x36, 0x60, 0xa8, 0x9e, 0xca, 0xf3, 0x24, 0x66, 0xef, 0x97,
+    0xf5, 0xd3, 0xd5, 0x85, 0x03, 0xb9, 0x69, 0x9d, 0xe7, 0x85, 0x89, 0x5a, 0x96, 0xfd, 0xba, 0xaf,
+    0x43, 0xb1, 0xcd, 0x7f, 0x59, 0x8e, 0xce, 0x23, 0x88, 0x1b, 0x00, 0xe3, 0xed, 0x03, 0x06, 0x88,
+    0x7b, 0x0c, 0x78, 0x5e, 0x27, 0xe8, 0xad, 0x3f, 0x82, 0x23, 0x20, 0x71, 0x04, 0x72, 0x5d, 0xd4
+};
+
+/* SP 800-38A F.5.1 */
+static const uint8_t ctr_init_38a[16] = {
+    0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
+};
+
+static const uint8_t ctr_38a[64] = {
+    0x87, 0x4d, 0x61, 0x91, 0xb6, 0x20, 0xe3, 0x26, 0x1b, 0xef, 0x68, 0x64, 0x99, 0x0d, 0xb6, 0xce,
+    0x98, 0x06, 0xf6, 0x6b, 0x79, 0x70, 0xfd, 0xff, 0x86, 0x17, 0x18, 0x7b, 0xb9, 0xff, 0xfd, 0xff,
+    0x5a, 0xe4, 0xdf, 0x3e, 0xdb, 0xd5, 0xd3, 0x5e, 0x5b, 0x4f, 0x09, 0x02, 0x0d, 0xb0, 0x3e, 0xab,
+    0x1e, 0x03, 0x1d, 0xda, 0x2f, 0xbe, 0x03, 0xd1, 0x79, 0x21, 0x70, 0xa0, 0xf3, 0x00, 0x9c, 0xee
+};
+
+/* RFC 4493 4. */
+static const uint32_t cmac_len[4] = { 0, 16, 40, 64 };
+static const uint8_t cmac_4493[4][16] = {
+    { 0xbb, 0x1d, 0x69, 0x29, 0xe9, 0x59, 0x37, 0x28, 0x7f, 0xa3, 0x7d, 0x12, 0x9b, 0x75, 0x67, 0x46 },
+    { 0x07, 0x0a, 0x16, 0xb4, 0x6b, 0x4d, 0x41, 0x44, 0xf7, 0x9b, 0xdd, 0x9d, 0xd0, 0x4a, 0x28, 0x7c },
+    { 0xdf, 0xa6, 0x67, 0x47, 0xde, 0x9a, 0xe6, 0x30, 0x30, 0xca, 0x32, 0x61, 0x14, 0x97, 0xc8, 0x27 },
+    { 0x51, 0xf0, 0xbe, 0xbf, 0x7e, 0x3b, 0x9d, 0x92, 0xfc, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3c, 0xfe }
+};
+
+static double now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void check(int ok, const char *what) {
+    if (!ok) {
+        printf("ERROR: %s with the %s backend\n", what, AES128_BackendName());
+        fail = 1;
+    }
+}
+
+static void random_bytes(uint8_t *buf, int size) {
+    int i;
+
+    for (i = 0; i < size; i++) {
+        buf[i] = (uint8_t)rand();
+    }
+}
+
+static void known_answers(void) {
+    /* FIPS-197 C.1 */
+    static const uint8_t key_197[16] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+    };
+    static const uint8_t plain_197[16] = {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+    };
+    static const uint8_t cipher_197[16] = {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+    };
+    Aes128Ctx_t ctx;
+    AesCmacCtx_t cmac;
+    uint8_t out[5 * 16], in[5 * 16], counter[16], mac[16];
+    int i;
+
+    AES128_InitCtx(&ctx, key_197);
+    AES128_EncryptBlocks(&ctx, plain_197, out, 1);
+    check(memcmp(out, cipher_197, 16) == 0, "FIPS-197 C.1");
+
+    /* 4 blocks then 5 blocks, for the interleaved and the tail paths */
+    AES128_InitCtx(&ctx, key_38a);
+    AES128_EncryptBlocks(&ctx, plain_38a, out, 4);
+    check(memcmp(out, ecb_38a, 64) == 0, "SP 800-38A ECB");
+    memcpy(in, plain_38a, 64);
+    memcpy(&in[64], plain_38a, 16);
+    AES128_EncryptBlocks(&ctx, in, in, 5);
+    check((memcmp(in, ecb_38a, 64) == 0) && (memcmp(&in[64], ecb_38a, 16) == 0), "SP 800-38A ECB in place");
+
+    /* whole message, then byte by byte lengths split at odd places */
+    memcpy(counter, ctr_init_38a, 16);
+    AES128_CTR_Xor(&ctx, counter, plain_38a, out, 64);
+    check(memcmp(out, ctr_38a, 64) == 0, "SP 800-38A CTR");
+    memcpy(counter, ctr_init_38a, 16);
+    AES128_CTR_Xor(&ctx, counter, plain_38a, out, 32);
+    AES128_CTR_Xor(&ctx, counter, &plain_38a[32], &out[32], 21);
+    check(memcmp(out, ctr_38a, 53) == 0, "SP 800-38A CTR split");
+
+    /* the counter carries over the whole 128 bits */
+    memset(counter, 0xff, 16);
+    AES128_CTR_Xor(&ctx, counter, plain_38a, out, 16);
+    for (i = 0; i < 16; i++) {
+        check(counter[i] == 0, "CTR counter wrap");
+    }
+
+    AES128_CMAC_InitCtx(&cmac, key_38a);
+    for (i = 0; i < 4; i++) {
+        AES128_CMAC_Ctx(&cmac, plain_38a, cmac_len[i], mac);
+        check(memcmp(mac, cmac_4493[i], 16) == 0, "RFC 4493 CMAC");
+        AES128_CMAC((uint8_t *)key_38a, (uint8_t *)plain_38a, (uint8_t)cmac_len[i], mac);
+        check(memcmp(mac, cmac_4493[i], 4) == 0, "RFC 4493 CMAC, legacy call");
+    }
+}
+
+/* Payload encryption of the LoRaWAN specification, one AESEncryptBlock per block */
+static void encrypt_payload_per_block(uint8_t *dest, uint8_t *src, uint16_t size, uint8_t dir, LoRaFrameHeader_t fHeader,
+        uint8_t *key) {
+    uint8_t a[16], s[16];
+    int i, j;
+
+    memset(a, 0, 16);
+    a[0] = 0x01;
+    a[5] = dir;
+    memcpy(&a[6], &fHeader.DevAddr.Address, 4);
+    memcpy(&a[10], &fHeader.FrameCounter, 2);
+    for (i = 0; i < size; i += 16) {
+        a[15] = (uint8_t)(i / 16 + 1);
+        AES_ECB_encrypt(a, key, s, 16);
+        for (j = i; (j < i + 16) && (j < size); j++) {
+            dest[j] = src[j] ^ s[j - i];
+        }
+    }
+}
+
+static void random_checks(void) {
+    uint8_t key[16], in[8 * 16], out[8 * 16], ref[8 * 16], mic[4], mic_ref[4];
+    uint8_t payload[255], enc[255], enc_ref[255];
+    LoRaFrameHeader_t fHeader;
+    Aes128Ctx_t ctx;
+    AesCmacCtx_t cmac;
+    int i, n, b;
+    uint16_t size;
+
+    for (i = 0; i < NB_RANDOM; i++) {
+        random_bytes(key, 16);
+        n = 1 + rand() % 8;
+        random_bytes(in, n * 16);
+
+        AES128_InitCtx(&ctx, key);
+        AES128_EncryptBlocks(&ctx, in, out, n);
+        for (b = 0; b < n; b++) {
+            AES_ECB_encrypt(&in[b * 16], key, &ref[b * 16], 16);
+        }
+        check(memcmp(out, ref, n * 16) == 0, "ECB against the reference");
+        AES_ECB_decrypt(out, key, ref, 16);
+        check(memcmp(ref, in, 16) == 0, "decryption of the encryption");
+
+        size = (uint16_t)(rand() % 240);
+        random_bytes(payload, size);
+        fHeader.DevAddr.Address = (uint32_t)rand();
+        fHeader.FrameCounter = (uint16_t)rand();
+        EncryptPayload(enc, payload, size, (uint8_t)(i & 1), fHeader, 1, key, key);
+        encrypt_payload_per_block(enc_ref, payload, size, (uint8_t)(i & 1), fHeader, key);
+        check(memcmp(enc, enc_ref, size) == 0, "EncryptPayload against the block per block algorithm");
+
+        AES128_CMAC_InitCtx(&cmac, key);
+        AES128_CMAC_Ctx(&cmac, payload, size, out);
+        AES128_CMAC(key, payload, (uint8_t)size, mic_ref);
+        memcpy(mic, out, 4);
+        check(memcmp(mic, mic_ref, 4) == 0, "CMAC with a context against the legacy call");
+    }
+}
+
+static void bench(void) {
+    static uint8_t blocks[NB_BENCH_BLOCKS / 100 * 16];
+    uint8_t key[16], msg[16 + 32], mic[16];
+    LoRaFrameHeader_t fHeader;
+    AesCmacCtx_t cmac;
+    Aes128Ctx_t ctx;
+    double start, block_ns, mic_ns, mic_ctx_ns;
+    int i;
+
+    random_bytes(key, 16);
+    random_bytes(blocks, sizeof(blocks));
+    random_bytes(msg, sizeof(msg));
+    memset(&fHeader, 0, sizeof(fHeader));
+
+    AES128_InitCtx(&ctx, key);
+    start = now_ns();
+    for (i = 0; i < 100; i++) {
+        AES128_EncryptBlocks(&ctx, blocks, blocks, NB_BENCH_BLOCKS / 100);
+    }
+    block_ns = (now_ns() - start) / NB_BENCH_BLOCKS;
+
+    /* MIC of a 32 bytes frame: key expanded at each call, as GenerateMIC, or kept in a context */
+    start = now_ns();
+    for (i = 0; i < NB_BENCH_MIC; i++) {
+        fHeader.FrameCounter = (uint16_t)i;
+        GenerateMIC(&msg[16], 32, 0, fHeader, key, mic);
+    }
+    mic_ns = (now_ns() - start) / NB_BENCH_MIC;
+
+    AES128_CMAC_InitCtx(&cmac, key);
+    start = now_ns();
+    for (i = 0; i < NB_BENCH_MIC; i++) {
+        msg[10] = (uint8_t)i;
+        AES128_CMAC_Ctx(&cmac, msg, sizeof(msg), mic);
+    }
+    mic_ctx_ns = (now_ns() - start) / NB_BENCH_MIC;
+
+    printf("%-9s: %6.1f ns per block, MIC %7.1f ns, cached key %7.1f ns\n", AES128_BackendName(), block_ns, mic_ns,
+            mic_ctx_ns);
+}
+
+int main(void) {
+    static const AesBackend_e backends[] = { AES_BACKEND_REFERENCE, AES_BACKEND_TTABLE, AES_BACKEND_AESNI };
+    unsigned int i;
+
+    log_file = stdout;
+    srand(1);
+
+    printf("default backend: %s\n", AES128_BackendName());
+    for (i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        if (AES128_SelectBackend(backends[i]) != 0) {
+            printf("backend %d not available\n", (int)backends[i]);
+            continue;
+        }
+        known_answers();
+        random_checks();
+        bench();
+    }
+    AES128_SelectBackend(AES_BACKEND_AUTO);
+
+    printf("%s\n", fail ? "FAILED" : "PASSED");
+    return fail;
+}
@@ -0,0 +1,168 @@
+/*
+ * File:   test_async_log.c
+ * Author: LAM-HOANG
+ * Description:
+ *          Records formatted by the writer thread match printf, levels are
+ *          filtered, and the rings of concurrent threads lose nothing but
+ *          the counted drops and keep each thread's order.
+ * Created on October 17, 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "async_log.h"
+
+#define NB_THREADS      4
+#define NB_RECORDS      20000
+#define NB_FORMATS      8
+#define LINE_SIZE       512
+
+static char expected[NB_FORMATS][LINE_SIZE];
+static int nbExpected;
+
+/* log a line and keep what printf makes of it */
+#define LOG_AND_EXPECT(fmt, ...)                                                        \
+            do {                                                                        \
+                snprintf(expected[nbExpected++], LINE_SIZE, fmt, ##__VA_ARGS__);        \
+                LOG_MSG(LOG_LVL_INFO, fmt, ##__VA_ARGS__);                              \
+            } while (0)
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static void *record_thread(void *arg) {
+    int id = (int)(long)arg;
+    unsigned int i;
+
+    for (i = 0; i < NB_RECORDS; i++) {
+        LOG_MSG(LOG_LVL_INFO, "T%d %u %s\n", id, i, (i & 1) ? "odd" : "even");
+        if ((i % 256) == 255) {
+            usleep(2000);
+        }
+    }
+    return NULL;
+}
+
+int main(void) {
+    char dir[] = "/tmp/test_async_log_XXXXXX";
+    char path[LINE_SIZE], line[LINE_SIZE], longStr[300];
+    pthread_t threads[NB_THREADS];
+    unsigned int lastSeq[NB_THREADS];
+    unsigned int nbLines[NB_THREADS] = { 0 };
+    unsigned long long total = 0;
+    uint64_t nbWritten, nbDropped, start, cost;
+    unsigned int seq;
+    struct dirent *entry;
+    DIR *d;
+    FILE *f;
+    int fail = 0, id, i, next = 0;
+
+    if ((mkdtemp(dir) == NULL) || (chdir(dir) != 0)) {
+        printf("ERROR: no temporary directory\n");
+        return 1;
+    }
+    if (asyncLogStart(0) != 0) {
+        printf("ERROR: log not started\n");
+        return 1;
+    }
+    asyncLogSetConsoleLevel(LOG_LVL_ERROR);
+    asyncLogSetFileLevel(LOG_LVL_INFO);
+
+    /* the writer formats the records like printf would have done */
+    memset(longStr, 'a', sizeof longStr - 1);
+    longStr[sizeof longStr - 1] = '\0';
+    LOG_AND_EXPECT("NODE %hu: Rx DATA %hu - DL(%d,%d) UL(%.2f,%.2f)\n", (unsigned short)7, (unsigned short)65535, -3, 12, -117.25, 7.5);
+    LOG_AND_EXPECT("%hhu|%5.1f|%-8s|%8s|%ld|%llu|%#x|%c|%%|%zu\n", (unsigned char)200, 3.14159, "left", "right",
+            -1234567890123L, 18446744073709551615ULL, 0xBEEFu, 'Z', sizeof(long));
+    LOG_AND_EXPECT("TIMESTAMP: %ld.%06ld (%d-%02d-%02d %2d:%02d:%02d)\n", 1700000000L, 42L, 2026, 10, 17, 9, 5, 3);
+    LOG_AND_EXPECT("%s and %s\n", "first", (const char *)NULL);
+    LOG_AND_EXPECT("%e %g %X %o\n", 1e-9, 123456789.0, 0xABCDu, 8u);
+    /* %s are cut to the room of the record */
+    LOG_MSG(LOG_LVL_INFO, "%s\n", longStr);
+    snprintf(expected[nbExpected++], LINE_SIZE, "%.*s\n", ASYNC_LOG_STR_SIZE - 1, longStr);
+    /* above the file level */
+    LOG_MSG(LOG_LVL_DEBUG, "not written\n");
+    LOG_AND_EXPECT("after debug\n");
+
+    /* cost of a record on the caller side, well under a ring */
+    start = now_ns();
+    for (i = 0; i < ASYNC_LOG_RING_SIZE / 2; i++) {
+        LOG_MSG(LOG_LVL_INFO, "cost %d %s %.2f\n", i, "x", 1.5);
+    }
+    cost = (now_ns() - start) / (ASYNC_LOG_RING_SIZE / 2);
+    usleep(ASYNC_LOG_FLUSH_INTERVAL_MS * 3000);
+
+    for (id = 0; id < NB_THREADS; id++) {
+        pthread_create(&threads[id], NULL, record_thread, (void *)(long)id);
+    }
+    for (id = 0; id < NB_THREADS; id++) {
+        pthread_join(threads[id], NULL);
+    }
+    asyncLogGetCounters(&nbWritten, &nbDropped);
+    asyncLogStop();
+
+    /* read the file back */
+    d = opendir(".");
+    f = NULL;
+    while ((d != NULL) && ((entry = readdir(d)) != NULL)) {
+        if (strncmp(entry->d_name, "twohoplora_", 11) == 0) {
+            snprintf(path, sizeof path, "%s/%s", dir, entry->d_name);
+            f = fopen(path, "r");
+            break;
+        }
+    }
+    if (d != NULL) {
+        closedir(d);
+    }
+    if (f == NULL) {
+        printf("ERROR: no log file\n");
+        return 1;
+    }
+    while (fgets(line, sizeof line, f) != NULL) {
+        if (sscanf(line, "T%d %u", &id, &seq) == 2) {
+            if ((id < 0) || (id >= NB_THREADS) || (strcmp(strchr(strchr(line, ' ') + 1, ' ') + 1, (seq & 1) ? "odd\n" : "even\n") != 0) ||
+                    ((nbLines[id] > 0) && (seq <= lastSeq[id]))) {
+                printf("ERROR: bad or unordered line %s", line);
+                fail = 1;
+            }
+            lastSeq[id] = seq;
+            nbLines[id]++;
+            total++;
+        } else if ((next < nbExpected) && (strcmp(line, expected[next]) == 0)) {
+            next++;
+        } else if ((strcmp(line, "START LOG\n") != 0) && (strncmp(line, "cost", 4) != 0)) {
+            printf("ERROR: unexpected line %s", line);
+            fail = 1;
+        }
+    }
+    fclose(f);
+    unlink(path);
+    chdir("/tmp");
+    rmdir(dir);
+
+    if (next != nbExpected) {
+        printf("ERROR: line %d formatted as \"%s\" expected\n", next, expected[next]);
+        fail = 1;
+    }
+    printf("format : %d lines formatted like printf\n", next);
+    if (total + nbDropped != (unsigned long long)NB_THREADS * NB_RECORDS) {
+        printf("ERROR: %llu lines written, %llu dropped, %d records logged\n", total, (unsigned long long)nbDropped,
+                NB_THREADS * NB_RECORDS);
+        fail = 1;
+    }
+    printf("threads: %llu records written, %llu dropped, each thread in order\n", total, (unsigned long long)nbDropped);
+    printf("cost   : %llu ns per record on the caller side\n", (unsigned long long)cost);
+
+    printf("%s\n", fail ? "FAILED" : "PASSED");
+    return fail;
+}
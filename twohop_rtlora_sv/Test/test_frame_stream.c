@@ -0,0 +1,147 @@
+/*
+ * File:   test_frame_stream.c
+ * Author: LAM-HOANG
+ * Description:
+ *          Reassembly of the gateway <-> server frames: the same byte stream
+ *          read one byte at a time, in odd chunks and all at once, with
+ *          garbage and a header of bad version or length in between (one
+ *          byte resync) and a frame of the largest length. Every frame must
+ *          come out whole, NUL terminated, and the terminator byte be put
+ *          back on the next call.
+ * Created on October 17, 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame_stream.h"
+
+#define BUF_SIZE        512                             /* reassembly buffer, as TCP_STREAM_BUFFER_SIZE but smaller */
+#define MAX_PAYLOAD     (BUF_SIZE - 1 - FRAME_HDR_SIZE) /* largest frame the buffer holds */
+#define SRC_SIZE        4096
+#define MAX_FRAMES      32
+
+/* the byte stream, and where its frames start */
+static uint8_t src[SRC_SIZE];
+static uint32_t src_len;
+static uint32_t frame_ofs[MAX_FRAMES];
+static uint32_t frame_size[MAX_FRAMES];
+static int nb_frames;
+static uint32_t nb_garbage;
+
+static void add_frame(uint8_t type, uint16_t payload_len) {
+    uint32_t i;
+
+    frame_header_write(src + src_len, type, (uint8_t)nb_frames, 0xA5, payload_len);
+    for (i = 0; i < payload_len; i++) {
+        src[src_len + FRAME_HDR_SIZE + i] = (uint8_t)(nb_frames * 7 + i);
+    }
+    frame_ofs[nb_frames] = src_len;
+    frame_size[nb_frames] = FRAME_HDR_SIZE + payload_len;
+    src_len += frame_size[nb_frames];
+    nb_frames++;
+}
+
+static void add_garbage(const uint8_t *bytes, uint32_t len) {
+    memcpy(src + src_len, bytes, len);
+    src_len += len;
+    nb_garbage += len;
+}
+
+static void build_stream(void) {
+    /* none of these bytes is PROTOCOL_VERSION */
+    static const uint8_t noise[] = {0x55, 0x00, 0xFF, 0x10, 0x20};
+    /* right version, lengths the buffer cannot hold: each one skipped byte by byte */
+    static const uint8_t bad_len[] = {PROTOCOL_VERSION, 0x00, 0x00, PKT_UPLINK_DATA,
+            (uint8_t)((MAX_PAYLOAD + 1) >> 8), (uint8_t)(MAX_PAYLOAD + 1)};
+    static const uint8_t huge_len[] = {PROTOCOL_VERSION, 0x11, 0x22, PKT_UPLINK_DATA, 0xFF, 0xFF};
+
+    add_frame(PKT_TIMESYNC_REQ, 0);
+    add_frame(PKT_UPLINK_DATA, 40);
+    add_garbage(noise, sizeof noise);
+    add_frame(PKT_HELLO, 9);
+    add_garbage(bad_len, sizeof bad_len);
+    add_frame(PKT_UPLINK_DATA, MAX_PAYLOAD);
+    add_garbage(huge_len, sizeof huge_len);
+    add_frame(PKT_UPLINK_DATA, 1);
+    add_frame(PKT_UPLINK_DATA, 300);
+    add_frame(PKT_UPLINK_DATA, MAX_PAYLOAD);
+    add_frame(PKT_TIMESYNC_REQ, 0);
+}
+
+/* feed the stream by reads of at most chunk bytes, check every frame returned */
+static int run(uint32_t chunk) {
+    uint8_t buf[BUF_SIZE];
+    struct frame_stream_s fs;
+    uint8_t *wptr, *frame, *term = NULL;
+    uint32_t room, n, fed = 0, frame_len, term_src = 0;
+    int got = 0;
+
+    frame_stream_init(&fs, buf, sizeof buf);
+    while (fed < src_len) {
+        wptr = frame_stream_wptr(&fs, &room);
+        n = src_len - fed;
+        if (n > chunk) {
+            n = chunk;
+        }
+        if (n > room) {
+            n = room;
+        }
+        if (n == 0) {
+            printf("ERROR: chunk %u, no room left in the buffer\n", chunk);
+            return 1;
+        }
+        memcpy(wptr, src + fed, n);
+        frame_stream_commit(&fs, n);
+        fed += n;
+        term = NULL; /* wptr may have moved the data */
+
+        while ((frame = frame_stream_next(&fs, &frame_len)) != NULL) {
+            /* the byte under the previous terminator is back */
+            if ((term != NULL) && (*term != src[term_src])) {
+                printf("ERROR: chunk %u, terminator byte not restored after frame %d\n", chunk, got - 1);
+                return 1;
+            }
+            if ((got >= nb_frames) || (frame_len != frame_size[got])
+                    || (memcmp(frame, src + frame_ofs[got], frame_len) != 0)) {
+                printf("ERROR: chunk %u, frame %d of %u bytes does not match\n", chunk, got, frame_len);
+                return 1;
+            }
+            if (frame[frame_len] != 0) {
+                printf("ERROR: chunk %u, frame %d not NUL terminated\n", chunk, got);
+                return 1;
+            }
+            /* only a byte already read can be checked once restored */
+            term_src = frame_ofs[got] + frame_len;
+            term = (term_src < fed) ? (frame + frame_len) : NULL;
+            got++;
+        }
+        if ((term != NULL) && (*term != src[term_src])) {
+            printf("ERROR: chunk %u, terminator byte not restored after frame %d\n", chunk, got - 1);
+            return 1;
+        }
+    }
+    if ((got != nb_frames) || (fs.nb_frames != (uint32_t)nb_frames) || (fs.nb_dropped != nb_garbage)) {
+        printf("ERROR: chunk %u, %d frames of %d, %u bytes dropped instead of %u\n", chunk, got, nb_frames,
+                fs.nb_dropped, nb_garbage);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void) {
+    static const uint32_t chunks[] = {1, 2, 5, 7, 13, 64, 509, SRC_SIZE};
+    unsigned int i;
+    int fail = 0;
+
+    build_stream();
+    for (i = 0; i < sizeof chunks / sizeof chunks[0]; i++) {
+        fail |= run(chunks[i]);
+    }
+    printf("stream : %d frames and %u garbage bytes in %u bytes, %u read sizes\n", nb_frames, nb_garbage, src_len,
+            (unsigned int)(sizeof chunks / sizeof chunks[0]));
+
+    printf("%s\n", fail ? "FAILED" : "PASSED");
+    return fail;
+}
@@ -0,0 +1,328 @@
+/*
+ * File:   test_gw_codec.c
+ * Author: LAM-HOANG
+ * Description:
+ *          Round trip of the gateway uplink and downlink encodings (JSON and
+ *          binary records) through gw_codec, and per packet CPU cost of both
+ *          paths. Downlinks are decoded the way the gateway does it, so the
+ *          figures give the server -> concentrator processing time.
+ * Created on October 17, 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "gw_codec.h"
+#include "rtlora_mac.h"
+#include "base64.h"
+
+#define NB_PKT          8       /* packets per uplink, as NB_PKT_MAX on the gateway */
+#define PKT_SIZE        24      /* typical two-hop data packet */
+#define NB_LOOP         20000
+#define BUFF_SIZE       4096
+
+static struct MsgInfo_ pkts[NB_PKT];
+
+static double elapsed_ns(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+static void make_packets(void) {
+    int i, j;
+
+    for (i = 0; i < NB_PKT; i++) {
+        memset(&pkts[i], 0, sizeof pkts[i]);
+        pkts[i].freq = 922100000 + i * 200000;
+        pkts[i].if_chain = i;
+        pkts[i].rf_chain = i & 1;
+        pkts[i].status = STAT_CRC_OK;
+        pkts[i].modulation = MOD_LORA;
+        pkts[i].bandwidth = BW_125KHZ;
+        pkts[i].datarate = DR_LORA_SF7;
+        pkts[i].coderate = CR_LORA_4_5;
+        pkts[i].count_us = 0xFFFF0000u + i * 1000;
+        pkts[i].rssi = -57.0f - i * 3.5f;
+        pkts[i].snr = 9.5f - i * 2.25f;
+        pkts[i].crc = 0x1234 + i;
+        pkts[i].size = PKT_SIZE + i;
+        for (j = 0; j < pkts[i].size; j++) {
+            pkts[i].payload[j] = (uint8_t)(i * 31 + j);
+        }
+    }
+}
+
+/* same layout as thread_up() of the gateway */
+static int encode_json(uint8_t *buff) {
+    int i, n = 0;
+
+    n += sprintf((char *)buff, "{\"rxpk\":[");
+    for (i = 0; i < NB_PKT; i++) {
+        n += sprintf((char *)buff + n, "%s{\"datr\":\"SF7BW125\",\"lsnr\":%.1f,\"rssi\":%.0f,\"size\":%u,\"data\":\"",
+                (i == 0) ? "" : ",", pkts[i].snr, pkts[i].rssi, pkts[i].size);
+        n += bin_to_b64(pkts[i].payload, pkts[i].size, (char *)buff + n, 341);
+        n += sprintf((char *)buff + n, "\"}");
+    }
+    n += sprintf((char *)buff + n, "]}");
+    return n;
+}
+
+/* same layout as serialize_bin_uplink() of the gateway */
+static int encode_bin(uint8_t *buff) {
+    int i, n = UL_BIN_HDR_SIZE;
+    uint8_t *rec;
+
+    buff[0] = UPLINK_FMT_BIN;
+    buff[1] = NB_PKT;
+    for (i = 0; i < NB_PKT; i++) {
+        rec = buff + n;
+        frame_put_u32(rec + UL_BIN_OFS_FREQ, pkts[i].freq);
+        rec[UL_BIN_OFS_IF_CHAIN] = pkts[i].if_chain;
+        rec[UL_BIN_OFS_RF_CHAIN] = pkts[i].rf_chain;
+        rec[UL_BIN_OFS_STATUS] = pkts[i].status;
+        rec[UL_BIN_OFS_MODULATION] = pkts[i].modulation;
+        rec[UL_BIN_OFS_BANDWIDTH] = pkts[i].bandwidth;
+        rec[UL_BIN_OFS_CODERATE] = pkts[i].coderate;
+        frame_put_u32(rec + UL_BIN_OFS_DATARATE, pkts[i].datarate);
+        frame_put_u32(rec + UL_BIN_OFS_COUNT_US, pkts[i].count_us);
+        frame_put_u16(rec + UL_BIN_OFS_RSSI, (uint16_t)(int16_t)lroundf(pkts[i].rssi * 10.0f));
+        frame_put_u16(rec + UL_BIN_OFS_SNR, (uint16_t)(int16_t)lroundf(pkts[i].snr * 10.0f));
+        frame_put_u16(rec + UL_BIN_OFS_CRC, pkts[i].crc);
+        frame_put_u16(rec + UL_BIN_OFS_SIZE, pkts[i].size);
+        memcpy(rec + UL_BIN_REC_SIZE, pkts[i].payload, pkts[i].size);
+        n += UL_BIN_REC_SIZE + pkts[i].size;
+    }
+    return n;
+}
+
+/* decode one uplink, return the number of packets matching the reference */
+static int decode(const uint8_t *buff, int len, bool check) {
+    GwcUplinkIter_t it;
+    struct MsgInfo_ msg;
+    int nb = 0;
+    bool full;
+
+    if (gwcUplinkOpen(&it, buff, len) != GWC_OK) {
+        return -1;
+    }
+    full = (it.format == UPLINK_FMT_BIN);
+    while (gwcUplinkNext(&it, &msg) == GWC_OK) {
+        if (check) {
+            const struct MsgInfo_ *ref = &pkts[nb];
+            /* JSON only carries the fields used by the MAC, RSSI is rounded to 1 dB */
+            if ((msg.size != ref->size) || memcmp(msg.payload, ref->payload, ref->size) \
+                    || (fabsf(msg.snr - ref->snr) > 0.051f) || (fabsf(msg.rssi - ref->rssi) > (full ? 0.051f : 0.5f))) {
+                break;
+            }
+            if (full && ((msg.freq != ref->freq) || (msg.if_chain != ref->if_chain) || (msg.rf_chain != ref->rf_chain) \
+                    || (msg.status != ref->status) || (msg.modulation != ref->modulation) \
+                    || (msg.bandwidth != ref->bandwidth) || (msg.datarate != ref->datarate) \
+                    || (msg.coderate != ref->coderate) || (msg.count_us != ref->count_us) || (msg.crc != ref->crc))) {
+                break;
+            }
+        }
+        nb++;
+    }
+    gwcUplinkClose(&it);
+    return nb;
+}
+
+static int run(const char *name, int (*encode)(uint8_t *)) {
+    static uint8_t buff[BUFF_SIZE];
+    struct timespec t0, t1, t2;
+    int i, len = 0;
+
+    len = encode(buff);
+    buff[len] = 0;
+    if (decode(buff, len, true) != NB_PKT) {
+        printf("FAIL: %s round trip\n", name);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < NB_LOOP; i++) {
+        len = encode(buff);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    buff[len] = 0;
+    for (i = 0; i < NB_LOOP; i++) {
+        decode(buff, len, false);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    printf("%-6s: %4d bytes/uplink, encode %7.1f ns/pkt, decode %7.1f ns/pkt\n", name, len,
+            elapsed_ns(&t0, &t1) / (NB_LOOP * NB_PKT), elapsed_ns(&t1, &t2) / (NB_LOOP * NB_PKT));
+    return 0;
+}
+
+static void make_downlink(struct MsgInfo_ *msg, int i) {
+    int j;
+
+    memset(msg, 0, sizeof *msg);
+    msg->tx_mode = IMMEDIATE;
+    msg->rf_power = 14;
+    msg->preamble = 8;
+    msg->freq = 923300000;
+    msg->modulation = MOD_LORA;
+    msg->bandwidth = BW_125KHZ;
+    msg->datarate = DR_LORA_SF7;
+    msg->coderate = CR_LORA_4_5;
+    msg->msg_tx_time.tv_sec = 1760000000 + i;
+    msg->msg_tx_time.tv_usec = (i * 7919) % 1000000;
+    msg->size = 40;
+    for (j = 0; j < msg->size; j++) {
+        msg->payload[j] = (uint8_t)(i + j);
+    }
+}
+
+/* same steps as the JSON path of thread_down() on the gateway */
+static int decode_dl_json(const char *json, struct MsgInfo_ *msg) {
+    JSON_Value *root_val;
+    JSON_Object *txpk_obj;
+    const char *str;
+    short x0, x1;
+
+    memset(msg, 0, sizeof *msg);
+    root_val = json_parse_string_with_comments(json);
+    txpk_obj = json_object_get_object(json_value_get_object(root_val), "txpk");
+    if (txpk_obj == NULL) {
+        json_value_free(root_val);
+        return -1;
+    }
+    msg->msg_tx_time.tv_sec = (uint32_t)json_object_get_number(txpk_obj, "tm_s");
+    msg->msg_tx_time.tv_usec = (uint32_t)json_object_get_number(txpk_obj, "tm_us");
+    msg->tx_mode = (json_object_get_boolean(txpk_obj, "imme") == 1) ? IMMEDIATE : TIMESTAMPED;
+    msg->freq = (uint32_t)((double)(1.0e6) * json_object_get_number(txpk_obj, "freq"));
+    msg->rf_chain = (uint8_t)json_object_get_number(txpk_obj, "rfch");
+    msg->rf_power = (int8_t)json_object_get_number(txpk_obj, "powe");
+    msg->modulation = (strcmp(json_object_get_string(txpk_obj, "modu"), "LORA") == 0) ? MOD_LORA : MOD_FSK;
+    if (sscanf(json_object_get_string(txpk_obj, "datr"), "SF%2hdBW%3hd", &x0, &x1) != 2) {
+        json_value_free(root_val);
+        return -1;
+    }
+    msg->datarate = DR_LORA_SF7 << (x0 - 7);
+    msg->bandwidth = (x1 == 125) ? BW_125KHZ : ((x1 == 250) ? BW_250KHZ : BW_500KHZ);
+    str = json_object_get_string(txpk_obj, "codr");
+    if      (strcmp(str, "4/5") == 0) msg->coderate = CR_LORA_4_5;
+    else if (strcmp(str, "4/6") == 0) msg->coderate = CR_LORA_4_6;
+    else if (strcmp(str, "4/7") == 0) msg->coderate = CR_LORA_4_7;
+    else if (strcmp(str, "4/8") == 0) msg->coderate = CR_LORA_4_8;
+    msg->invert_pol = json_object_get_boolean(txpk_obj, "ipol") == 1;
+    msg->preamble = (uint16_t)json_object_get_number(txpk_obj, "prea");
+    msg->size = (uint16_t)json_object_get_number(txpk_obj, "size");
+    str = json_object_get_string(txpk_obj, "data");
+    b64_to_bin(str, strlen(str), msg->payload, sizeof msg->payload);
+    json_value_free(root_val);
+    return 0;
+}
+
+/* same steps as parse_bin_downlink() on the gateway */
+static int decode_dl_bin(const uint8_t *data, int len, struct MsgInfo_ *msg) {
+    const uint8_t *rec = data + DL_BIN_HDR_SIZE;
+
+    memset(msg, 0, sizeof *msg);
+    msg->size = frame_get_u16(rec + DL_BIN_OFS_SIZE);
+    if ((data[0] != DOWNLINK_FMT_BIN) || (len < (DL_BIN_HDR_SIZE + DL_BIN_REC_SIZE + msg->size))) {
+        return -1;
+    }
+    msg->msg_tx_time.tv_sec = frame_get_u32(rec + DL_BIN_OFS_TM_S);
+    msg->msg_tx_time.tv_usec = frame_get_u32(rec + DL_BIN_OFS_TM_US);
+    msg->freq = frame_get_u32(rec + DL_BIN_OFS_FREQ);
+    msg->tx_mode = rec[DL_BIN_OFS_TX_MODE];
+    msg->rf_chain = rec[DL_BIN_OFS_RF_CHAIN];
+    msg->rf_power = (int8_t)rec[DL_BIN_OFS_RF_POWER];
+    msg->modulation = rec[DL_BIN_OFS_MODULATION];
+    msg->bandwidth = rec[DL_BIN_OFS_BANDWIDTH];
+    msg->coderate = rec[DL_BIN_OFS_CODERATE];
+    msg->datarate = frame_get_u32(rec + DL_BIN_OFS_DATARATE);
+    msg->invert_pol = rec[DL_BIN_OFS_INVERT_POL] != 0;
+    msg->preamble = frame_get_u16(rec + DL_BIN_OFS_PREAMBLE);
+    memcpy(msg->payload, rec + DL_BIN_REC_SIZE, msg->size);
+    return 0;
+}
+
+static bool same_downlink(const struct MsgInfo_ *a, const struct MsgInfo_ *b) {
+    return (a->msg_tx_time.tv_sec == b->msg_tx_time.tv_sec) && (a->msg_tx_time.tv_usec == b->msg_tx_time.tv_usec)
+            && (a->tx_mode == b->tx_mode) && (a->freq == b->freq) && (a->rf_chain == b->rf_chain)
+            && (a->rf_power == b->rf_power) && (a->modulation == b->modulation) && (a->bandwidth == b->bandwidth)
+            && (a->datarate == b->datarate) && (a->coderate == b->coderate) && (a->invert_pol == b->invert_pol)
+            && (a->preamble == b->preamble) && (a->size == b->size) && !memcmp(a->payload, b->payload, a->size);
+}
+
+static int run_downlink(const char *name, bool bin) {
+    static uint8_t buff[BUFF_SIZE];
+    static GwcDlEncoder_t enc;
+    struct MsgInfo_ ref, msg;
+    struct timespec t0, t1, t2;
+    int i, len = 0;
+
+    gwcDownlinkInit(&enc);
+    for (i = 0; i < 4; i++) {
+        make_downlink(&ref, i);
+        len = bin ? gwcDownlinkEncodeBin(&enc, &ref, buff, sizeof buff) : gwcDownlinkEncodeJson(&enc, &ref, buff, sizeof buff);
+        if (len < 0) {
+            printf("FAIL: %s downlink encoding\n", name);
+            return 1;
+        }
+        buff[len] = 0;
+        if ((bin ? decode_dl_bin(buff, len, &msg) : decode_dl_json((const char *)buff, &msg)) != 0 || !same_downlink(&ref, &msg)) {
+            printf("FAIL: %s downlink round trip\n", name);
+            return 1;
+        }
+    }
+    if ((enc.nbMiss != 1) || (enc.nbHit != 3)) {
+        printf("FAIL: %s downlink template cache hit %u miss %u\n", name, enc.nbHit, enc.nbMiss);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < NB_LOOP; i++) {
+        ref.msg_tx_time.tv_usec = i;
+        len = bin ? gwcDownlinkEncodeBin(&enc, &ref, buff, sizeof buff) : gwcDownlinkEncodeJson(&enc, &ref, buff, sizeof buff);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    buff[len] = 0;
+    for (i = 0; i < NB_LOOP; i++) {
+        bin ? decode_dl_bin(buff, len, &msg) : decode_dl_json((const char *)buff, &msg);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    printf("%-6s: %4d bytes/downlink, encode %7.1f ns, gateway decode %7.1f ns\n", name, len,
+            elapsed_ns(&t0, &t1) / NB_LOOP, elapsed_ns(&t1, &t2) / NB_LOOP);
+    return 0;
+}
+
+/* a record announcing more bytes than the payload holds must be rejected */
+static int run_truncated(void) {
+    static uint8_t buff[BUFF_SIZE];
+    GwcUplinkIter_t it;
+    struct MsgInfo_ msg;
+    int len, nb = 0;
+
+    len = encode_bin(buff);
+    gwcUplinkOpen(&it, buff, len - 1);
+    while (gwcUplinkNext(&it, &msg) == GWC_OK) {
+        nb++;
+    }
+    gwcUplinkClose(&it);
+    if (nb != (NB_PKT - 1)) {
+        printf("FAIL: truncated binary uplink decoded %d packets\n", nb);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void) {
+    int err = 0;
+
+    make_packets();
+    err |= run("json", encode_json);
+    err |= run("binary", encode_bin);
+    err |= run_truncated();
+    err |= run_downlink("json", false);
+    err |= run_downlink("binary", true);
+    printf("%s\n", err ? "FAILED" : "PASSED");
+    return err;
+}
@@ -0,0 +1,90 @@
+/*
+ * File:   test_latency_hist.c
+ * Author: LAM-HOANG
+ * Description:
+ *          Bucket precision, percentiles and concurrent recording of the
+ *          latency histograms, and cost of one record.
+ * Created on October 17, 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "latency_hist.h"
+
+#define NB_THREADS      4
+#define NB_RECORDS      1000000
+
+extern FILE *log_file;
+
+static LatHist_t shared = LAT_HIST_INITIALIZER("shared", 0);
+
+static void *record_thread(void *arg) {
+    int i;
+
+    (void)arg;
+    for (i = 0; i < NB_RECORDS; i++) {
+        latHistRecord(&shared, (uint64_t)(i % 5000));
+    }
+    return NULL;
+}
+
+int main(void) {
+    LatHist_t hist = LAT_HIST_INITIALIZER("uniform", 5000);
+    pthread_t threads[NB_THREADS];
+    uint64_t v, p, start;
+    double err_max = 0.0, err;
+    int fail = 0;
+    int i;
+
+    log_file = stdout;
+
+    /* every value falls in a bucket whose upper bound is at most 1/16 above it */
+    for (v = 1; v < ((uint64_t)1 << 32); v += 1 + v / 7) {
+        LatHist_t one = LAT_HIST_INITIALIZER("one", 0);
+
+        latHistRecord(&one, v);
+        p = latHistPercentile(&one, 50.0);
+        err = (double)(p - v) / v;
+        if ((p < v) || (err > 1.0 / 16)) {
+            printf("ERROR: %llu reported as %llu\n", (unsigned long long)v, (unsigned long long)p);
+            fail = 1;
+            break;
+        }
+        if (err > err_max) {
+            err_max = err;
+        }
+    }
+    printf("bucket : worst relative error %.2f%%\n", err_max * 100);
+
+    /* 1 to 10000 us, uniform */
+    for (v = 1; v <= 10000; v++) {
+        latHistRecord(&hist, v);
+    }
+    p = latHistPercentile(&hist, 50.0);
+    if ((p < 5000) || (p > 5000 + 5000 / 16) || (hist.nbOverBudget != 5000) || (hist.maxUs != 10000)) {
+        printf("ERROR: p50 %llu, %llu over budget, max %llu\n", (unsigned long long)p,
+                (unsigned long long)hist.nbOverBudget, (unsigned long long)hist.maxUs);
+        fail = 1;
+    }
+    latHistPrint(&hist, stdout);
+
+    /* no record lost between threads */
+    start = latHistNowNs();
+    for (i = 0; i < NB_THREADS; i++) {
+        pthread_create(&threads[i], NULL, record_thread, NULL);
+    }
+    for (i = 0; i < NB_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if ((shared.total != (uint64_t)NB_THREADS * NB_RECORDS) || (shared.maxUs != 4999)) {
+        printf("ERROR: %llu records, max %llu\n", (unsigned long long)shared.total, (unsigned long long)shared.maxUs);
+        fail = 1;
+    }
+    printf("threads: %d x %d records, %.1f ns per record\n", NB_THREADS, NB_RECORDS,
+            (double)(latHistNowNs() - start) / ((double)NB_THREADS * NB_RECORDS));
+
+    printf("%s\n", fail ? "FAILED" : "PASSED");
+    return fail;
+}
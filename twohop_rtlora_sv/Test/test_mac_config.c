@@ -0,0 +1,100 @@
+/*
+ * File:   test_mac_config.c
+ * Author: LAM-HOANG
+ * Description:
+ *          MAC configuration file: partial files override only their own
+ *          parameters, milliseconds converted, comments accepted, and any
+ *          unknown name, wrong type or out of range value rejected with the
+ *          configuration left untouched.
+ * Created on October 17, 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mac_config.h"
+
+static const MacConfig_t defaults = {
+    .frameFactor = 6, .ulSlotSizeMs = 100, .dlSlotSizeMs = 200, .nboChannels = 1, .schIncremental = 1,
+    .maxNboChildren = TWOHOP_MAX_NBO_CHILDREN, .rnlIntervalUs = TWOHOP_RNL_INTERVAL_US,
+    .sch1SlotSizeUs = TWOHOP_SCH1_SLOT_SIZE_US, .sch2SlotSizeUs = TWOHOP_SCH2_SLOT_SIZE_US,
+    .dlFreqHz = TWOHOP_DOWNLINK_CHANNEL, .dlPowerDbm = TWOHOP_DL_POWER,
+};
+
+/* texts that must be rejected, the configuration unchanged */
+static const char *invalid[] = {
+    "not json",
+    "{\"other_conf\": {\"frame_factor\": 5}}",
+    "{\"mac_conf\": {\"frame_factr\": 5}}",
+    "{\"mac_conf\": {\"frame_factor\": \"5\"}}",
+    "{\"mac_conf\": {\"frame_factor\": 5.5}}",
+    "{\"mac_conf\": {\"frame_factor\": -1}}",
+    "{\"mac_conf\": {\"frame_factor\": 8}}",
+    "{\"mac_conf\": {\"frame_factor\": 4, \"ul_slot_size_ms\": 105}}",
+    "{\"mac_conf\": {\"dl_slot_size_ms\": 320}}",
+    "{\"mac_conf\": {\"nbo_channels\": 0}}",
+    "{\"mac_conf\": {\"nbo_channels\": 8}}",
+    "{\"mac_conf\": {\"max_children\": 3}}",
+    "{\"mac_conf\": {\"sch_incremental\": 2}}",
+    "{\"mac_conf\": {\"rnl_interval_ms\": 50}}",
+    "{\"mac_conf\": {\"rnl_interval_ms\": 1e12}}",
+    "{\"mac_conf\": {\"sch1_slot_size_ms\": 2000}}",
+    "{\"mac_conf\": {\"dl_freq_hz\": 5000000000}}",
+    "{\"mac_conf\": {\"dl_power\": 31}}",
+};
+
+int main(void) {
+    MacConfig_t conf;
+    FILE *f;
+    const char *path = "/tmp/test_mac_conf.json";
+    int i, fail = 0;
+
+    /* partial text, the other parameters kept */
+    conf = defaults;
+    if (macConfParseString("/* tuned for 40 nodes */\n{\"mac_conf\": {\"frame_factor\": 4, \"nbo_channels\": 3,"
+            " \"rnl_interval_ms\": 2500, \"dl_freq_hz\": 919100000, \"max_children\": 0}}", &conf) != 0) {
+        printf("ERROR: valid configuration rejected\n");
+        fail = 1;
+    }
+    if (conf.frameFactor != 4 || conf.nboChannels != 3 || conf.rnlIntervalUs != 2500000 || conf.dlFreqHz != 919100000
+            || conf.maxNboChildren != 0 || conf.ulSlotSizeMs != defaults.ulSlotSizeMs
+            || conf.sch1SlotSizeUs != defaults.sch1SlotSizeUs || conf.dlPowerDbm != defaults.dlPowerDbm) {
+        printf("ERROR: parameters not overridden as expected\n");
+        fail = 1;
+    }
+
+    /* empty object, nothing changes */
+    conf = defaults;
+    if (macConfParseString("{\"mac_conf\": {}}", &conf) != 0 || memcmp(&conf, &defaults, sizeof conf) != 0) {
+        printf("ERROR: empty configuration changed the parameters\n");
+        fail = 1;
+    }
+
+    for (i = 0; i < (int)(sizeof invalid / sizeof invalid[0]); i++) {
+        conf = defaults;
+        if (macConfParseString(invalid[i], &conf) == 0 || memcmp(&conf, &defaults, sizeof conf) != 0) {
+            printf("ERROR: accepted or partly applied: %s\n", invalid[i]);
+            fail = 1;
+        }
+    }
+
+    /* file, and a missing one */
+    f = fopen(path, "w");
+    fprintf(f, "{\n  \"mac_conf\": {\n    \"ul_slot_size_ms\": 150, // comment\n    \"sch2_slot_size_ms\": 50\n  }\n}\n");
+    fclose(f);
+    conf = defaults;
+    if (macConfParseFile(path, &conf) != 0 || conf.ulSlotSizeMs != 150 || conf.sch2SlotSizeUs != 50000) {
+        printf("ERROR: configuration file not applied\n");
+        fail = 1;
+    }
+    remove(path);
+    if (macConfParseFile(path, &conf) == 0) {
+        printf("ERROR: missing file accepted\n");
+        fail = 1;
+    }
+    macConfPrint(&conf, stdout);
+
+    printf("%s\n", fail ? "FAILED" : "PASSED");
+    return fail;
+}
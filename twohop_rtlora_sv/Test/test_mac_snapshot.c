@@ -0,0 +1,234 @@
+/*
+ * File:   test_mac_snapshot.c
+ * Author: LAM-HOANG
+ * Description:
+ *          MAC snapshot: copy of a node list and of schedule groups, no torn
+ *          or out of order snapshot seen by readers copying it while a writer
+ *          publishes at full speed, and cost of a read and of a publication.
+ * Created on October 17, 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "mac_snapshot.h"
+
+#define NB_PUBLISH      20000
+#define NB_READERS      2
+
+extern FILE *log_file;
+
+static MacSnapshotStore_t store;
+static volatile int writerDone;
+
+typedef struct Reader_{
+    pthread_t th;
+    MacSnapshot_t snap;
+    unsigned long nbReads;
+    unsigned long nbRetries;
+    double readNs;
+    int fail;
+}Reader_t;
+
+static double now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/* every row of a generation carries the generation, any mix of two is a torn copy */
+static void fill_generation(MacSnapshot_t *snap, uint32_t gen) {
+    int i;
+
+    snap->phase = "DATA COLL";
+    snap->period = (uint16_t)gen;
+    snap->nboNodes = (uint16_t)(1 + gen % MAC_SNAP_MAX_NODES);
+    for (i = 0; i < MAC_SNAP_MAX_NODES; i++) {
+        snap->nodes[i].addr = (uint16_t)gen;
+        snap->nodes[i].dataCount = (uint16_t)(gen >> 16);
+        snap->nodes[i].latestSeqNo = (uint16_t)i;
+    }
+    snap->nboSchNodes = (uint16_t)(gen % MAC_SNAP_MAX_SCH_NODES);
+    for (i = 0; i < MAC_SNAP_MAX_SCH_NODES; i++) {
+        snap->schNodes[i].addr = (uint16_t)gen;
+    }
+    snap->nboGateways = 1;
+    snap->gateways[0].rxFrames = gen;
+}
+
+static int check_generation(const MacSnapshot_t *snap) {
+    uint32_t gen = snap->generation;
+    int i;
+
+    if (snap->period != (uint16_t)gen || snap->nboNodes != (uint16_t)(1 + gen % MAC_SNAP_MAX_NODES)
+            || snap->gateways[0].rxFrames != gen) {
+        return 1;
+    }
+    for (i = 0; i < MAC_SNAP_MAX_NODES; i++) {
+        if (snap->nodes[i].addr != (uint16_t)gen || snap->nodes[i].dataCount != (uint16_t)(gen >> 16)
+                || snap->nodes[i].latestSeqNo != (uint16_t)i) {
+            return 1;
+        }
+    }
+    for (i = 0; i < MAC_SNAP_MAX_SCH_NODES; i++) {
+        if (snap->schNodes[i].addr != (uint16_t)gen) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *reader_thread(void *arg) {
+    Reader_t *reader = arg;
+    uint32_t last = 0;
+    double start;
+
+    start = now_ns();
+    while (!writerDone && !reader->fail) {
+        reader->nbRetries += macSnapshotRead(&store, &reader->snap);
+        reader->nbReads++;
+        if (reader->snap.generation == 0) {
+            continue;
+        }
+        if (reader->snap.generation < last) {
+            printf("ERROR: generation %u read after %u\n", reader->snap.generation, last);
+            reader->fail = 1;
+        }
+        last = reader->snap.generation;
+        if (check_generation(&reader->snap)) {
+            printf("ERROR: torn copy of generation %u\n", last);
+            reader->fail = 1;
+        }
+    }
+    reader->readNs = (now_ns() - start) / (reader->nbReads ? reader->nbReads : 1);
+    return NULL;
+}
+
+/* Fill from a node list and schedule groups, field by field */
+static int test_fill(void) {
+    static MacSnapshot_t snap;
+    MngtNodeList_t lst;
+    SchList_t sch[2];
+    SchNode_t schNode;
+    NodeGenInfo_t info;
+    MngtNode_t *node;
+    FILE *out;
+    int i, fail = 0;
+
+    initNodeList(&lst, true);
+    for (i = 0; i < 40; i++) {
+        memset(&info, 0, sizeof info);
+        info.addr = (uint16_t)(100 + i);
+        info.class = (uint8_t)(i % 4);
+        info.slotDmn = (uint8_t)(1 << info.class);
+        info.type = (i % 3 == 0) ? Node_Type_Twohop : Node_Type_Onehop;
+        node = createNewNode(info, (i % 3 == 0) ? 100 : 0);
+        node->dataCount = (uint16_t)i;
+        node->latestSeqNo = (uint16_t)(2 * i);
+        pushNode(&lst, node);
+    }
+    for (i = 0; i < 2; i++) {
+        smInitSchedule(&sch[i], 64);
+    }
+    memset(&schNode, 0, sizeof schNode);
+    for (i = 0; i < 10; i++) {
+        schNode.addr = (unsigned short)(200 + i);
+        schNode.slotDemand = (unsigned short)(1 + i % 4);
+        schNode.nboSchDist = 1;
+        smScheduleOneNode(&sch[i % 2], schNode);
+    }
+
+    macSnapshotFillNodes(&snap, &lst);
+    macSnapshotFillSchedules(&snap, sch, 2);
+    snap.nboGateways = 0;
+    snap.phase = "INIT";
+
+    if (snap.nboNodes != lst.size) {
+        printf("ERROR: %u nodes copied from a list of %u\n", snap.nboNodes, lst.size);
+        fail = 1;
+    }
+    for (i = 0, node = lst.head; node != NULL && !fail; i++, node = node->next) {
+        if (snap.nodes[i].addr != node->genInfo.addr || snap.nodes[i].type != node->genInfo.type
+                || snap.nodes[i].parentAddr != node->parrentAddr || snap.nodes[i].slotDmn != node->genInfo.slotDmn
+                || snap.nodes[i].dataCount != node->dataCount || snap.nodes[i].latestSeqNo != node->latestSeqNo) {
+            printf("ERROR: node %d differs from the list\n", i);
+            fail = 1;
+        }
+    }
+    if (snap.nboSchGroups != 2 || snap.nboSchNodes != 10 || snap.schGroups[0].nboNode != sch[0].nboNode
+            || snap.schGroups[1].first != snap.schGroups[0].nboNode
+            || snap.schGroups[1].nboAsgSlots != sch[1].nboAsgSlots) {
+        printf("ERROR: schedule groups differ from the lists\n");
+        fail = 1;
+    }
+    for (i = 1; i < snap.schGroups[0].nboNode; i++) {
+        if (snap.schNodes[i].startLSI <= snap.schNodes[i - 1].startLSI) {
+            printf("ERROR: schedule copy not in the order of ascending LSI\n");
+            fail = 1;
+        }
+    }
+
+    out = fopen("/dev/null", "w");
+    macSnapshotPrint(&snap, out);
+    fclose(out);
+    deinitNodeList(&lst);
+    for (i = 0; i < 2; i++) {
+        smClearSchedule(&sch[i]);
+    }
+    return fail;
+}
+
+int main(void) {
+    static Reader_t readers[NB_READERS];
+    MacSnapshot_t *snap;
+    double start, publishNs;
+    uint32_t gen;
+    int i, fail;
+
+    log_file = fopen("/dev/null", "w");
+    fail = test_fill();
+
+    /* nothing published yet */
+    macSnapshotRead(&store, &readers[0].snap);
+    if (readers[0].snap.generation != 0 || readers[0].snap.nboNodes != 0) {
+        printf("ERROR: empty store read as generation %u\n", readers[0].snap.generation);
+        fail = 1;
+    }
+
+    for (i = 0; i < NB_READERS; i++) {
+        pthread_create(&readers[i].th, NULL, reader_thread, &readers[i]);
+    }
+    start = now_ns();
+    for (gen = 1; gen <= NB_PUBLISH; gen++) {
+        snap = macSnapshotBegin(&store);
+        if (snap->generation != gen) {
+            printf("ERROR: generation %u begun as %u\n", gen, snap->generation);
+            fail = 1;
+        }
+        fill_generation(snap, gen);
+        macSnapshotPublish(&store);
+    }
+    publishNs = (now_ns() - start) / NB_PUBLISH;
+    writerDone = 1;
+    for (i = 0; i < NB_READERS; i++) {
+        pthread_join(readers[i].th, NULL);
+        fail |= readers[i].fail;
+        printf("reader %d: %lu reads, %lu retries, %.0f ns per read\n", i, readers[i].nbReads, readers[i].nbRetries,
+                readers[i].readNs);
+    }
+    printf("writer: %d publications of %u bytes, %.0f ns each (fill included)\n", NB_PUBLISH,
+            (unsigned int)sizeof(MacSnapshot_t), publishNs);
+
+    macSnapshotRead(&store, &readers[0].snap);
+    if (readers[0].snap.generation != NB_PUBLISH || check_generation(&readers[0].snap)) {
+        printf("ERROR: last read is generation %u\n", readers[0].snap.generation);
+        fail = 1;
+    }
+
+    printf("%s\n", fail ? "FAILED" : "PASSED");
+    return fail;
+}
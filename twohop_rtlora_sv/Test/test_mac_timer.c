@@ -0,0 +1,72 @@
+/*
+ * File:   test_mac_timer.c
+ * Author: LAM-HOANG
+ * Description:
+ *          Phase lock of the MAC timers: periods keep the same boundaries
+ *          whatever the work done in them, overruns skip whole periods and
+ *          a timer started by the next phase continues the timeline.
+ * Created on October 17, 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "mac_timer.h"
+
+#define PERIOD_US       10000
+#define NB_PERIODS      50
+
+extern FILE *log_file;
+
+static int64_t ns(const struct timespec *ts) {
+    return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+int main(void) {
+    MacTimer_t frame, next;
+    int64_t origin, expected;
+    unsigned int skipped;
+    int err = 0;
+    int i;
+
+    log_file = stdout;
+
+    /* work of random length in each period, the boundaries do not move */
+    macTimerStart(&frame, "Frame", PERIOD_US);
+    origin = ns(&frame.start);
+    for (i = 1; i <= NB_PERIODS; i++) {
+        usleep(rand() % (PERIOD_US / 2));
+        macTimerWait(&frame);
+        expected = origin + (int64_t)i * PERIOD_US * 1000;
+        if (ns(&frame.start) != expected) {
+            printf("ERROR: period %d starts %lld ns away from its boundary\n", i, (long long)(ns(&frame.start) - expected));
+            err = 1;
+        }
+    }
+    printf("lock   : %d periods on their boundaries, %llu overruns\n", NB_PERIODS, (unsigned long long)frame.nbOverruns);
+
+    /* 2.5 periods of work end 1.5 period late, the period over is skipped and the boundaries kept */
+    usleep(PERIOD_US * 5 / 2);
+    skipped = macTimerWait(&frame);
+    expected = origin + (int64_t)(NB_PERIODS + 1 + skipped) * PERIOD_US * 1000;
+    if ((skipped < 1) || (frame.nbOverruns == 0) || (ns(&frame.start) != expected)) {
+        printf("ERROR: overrun of 1.5 period skipped %u periods\n", skipped);
+        err = 1;
+    }
+    printf("overrun: %u periods skipped, boundary kept\n", skipped);
+
+    /* the next phase starts on the last deadline */
+    macTimerStart(&next, "Next", PERIOD_US * 3);
+    if (ns(&next.start) != ns(&frame.start)) {
+        printf("ERROR: next phase starts %lld ns after the last deadline\n", (long long)(ns(&next.start) - ns(&frame.start)));
+        err = 1;
+    }
+    macTimerWait(&next);
+    printf("phase  : next timer continues the timeline\n");
+
+    macTimerPrint(&frame);
+    macTimerPrint(&next);
+    printf("%s\n", err ? "FAILED" : "PASSED");
+    return err;
+}
@@ -0,0 +1,179 @@
+/*
+ * File:   test_mem_pool.c
+ * Author: LAM-HOANG
+ * Description:
+ *          Allocation, reuse and overflow of the object pools, the
+ *          counters printed by the 'm' console command, and every channel
+ *          carrying a full schedule of relays with all their children and a
+ *          full RNL without falling back to malloc.
+ * Created on October 17, 2026
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mem_pool.h"
+#include "device_mngt.h"
+#include "schedule_mngt.h"
+
+#define POOL_SIZE       8
+
+extern FILE *log_file;
+
+typedef struct {
+    void *link;
+    uint32_t value;
+} Obj_t;
+
+static Obj_t storage[POOL_SIZE];
+static MemPool_t pool = MEM_POOL_INITIALIZER("test", storage, POOL_SIZE);
+
+static bool in_storage(void *obj) {
+    return ((Obj_t *)obj >= storage) && ((Obj_t *)obj < storage + POOL_SIZE);
+}
+
+static int run_pool(void) {
+    Obj_t *objs[POOL_SIZE + 2];
+    Obj_t *again;
+    int i;
+
+    for (i = 0; i < POOL_SIZE + 2; i++) {
+        objs[i] = memPoolAlloc(&pool);
+        if (objs[i] == NULL) {
+            printf("ERROR: allocation %d failed\n", i);
+            return 1;
+        }
+        objs[i]->value = i;
+    }
+    for (i = 0; i < POOL_SIZE; i++) {
+        if (!in_storage(objs[i])) {
+            printf("ERROR: object %d is not taken from the storage\n", i);
+            return 1;
+        }
+    }
+    if (in_storage(objs[POOL_SIZE]) || (pool.nbOverflow != 2) || (pool.highWater != POOL_SIZE + 2)) {
+        printf("ERROR: overflow of an empty pool is not counted\n");
+        return 1;
+    }
+
+    /* released objects are reused first, overflow objects go back to the heap */
+    memPoolFree(&pool, objs[POOL_SIZE + 1]);
+    memPoolFree(&pool, objs[POOL_SIZE]);
+    memPoolFree(&pool, objs[3]);
+    again = memPoolAlloc(&pool);
+    if ((again != objs[3]) || (pool.nbUsed != POOL_SIZE)) {
+        printf("ERROR: released object is not reused\n");
+        return 1;
+    }
+    for (i = 0; i < POOL_SIZE; i++) {
+        memPoolFree(&pool, objs[i]);
+    }
+    memPoolFree(&pool, NULL);
+    if ((pool.nbUsed != 0) || (pool.highWater != POOL_SIZE + 2)) {
+        printf("ERROR: counters are wrong after release, %u used\n", pool.nbUsed);
+        return 1;
+    }
+    printf("pool   : %u objects, %u overflow, high-water %u\n", pool.capacity, pool.nbOverflow, pool.highWater);
+    return 0;
+}
+
+/* nodes of the MAC lists */
+static int run_node_lists(void) {
+    MngtNodeList_t lst;
+    NodeGenInfo_t info;
+    MngtNode_t *node;
+    int i;
+
+    initNodeList(&lst, true);
+    memset(&info, 0, sizeof info);
+    for (i = 0; i < 3; i++) {
+        /* the node created twice is given back by pushNode */
+        info.addr = 10 + (i % 2);
+        info.class = 1;
+        node = createNewNode(info, 0);
+        pushNode(&lst, node);
+    }
+    if ((lst.size != 2) || (mngtNodePool.nbUsed != 2)) {
+        printf("ERROR: %u nodes in the list, %u taken from the pool\n", lst.size, mngtNodePool.nbUsed);
+        return 1;
+    }
+    deinitNodeList(&lst);
+    if ((mngtNodePool.nbUsed != 0) || (mngtNodePool.nbOverflow != 0)) {
+        printf("ERROR: node pool not empty after deinit\n");
+        return 1;
+    }
+    memPoolPrint(&mngtNodePool);
+    return 0;
+}
+
+/* largest MAC state: a full group of one LSI relays on every channel, their children and a full RNL */
+static int run_full_channels(void) {
+    static SchList_t schedules[TWOHOP_MAX_NBO_CHANNELS];
+    MngtNodeList_t nodes, rnl;
+    NodeGenInfo_t info;
+    SchNode_t schNode;
+    unsigned short addr = 1, relay;
+    int ch, i, j;
+
+    initNodeList(&nodes, true);
+    initNodeList(&rnl, false);
+    memset(&info, 0, sizeof info);
+    memset(&schNode, 0, sizeof schNode);
+    info.class = 1;
+    info.slotDmn = 1;
+    schNode.slotDemand = 1;
+    for (ch = 0; ch < TWOHOP_MAX_NBO_CHANNELS; ch++) {
+        smInitSchedule(&schedules[ch], TWOHOP_MAX_NBO_LSI);
+        for (i = 0; i < TWOHOP_MAX_NBO_LSI; i++) {
+            relay = addr++;
+            schNode.addr = relay;
+            if (smScheduleOneNode(&schedules[ch], schNode) != SCH_SUCCEEDED) {
+                printf("ERROR: node %u not scheduled on channel %d\n", relay, ch);
+                return 1;
+            }
+            info.addr = relay;
+            info.type = Node_Type_Onehop;
+            pushNode(&nodes, createNewNode(info, 0));
+            for (j = 0; j < TWOHOP_MAX_NBO_CHILDREN; j++) {
+                info.addr = addr++;
+                info.type = Node_Type_Twohop;
+                pushNode(&nodes, createNewNode(info, relay));
+            }
+        }
+    }
+    for (i = 0; i < TWOHOP_MAX_NBO_NODES_IN_RNL; i++) {
+        info.addr = addr++;
+        info.type = Node_Type_Onehop;
+        pushNode(&rnl, createNewNode(info, 0));
+    }
+    memPoolPrint(&schNodePool);
+    memPoolPrint(&mngtNodePool);
+    if ((schNodePool.nbOverflow != 0) || (mngtNodePool.nbOverflow != 0)) {
+        printf("ERROR: %u schedule nodes and %u nodes taken from the heap\n", schNodePool.nbOverflow,
+                mngtNodePool.nbOverflow);
+        return 1;
+    }
+
+    for (ch = 0; ch < TWOHOP_MAX_NBO_CHANNELS; ch++) {
+        smClearSchedule(&schedules[ch]);
+    }
+    deinitNodeList(&nodes);
+    deinitNodeList(&rnl);
+    if ((schNodePool.nbUsed != 0) || (mngtNodePool.nbUsed != 0)) {
+        printf("ERROR: pools not empty after clear\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(void) {
+    int err = 0;
+
+    log_file = fopen("/dev/null", "w");
+    err |= run_pool();
+    err |= run_node_lists();
+    err |= run_full_channels();
+
+    printf("%s\n", err ? "FAILED" : "PASSED");
+    return err;
+}
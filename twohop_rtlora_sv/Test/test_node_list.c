@@ -0,0 +1,286 @@
+/*
+ * File:   test_node_list.c
+ * Author: LAM-HOANG
+ * Description:
+ *          Order and index consistency of the MAC node lists, and cost of
+ *          insert, per DATA update and remove from 10 to 8000 nodes against
+ *          the previous list walks, kept below as the reference.
+ * Created on October 17, 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "device_mngt.h"
+
+#define NB_UPDATE       20000   /* DATA frames per measure */
+
+extern FILE *log_file;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static NodeGenInfo_t make_info(uint16_t addr) {
+    NodeGenInfo_t info;
+
+    memset(&info, 0, sizeof info);
+    info.addr = addr;
+    info.class = rand() % 5;
+    info.slotDmn = 1 << info.class;
+    info.type = Node_Type_Onehop;
+    return info;
+}
+
+/* distinct random addresses of the 13-bit address space */
+static void make_addresses(uint16_t *addr, int nb) {
+    int i, j;
+    uint16_t tmp;
+
+    for (i = 0; i < TWOHOP_NODE_ADDR_SPACE - 1; i++) {
+        addr[i] = i + 1;
+    }
+    for (i = 0; i < nb; i++) {
+        j = i + rand() % (TWOHOP_NODE_ADDR_SPACE - 1 - i);
+        tmp = addr[i];
+        addr[i] = addr[j];
+        addr[j] = tmp;
+    }
+}
+
+/* --- REFERENCE: PREVIOUS LIST WALKS --------------------------------------- */
+
+static bool legacyExisted(MngtNodeList_t *lst, uint16_t addr) {
+    MngtNode_t *curNode;
+
+    for (curNode = lst->head; curNode != NULL; curNode = curNode->next) {
+        if (curNode->genInfo.addr == addr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void legacyPush(MngtNodeList_t *lst, MngtNode_t *node) {
+    MngtNode_t *curNode = lst->head;
+
+    if (legacyExisted(lst, node->genInfo.addr)) {
+        destroyNode(node);
+        return;
+    }
+    lst->size++;
+    if (curNode == NULL) {
+        lst->head = lst->tail = node;
+        node->next = node->prev = NULL;
+        return;
+    }
+    while (1) {
+        if (curNode->genInfo.slotDmn < node->genInfo.slotDmn) {
+            node->prev = curNode->prev;
+            if (curNode == lst->head) {
+                lst->head = node;
+            } else {
+                curNode->prev->next = node;
+            }
+            curNode->prev = node;
+            node->next = curNode;
+            return;
+        }
+        if (curNode->next == NULL) {
+            lst->tail = node;
+            curNode->next = node;
+            node->prev = curNode;
+            node->next = NULL;
+            return;
+        }
+        curNode = curNode->next;
+    }
+}
+
+static MngtNode_t *legacyFind(MngtNodeList_t *lst, uint16_t addr) {
+    MngtNode_t *curNode;
+
+    for (curNode = lst->head; curNode != NULL; curNode = curNode->next) {
+        if (curNode->genInfo.addr == addr) {
+            return curNode;
+        }
+    }
+    return NULL;
+}
+
+static void legacyUpdate(MngtNodeList_t *lst, uint16_t addr, uint16_t seq) {
+    MngtNode_t *curNode = legacyFind(lst, addr);
+
+    if ((curNode != NULL) && (curNode->latestSeqNo < seq)) {
+        curNode->dataCount++;
+        curNode->latestSeqNo = seq;
+    }
+}
+
+static MngtNode_t *legacyPop(MngtNodeList_t *lst, uint16_t addr) {
+    MngtNode_t *curNode = legacyFind(lst, addr);
+
+    if (curNode == NULL) {
+        return NULL;
+    }
+    if (curNode->prev != NULL) {
+        curNode->prev->next = curNode->next;
+    } else {
+        lst->head = curNode->next;
+    }
+    if (curNode->next != NULL) {
+        curNode->next->prev = curNode->prev;
+    } else {
+        lst->tail = curNode->prev;
+    }
+    lst->size--;
+    return curNode;
+}
+
+/* --- TESTS ---------------------------------------------------------------- */
+
+static MngtNodeList_t lst;
+static MngtNodeList_t ref;
+static uint16_t addr[TWOHOP_NODE_ADDR_SPACE];
+
+/* decreasing demand, insertion order within a demand, index and demand tails in sync */
+static int check_list(MngtNodeList_t *l, int expected) {
+    MngtNode_t *node, *prev = NULL;
+    int nb = 0;
+
+    for (node = l->head; node != NULL; prev = node, node = node->next) {
+        if ((node->prev != prev) || (l->index[node->genInfo.addr] != node)) {
+            printf("ERROR: node %u is badly linked or indexed\n", node->genInfo.addr);
+            return 1;
+        }
+        if ((prev != NULL) && (prev->listDmn < node->listDmn)) {
+            printf("ERROR: node %u is out of demand order\n", node->genInfo.addr);
+            return 1;
+        }
+        if (((node->next == NULL) || (node->next->listDmn != node->listDmn)) && (l->dmnTail[node->listDmn] != node)) {
+            printf("ERROR: node %u is not the last of demand %u\n", node->genInfo.addr, node->listDmn);
+            return 1;
+        }
+        nb++;
+    }
+    if ((l->tail != prev) || (nb != expected) || (l->size != (unsigned int)expected)) {
+        printf("ERROR: %d nodes linked, %u counted, %d expected\n", nb, l->size, expected);
+        return 1;
+    }
+    return 0;
+}
+
+static int run_consistency(void) {
+    MngtNode_t *node;
+    int nb = 0;
+    int i;
+
+    initNodeList(&lst, true);
+    make_addresses(addr, 1000);
+    for (i = 0; i < 1000; i++) {
+        pushNode(&lst, createNewNode(make_info(addr[i]), 0));
+        nb++;
+        /* remove a node from time to time, by address, at the head or at the tail */
+        if ((i % 7) == 3) {
+            node = popNodeByAddress(&lst, addr[rand() % (i + 1)]);
+            nb -= (node != NULL);
+            destroyNode(node);
+        } else if ((i % 11) == 5) {
+            destroyNode((i & 1) ? popHeadNode(&lst) : popTailNode(&lst));
+            nb--;
+        }
+        if (check_list(&lst, nb)) {
+            return 1;
+        }
+    }
+    /* a node pushed twice is updated in place */
+    node = createNewNode(make_info(lst.head->genInfo.addr), 0);
+    if ((pushNode(&lst, node) != 0) || check_list(&lst, nb)) {
+        printf("ERROR: duplicated node added\n");
+        return 1;
+    }
+    while ((node = popHeadNode(&lst)) != NULL) {
+        destroyNode(node);
+    }
+    if ((lst.head != NULL) || (lst.tail != NULL) || (lst.size != 0) || (lst.dmnMap[0] | lst.dmnMap[1] | lst.dmnMap[2] | lst.dmnMap[3])) {
+        printf("ERROR: list not empty\n");
+        return 1;
+    }
+    printf("order  : %d operations, demand order, address index and demand tails consistent\n", i);
+    return 0;
+}
+
+static void run_scaling(int nb) {
+    uint64_t start, t_push[2], t_update[2], t_pop[2];
+    MngtNode_t *node;
+    int i;
+
+    make_addresses(addr, nb);
+    initNodeList(&lst, true);
+    initNodeList(&ref, true);
+
+    srand(nb);
+    start = now_ns();
+    for (i = 0; i < nb; i++) {
+        pushNode(&lst, createNewNode(make_info(addr[i]), 0));
+    }
+    t_push[0] = now_ns() - start;
+    srand(nb);
+    start = now_ns();
+    for (i = 0; i < nb; i++) {
+        legacyPush(&ref, createNewNode(make_info(addr[i]), 0));
+    }
+    t_push[1] = now_ns() - start;
+
+    start = now_ns();
+    for (i = 0; i < NB_UPDATE; i++) {
+        dmNodeUpdateDataInfo(&lst, addr[i % nb], i + 1, false);
+    }
+    t_update[0] = now_ns() - start;
+    start = now_ns();
+    for (i = 0; i < NB_UPDATE; i++) {
+        legacyUpdate(&ref, addr[i % nb], i + 1);
+    }
+    t_update[1] = now_ns() - start;
+
+    start = now_ns();
+    for (i = 0; i < nb; i++) {
+        node = popNodeByAddress(&lst, addr[nb - 1 - i]);
+        destroyNode(node);
+    }
+    t_pop[0] = now_ns() - start;
+    start = now_ns();
+    for (i = 0; i < nb; i++) {
+        node = legacyPop(&ref, addr[nb - 1 - i]);
+        destroyNode(node);
+    }
+    t_pop[1] = now_ns() - start;
+
+    printf("%5d nodes: push %7.1f / %9.1f ns, DATA update %6.1f / %9.1f ns, remove %6.1f / %9.1f ns\n", nb,
+            (double)t_push[0] / nb, (double)t_push[1] / nb, (double)t_update[0] / NB_UPDATE, (double)t_update[1] / NB_UPDATE,
+            (double)t_pop[0] / nb, (double)t_pop[1] / nb);
+}
+
+int main(void) {
+    int sizes[] = { 10, 100, 1000, 4000, 8000 };
+    int err = 0;
+    int i;
+
+    log_file = stdout;
+    srand(1);
+    err |= run_consistency();
+
+    printf("indexed / previous walk, per operation\n");
+    for (i = 0; i < (int)(sizeof sizes / sizeof sizes[0]); i++) {
+        run_scaling(sizes[i]);
+    }
+    memPoolPrint(&mngtNodePool);
+
+    printf("%s\n", err ? "FAILED" : "PASSED");
+    return err;
+}
@@ -0,0 +1,380 @@
+/*
+ * File:   test_pkt_queue.c
+ * Author: LAM-HOANG
+ * Description:
+ *          FIFO order and bounds of the packet ring, then enqueue -> dequeue
+ *          latency and throughput of the ring against the previous queue
+ *          (malloc'd list, queue mutex, mutexRxMsg/condRxMsg wakeup), kept
+ *          below as the reference.
+ * Created on October 17, 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "packet_queue.h"
+
+#define PKT_SIZE        24      /* typical two-hop data packet */
+#define NB_LOOP         200000  /* single thread enqueue -> dequeue */
+#define NB_STREAM       500000  /* packets streamed between two threads */
+#define NB_WAKEUP       2000    /* packets sent to a sleeping consumer */
+#define WAKEUP_GAP_US   50
+
+#define LEGACY_QUEUE_MAX    16
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void make_packet(struct MsgInfo_ *msg, uint32_t seq) {
+    memset(msg, 0, sizeof *msg);
+    msg->freq = 922100000;
+    msg->datarate = 7;
+    msg->count_us = seq;
+    msg->size = PKT_SIZE;
+    memset(msg->payload, (uint8_t)seq, PKT_SIZE);
+}
+
+/* --- REFERENCE: PREVIOUS QUEUE -------------------------------------------- */
+
+struct LegacyNode {
+    struct MsgInfo_ pkt;
+    struct LegacyNode *next;
+};
+
+struct LegacyQueue {
+    uint8_t size;
+    pthread_mutex_t mutex;
+    struct LegacyNode *head;
+    struct LegacyNode *tail;
+    /* wakeup of the consumer, as mutexRxMsg/condRxMsg/flagRxMsg */
+    pthread_mutex_t mutexFlag;
+    pthread_cond_t condFlag;
+    bool flag;
+};
+
+static void legacyInit(struct LegacyQueue *queue) {
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_mutex_init(&queue->mutexFlag, NULL);
+    pthread_cond_init(&queue->condFlag, NULL);
+    queue->size = 0;
+    queue->head = NULL;
+    queue->tail = NULL;
+    queue->flag = false;
+}
+
+static bool legacyIsFull(struct LegacyQueue *queue) {
+    bool result;
+
+    pthread_mutex_lock(&queue->mutex);
+    result = (queue->size == LEGACY_QUEUE_MAX);
+    pthread_mutex_unlock(&queue->mutex);
+    return result;
+}
+
+static bool legacyIsEmpty(struct LegacyQueue *queue) {
+    bool result;
+
+    pthread_mutex_lock(&queue->mutex);
+    result = (queue->size == 0);
+    pthread_mutex_unlock(&queue->mutex);
+    return result;
+}
+
+static PktError_e legacyEnqueue(struct LegacyQueue *queue, struct MsgInfo_ *packet) {
+    struct LegacyNode *node;
+
+    if (legacyIsFull(queue)) {
+        return PKT_ERROR_FULL;
+    }
+    pthread_mutex_lock(&queue->mutex);
+    node = malloc(sizeof *node);
+    memcpy(&node->pkt, packet, sizeof(struct MsgInfo_));
+    node->next = NULL;
+    if (queue->head == NULL) {
+        queue->head = node;
+    } else {
+        queue->tail->next = node;
+    }
+    queue->tail = node;
+    queue->size++;
+    pthread_mutex_unlock(&queue->mutex);
+
+    pthread_mutex_lock(&queue->mutexFlag);
+    queue->flag = true;
+    pthread_cond_signal(&queue->condFlag);
+    pthread_mutex_unlock(&queue->mutexFlag);
+    return PKT_ERROR_OK;
+}
+
+static PktError_e legacyDequeue(struct LegacyQueue *queue, struct MsgInfo_ *packet) {
+    struct LegacyNode *node;
+
+    if (legacyIsEmpty(queue)) {
+        return PKT_ERROR_EMPTY;
+    }
+    pthread_mutex_lock(&queue->mutex);
+    node = queue->head;
+    queue->head = node->next;
+    queue->size--;
+    memcpy(packet, &node->pkt, sizeof(struct MsgInfo_));
+    free(node);
+    pthread_mutex_unlock(&queue->mutex);
+    return PKT_ERROR_OK;
+}
+
+static void legacyWait(struct LegacyQueue *queue) {
+    pthread_mutex_lock(&queue->mutexFlag);
+    while (queue->flag == false) {
+        pthread_cond_wait(&queue->condFlag, &queue->mutexFlag);
+    }
+    queue->flag = false;
+    pthread_mutex_unlock(&queue->mutexFlag);
+}
+
+/* --- RING AND REFERENCE BEHIND THE SAME INTERFACE ------------------------- */
+
+typedef struct {
+    const char *name;
+    PktError_e (*enqueue)(void *queue, struct MsgInfo_ *packet);
+    PktError_e (*dequeue)(void *queue, struct MsgInfo_ *packet);
+    void (*wait)(void *queue);
+    void *queue;
+} QueueOps_t;
+
+static struct PktDoorbell doorbell;
+static struct PktQueue ring;
+static struct LegacyQueue legacy;
+
+static PktError_e ringEnqueue(void *queue, struct MsgInfo_ *packet) {
+    if (isPktQueueFull(queue)) {
+        return PKT_ERROR_FULL; /* without the error message of pktEnqueue */
+    }
+    return pktEnqueue(queue, packet);
+}
+
+static PktError_e ringDequeue(void *queue, struct MsgInfo_ *packet) {
+    return pktDequeue(queue, packet);
+}
+
+static void ringWait(void *queue) {
+    pktDoorbellWait(&doorbell, queue, 1);
+}
+
+/* producer side of the zero-copy path: the packet is built in its slot */
+static PktError_e ringEnqueueInPlace(void *queue, struct MsgInfo_ *packet) {
+    struct MsgInfo_ *slot = pktQueueReserve(queue);
+
+    if (slot == NULL) {
+        return PKT_ERROR_FULL;
+    }
+    slot->freq = packet->freq;
+    slot->datarate = packet->datarate;
+    slot->count_us = packet->count_us;
+    slot->size = packet->size;
+    memcpy(slot->payload, packet->payload, packet->size);
+    pktQueueCommit(queue);
+    return PKT_ERROR_OK;
+}
+
+/* consumer side of the zero-copy path: only the fields used are read */
+static PktError_e ringDequeueInPlace(void *queue, struct MsgInfo_ *packet) {
+    struct MsgInfo_ *slot = pktQueuePeek(queue);
+
+    if (slot == NULL) {
+        return PKT_ERROR_EMPTY;
+    }
+    packet->count_us = slot->count_us;
+    packet->size = slot->size;
+    packet->payload[0] = slot->payload[0];
+    pktQueueRelease(queue);
+    return PKT_ERROR_OK;
+}
+
+static PktError_e legacyEnqueueOp(void *queue, struct MsgInfo_ *packet) {
+    return legacyEnqueue(queue, packet);
+}
+
+static PktError_e legacyDequeueOp(void *queue, struct MsgInfo_ *packet) {
+    return legacyDequeue(queue, packet);
+}
+
+static void legacyWaitOp(void *queue) {
+    legacyWait(queue);
+}
+
+/* --- TESTS ---------------------------------------------------------------- */
+
+static int run_fifo(void) {
+    struct MsgInfo_ msg;
+    uint32_t seq_in = 0, seq_out = 0;
+    int round, i;
+
+    pktQueueInit(&ring, NULL);
+    if (!isPktQueueEmpty(&ring) || (pktDequeue(&ring, &msg) != PKT_ERROR_EMPTY)) {
+        printf("ERROR: new queue is not empty\n");
+        return 1;
+    }
+    /* fill and drain several times so that the indexes wrap over the slots */
+    for (round = 0; round < 5; round++) {
+        for (i = 0; i < PKT_QUEUE_MAX - round; i++) {
+            make_packet(&msg, seq_in++);
+            if (pktEnqueue(&ring, &msg) != PKT_ERROR_OK) {
+                printf("ERROR: enqueue %d failed before the queue is full\n", i);
+                return 1;
+            }
+        }
+        if (round == 0) {
+            if (!isPktQueueFull(&ring) || (pktEnqueue(&ring, &msg) != PKT_ERROR_FULL) || (pktQueueReserve(&ring) != NULL)) {
+                printf("ERROR: full queue accepts a packet\n");
+                return 1;
+            }
+        }
+        for (i = 0; i < PKT_QUEUE_MAX - round; i++) {
+            memset(&msg, 0xEE, sizeof msg);
+            if ((pktDequeue(&ring, &msg) != PKT_ERROR_OK) || (msg.count_us != seq_out) || (msg.size != PKT_SIZE)
+                    || (msg.payload[PKT_SIZE - 1] != (uint8_t)seq_out)) {
+                printf("ERROR: packet %u lost or out of order\n", seq_out);
+                return 1;
+            }
+            seq_out++;
+        }
+        if (pktQueuePeek(&ring) != NULL) {
+            printf("ERROR: drained queue is not empty\n");
+            return 1;
+        }
+    }
+    printf("fifo   : %u packets through %d slots in order, full and empty detected\n", seq_out, PKT_QUEUE_MAX);
+    return 0;
+}
+
+static void run_single_thread(QueueOps_t *ops) {
+    struct MsgInfo_ in, out;
+    uint64_t start;
+    int i;
+
+    make_packet(&in, 0);
+    start = now_ns();
+    for (i = 0; i < NB_LOOP; i++) {
+        in.count_us = i;
+        ops->enqueue(ops->queue, &in);
+        ops->dequeue(ops->queue, &out);
+    }
+    printf("%-9s: enqueue -> dequeue %7.1f ns, one thread\n", ops->name, (double)(now_ns() - start) / NB_LOOP);
+}
+
+typedef struct {
+    QueueOps_t *ops;
+    int nb_pkt;
+    uint32_t nb_err;
+    uint64_t *latency_ns;
+    uint64_t *sent_ns;
+} StreamArgs_t;
+
+static void *consumer_thread(void *arg) {
+    StreamArgs_t *args = arg;
+    struct MsgInfo_ msg;
+    uint32_t seq = 0;
+
+    while (seq < (uint32_t)args->nb_pkt) {
+        args->ops->wait(args->ops->queue);
+        while (args->ops->dequeue(args->ops->queue, &msg) == PKT_ERROR_OK) {
+            if (args->latency_ns != NULL) {
+                args->latency_ns[seq] = now_ns() - __atomic_load_n(&args->sent_ns[seq], __ATOMIC_ACQUIRE);
+            }
+            if ((msg.count_us != seq) || (msg.size != PKT_SIZE)) {
+                args->nb_err++;
+            }
+            seq++;
+        }
+    }
+    return NULL;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* stream NB_STREAM packets, or NB_WAKEUP spaced packets to measure the wakeup latency */
+static int run_two_threads(QueueOps_t *ops, bool wakeup) {
+    StreamArgs_t args;
+    pthread_t thread;
+    struct MsgInfo_ msg;
+    uint64_t start, duration;
+    int i;
+
+    memset(&args, 0, sizeof args);
+    args.ops = ops;
+    args.nb_pkt = wakeup ? NB_WAKEUP : NB_STREAM;
+    if (wakeup) {
+        args.latency_ns = calloc(NB_WAKEUP, sizeof(uint64_t));
+        args.sent_ns = calloc(NB_WAKEUP, sizeof(uint64_t));
+    }
+    pthread_create(&thread, NULL, consumer_thread, &args);
+
+    start = now_ns();
+    for (i = 0; i < args.nb_pkt; i++) {
+        make_packet(&msg, i);
+        if (wakeup) {
+            usleep(WAKEUP_GAP_US); /* let the consumer fall asleep */
+            __atomic_store_n(&args.sent_ns[i], now_ns(), __ATOMIC_RELEASE);
+        }
+        while (ops->enqueue(ops->queue, &msg) == PKT_ERROR_FULL) {
+            sched_yield();
+        }
+    }
+    pthread_join(thread, NULL);
+    duration = now_ns() - start;
+
+    if (wakeup) {
+        qsort(args.latency_ns, NB_WAKEUP, sizeof(uint64_t), compare_u64);
+        printf("%-9s: wakeup latency median %6.1f us, 99%% %6.1f us\n", ops->name,
+                args.latency_ns[NB_WAKEUP / 2] / 1e3, args.latency_ns[NB_WAKEUP * 99 / 100] / 1e3);
+        free(args.latency_ns);
+        free(args.sent_ns);
+    } else {
+        printf("%-9s: %6.2f Mpkt/s between two threads\n", ops->name, NB_STREAM * 1e3 / duration);
+    }
+    if (args.nb_err != 0) {
+        printf("ERROR: %s, %u packets lost or out of order\n", ops->name, args.nb_err);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void) {
+    QueueOps_t ops[] = {
+        { "list",     legacyEnqueueOp,    legacyDequeueOp,    legacyWaitOp, &legacy },
+        { "ring",     ringEnqueue,        ringDequeue,        ringWait,     &ring },
+        { "ring/0cp", ringEnqueueInPlace, ringDequeueInPlace, ringWait,     &ring },
+    };
+    int err = 0;
+    int i;
+
+    err |= run_fifo();
+
+    if (pktDoorbellInit(&doorbell) != 0) {
+        printf("FAILED\n");
+        return 1;
+    }
+    for (i = 0; i < (int)(sizeof ops / sizeof ops[0]); i++) {
+        legacyInit(&legacy);
+        pktQueueInit(&ring, &doorbell);
+        run_single_thread(&ops[i]);
+        err |= run_two_threads(&ops[i], false);
+        err |= run_two_threads(&ops[i], true);
+    }
+
+    printf("%s\n", err ? "FAILED" : "PASSED");
+    return err;
+}
@@ -0,0 +1,273 @@
+/*
+ * File:   test_schedule.c
+ * Author: LAM-HOANG
+ * Description:
+ *          LSI assignment of the schedule groups checked against the previous
+ *          first fit list walk, kept below as the reference, groups resized
+ *          to another frame factor, and cost of a re-registration storm on a
+ *          full group.
+ * Created on October 17, 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "schedule_mngt.h"
+
+#define NB_STORM        20000   /* remove and schedule again, per measure */
+
+extern FILE *log_file;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static SchNode_t make_node(unsigned short addr, unsigned short demand) {
+    SchNode_t node;
+
+    memset(&node, 0, sizeof node);
+    node.addr = addr;
+    node.slotDemand = demand;
+    node.nboSchDist = 1;
+    return node;
+}
+
+/* --- REFERENCE: PREVIOUS LIST WALKS --------------------------------------- */
+
+static unsigned short legacyAssign(SchNode_t *head, unsigned int nboTotSlots, unsigned short demandSlot) {
+    SchNode_t *curNode = head;
+    unsigned short lastLsi;
+
+    if ((curNode == NULL) || (curNode->startLSI > demandSlot)) {
+        return 1;
+    }
+    for (; curNode != NULL; curNode = curNode->next) {
+        lastLsi = curNode->startLSI + curNode->slotDemand - 1;
+        if (curNode->next == NULL) {
+            return (nboTotSlots - lastLsi >= demandSlot) ? lastLsi + 1 : 0;
+        }
+        if (curNode->next->startLSI - lastLsi > demandSlot) {
+            return lastLsi + 1;
+        }
+    }
+    return 0;
+}
+
+static void legacyInsert(SchNode_t **head, SchNode_t *node) {
+    SchNode_t **link = head;
+
+    while ((*link != NULL) && ((*link)->startLSI < node->startLSI)) {
+        link = &(*link)->next;
+    }
+    node->next = *link;
+    *link = node;
+}
+
+static SchNode_t *legacyRemove(SchNode_t **head, unsigned short addr) {
+    SchNode_t **link, *node;
+
+    for (link = head; *link != NULL; link = &(*link)->next) {
+        if ((*link)->addr == addr) {
+            node = *link;
+            *link = node->next;
+            return node;
+        }
+    }
+    return NULL;
+}
+
+/* --- TESTS ---------------------------------------------------------------- */
+
+static SchList_t sch;
+
+/* ascending LSI without overlap, bitmap, owners, index and counters in sync */
+static int check_schedule(SchList_t *l) {
+    SchNode_t *node, *prev = NULL;
+    unsigned int nb = 0, slots = 0, bits = 0;
+    int i;
+
+    for (node = l->head; node != NULL; prev = node, node = node->next) {
+        if ((prev != NULL) && (prev->startLSI + prev->slotDemand > node->startLSI)) {
+            printf("ERROR: node %u overlaps node %u\n", node->addr, prev->addr);
+            return 1;
+        }
+        if ((l->lsiOwner[node->startLSI - 1] != node) || (l->lsiOwner[node->startLSI + node->slotDemand - 2] != node) ||
+                (smGetRefToNode(l, node->addr) != node)) {
+            printf("ERROR: node %u is badly indexed\n", node->addr);
+            return 1;
+        }
+        nb++;
+        slots += node->slotDemand;
+    }
+    for (i = 0; i < SM_LSI_MAP_WORDS; i++) {
+        bits += __builtin_popcountll(l->lsiMap[i]);
+    }
+    if ((nb != l->nboNode) || (slots != l->nboAsgSlots) || (bits != slots) || (l->nboRmnSlots != l->nboTotSlots - slots) ||
+            (smGetLastAsgLsi(l) != ((prev == NULL) ? 0 : prev->startLSI + prev->slotDemand - 1))) {
+        printf("ERROR: %u nodes %u slots linked, %u nodes %u slots %u bits counted\n", nb, slots, l->nboNode, l->nboAsgSlots, bits);
+        return 1;
+    }
+    return 0;
+}
+
+static int run_consistency(unsigned int nboTotSlots) {
+    unsigned short addr, expected;
+    SchNode_t node;
+    int i, nbOps = 0;
+
+    smInitSchedule(&sch, nboTotSlots);
+    for (i = 0; i < 5000; i++) {
+        addr = 1 + rand() % 200;
+        if (smGetRefToNode(&sch, addr) != NULL) {
+            if (smRemoveOneNode(&sch, addr) != SCH_SUCCEEDED) {
+                printf("ERROR: node %u not removed\n", addr);
+                return 1;
+            }
+        } else {
+            node = make_node(addr, 1 << (rand() % 4));
+            expected = legacyAssign(sch.head, sch.nboTotSlots, node.slotDemand);
+            if (smScheduleOneNode(&sch, node) == SCH_SUCCEEDED) {
+                if (smGetRefToNode(&sch, addr)->startLSI != expected) {
+                    printf("ERROR: node %u at LSI %u, first fit is %u\n", addr, smGetRefToNode(&sch, addr)->startLSI, expected);
+                    return 1;
+                }
+            } else if (expected != 0) {
+                printf("ERROR: node %u not scheduled, first fit is %u\n", addr, expected);
+                return 1;
+            }
+        }
+        if (check_schedule(&sch)) {
+            return 1;
+        }
+        nbOps++;
+    }
+    if (smRemoveOneNode(&sch, 0x1FFF) != SCH_FAILED) {
+        printf("ERROR: unknown node removed\n");
+        return 1;
+    }
+    smClearSchedule(&sch);
+    if ((sch.head != NULL) || check_schedule(&sch)) {
+        printf("ERROR: schedule not empty\n");
+        return 1;
+    }
+    printf("%3u LSIs: %d operations, first fit, bitmap and address index consistent\n", nboTotSlots, nbOps);
+    return 0;
+}
+
+/* random groups shrunk then grown back, nodes keep their LSIs while they fit */
+static int run_resize(void) {
+    unsigned short lsi[TWOHOP_MAX_NBO_LSI + 1];
+    unsigned int newSize, nboBefore, nboRemoved, nboKept, round;
+    unsigned short addr;
+    SchNode_t *node;
+
+    for (round = 0; round < 200; round++) {
+        smInitSchedule(&sch, TWOHOP_MAX_NBO_LSI);
+        memset(lsi, 0, sizeof lsi);
+        for (addr = 1; addr <= TWOHOP_MAX_NBO_LSI; addr++) {
+            if (smScheduleOneNode(&sch, make_node(addr, 1 << (rand() % 4))) == SCH_SUCCEEDED) {
+                lsi[addr] = smGetRefToNode(&sch, addr)->startLSI;
+            }
+        }
+        nboBefore = sch.nboNode;
+        newSize = 1u << (rand() % 8);
+        nboRemoved = smResizeSchedule(&sch, newSize);
+        nboKept = 0;
+        for (addr = 1; addr <= TWOHOP_MAX_NBO_LSI; addr++) {
+            node = smGetRefToNode(&sch, addr);
+            if (node == NULL) {
+                continue;
+            }
+            nboKept++;
+            if (node->startLSI != lsi[addr] || node->startLSI + node->slotDemand - 1 > newSize) {
+                printf("ERROR: node %u moved from LSI %u to %u after a resize to %u\n", addr, lsi[addr], node->startLSI, newSize);
+                return 1;
+            }
+        }
+        if (nboKept + nboRemoved != nboBefore || sch.nboNode != nboKept || sch.nboTotSlots != newSize
+                || sch.nboAsgSlots + sch.nboRmnSlots != newSize || smGetLastAsgLsi(&sch) > newSize
+                || (newSize == TWOHOP_MAX_NBO_LSI && nboRemoved != 0)) {
+            printf("ERROR: group of %u nodes resized to %u LSIs: %u kept, %u removed\n", nboBefore, newSize, nboKept, nboRemoved);
+            return 1;
+        }
+        // grown back, the freed LSIs are available again
+        smResizeSchedule(&sch, TWOHOP_MAX_NBO_LSI);
+        if (sch.nboRmnSlots != TWOHOP_MAX_NBO_LSI - sch.nboAsgSlots
+                || (sch.nboRmnSlots > 0 && smScheduleOneNode(&sch, make_node(TWOHOP_MAX_NBO_LSI + 1, 1)) != SCH_SUCCEEDED)) {
+            printf("ERROR: LSIs not released by a resize\n");
+            return 1;
+        }
+        smClearSchedule(&sch);
+    }
+    printf("resize: nodes kept in place, the others removed\n");
+    return 0;
+}
+
+/* full group of single LSI nodes, a random node leaves and registers again */
+static void run_storm(unsigned int nboTotSlots) {
+    static SchNode_t legacyNodes[TWOHOP_MAX_NBO_LSI];
+    SchNode_t *head = NULL, *node;
+    uint64_t start, t_new, t_old;
+    unsigned short addr;
+    unsigned int i;
+
+    smInitSchedule(&sch, nboTotSlots);
+    for (i = 0; i < nboTotSlots; i++) {
+        smScheduleOneNode(&sch, make_node(i + 1, 1));
+        legacyNodes[i] = make_node(i + 1, 1);
+        legacyNodes[i].startLSI = legacyAssign(head, nboTotSlots, 1);
+        legacyInsert(&head, &legacyNodes[i]);
+    }
+
+    srand(nboTotSlots);
+    start = now_ns();
+    for (i = 0; i < NB_STORM; i++) {
+        addr = 1 + rand() % nboTotSlots;
+        smRemoveOneNode(&sch, addr);
+        smScheduleOneNode(&sch, make_node(addr, 1));
+        smGetLastAsgLsi(&sch);
+    }
+    t_new = now_ns() - start;
+
+    srand(nboTotSlots);
+    start = now_ns();
+    for (i = 0; i < NB_STORM; i++) {
+        addr = 1 + rand() % nboTotSlots;
+        node = legacyRemove(&head, addr);
+        node->startLSI = legacyAssign(head, nboTotSlots, 1);
+        legacyInsert(&head, node);
+        for (node = head; node->next != NULL; node = node->next)
+            ;
+    }
+    t_old = now_ns() - start;
+
+    smClearSchedule(&sch);
+    printf("%3u LSIs: re-register %6.1f / %7.1f ns\n", nboTotSlots, (double)t_new / NB_STORM, (double)t_old / NB_STORM);
+}
+
+int main(void) {
+    unsigned int sizes[] = { 16, 64, 128 };
+    int err = 0;
+    int i;
+
+    log_file = fopen("/dev/null", "w");
+    srand(1);
+    for (i = 0; i < (int)(sizeof sizes / sizeof sizes[0]); i++) {
+        err |= run_consistency(sizes[i]);
+    }
+    err |= run_resize();
+
+    printf("bitmap / previous walk, per operation\n");
+    for (i = 0; i < (int)(sizeof sizes / sizeof sizes[0]); i++) {
+        run_storm(sizes[i]);
+    }
+    memPoolPrint(&schNodePool);
+
+    printf("%s\n", err ? "FAILED" : "PASSED");
+    return err;
+}
@@ -0,0 +1,388 @@
+/*
+ * File:   test_twohop_msg.c
+ * Author: LAM-HOANG
+ * Description:
+ *          Downlink message encoders: same bytes as the field by field
+ *          memcpy layout of the MAC, round trip through the decoders for
+ *          random snapshots, decoders fed with truncated, extended and
+ *          random payloads, and encoding time per message.
+ * Created on October 17, 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "twohop_msg.h"
+
+#define NB_ROUNDS       100000
+#define PAYLOAD_SIZE    256
+
+static double now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void random_node(TwohopMsgNode_t *node, int withDemand) {
+    node->addr = (uint16_t)(rand() % TWOHOP_NODE_ADDR_SPACE);
+    node->class = (uint8_t)(rand() % 8);
+    node->slotDemand = withDemand ? (uint8_t)rand() : 0;
+}
+
+static void random_hdr(TwohopMsgHdr_t *hdr, TwohopMsgType_e type) {
+    hdr->type = type;
+    hdr->srcAddr = (uint16_t)rand();
+    hdr->destAddr = (uint16_t)rand();
+    hdr->macParams.value = (uint16_t)rand();
+}
+
+static void random_rnl(TwohopRnlMsg_t *rnl) {
+    int i;
+
+    memset(rnl, 0, sizeof(*rnl));
+    rnl->seq = (uint16_t)rand();
+    rnl->netReady = rand() & 1;
+    rnl->nboNodes = (uint8_t)(rand() % (TWOHOP_MAX_NBO_NODES_IN_RNL + 1));
+    for (i = 0; i < rnl->nboNodes; i++) {
+        random_node(&rnl->nodes[i], 0);
+    }
+}
+
+static void random_sm(TwohopSmMsg_t *sm) {
+    int i;
+
+    memset(sm, 0, sizeof(*sm));
+    sm->smCount = (uint8_t)(rand() % 16);
+    sm->sch1Size = (uint8_t)(rand() % 16);
+    sm->sch2Sslot = (uint8_t)rand();
+    sm->nboRelays = (uint8_t)rand();
+    sm->groupId = (uint8_t)(rand() % TWOHOP_MAX_NBO_CHANNELS);
+    sm->nboNodes = (uint8_t)(rand() % (TWOHOP_MAX_NBO_NODES_IN_SM + 1));
+    if (sm->nboNodes > 0) {
+        sm->startLSI = (uint8_t)rand();
+    }
+    for (i = 0; i < sm->nboNodes; i++) {
+        random_node(&sm->nodes[i], 1);
+    }
+}
+
+static void random_cm(TwohopCmMsg_t *cm, int nboChannels) {
+    int i, j;
+
+    memset(cm, 0, sizeof(*cm));
+    cm->seq = (uint16_t)rand();
+    for (i = 0; i < nboChannels; i++) {
+        cm->lastLSI[i] = (uint8_t)rand();
+    }
+    cm->nboUsi = (uint8_t)(rand() % (TWOHOP_MAX_NBO_RELAYS_IN_USI + 1));
+    for (i = 0; i < cm->nboUsi; i++) {
+        cm->usi[i].groupId = (uint8_t)(rand() % TWOHOP_MAX_NBO_CHANNELS);
+        cm->usi[i].startLSI = (uint8_t)rand();
+        random_node(&cm->usi[i].parent, 0);
+        cm->usi[i].nboChild = (uint8_t)(rand() % (TWOHOP_MAX_NBO_CHILDREN + 1));
+        for (j = 0; j < cm->usi[i].nboChild; j++) {
+            random_node(&cm->usi[i].children[j], 0);
+        }
+    }
+}
+
+/* Layout written by the MAC before the encoders: each field as a union, memcpy in turn */
+static int legacy_hdr(uint8_t *p, const TwohopMsgHdr_t *hdr) {
+    TwohopMacHeader_u macHeader;
+    int len = 0;
+
+    macHeader.bits.pktType = hdr->type;
+    macHeader.bits.RFU = 0;
+    memcpy(&p[len], &macHeader.value, 1);
+    len += 1;
+    memcpy(&p[len], &hdr->srcAddr, 2);
+    len += 2;
+    memcpy(&p[len], &hdr->destAddr, 2);
+    len += 2;
+    memcpy(&p[len], &hdr->macParams, 2);
+    len += 2;
+    return len;
+}
+
+static int legacy_addr(uint8_t *p, const TwohopMsgNode_t *node) {
+    TwohopNodeAddrFormat_u addrFormat;
+
+    addrFormat.bits.address = node->addr;
+    addrFormat.bits.class = node->class;
+    memcpy(p, &addrFormat, 2);
+    return 2;
+}
+
+static int legacy_rnl(uint8_t *p, const TwohopMsgHdr_t *hdr, const TwohopRnlMsg_t *rnl) {
+    TwohopMsgRnlCtrl_u rnlCtrl;
+    int i, len;
+
+    len = legacy_hdr(p, hdr);
+    memcpy(&p[len], &rnl->seq, 2);
+    len += 2;
+    rnlCtrl.bits.netReadyFlag = rnl->netReady ? 1 : 0;
+    rnlCtrl.bits.nboAddedNodes = rnl->nboNodes;
+    memcpy(&p[len], &rnlCtrl, 1);
+    len += 1;
+    for (i = 0; i < rnl->nboNodes; i++) {
+        len += legacy_addr(&p[len], &rnl->nodes[i]);
+    }
+    return len;
+}
+
+static int legacy_sm(uint8_t *p, const TwohopMsgHdr_t *hdr, const TwohopSmMsg_t *sm) {
+    TwohopMsgSmCtrl_u smCtrl;
+    TwohopMsgSmPlCtrl_u smPlCtrl;
+    int i, len;
+
+    len = legacy_hdr(p, hdr);
+    smCtrl.bits.smCount = sm->smCount;
+    smCtrl.bits.sch1Size = sm->sch1Size;
+    memcpy(&p[len], &smCtrl, 1);
+    len += 1;
+    memcpy(&p[len], &sm->sch2Sslot, 1);
+    len += 1;
+    memcpy(&p[len], &sm->nboRelays, 1);
+    len += 1;
+    smPlCtrl.bits.groupId = sm->groupId;
+    smPlCtrl.bits.nboNodes = sm->nboNodes;
+    memcpy(&p[len], &smPlCtrl.value, 1);
+    len += 1;
+    if (sm->nboNodes > 0) {
+        memcpy(&p[len], &sm->startLSI, 1);
+        len += 1;
+        for (i = 0; i < sm->nboNodes; i++) {
+            len += legacy_addr(&p[len], &sm->nodes[i]);
+            memcpy(&p[len], &sm->nodes[i].slotDemand, 1);
+            len += 1;
+        }
+    }
+    return len;
+}
+
+static int legacy_cm(uint8_t *p, const TwohopMsgHdr_t *hdr, const TwohopCmMsg_t *cm) {
+    TwohopMsgCmCtrl_u cmCtrl;
+    TwohopMsgUsiCtrl_u usiCtrl;
+    int i, j, len;
+
+    len = legacy_hdr(p, hdr);
+    memcpy(&p[len], &cm->seq, 2);
+    len += 2;
+    for (i = 0; i < hdr->macParams.bits.nboChannels; i++) {
+        memcpy(&p[len], &cm->lastLSI[i], 1);
+        len += 1;
+    }
+    cmCtrl.bits.usiFlag = (cm->nboUsi > 0) ? 1 : 0;
+    cmCtrl.bits.nboNodesInUsi = cm->nboUsi;
+    cmCtrl.bits.unuse = 0;
+    memcpy(&p[len], &cmCtrl.value, 1);
+    len += 1;
+    for (i = 0; i < cm->nboUsi; i++) {
+        usiCtrl.bits.groupId = cm->usi[i].groupId;
+        usiCtrl.bits.nboChild = cm->usi[i].nboChild;
+        memcpy(&p[len], &usiCtrl.value, 1);
+        len += 1;
+        memcpy(&p[len], &cm->usi[i].startLSI, 1);
+        len += 1;
+        len += legacy_addr(&p[len], &cm->usi[i].parent);
+        for (j = 0; j < cm->usi[i].nboChild; j++) {
+            len += legacy_addr(&p[len], &cm->usi[i].children[j]);
+        }
+    }
+    return len;
+}
+
+/* Decode a payload of any type, 0 if valid */
+static int decode_any(const uint8_t *buf, uint16_t size) {
+    static TwohopMsgHdr_t hdr;
+    static TwohopRnlMsg_t rnl;
+    static TwohopSmMsg_t sm;
+    static TwohopCmMsg_t cm;
+
+    return ((twmDecodeRnl(buf, size, &hdr, &rnl) == 0) + (twmDecodeSm(buf, size, &hdr, &sm) == 0)
+            + (twmDecodeCm(buf, size, &hdr, &cm) == 0) == 1) ? 0 : -1;
+}
+
+/* Every prefix and a longer payload are rejected */
+static int check_bounds(const uint8_t *buf, int len) {
+    uint8_t longer[PAYLOAD_SIZE + 1];
+    int i;
+
+    for (i = 0; i < len; i++) {
+        if (decode_any(buf, (uint16_t)i) == 0) {
+            printf("ERROR: message of %d bytes decoded from %d bytes\n", len, i);
+            return 1;
+        }
+    }
+    memcpy(longer, buf, len);
+    longer[len] = (uint8_t)rand();
+    if (decode_any(longer, (uint16_t)(len + 1)) == 0) {
+        printf("ERROR: message of %d bytes decoded with a trailing byte\n", len);
+        return 1;
+    }
+    return 0;
+}
+
+static int round_trip(int round) {
+    uint8_t buf[PAYLOAD_SIZE], legacy[PAYLOAD_SIZE], again[PAYLOAD_SIZE];
+    TwohopMsgHdr_t hdr, hdrOut;
+    TwohopRnlMsg_t rnl, rnlOut;
+    TwohopSmMsg_t sm, smOut;
+    TwohopCmMsg_t cm, cmOut;
+    int len, legacyLen, againLen = -1, ret = -1;
+
+    switch (round % 3) {
+        case 0:
+            random_hdr(&hdr, Twohop_MsgType_DL_RNL);
+            random_rnl(&rnl);
+            len = twmEncodeRnl(buf, sizeof(buf), &hdr, &rnl);
+            legacyLen = legacy_rnl(legacy, &hdr, &rnl);
+            memset(&rnlOut, 0, sizeof(rnlOut));
+            if (len > 0 && (ret = twmDecodeRnl(buf, (uint16_t)len, &hdrOut, &rnlOut)) == 0) {
+                ret = memcmp(&rnl, &rnlOut, sizeof(rnl));
+                againLen = twmEncodeRnl(again, sizeof(again), &hdrOut, &rnlOut);
+            }
+            break;
+        case 1:
+            random_hdr(&hdr, Twohop_MsgType_DL_SM);
+            random_sm(&sm);
+            len = twmEncodeSm(buf, sizeof(buf), &hdr, &sm);
+            legacyLen = legacy_sm(legacy, &hdr, &sm);
+            memset(&smOut, 0, sizeof(smOut));
+            if (len > 0 && (ret = twmDecodeSm(buf, (uint16_t)len, &hdrOut, &smOut)) == 0) {
+                ret = memcmp(&sm, &smOut, sizeof(sm));
+                againLen = twmEncodeSm(again, sizeof(again), &hdrOut, &smOut);
+            }
+            break;
+        default:
+            random_hdr(&hdr, Twohop_MsgType_DL_CM);
+            random_cm(&cm, hdr.macParams.bits.nboChannels);
+            len = twmEncodeCm(buf, sizeof(buf), &hdr, &cm);
+            legacyLen = legacy_cm(legacy, &hdr, &cm);
+            memset(&cmOut, 0, sizeof(cmOut));
+            if (len > 0 && (ret = twmDecodeCm(buf, (uint16_t)len, &hdrOut, &cmOut)) == 0) {
+                ret = memcmp(&cm, &cmOut, sizeof(cm));
+                againLen = twmEncodeCm(again, sizeof(again), &hdrOut, &cmOut);
+            }
+            break;
+    }
+    if (len != legacyLen || memcmp(buf, legacy, len) != 0) {
+        printf("ERROR: round %d, encoded %d bytes, %d bytes with memcpy\n", round, len, legacyLen);
+        return 1;
+    }
+    if (ret != 0 || hdrOut.type != hdr.type || hdrOut.srcAddr != hdr.srcAddr || hdrOut.destAddr != hdr.destAddr
+            || hdrOut.macParams.value != hdr.macParams.value) {
+        printf("ERROR: round %d, decoded message differs\n", round);
+        return 1;
+    }
+    if (againLen != len || memcmp(buf, again, len) != 0) {
+        printf("ERROR: round %d, message encoded again differs\n", round);
+        return 1;
+    }
+    /* a truncated buffer fails the encoder, every prefix fails the decoders */
+    if ((round % 3 == 0 && twmEncodeRnl(again, (uint16_t)(len - 1), &hdr, &rnl) != -1)
+            || (round % 3 == 1 && twmEncodeSm(again, (uint16_t)(len - 1), &hdr, &sm) != -1)
+            || (round % 3 == 2 && twmEncodeCm(again, (uint16_t)(len - 1), &hdr, &cm) != -1)) {
+        printf("ERROR: round %d, message of %d bytes encoded in %d bytes\n", round, len, len - 1);
+        return 1;
+    }
+    if (round < 3000) {
+        return check_bounds(buf, len);
+    }
+    return 0;
+}
+
+/* Random payloads: whatever decodes encodes back to the same bytes */
+static int fuzz_decoders(void) {
+    uint8_t buf[PAYLOAD_SIZE], again[PAYLOAD_SIZE];
+    TwohopMsgHdr_t hdr;
+    TwohopRnlMsg_t rnl;
+    TwohopSmMsg_t sm;
+    TwohopCmMsg_t cm;
+    int i, j, size, len;
+    int nbValid = 0;
+
+    for (i = 0; i < NB_ROUNDS; i++) {
+        size = rand() % 64;
+        for (j = 0; j < size; j++) {
+            buf[j] = (uint8_t)rand();
+        }
+        if (size > 0) {
+            buf[0] &= 0x30;    /* RFU cleared, type RNL, SM, CM or UL_RR */
+        }
+        len = -2;
+        if (twmDecodeRnl(buf, (uint16_t)size, &hdr, &rnl) == 0) {
+            len = twmEncodeRnl(again, sizeof(again), &hdr, &rnl);
+        } else if (twmDecodeSm(buf, (uint16_t)size, &hdr, &sm) == 0) {
+            len = twmEncodeSm(again, sizeof(again), &hdr, &sm);
+        } else if (twmDecodeCm(buf, (uint16_t)size, &hdr, &cm) == 0) {
+            len = twmEncodeCm(again, sizeof(again), &hdr, &cm);
+        }
+        if (len == -2) {
+            continue;
+        }
+        nbValid++;
+        if (len != size || memcmp(buf, again, size) != 0) {
+            printf("ERROR: random payload of %d bytes decoded, encoded back in %d bytes\n", size, len);
+            return 1;
+        }
+    }
+    printf("%d random payloads, %d decoded\n", NB_ROUNDS, nbValid);
+    return 0;
+}
+
+int main(void) {
+    uint8_t buf[PAYLOAD_SIZE];
+    TwohopMsgHdr_t hdr;
+    TwohopCmMsg_t cm;
+    TwohopRnlMsg_t rnl;
+    double start, cm_ns;
+    int fail = 0;
+    int i, len;
+
+    srand(1);
+
+    for (i = 0; i < NB_ROUNDS && !fail; i++) {
+        fail = round_trip(i);
+    }
+    if (!fail) {
+        fail = fuzz_decoders();
+    }
+
+    /* out of range snapshots are refused */
+    random_hdr(&hdr, Twohop_MsgType_DL_RNL);
+    random_rnl(&rnl);
+    rnl.nboNodes = TWOHOP_MAX_NBO_NODES_IN_RNL + 1;
+    if (twmEncodeRnl(buf, sizeof(buf), &hdr, &rnl) != -1) {
+        printf("ERROR: RNL of %d nodes encoded\n", rnl.nboNodes);
+        fail = 1;
+    }
+    hdr.type = Twohop_MsgType_DL_SM;
+    rnl.nboNodes = 1;
+    if (twmEncodeRnl(buf, sizeof(buf), &hdr, &rnl) != -1) {
+        printf("ERROR: RNL encoded with the SM type\n");
+        fail = 1;
+    }
+
+    /* largest CM: every channel, every relay with all its children */
+    random_hdr(&hdr, Twohop_MsgType_DL_CM);
+    hdr.macParams.bits.nboChannels = TWOHOP_MAX_NBO_CHANNELS;
+    random_cm(&cm, TWOHOP_MAX_NBO_CHANNELS);
+    cm.nboUsi = TWOHOP_MAX_NBO_RELAYS_IN_USI;
+    for (i = 0; i < cm.nboUsi; i++) {
+        cm.usi[i].nboChild = TWOHOP_MAX_NBO_CHILDREN;
+    }
+    start = now_ns();
+    for (i = 0; i < NB_ROUNDS; i++) {
+        cm.seq = (uint16_t)i;
+        len = twmEncodeCm(buf, sizeof(buf), &hdr, &cm);
+    }
+    cm_ns = (now_ns() - start) / NB_ROUNDS;
+    printf("largest CM: %d bytes encoded in %.0f ns\n", len, cm_ns);
+
+    printf("%s\n", fail ? "FAILED" : "PASSED");
+    return fail;
+}
@@ -0,0 +1,274 @@
+/*
+ * File:   test_twohop_uplink.c
+ * Author: LAM-HOANG
+ * Description:
+ *          RT-LoRa uplink decoder: same fields as the memcpy parsing of the
+ *          MAC for valid RR and DATA frames, truncated frames rejected,
+ *          random and mutated frames never decoded past their size, and
+ *          frames decoded per second.
+ * Created on October 17, 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "twohop_msg.h"
+
+#define NB_FRAMES       100000
+#define FRAME_SIZE_MAX  64
+
+typedef struct Frame_{
+    uint16_t size;
+    uint16_t needed;    /* bytes read by the decoder, the rest is padding */
+    uint8_t buf[FRAME_SIZE_MAX];
+}Frame_t;
+
+static Frame_t frames[NB_FRAMES];
+
+static double now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int put_addr(uint8_t *p, uint16_t addr, uint8_t class) {
+    TwohopNodeAddrFormat_u addrFormat;
+
+    addrFormat.bits.address = addr;
+    addrFormat.bits.class = class;
+    memcpy(p, &addrFormat.value, 2);
+    return 2;
+}
+
+/* Valid RR or DATA frame with random fields, sometimes followed by padding */
+static void build_frame(Frame_t *frame) {
+    TwohopMacHeader_u macHeader;
+    TwohopMsgRrCtrl_u rrCtrl;
+    TwohopMsgDataCtrl_u dataCtrl;
+    uint8_t *p = frame->buf;
+    int len, i, nb, payloadSize;
+
+    macHeader.value = 0;
+    macHeader.bits.pktType = (rand() & 1) ? Twohop_MsgType_UL_RR : Twohop_MsgType_UL_DATA;
+    p[0] = macHeader.value;
+    len = 1;
+    len += put_addr(&p[len], (uint16_t)(rand() % TWOHOP_NODE_ADDR_SPACE), 0);
+    len += put_addr(&p[len], (rand() % 8) ? TWOHOP_SERVER_ADDR : (uint16_t)rand(), 0);
+    if (macHeader.bits.pktType == Twohop_MsgType_UL_RR) {
+        rrCtrl.value = 0;
+        rrCtrl.bits.rrType1 = rand() & 1;
+        nb = 1;
+        if (rrCtrl.bits.rrType1) {
+            nb = rand() % (TWM_RR_MAX_NODES + 1);
+            rrCtrl.bits.nboChild = nb;
+        }
+        p[len++] = rrCtrl.value;
+        for (i = 0; i < nb; i++) {
+            len += put_addr(&p[len], (uint16_t)(rand() % TWOHOP_NODE_ADDR_SPACE), (uint8_t)(rand() % 8));
+        }
+    } else {
+        memset(&p[len], rand(), 2);    /* seq */
+        len += 2;
+        dataCtrl.value = (uint8_t)rand();
+        p[len++] = dataCtrl.value;
+        if (dataCtrl.bits.ctrl1) {
+            p[len++] = (uint8_t)rand();
+        }
+        if (dataCtrl.bits.ctrl0) {
+            len += put_addr(&p[len], (uint16_t)rand(), 0);
+        } else if (dataCtrl.bits.ctrl2) {
+            p[len++] = (uint8_t)rand();
+            p[len++] = (uint8_t)rand();
+            p[len++] = (uint8_t)rand();
+        }
+        payloadSize = rand() % (FRAME_SIZE_MAX - 16);
+        p[len++] = (uint8_t)payloadSize;
+        for (i = 0; i < payloadSize; i++) {
+            p[len++] = (uint8_t)rand();
+        }
+    }
+    frame->needed = (uint16_t)len;
+    frame->size = (uint16_t)len;
+    if (rand() % 4 == 0 && len < FRAME_SIZE_MAX) {
+        frame->size += (uint16_t)(rand() % (FRAME_SIZE_MAX - len));
+    }
+}
+
+/* Parsing of the MAC before the decoder, offsets only, on a zero padded buffer */
+static int legacy_decode(const uint8_t *payload, TwohopUlFrame_t *frame) {
+    TwohopMacHeader_u rxMacHdr;
+    TwohopMsgRrCtrl_u rrCtrl;
+    TwohopMsgDataCtrl_u dataCtrl;
+    TwohopNodeAddrFormat_u addFmt;
+    int pktLen = 0, i;
+
+    memcpy(&rxMacHdr, &payload[pktLen], 1);
+    pktLen += 1;
+    memcpy(&frame->srcAddr, &payload[pktLen], 2);
+    pktLen += 2;
+    memcpy(&frame->destAddr, &payload[pktLen], 2);
+    pktLen += 2;
+    frame->type = rxMacHdr.bits.pktType;
+    switch (rxMacHdr.bits.pktType) {
+        case Twohop_MsgType_UL_RR:
+            memcpy(&rrCtrl.value, &payload[pktLen], 1);
+            pktLen += 1;
+            frame->body.rr.viaRelay = rrCtrl.bits.rrType1;
+            frame->body.rr.nboNodes = (rrCtrl.bits.rrType1 == 0) ? 1 : rrCtrl.bits.nboChild;
+            for (i = 0; i < frame->body.rr.nboNodes && i < TWM_RR_MAX_NODES; i++) {
+                memcpy(&addFmt.value, &payload[pktLen], 2);
+                pktLen += 2;
+                frame->body.rr.nodes[i].addr = addFmt.bits.address;
+                frame->body.rr.nodes[i].class = addFmt.bits.class;
+            }
+            break;
+        case Twohop_MsgType_UL_DATA:
+            memcpy(&frame->body.data.seq, &payload[pktLen], 2);
+            pktLen += 2;
+            memcpy(&dataCtrl.value, &payload[pktLen], 1);
+            pktLen += 1;
+            if (dataCtrl.bits.ctrl1 == 1)
+                pktLen += 1;
+            frame->body.data.relayed = dataCtrl.bits.ctrl0;
+            frame->body.data.dlRssi = 0;
+            frame->body.data.dlSnr = 0;
+            if (dataCtrl.bits.ctrl0 == 1) {
+                memcpy(&frame->body.data.dataSrcAddr, &payload[pktLen], 2);
+                pktLen += 2;
+            } else {
+                if (dataCtrl.bits.ctrl2 == 1) {
+                    memcpy(&frame->body.data.dlRssi, &payload[pktLen], 2);
+                    pktLen += 2;
+                    memcpy(&frame->body.data.dlSnr, &payload[pktLen], 1);
+                    pktLen += 1;
+                }
+                frame->body.data.dataSrcAddr = frame->srcAddr;
+            }
+            memcpy(&frame->body.data.payloadSize, &payload[pktLen], 1);
+            pktLen++;
+            frame->body.data.payloadOfs = (uint8_t)pktLen;
+            break;
+        default:
+            return -1;
+    }
+    return 0;
+}
+
+static int same_frame(const TwohopUlFrame_t *a, const TwohopUlFrame_t *b) {
+    int i;
+
+    if (a->type != b->type || a->srcAddr != b->srcAddr || a->destAddr != b->destAddr) {
+        return 0;
+    }
+    if (a->type == Twohop_MsgType_UL_RR) {
+        if (a->body.rr.viaRelay != b->body.rr.viaRelay || a->body.rr.nboNodes != b->body.rr.nboNodes) {
+            return 0;
+        }
+        for (i = 0; i < a->body.rr.nboNodes; i++) {
+            if (a->body.rr.nodes[i].addr != b->body.rr.nodes[i].addr || a->body.rr.nodes[i].class != b->body.rr.nodes[i].class) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    return a->body.data.seq == b->body.data.seq && a->body.data.dataSrcAddr == b->body.data.dataSrcAddr
+            && a->body.data.relayed == b->body.data.relayed && a->body.data.dlRssi == b->body.data.dlRssi
+            && a->body.data.dlSnr == b->body.data.dlSnr && a->body.data.payloadOfs == b->body.data.payloadOfs
+            && a->body.data.payloadSize == b->body.data.payloadSize;
+}
+
+/* Whatever decodes stays within the frame, and matches the MAC parsing */
+static int check_decoded(const uint8_t *buf, uint16_t size, const TwohopUlFrame_t *frame) {
+    uint8_t padded[256];
+    TwohopUlFrame_t legacy;
+
+    if (frame->type == Twohop_MsgType_UL_DATA && frame->body.data.payloadOfs + frame->body.data.payloadSize > size) {
+        printf("ERROR: payload of %u bytes at %u out of a %u byte frame\n", frame->body.data.payloadSize,
+                frame->body.data.payloadOfs, size);
+        return 1;
+    }
+    if (frame->type == Twohop_MsgType_UL_RR && frame->body.rr.nboNodes > TWM_RR_MAX_NODES) {
+        printf("ERROR: RR of %u nodes\n", frame->body.rr.nboNodes);
+        return 1;
+    }
+    memset(padded, 0, sizeof(padded));
+    memcpy(padded, buf, size);
+    if (legacy_decode(padded, &legacy) != 0 || !same_frame(frame, &legacy)) {
+        printf("ERROR: decoded frame differs from the MAC parsing\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(void) {
+    TwohopUlFrame_t frame;
+    uint8_t *exact;
+    double start, decode_ns;
+    int fail = 0;
+    int i, j, size, nbValid = 0;
+    unsigned int sum = 0;
+
+    srand(1);
+    for (i = 0; i < NB_FRAMES; i++) {
+        build_frame(&frames[i]);
+    }
+
+    /* valid frames decode as the MAC parsed them, their prefixes are rejected */
+    for (i = 0; i < NB_FRAMES && !fail; i++) {
+        if (twmDecodeUplink(frames[i].buf, frames[i].size, &frame) != 0) {
+            printf("ERROR: valid frame %d rejected\n", i);
+            fail = 1;
+            break;
+        }
+        fail = check_decoded(frames[i].buf, frames[i].size, &frame);
+        for (size = 0; size < frames[i].needed && !fail; size++) {
+            if (twmDecodeUplink(frames[i].buf, (uint16_t)size, &frame) == 0 || frame.type != TWM_UL_INVALID) {
+                printf("ERROR: frame %d of %u bytes decoded from %d bytes\n", i, frames[i].needed, size);
+                fail = 1;
+            }
+        }
+    }
+
+    /* random bytes and mutated frames, each in a buffer of its exact size */
+    for (i = 0; i < 4 * NB_FRAMES && !fail; i++) {
+        if (i & 1) {
+            size = rand() % FRAME_SIZE_MAX;
+            exact = malloc(size + 1);
+            for (j = 0; j < size; j++) {
+                exact[j] = (uint8_t)rand();
+            }
+        } else {
+            size = frames[i % NB_FRAMES].size;
+            exact = malloc(size + 1);
+            memcpy(exact, frames[i % NB_FRAMES].buf, size);
+            for (j = rand() % 3; j >= 0 && size > 0; j--) {
+                exact[rand() % size] ^= (uint8_t)(1 << (rand() % 8));
+            }
+            size -= (rand() % 4 == 0) ? rand() % (size + 1) : 0;
+        }
+        if (twmDecodeUplink(exact, (uint16_t)size, &frame) == 0) {
+            nbValid++;
+            fail = check_decoded(exact, (uint16_t)size, &frame);
+        } else if (frame.type != TWM_UL_INVALID) {
+            printf("ERROR: rejected frame with type %u\n", frame.type);
+            fail = 1;
+        }
+        free(exact);
+    }
+    printf("%d random and mutated frames, %d decoded\n", 4 * NB_FRAMES, nbValid);
+
+    start = now_ns();
+    for (i = 0; i < NB_FRAMES; i++) {
+        if (twmDecodeUplink(frames[i].buf, frames[i].size, &frame) == 0) {
+            sum += frame.srcAddr;
+        }
+    }
+    decode_ns = (now_ns() - start) / NB_FRAMES;
+    printf("RR and DATA uplinks: %.0f ns per frame, %.0f frames/s (%u)\n", decode_ns, 1e9 / decode_ns, sum & 1);
+
+    printf("%s\n", fail ? "FAILED" : "PASSED");
+    return fail;
+}
@@ -0,0 +1,219 @@
+/*
+ * File:   test_uplink_crypto.c
+ * Author: LAM-HOANG
+ * Description:
+ *          Batch crypto stage of the uplinks: results and plaintexts equal to
+ *          the frame by frame functions, rejected and pass-through frames,
+ *          and frames per second on one core, serial against batched, for
+ *          every AES backend.
+ * Created on October 17, 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "uplink_crypto.h"
+
+#define NB_DEVICES      4096
+#define NB_FRAMES       (UL_CRYPTO_BATCH_MAX * 8000)
+#define FRAME_SIZE_MAX  80
+#define NB_RUNS         5
+
+typedef struct Frame_{
+    int         device;
+    uint16_t    size;
+    uint8_t     phy[FRAME_SIZE_MAX];    /* as received */
+    uint8_t     plain[FRAME_SIZE_MAX];  /* FRMPayload in clear, at the same offset */
+}Frame_t;
+
+extern FILE *log_file;
+
+static LoRaSessionCtx_t sessions[NB_DEVICES];
+static Frame_t frames[NB_FRAMES];
+static uint8_t work[NB_FRAMES][FRAME_SIZE_MAX];
+
+static double now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void random_bytes(uint8_t *buf, int size) {
+    int i;
+
+    for (i = 0; i < size; i++) {
+        buf[i] = (uint8_t)rand();
+    }
+}
+
+/* Uplink data frame of a device, FOpts and FPort optional, port 0 sometimes */
+static void build_frame(Frame_t *frame, int device, uint16_t fcnt) {
+    LoRaFrameHeader_t fHeader;
+    int optLen, payloadLen, ofs;
+    uint8_t port;
+
+    optLen = (rand() % 4 == 0) ? rand() % 4 : 0;
+    payloadLen = (rand() % 16 == 0) ? 0 : 1 + rand() % 51;
+    port = (rand() % 8 == 0) ? 0 : (uint8_t)(1 + rand() % 223);
+
+    memset(&fHeader, 0, sizeof(fHeader));
+    fHeader.DevAddr.Address = 0x02000000 + (uint32_t)device;
+    fHeader.FCtrl.up.bits.FOptsLen = optLen;
+    fHeader.FrameCounter = fcnt;
+
+    frame->device = device;
+    frame->phy[0] = (rand() & 1) ? 0x40 : 0x80;     /* unconfirmed or confirmed data up */
+    memcpy(&frame->phy[1], &fHeader.DevAddr.Address, 4);
+    frame->phy[5] = fHeader.FCtrl.up.value;
+    memcpy(&frame->phy[6], &fHeader.FrameCounter, 2);
+    random_bytes(&frame->phy[8], optLen);
+    ofs = 8 + optLen;
+    if (payloadLen > 0) {
+        frame->phy[ofs++] = port;
+        random_bytes(&frame->plain[ofs], payloadLen);
+        EncryptPayloadCtx(&frame->phy[ofs], &frame->plain[ofs], (uint16_t)payloadLen, LoRa_UP_LINK, fHeader, port,
+                &sessions[device]);
+    }
+    GenerateMICCtx(frame->phy, (uint16_t)(ofs + payloadLen), LoRa_UP_LINK, fHeader, &sessions[device],
+            &frame->phy[ofs + payloadLen]);
+    frame->size = (uint16_t)(ofs + payloadLen + UL_CRYPTO_MIC_SIZE);
+}
+
+/* One batch through the stage */
+static void run_batch(int first, UlCryptoFrame_t *batch) {
+    int i;
+
+    for (i = 0; i < UL_CRYPTO_BATCH_MAX; i++) {
+        memcpy(work[first + i], frames[first + i].phy, frames[first + i].size);
+        if (ulCryptoParse(&batch[i], work[first + i], frames[first + i].size) == UL_CRYPTO_OK) {
+            batch[i].session = &sessions[batch[i].fHeader.DevAddr.Address - 0x02000000];
+        }
+    }
+    ulCryptoRun(batch, UL_CRYPTO_BATCH_MAX);
+}
+
+/* Same work frame by frame with the session functions of crypto.c */
+static int run_serial(int index, uint8_t *out) {
+    UlCryptoFrame_t frame;
+    uint16_t msgLen;
+
+    memcpy(out, frames[index].phy, frames[index].size);
+    if (ulCryptoParse(&frame, out, frames[index].size) != UL_CRYPTO_OK) {
+        return frame.result;
+    }
+    frame.session = &sessions[frames[index].device];
+    msgLen = frame.size - UL_CRYPTO_MIC_SIZE;
+    if (!CheckMICCtx(out, msgLen, LoRa_UP_LINK, frame.fHeader, frame.session, &out[msgLen])) {
+        return UL_CRYPTO_BAD_MIC;
+    }
+    DecryptPayloadCtx(&out[frame.payloadOfs], &out[frame.payloadOfs], msgLen - frame.payloadOfs, LoRa_UP_LINK,
+            frame.fHeader, frame.port, frame.session);
+    return UL_CRYPTO_OK;
+}
+
+static int check_results(void) {
+    UlCryptoFrame_t batch[UL_CRYPTO_BATCH_MAX];
+    uint8_t serial[FRAME_SIZE_MAX];
+    int i, b, result;
+
+    for (b = 0; b < 500 * UL_CRYPTO_BATCH_MAX; b += UL_CRYPTO_BATCH_MAX) {
+        run_batch(b, batch);
+        for (i = 0; i < UL_CRYPTO_BATCH_MAX; i++) {
+            result = run_serial(b + i, serial);
+            if ((batch[i].result != result) || (memcmp(work[b + i], serial, frames[b + i].size) != 0)) {
+                printf("ERROR: frame %d, batch result %d, serial result %d\n", b + i, batch[i].result, result);
+                return 1;
+            }
+            if ((result == UL_CRYPTO_OK) && (memcmp(&work[b + i][batch[i].payloadOfs], &frames[b + i].plain[batch[i].payloadOfs],
+                    frames[b + i].size - UL_CRYPTO_MIC_SIZE - batch[i].payloadOfs) != 0)) {
+                printf("ERROR: frame %d not decrypted\n", b + i);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(void) {
+    static const AesBackend_e backends[] = { AES_BACKEND_TTABLE, AES_BACKEND_AESNI };
+    UlCryptoFrame_t batch[UL_CRYPTO_BATCH_MAX];
+    uint8_t keys[32];
+    double start, elapsed, serial_ns, batch_ns;
+    int run;
+    int fail = 0;
+    unsigned int k;
+    int i, b;
+
+    log_file = stdout;
+    srand(1);
+
+    for (i = 0; i < NB_DEVICES; i++) {
+        random_bytes(keys, 32);
+        InitSessionCtx(&sessions[i], keys, &keys[16]);
+    }
+    for (i = 0; i < NB_FRAMES; i++) {
+        build_frame(&frames[i], rand() % NB_DEVICES, (uint16_t)i);
+    }
+
+    /* one bad MIC, one RT-LoRa frame, one unknown device and one truncated frame in the first batch */
+    frames[1].phy[frames[1].size - 1] ^= 0x01;
+    frames[2].phy[0] = 0x00;
+    frames[4].size = 8;
+    for (i = 0; i < UL_CRYPTO_BATCH_MAX; i++) {
+        memcpy(work[i], frames[i].phy, frames[i].size);
+        ulCryptoParse(&batch[i], work[i], frames[i].size);
+        if (i != 3) {
+            batch[i].session = &sessions[frames[i].device];
+        }
+    }
+    ulCryptoRun(batch, UL_CRYPTO_BATCH_MAX);
+    if ((batch[0].result != UL_CRYPTO_OK) || (batch[1].result != UL_CRYPTO_BAD_MIC) || (batch[2].result != UL_CRYPTO_PLAIN)
+            || (batch[3].result != UL_CRYPTO_PLAIN) || (batch[4].result != UL_CRYPTO_INVALID)
+            || (memcmp(work[1], frames[1].phy, frames[1].size) != 0) || (memcmp(work[3], frames[3].phy, frames[3].size) != 0)) {
+        printf("ERROR: results %d %d %d %d %d\n", batch[0].result, batch[1].result, batch[2].result, batch[3].result,
+                batch[4].result);
+        fail = 1;
+    }
+    for (i = 1; i <= 4; i++) {
+        build_frame(&frames[i], rand() % NB_DEVICES, (uint16_t)i);
+    }
+
+    for (k = 0; k < sizeof(backends) / sizeof(backends[0]); k++) {
+        if (AES128_SelectBackend(backends[k]) != 0) {
+            printf("%d not available\n", (int)backends[k]);
+            continue;
+        }
+        if (check_results() != 0) {
+            fail = 1;
+        }
+
+        /* best of NB_RUNS, alternated, the host may be shared */
+        serial_ns = 1e12;
+        batch_ns = 1e12;
+        for (run = 0; run < NB_RUNS; run++) {
+            start = now_ns();
+            for (i = 0; i < NB_FRAMES; i++) {
+                run_serial(i, work[i]);
+            }
+            elapsed = (now_ns() - start) / NB_FRAMES;
+            serial_ns = (elapsed < serial_ns) ? elapsed : serial_ns;
+
+            start = now_ns();
+            for (b = 0; b < NB_FRAMES; b += UL_CRYPTO_BATCH_MAX) {
+                run_batch(b, batch);
+            }
+            elapsed = (now_ns() - start) / NB_FRAMES;
+            batch_ns = (elapsed < batch_ns) ? elapsed : batch_ns;
+        }
+
+        printf("%-7s: %d devices, batches of %d, serial %7.0f frames/s, batched %7.0f frames/s per core, x%.2f\n",
+                AES128_BackendName(), NB_DEVICES, UL_CRYPTO_BATCH_MAX, 1e9 / serial_ns, 1e9 / batch_ns, serial_ns / batch_ns);
+    }
+    AES128_SelectBackend(AES_BACKEND_AUTO);
+
+    printf("%s\n", fail ? "FAILED" : "PASSED");
+    return fail;
+}